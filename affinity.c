@@ -0,0 +1,550 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "util.h"
+#include "affinity.h"
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+#define AFFINITY_ROOT_MAX_LEN 127
+#define AFFINITY_PATH_MAX_LEN 255
+#define AFFINITY_LINE_MAX_LEN 4095
+#define AFFINITY_NODE_MASK_BITS (8 * sizeof(unsigned long))
+
+static const char *role_names[AFFINITY_ROLE_CNT] = {
+    [AFFINITY_ROLE_IO] = "io",
+    [AFFINITY_ROLE_WORKER] = "worker",
+    [AFFINITY_ROLE_PRODUCER] = "producer",
+    [AFFINITY_ROLE_SENDER] = "sender",
+    [AFFINITY_ROLE_COUNTER] = "counter",
+};
+
+/*
+ * Topology and placements so far, indexed by cpu id. Cores are numbered
+ * across packages, SMT siblings share one.
+ */
+typedef struct affinity_s {
+    pthread_mutex_t lock;
+    char root[AFFINITY_ROOT_MAX_LEN+1];
+    cpu_set_t usable;
+    int cpus[AFFINITY_MAX_CPUS];    // usable ones in id order
+    int cpu_cnt;
+    int node_cnt;
+    int core_cnt;
+    int16_t node[AFFINITY_MAX_CPUS];
+    int16_t core[AFFINITY_MAX_CPUS];
+    bool irq[AFFINITY_MAX_CPUS];    // takes an interrupt of the nic
+    int irq_cnt;
+    uint32_t used[AFFINITY_MAX_CPUS];
+    uint32_t core_used[AFFINITY_MAX_CPUS];
+    int role_cpus[AFFINITY_ROLE_CNT][AFFINITY_MAX_CPUS];
+    int role_cpu_cnt[AFFINITY_ROLE_CNT];
+    uint32_t picked[AFFINITY_ROLE_CNT];
+    bool auto_mode;
+    int pref_node;
+    char nic[AFFINITY_NAME_MAX_LEN+1];
+    int nic_node;
+} affinity_t;
+
+static affinity_t affinity = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static int
+read_line (const char *path, char *buf, int size)
+{
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    if (fgets(buf, size, fp) == NULL) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+static int
+read_int (const char *path, int *v)
+{
+    char buf[32];
+    char *end;
+
+    if (read_line(path, buf, sizeof(buf)) != 0) {
+        return -1;
+    }
+    *v = strtol(buf, &end, 10);
+    return end == buf ? -1 : 0;
+}
+
+/*
+ * Parse a cpu list as sysfs prints them, "0-3,8,10-11". An empty string
+ * is an empty set.
+ */
+int
+affinity_parse_cpulist (const char *s, cpu_set_t *set)
+{
+    char *end;
+    long lo, hi;
+
+    CPU_ZERO(set);
+    if (*s == '\0') {
+        return 0;
+    }
+    for (;;) {
+        lo = strtol(s, &end, 10);
+        if (end == s || lo < 0) {
+            return -1;
+        }
+        hi = lo;
+        if (*end == '-') {
+            s = end + 1;
+            hi = strtol(s, &end, 10);
+            if (end == s || hi < lo) {
+                return -1;
+            }
+        }
+        if (hi >= AFFINITY_MAX_CPUS) {
+            return -1;
+        }
+        for (; lo <= hi; lo++) {
+            CPU_SET(lo, set);
+        }
+        if (*end == '\0') {
+            return 0;
+        }
+        if (*end != ',') {
+            return -1;
+        }
+        s = end + 1;
+    }
+}
+
+static void
+format_cpulist (cpu_set_t *set, char *buf, int size)
+{
+    int cpu, last, len = 0;
+
+    buf[0] = '\0';
+    for (cpu = 0; cpu < AFFINITY_MAX_CPUS && len < size; cpu++) {
+        if (!CPU_ISSET(cpu, set)) {
+            continue;
+        }
+        for (last = cpu; last + 1 < AFFINITY_MAX_CPUS &&
+             CPU_ISSET(last + 1, set); last++) {
+        }
+        if (last == cpu) {
+            len += snprintf(buf + len, size - len, "%s%d",
+                            len ? "," : "", cpu);
+        } else {
+            len += snprintf(buf + len, size - len, "%s%d-%d",
+                            len ? "," : "", cpu, last);
+        }
+        cpu = last;
+    }
+}
+
+static int
+find_core (int *keys, int key)
+{
+    int i;
+
+    for (i = 0; i < affinity.core_cnt; i++) {
+        if (keys[i] == key) {
+            return i;
+        }
+    }
+    keys[affinity.core_cnt] = key;
+    return affinity.core_cnt++;
+}
+
+/*
+ * Only the CPUs both online and in the process's affinity mask are used,
+ * so a server started under taskset or in a cpuset stays inside it.
+ */
+int
+affinity_init (const char *sysfs_root)
+{
+    char path[AFFINITY_PATH_MAX_LEN+1], line[AFFINITY_LINE_MAX_LEN+1];
+    cpu_set_t online, allowed, set;
+    static int keys[AFFINITY_MAX_CPUS];
+    int cpu, node, package, core_id;
+    long cnt;
+
+    pthread_mutex_lock(&affinity.lock);
+    memzero((char *)&affinity + sizeof(pthread_mutex_t),
+            sizeof(affinity_t) - sizeof(pthread_mutex_t));
+    snprintf(affinity.root, sizeof(affinity.root), "%s",
+             sysfs_root != NULL ? sysfs_root : "/sys");
+    affinity.node_cnt = 1;
+    affinity.nic_node = -1;
+
+    snprintf(path, sizeof(path), "%s/devices/system/cpu/online",
+             affinity.root);
+    if (read_line(path, line, sizeof(line)) != 0 ||
+        affinity_parse_cpulist(line, &online) != 0) {
+        CPU_ZERO(&online);
+        cnt = sysconf(_SC_NPROCESSORS_ONLN);
+        for (cpu = 0; cpu < cnt && cpu < AFFINITY_MAX_CPUS; cpu++) {
+            CPU_SET(cpu, &online);
+        }
+    }
+    if (sysfs_root == NULL &&
+        sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        CPU_AND(&online, &online, &allowed);
+    }
+
+    for (cpu = 0; cpu < AFFINITY_MAX_CPUS; cpu++) {
+        if (!CPU_ISSET(cpu, &online)) {
+            continue;
+        }
+        snprintf(path, sizeof(path),
+                 "%s/devices/system/cpu/cpu%d/topology/physical_package_id",
+                 affinity.root, cpu);
+        if (read_int(path, &package) != 0) {
+            package = 0;
+        }
+        snprintf(path, sizeof(path),
+                 "%s/devices/system/cpu/cpu%d/topology/core_id",
+                 affinity.root, cpu);
+        if (read_int(path, &core_id) != 0) {
+            core_id = cpu;
+        }
+        affinity.core[cpu] = find_core(keys, (package << 16) | core_id);
+        affinity.cpus[affinity.cpu_cnt++] = cpu;
+    }
+
+    for (node = 0; node < AFFINITY_MAX_NODES; node++) {
+        snprintf(path, sizeof(path), "%s/devices/system/node/node%d/cpulist",
+                 affinity.root, node);
+        if (read_line(path, line, sizeof(line)) != 0 ||
+            affinity_parse_cpulist(line, &set) != 0) {
+            continue;
+        }
+        for (cpu = 0; cpu < AFFINITY_MAX_CPUS; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                affinity.node[cpu] = node;
+            }
+        }
+        affinity.node_cnt = node + 1;
+    }
+
+    affinity.usable = online;
+    if (affinity.cpu_cnt > 0) {
+        affinity.pref_node = affinity.node[affinity.cpus[0]];
+    }
+    pthread_mutex_unlock(&affinity.lock);
+
+    if (affinity.cpu_cnt == 0) {
+        logger(ERROR, "No cpu to run on.");
+        return -1;
+    }
+    return 0;
+}
+
+// iface as a whole word of an interrupt's name, eth1 not matching eth10
+static bool
+irq_of_nic (const char *line, const char *iface)
+{
+    const char *p = line;
+    size_t len = strlen(iface);
+
+    while ((p = strstr(p, iface)) != NULL) {
+        if ((p == line || !isalnum((uint8_t)p[-1])) &&
+            !isalnum((uint8_t)p[len])) {
+            return True;
+        }
+        p += len;
+    }
+    return False;
+}
+
+/*
+ * The node the interface's device sits on, and the CPUs its interrupts
+ * are delivered to, one queue each with RSS.
+ */
+static int
+affinity_set_nic (const char *iface)
+{
+    char path[AFFINITY_PATH_MAX_LEN+1], list[AFFINITY_LINE_MAX_LEN+1];
+    char *line = NULL, *end;
+    size_t size = 0;
+    cpu_set_t set;
+    FILE *fp;
+    int node, irq, cpu;
+
+    snprintf(path, sizeof(path), "%s/class/net/%s", affinity.root, iface);
+    if (strlen(iface) > AFFINITY_NAME_MAX_LEN || access(path, F_OK) != 0) {
+        printf("Fail to find network interface %s.\n", iface);
+        return -1;
+    }
+    snprintf(affinity.nic, sizeof(affinity.nic), "%s", iface);
+    // virtual devices and single node platforms don't tell
+    snprintf(path, sizeof(path), "%s/class/net/%s/device/numa_node",
+             affinity.root, iface);
+    if (read_int(path, &node) != 0) {
+        node = -1;
+    }
+    affinity.nic_node = node;
+    if (node >= 0 && node < affinity.node_cnt) {
+        affinity.pref_node = node;
+    }
+
+    fp = fopen("/proc/interrupts", "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    while (getline(&line, &size, fp) != -1) {
+        irq = strtol(line, &end, 10);
+        if (end == line || *end != ':' || !irq_of_nic(end, iface)) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/proc/irq/%d/effective_affinity_list",
+                 irq);
+        if (read_line(path, list, sizeof(list)) != 0) {
+            snprintf(path, sizeof(path), "/proc/irq/%d/smp_affinity_list",
+                     irq);
+            if (read_line(path, list, sizeof(list)) != 0) {
+                continue;
+            }
+        }
+        if (affinity_parse_cpulist(list, &set) != 0) {
+            continue;
+        }
+        for (cpu = 0; cpu < AFFINITY_MAX_CPUS; cpu++) {
+            if (CPU_ISSET(cpu, &set) && CPU_ISSET(cpu, &affinity.usable) &&
+                !affinity.irq[cpu]) {
+                affinity.irq[cpu] = True;
+                affinity.irq_cnt++;
+            }
+        }
+    }
+    free(line);
+    fclose(fp);
+    return 0;
+}
+
+/*
+ * spec is "auto" to spread the threads over the cores, "<role>=<cpus>"
+ * to pin the threads of a role to the CPUs of the list in turn, or
+ * "nic=<interface>" to place them by the node and interrupts of the
+ * interface in auto mode.
+ */
+int
+affinity_parse (const char *spec)
+{
+    const char *value;
+    cpu_set_t set;
+    size_t len;
+    int role, cpu, n = 0;
+
+    if (strcmp(spec, "auto") == 0) {
+        affinity.auto_mode = True;
+        return 0;
+    }
+    value = strchr(spec, '=');
+    if (value == NULL) {
+        printf("Unsupported affinity %s.\n", spec);
+        return -1;
+    }
+    len = value++ - spec;
+    if (len == 3 && strncmp(spec, "nic", len) == 0) {
+        return affinity_set_nic(value);
+    }
+
+    for (role = 0; role < AFFINITY_ROLE_CNT; role++) {
+        if (strlen(role_names[role]) == len &&
+            strncmp(spec, role_names[role], len) == 0) {
+            break;
+        }
+    }
+    if (role == AFFINITY_ROLE_CNT) {
+        printf("Unknown thread role in %s.\n", spec);
+        return -1;
+    }
+    if (affinity_parse_cpulist(value, &set) != 0 || CPU_COUNT(&set) == 0) {
+        printf("Bad cpu list %s.\n", value);
+        return -1;
+    }
+    for (cpu = 0; cpu < AFFINITY_MAX_CPUS; cpu++) {
+        if (!CPU_ISSET(cpu, &set)) {
+            continue;
+        }
+        if (!CPU_ISSET(cpu, &affinity.usable)) {
+            printf("cpu %d is not available.\n", cpu);
+            return -1;
+        }
+        affinity.role_cpus[role][n++] = cpu;
+    }
+    affinity.role_cpu_cnt[role] = n;
+    return 0;
+}
+
+/*
+ * Least loaded CPU, a core no thread runs on first, on the preferred
+ * node first, and for I/O threads the CPUs taking the nic's interrupts
+ * first while the others avoid them. Ties go to the lowest cpu id, which
+ * usually are the first thread of each core.
+ */
+static int
+affinity_pick_auto (int role)
+{
+    uint64_t score, best_score = UINT64_MAX;
+    int i, cpu, best = -1;
+    bool irq_wanted = (role == AFFINITY_ROLE_IO);
+
+    for (i = 0; i < affinity.cpu_cnt; i++) {
+        cpu = affinity.cpus[i];
+        score = (uint64_t)affinity.used[cpu] * 16 +
+                (uint64_t)affinity.core_used[affinity.core[cpu]] * 4;
+        if (affinity.node[cpu] != affinity.pref_node) {
+            score += 2;
+        }
+        if (affinity.irq_cnt > 0 && affinity.irq[cpu] != irq_wanted) {
+            score += 1;
+        }
+        if (score < best_score) {
+            best_score = score;
+            best = cpu;
+        }
+    }
+    return best;
+}
+
+/*
+ * The CPU for the next thread of role, -1 if the role isn't pinned. The
+ * placement is printed, it counts as taken from now on.
+ */
+int
+affinity_pick (int role)
+{
+    uint32_t n;
+    int cpu;
+
+    pthread_mutex_lock(&affinity.lock);
+    n = affinity.picked[role];
+    if (affinity.role_cpu_cnt[role] > 0) {
+        cpu = affinity.role_cpus[role][n % affinity.role_cpu_cnt[role]];
+    } else if (affinity.auto_mode && affinity.cpu_cnt > 0) {
+        cpu = affinity_pick_auto(role);
+    } else {
+        pthread_mutex_unlock(&affinity.lock);
+        return -1;
+    }
+    affinity.picked[role]++;
+    affinity.used[cpu]++;
+    affinity.core_used[affinity.core[cpu]]++;
+    pthread_mutex_unlock(&affinity.lock);
+
+    printf("Pin %s thread %u to cpu %d, node %d\n", role_names[role], n, cpu,
+           affinity.node[cpu]);
+    return cpu;
+}
+
+/*
+ * Pin the calling thread to cpu, -1 leaves it alone. Pinned before it
+ * allocates anything, the pages it touches first come from its node.
+ */
+int
+affinity_pin (int cpu)
+{
+    cpu_set_t set;
+    int rc;
+
+    if (cpu < 0) {
+        return 0;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) {
+        logger(ERROR, "Fail to pin thread to cpu %d, %d", cpu, rc);
+        return -1;
+    }
+    return 0;
+}
+
+int
+affinity_get_node (int cpu)
+{
+    if (cpu < 0 || cpu >= AFFINITY_MAX_CPUS) {
+        return -1;
+    }
+    return affinity.node[cpu];
+}
+
+/*
+ * Have the pages of addr not touched yet come from node, for memory of a
+ * thread allocated before it runs. addr must be page aligned, as mmap
+ * returns it. Nothing to do for node -1 or a single node.
+ */
+int
+affinity_bind (void *addr, size_t len, int node)
+{
+    unsigned long mask[AFFINITY_MAX_NODES / AFFINITY_NODE_MASK_BITS];
+
+    if (node < 0 || node >= AFFINITY_MAX_NODES || affinity.node_cnt <= 1) {
+        return 0;
+    }
+    memzero(mask, sizeof(mask));
+    mask[node / AFFINITY_NODE_MASK_BITS] |=
+        1UL << (node % AFFINITY_NODE_MASK_BITS);
+    // the kernel takes one bit less than maxnode says
+    if (syscall(SYS_mbind, addr, len, MPOL_PREFERRED, mask,
+                AFFINITY_MAX_NODES + 1, 0) != 0) {
+        logger(ERROR, "Fail to bind memory to node %d, %d", node, errno);
+        return -1;
+    }
+    return 0;
+}
+
+void
+affinity_print (void)
+{
+    char list[AFFINITY_LINE_MAX_LEN+1];
+    cpu_set_t set;
+    int node, i, cpu, role;
+    bool pinned = affinity.auto_mode;
+
+    printf("CPU topology: nodes %d, cores %d, cpus %d\n", affinity.node_cnt,
+           affinity.core_cnt, affinity.cpu_cnt);
+    for (node = 0; node < affinity.node_cnt; node++) {
+        CPU_ZERO(&set);
+        for (i = 0; i < affinity.cpu_cnt; i++) {
+            cpu = affinity.cpus[i];
+            if (affinity.node[cpu] == node) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        if (CPU_COUNT(&set) > 0) {
+            format_cpulist(&set, list, sizeof(list));
+            printf("  node %d: cpus %s\n", node, list);
+        }
+    }
+    if (affinity.nic[0] != '\0') {
+        CPU_ZERO(&set);
+        for (i = 0; i < affinity.cpu_cnt; i++) {
+            if (affinity.irq[affinity.cpus[i]]) {
+                CPU_SET(affinity.cpus[i], &set);
+            }
+        }
+        format_cpulist(&set, list, sizeof(list));
+        printf("  %s: node %d, irq cpus %s\n", affinity.nic,
+               affinity.nic_node, list[0] ? list : "unknown");
+    }
+    for (role = 0; role < AFFINITY_ROLE_CNT; role++) {
+        pinned = pinned || affinity.role_cpu_cnt[role] > 0;
+    }
+    if (!pinned) {
+        printf("  threads not pinned\n");
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef __AFFINITY_H__
+#define __AFFINITY_H__
+
+#include <sched.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define AFFINITY_MAX_CPUS CPU_SETSIZE
+#define AFFINITY_MAX_NODES 64
+#define AFFINITY_NAME_MAX_LEN 31
+
+// what a thread does, each role is pinned on its own
+enum {
+    AFFINITY_ROLE_IO = 0,    // epoll thread, reactors, client epoll loop
+    AFFINITY_ROLE_WORKER,
+    AFFINITY_ROLE_PRODUCER,
+    AFFINITY_ROLE_SENDER,
+    AFFINITY_ROLE_COUNTER,
+    AFFINITY_ROLE_CNT,
+};
+
+/*
+ * Read the CPU topology, from sysfs_root instead of /sys if not NULL.
+ * Without it every CPU the process may run on is a core of node 0.
+ */
+int
+affinity_init(const char *sysfs_root);
+
+int
+affinity_parse(const char *spec);
+
+int
+affinity_parse_cpulist(const char *s, cpu_set_t *set);
+
+int
+affinity_pick(int role);
+
+int
+affinity_pin(int cpu);
+
+int
+affinity_get_node(int cpu);
+
+int
+affinity_bind(void *addr, size_t len, int node);
+
+void
+affinity_print(void);
+#endif //__AFFINITY_H__
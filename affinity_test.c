@@ -0,0 +1,169 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "affinity.h"
+
+#define TEST_PATH_MAX_LEN 255
+
+static int
+write_file (const char *root, const char *rel, const char *content)
+{
+    char path[TEST_PATH_MAX_LEN+1];
+    char *p;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/%s", root, rel);
+    for (p = path + strlen(root) + 1; (p = strchr(p, '/')) != NULL; p++) {
+        *p = '\0';
+        mkdir(path, 0755);
+        *p = '/';
+    }
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        return -1;
+    }
+    fprintf(fp, "%s\n", content);
+    fclose(fp);
+    return 0;
+}
+
+/*
+ * Two nodes of two cores with two threads each, siblings numbered apart
+ * as Linux does: cpu n and n+4 share a core, node 0 has cores 0 and 1.
+ */
+static int
+make_sysfs (char *root)
+{
+    char rel[TEST_PATH_MAX_LEN+1], val[16];
+    int cpu, rc = 0;
+
+    if (mkdtemp(root) == NULL) {
+        return -1;
+    }
+    rc |= write_file(root, "devices/system/cpu/online", "0-7");
+    rc |= write_file(root, "devices/system/node/node0/cpulist", "0-1,4-5");
+    rc |= write_file(root, "devices/system/node/node1/cpulist", "2-3,6-7");
+    for (cpu = 0; cpu < 8; cpu++) {
+        snprintf(rel, sizeof(rel),
+                 "devices/system/cpu/cpu%d/topology/physical_package_id",
+                 cpu);
+        snprintf(val, sizeof(val), "%d", cpu % 4 / 2);
+        rc |= write_file(root, rel, val);
+        snprintf(rel, sizeof(rel),
+                 "devices/system/cpu/cpu%d/topology/core_id", cpu);
+        snprintf(val, sizeof(val), "%d", cpu % 2);
+        rc |= write_file(root, rel, val);
+    }
+    return rc;
+}
+
+static int
+test_cpulist (void)
+{
+    cpu_set_t set;
+
+    if (affinity_parse_cpulist("0-2,5", &set) != 0 || CPU_COUNT(&set) != 4 ||
+        !CPU_ISSET(5, &set) || CPU_ISSET(3, &set)) {
+        printf("FAIL: 0-2,5\n");
+        return -1;
+    }
+    if (affinity_parse_cpulist("", &set) != 0 || CPU_COUNT(&set) != 0) {
+        printf("FAIL: empty list\n");
+        return -1;
+    }
+    if (affinity_parse_cpulist("3-1", &set) == 0 ||
+        affinity_parse_cpulist("1,", &set) == 0 ||
+        affinity_parse_cpulist("x", &set) == 0 ||
+        affinity_parse_cpulist("100000", &set) == 0) {
+        printf("FAIL: bad list accepted\n");
+        return -1;
+    }
+    printf("cpulist: ok\n");
+    return 0;
+}
+
+/*
+ * Auto placement takes a core of its own per thread, the first node
+ * first, then the second threads of the cores, then starts over. A role
+ * given a list goes through it in turn.
+ */
+static int
+test_place (void)
+{
+    char root[] = "/tmp/affinity_testXXXXXX";
+    char cmd[TEST_PATH_MAX_LEN+1];
+    int expect[] = { 0, 1, 2, 3, 4, 5, 6, 7, 0 };
+    int i, cpu, rc = -1;
+
+    if (make_sysfs(root) != 0 || affinity_init(root) != 0) {
+        printf("FAIL: fake sysfs\n");
+        goto out;
+    }
+    affinity_print();
+    if (affinity_parse("auto") != 0 || affinity_parse("worker=5,7") != 0) {
+        printf("FAIL: parse\n");
+        goto out;
+    }
+    if (affinity_parse("bogus=1") == 0 || affinity_parse("io=1-") == 0 ||
+        affinity_parse("io=9") == 0 || affinity_parse("io") == 0) {
+        printf("FAIL: bad spec accepted\n");
+        goto out;
+    }
+    for (i = 0; i < sizeof(expect) / sizeof(expect[0]); i++) {
+        cpu = affinity_pick(AFFINITY_ROLE_IO);
+        if (cpu != expect[i]) {
+            printf("FAIL: io thread %d on cpu %d, not %d\n", i, cpu,
+                   expect[i]);
+            goto out;
+        }
+    }
+    if (affinity_pick(AFFINITY_ROLE_WORKER) != 5 ||
+        affinity_pick(AFFINITY_ROLE_WORKER) != 7 ||
+        affinity_pick(AFFINITY_ROLE_WORKER) != 5 ||
+        affinity_get_node(7) != 1) {
+        printf("FAIL: worker list\n");
+        goto out;
+    }
+    printf("place: ok\n");
+    rc = 0;
+out:
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+    if (system(cmd) != 0) {
+        printf("Fail to remove %s\n", root);
+    }
+    return rc;
+}
+
+// on this machine, the thread ends up on the cpu picked
+static int
+test_pin (void)
+{
+    int cpu;
+
+    if (affinity_init(NULL) != 0 || affinity_parse("auto") != 0) {
+        printf("FAIL: init\n");
+        return -1;
+    }
+    affinity_print();
+    cpu = affinity_pick(AFFINITY_ROLE_IO);
+    if (affinity_pin(cpu) != 0 || sched_getcpu() != cpu) {
+        printf("FAIL: not running on cpu %d\n", cpu);
+        return -1;
+    }
+    printf("pin: ok\n");
+    return 0;
+}
+
+int main (void)
+{
+    if (test_cpulist() != 0 || test_place() != 0 || test_pin() != 0) {
+        printf("FAIL\n");
+        return -1;
+    }
+    printf("PASS\n");
+    return 0;
+}
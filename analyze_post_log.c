@@ -0,0 +1,904 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "scan.h"
+
+#define DEFAULT_LOG_FILE "post.log"
+#define DEFAULT_SPOILER_MS 200
+#define MAX_PARSE_THREADS 64
+#define MS_PER_DAY (24*3600*1000)
+#define TID_TABLE_INIT_SIZE 64
+#define TS_LEN 12 // "HH:MM:SS.mmm"
+#define CSV_BUF_SIZE (64*1024)
+#define CSV_ROW_MAX_LEN 48
+
+/*
+ * What a sender thread of the client logs around one message, see
+ * sender_thread in client.c: it gets ready once, then for every message
+ * fetches it, sends it and gets the response, reconnecting first when the
+ * server closed the connection.
+ */
+enum {
+    STATUS_NONE = 0,
+    STATUS_READY,
+    STATUS_FETCH_MSG,
+    STATUS_GET_FIN,
+    STATUS_RECONNECT,
+    STATUS_GET_RESP,
+    STATUS_CNT,
+};
+
+enum {
+    SAMPLE_SEND = 0,
+    SAMPLE_SWITCH,
+    SAMPLE_CONNECT,
+    SAMPLE_KIND_CNT,
+};
+
+static const char *status_names[STATUS_CNT] = {
+    "none", "ready", "fetch_msg", "get_fin", "reconnect", "get_resp",
+};
+
+static const char *sample_names[SAMPLE_KIND_CNT] = {
+    "send", "switch", "connect",
+};
+
+static const char *csv_names[SAMPLE_KIND_CNT] = {
+    "post_send_time.csv", "post_switch_time.csv", "post_connect_time.csv",
+};
+
+typedef struct event_s {
+    uint32_t ts_ms; // since midnight
+    uint32_t status;
+} event_t;
+
+typedef struct event_list_s {
+    uint32_t tid;
+    uint32_t cnt;
+    uint32_t cap;
+    event_t *events;
+} event_list_t;
+
+/*
+ * Event lists of a chunk, one per thread id in order of first appearance,
+ * found by tid through an open addressing index.
+ */
+typedef struct tid_table_s {
+    event_list_t *lists;
+    uint32_t cnt;
+    uint32_t cap;
+    uint32_t *index; // list position + 1, 0 for an empty slot
+    uint32_t index_mask;
+} tid_table_t;
+
+typedef struct chunk_s {
+    const char *start;
+    const char *end;
+    tid_table_t table;
+    uint64_t line_cnt;
+    int rc;
+    pthread_t thread_id;
+    bool started;
+} chunk_t;
+
+typedef struct sample_s {
+    uint32_t time_idx_ms;
+    uint32_t interval_ms;
+} sample_t;
+
+typedef struct sample_list_s {
+    sample_t *samples;
+    uint32_t cnt;
+    uint32_t cap;
+} sample_list_t;
+
+typedef struct sender_s {
+    uint32_t tid;
+    uint32_t last_status;
+    int64_t ts[STATUS_CNT]; // -1 until the status is seen
+    sample_list_t samples[SAMPLE_KIND_CNT];
+    uint64_t msg_cnt;
+    uint64_t connect_cnt;
+    uint64_t invalid_cnt;
+} sender_t;
+
+typedef struct analyzer_s {
+    tid_table_t senders_index;
+    sender_t *senders;
+    uint32_t spoiler_ms;
+    uint64_t invalid_cnt;
+} analyzer_t;
+
+static uint32_t
+tid_hash (uint32_t tid)
+{
+    return tid * 2654435761u;
+}
+
+static int
+tid_table_init (tid_table_t *table)
+{
+    memzero(table, sizeof(tid_table_t));
+    table->index = calloc(TID_TABLE_INIT_SIZE, sizeof(uint32_t));
+    if (table->index == NULL) {
+        return -1;
+    }
+    table->index_mask = TID_TABLE_INIT_SIZE - 1;
+    return 0;
+}
+
+static void
+tid_table_clean (tid_table_t *table)
+{
+    uint32_t i;
+
+    for (i = 0; i < table->cnt; i++) {
+        free(table->lists[i].events);
+    }
+    free(table->lists);
+    free(table->index);
+    memzero(table, sizeof(tid_table_t));
+}
+
+static int
+tid_table_grow_index (tid_table_t *table)
+{
+    uint32_t size = (table->index_mask + 1) * 2, i, h;
+    uint32_t *index;
+
+    index = calloc(size, sizeof(uint32_t));
+    if (index == NULL) {
+        return -1;
+    }
+    for (i = 0; i < table->cnt; i++) {
+        h = tid_hash(table->lists[i].tid) & (size - 1);
+        while (index[h] != 0) {
+            h = (h + 1) & (size - 1);
+        }
+        index[h] = i + 1;
+    }
+    free(table->index);
+    table->index = index;
+    table->index_mask = size - 1;
+    return 0;
+}
+
+/*
+ * Position of the list of tid, added if it isn't there yet, -1 when out
+ * of memory.
+ */
+static int64_t
+tid_table_get (tid_table_t *table, uint32_t tid)
+{
+    event_list_t *lists;
+    uint32_t h, cap;
+
+    h = tid_hash(tid) & table->index_mask;
+    while (table->index[h] != 0) {
+        if (table->lists[table->index[h] - 1].tid == tid) {
+            return table->index[h] - 1;
+        }
+        h = (h + 1) & table->index_mask;
+    }
+
+    if (table->cnt == table->cap) {
+        cap = table->cap ? table->cap * 2 : TID_TABLE_INIT_SIZE / 2;
+        lists = realloc(table->lists, cap * sizeof(event_list_t));
+        if (lists == NULL) {
+            return -1;
+        }
+        table->lists = lists;
+        table->cap = cap;
+    }
+    memzero(&table->lists[table->cnt], sizeof(event_list_t));
+    table->lists[table->cnt].tid = tid;
+    table->index[h] = ++table->cnt;
+
+    if (table->cnt * 2 > table->index_mask + 1 &&
+        tid_table_grow_index(table) != 0) {
+        return -1;
+    }
+    return table->cnt - 1;
+}
+
+static int
+event_list_add (event_list_t *list, uint32_t ts_ms, uint32_t status)
+{
+    event_t *events;
+    uint32_t cap;
+
+    if (list->cnt == list->cap) {
+        cap = list->cap ? list->cap * 2 : 1024;
+        events = realloc(list->events, cap * sizeof(event_t));
+        if (events == NULL) {
+            return -1;
+        }
+        list->events = events;
+        list->cap = cap;
+    }
+    list->events[list->cnt].ts_ms = ts_ms;
+    list->events[list->cnt].status = status;
+    list->cnt++;
+    return 0;
+}
+
+static bool
+is_digit (char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/*
+ * "HH:MM:SS.mmm" as ms since midnight, -1 if the line doesn't start with
+ * one, like the lines of a multi-line message.
+ */
+static int64_t
+parse_ts (const char *p, const char *end)
+{
+    if (end - p < TS_LEN ||
+        !is_digit(p[0]) || !is_digit(p[1]) || p[2] != ':' ||
+        !is_digit(p[3]) || !is_digit(p[4]) || p[5] != ':' ||
+        !is_digit(p[6]) || !is_digit(p[7]) || p[8] != '.' ||
+        !is_digit(p[9]) || !is_digit(p[10]) || !is_digit(p[11])) {
+        return -1;
+    }
+    return (((p[0] - '0') * 10 + (p[1] - '0')) * 3600 +
+            ((p[3] - '0') * 10 + (p[4] - '0')) * 60 +
+            ((p[6] - '0') * 10 + (p[7] - '0'))) * 1000 +
+           (p[9] - '0') * 100 + (p[10] - '0') * 10 + (p[11] - '0');
+}
+
+static bool
+has_prefix (const char *p, const char *end, const char *prefix, uint32_t len)
+{
+    return end - p >= len && memcmp(p, prefix, len) == 0;
+}
+
+#define match_prefix(p, end, lit) has_prefix(p, end, lit, sizeof(lit) - 1)
+
+static uint32_t
+parse_status (const char *p, const char *end)
+{
+    if (p == end) {
+        return STATUS_NONE;
+    }
+    switch (*p) {
+    case 'S':
+        return match_prefix(p, end, "Start to work") ?
+               STATUS_READY : STATUS_NONE;
+    case 'F':
+        return match_prefix(p, end, "Fetch msg") ?
+               STATUS_FETCH_MSG : STATUS_NONE;
+    case 'C':
+        return match_prefix(p, end, "Connect succeed") ?
+               STATUS_RECONNECT : STATUS_NONE;
+    case 'G':
+        if (match_prefix(p, end, "Get FIN")) {
+            return STATUS_GET_FIN;
+        }
+        return match_prefix(p, end, "Get resp") ?
+               STATUS_GET_RESP : STATUS_NONE;
+    default:
+        return STATUS_NONE;
+    }
+}
+
+/*
+ * A record line is "<ts> <tid> <level> <content>", tid in hex between
+ * angle brackets. Return its status, STATUS_NONE for any other line.
+ */
+static uint32_t
+parse_line (const char *p, const char *end, uint32_t *ts_ms, uint32_t *tid)
+{
+    int64_t ts;
+    uint32_t id = 0;
+    char c;
+
+    ts = parse_ts(p, end);
+    if (ts < 0) {
+        return STATUS_NONE;
+    }
+    p += TS_LEN;
+
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    if (p == end || *p++ != '<') {
+        return STATUS_NONE;
+    }
+    for (; p < end && *p != '>'; p++) {
+        c = *p;
+        if (is_digit(c)) {
+            id = id * 16 + c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            id = id * 16 + c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            id = id * 16 + c - 'A' + 10;
+        } else {
+            return STATUS_NONE;
+        }
+    }
+    if (p++ == end) {
+        return STATUS_NONE;
+    }
+
+    // level
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    while (p < end && *p != ' ') {
+        p++;
+    }
+    while (p < end && *p == ' ') {
+        p++;
+    }
+
+    *ts_ms = ts;
+    *tid = id;
+    return parse_status(p, end);
+}
+
+static void *
+parse_chunk (void *args)
+{
+    chunk_t *chunk = (chunk_t *)args;
+    const char *p = chunk->start, *eol;
+    uint32_t status, ts_ms = 0, tid = 0;
+    int64_t idx;
+
+    while (p < chunk->end) {
+        eol = scan_find_eol(p, chunk->end - p);
+        if (eol == NULL) {
+            eol = chunk->end;
+        }
+        chunk->line_cnt++;
+
+        status = parse_line(p, eol, &ts_ms, &tid);
+        if (status != STATUS_NONE) {
+            idx = tid_table_get(&chunk->table, tid);
+            if (idx < 0 ||
+                event_list_add(&chunk->table.lists[idx], ts_ms, status) != 0) {
+                chunk->rc = -1;
+                return NULL;
+            }
+        }
+        p = eol + 1;
+    }
+    return NULL;
+}
+
+static int
+sample_list_add (sample_list_t *list, uint32_t time_idx_ms,
+                 uint32_t interval_ms)
+{
+    sample_t *samples;
+    uint32_t cap;
+
+    if (list->cnt == list->cap) {
+        cap = list->cap ? list->cap * 2 : 1024;
+        samples = realloc(list->samples, cap * sizeof(sample_t));
+        if (samples == NULL) {
+            return -1;
+        }
+        list->samples = samples;
+        list->cap = cap;
+    }
+    list->samples[list->cnt].time_idx_ms = time_idx_ms;
+    list->samples[list->cnt].interval_ms = interval_ms;
+    list->cnt++;
+    return 0;
+}
+
+/*
+ * Time of day only, a run going over midnight wraps.
+ */
+static uint32_t
+ts_diff (int64_t start, int64_t end)
+{
+    if (start < 0) {
+        return 0;
+    }
+    return end >= start ? end - start : end + MS_PER_DAY - start;
+}
+
+static void
+print_spoiler (sender_t *sender, uint32_t interval_ms, uint32_t ts_ms)
+{
+    printf("SPOILER %04x, %u:%02u:%02u.%06u, %u:%u:%u.%u\n", sender->tid,
+           interval_ms / 3600000, interval_ms / 60000 % 60,
+           interval_ms / 1000 % 60, interval_ms % 1000 * 1000,
+           ts_ms / 3600000, ts_ms / 60000 % 60, ts_ms / 1000 % 60,
+           ts_ms % 1000);
+}
+
+static int
+add_sample (analyzer_t *analyzer, sender_t *sender, int kind,
+            uint32_t from_status, uint32_t ts_ms)
+{
+    uint32_t interval = ts_diff(sender->ts[from_status], ts_ms);
+    uint32_t time_idx = ts_diff(sender->ts[STATUS_READY], ts_ms);
+
+    if (kind == SAMPLE_SEND && interval >= analyzer->spoiler_ms) {
+        print_spoiler(sender, interval, ts_ms);
+    }
+    return sample_list_add(&sender->samples[kind], time_idx, interval);
+}
+
+/*
+ * Feed one event to the state machine of its sender, a status whose
+ * previous one isn't a valid prior is counted and resyncs the machine.
+ */
+static int
+sender_consume (analyzer_t *analyzer, sender_t *sender, event_t *ev)
+{
+    uint32_t last = sender->last_status, cur = ev->status;
+    bool valid;
+    int rc = 0;
+
+    // connections made before the thread is ready
+    if (last == STATUS_NONE && cur == STATUS_RECONNECT) {
+        return 0;
+    }
+
+    switch (cur) {
+    case STATUS_READY:
+        valid = (last == STATUS_NONE);
+        break;
+    case STATUS_FETCH_MSG:
+        valid = (last == STATUS_READY || last == STATUS_GET_RESP);
+        if (valid && sender->ts[STATUS_GET_RESP] >= 0) {
+            rc = add_sample(analyzer, sender, SAMPLE_SWITCH,
+                            STATUS_GET_RESP, ev->ts_ms);
+        }
+        break;
+    case STATUS_GET_FIN:
+        valid = (last == STATUS_FETCH_MSG);
+        break;
+    case STATUS_RECONNECT:
+        valid = (last == STATUS_GET_FIN);
+        if (valid) {
+            rc = add_sample(analyzer, sender, SAMPLE_CONNECT,
+                            STATUS_FETCH_MSG, ev->ts_ms);
+            sender->connect_cnt++;
+        }
+        break;
+    case STATUS_GET_RESP:
+        valid = (last == STATUS_RECONNECT || last == STATUS_FETCH_MSG);
+        if (valid) {
+            rc = add_sample(analyzer, sender, SAMPLE_SEND, last, ev->ts_ms);
+            sender->msg_cnt++;
+        }
+        break;
+    default:
+        valid = False;
+        break;
+    }
+
+    if (!valid) {
+        fprintf(stderr, "<%04x> %s is not a valid prior for %s\n",
+                sender->tid, status_names[last], status_names[cur]);
+        sender->invalid_cnt++;
+        analyzer->invalid_cnt++;
+    }
+    sender->ts[cur] = ev->ts_ms;
+    sender->last_status = cur;
+    return rc;
+}
+
+/*
+ * Chunks are in file order and so are the events of a thread within each,
+ * feeding them chunk after chunk keeps every sender's order.
+ */
+static int
+analyze_chunks (analyzer_t *analyzer, chunk_t *chunks, int chunk_cnt)
+{
+    tid_table_t *index = &analyzer->senders_index;
+    event_list_t *list;
+    sender_t *sender, *senders;
+    uint32_t i, j, k, cnt, cap = 0;
+    int64_t idx;
+    int c;
+
+    for (c = 0; c < chunk_cnt; c++) {
+        for (i = 0; i < chunks[c].table.cnt; i++) {
+            list = &chunks[c].table.lists[i];
+            cnt = index->cnt;
+            idx = tid_table_get(index, list->tid);
+            if (idx < 0) {
+                return -1;
+            }
+            if (index->cap > cap) {
+                senders = realloc(analyzer->senders,
+                                  index->cap * sizeof(sender_t));
+                if (senders == NULL) {
+                    return -1;
+                }
+                analyzer->senders = senders;
+                cap = index->cap;
+            }
+
+            sender = &analyzer->senders[idx];
+            if (index->cnt > cnt) {
+                memzero(sender, sizeof(sender_t));
+                sender->tid = list->tid;
+                for (k = 0; k < STATUS_CNT; k++) {
+                    sender->ts[k] = -1;
+                }
+            }
+            for (j = 0; j < list->cnt; j++) {
+                if (sender_consume(analyzer, sender, &list->events[j]) != 0) {
+                    return -1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static char *
+put_u32 (char *p, uint32_t v, int min_digits)
+{
+    char tmp[10];
+    int n = 0;
+
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v != 0 || n < min_digits);
+    while (n > 0) {
+        *p++ = tmp[--n];
+    }
+    return p;
+}
+
+/*
+ * Milliseconds as seconds the way Python's str(float) prints them:
+ * trailing zeros dropped, but at least one decimal, 108.48, 1.5, 2.0.
+ */
+static char *
+put_seconds (char *p, uint32_t ms)
+{
+    uint32_t frac = ms % 1000;
+    int digits = 3;
+
+    p = put_u32(p, ms / 1000, 1);
+    *p++ = '.';
+    while (digits > 1 && frac % 10 == 0) {
+        frac /= 10;
+        digits--;
+    }
+    return put_u32(p, frac, digits);
+}
+
+static char *
+put_hex (char *p, uint32_t v)
+{
+    static const char digits[] = "0123456789abcdef";
+    char tmp[8];
+    int n = 0;
+
+    do {
+        tmp[n++] = digits[v & 0xf];
+        v >>= 4;
+    } while (v != 0 || n < 4);
+    while (n > 0) {
+        *p++ = tmp[--n];
+    }
+    return p;
+}
+
+/*
+ * Per sender csv rows "tid,time index in s,interval in ms" and the
+ * average, min and max of the intervals.
+ */
+static int
+write_csv (analyzer_t *analyzer, int kind)
+{
+    char buf[CSV_BUF_SIZE], *p = buf;
+    sample_list_t *list;
+    sample_t *sample;
+    sender_t *sender;
+    uint64_t sum;
+    uint32_t i, j, min, max;
+    FILE *fcsv;
+
+    fcsv = fopen(csv_names[kind], "w");
+    if (fcsv == NULL) {
+        fprintf(stderr, "Fail to open %s, %s\n", csv_names[kind],
+                strerror(errno));
+        return -1;
+    }
+
+    for (i = 0; i < analyzer->senders_index.cnt; i++) {
+        sender = &analyzer->senders[i];
+        list = &sender->samples[kind];
+        if (list->cnt == 0) {
+            continue;
+        }
+        sum = 0;
+        min = UINT32_MAX;
+        max = 0;
+        for (j = 0; j < list->cnt; j++) {
+            sample = &list->samples[j];
+            // same as "%04x,%s,%u\n", fprintf is most of the run time
+            if (p - buf > CSV_BUF_SIZE - CSV_ROW_MAX_LEN) {
+                fwrite(buf, 1, p - buf, fcsv);
+                p = buf;
+            }
+            p = put_hex(p, sender->tid);
+            *p++ = ',';
+            p = put_seconds(p, sample->time_idx_ms);
+            *p++ = ',';
+            p = put_u32(p, sample->interval_ms, 1);
+            *p++ = '\n';
+            sum += sample->interval_ms;
+            min = MIN(min, sample->interval_ms);
+            max = MAX(max, sample->interval_ms);
+        }
+
+        printf("<%04x> Average %s time %.1f", sender->tid,
+               sample_names[kind], (double)sum / list->cnt);
+        if (kind == SAMPLE_SEND) {
+            printf(", msg count %lu", (unsigned long)sender->msg_cnt);
+        } else if (kind == SAMPLE_CONNECT) {
+            printf(", count %lu", (unsigned long)sender->connect_cnt);
+        }
+        printf(", [%u, %u]\n", min, max);
+    }
+
+    fwrite(buf, 1, p - buf, fcsv);
+    fclose(fcsv);
+    return 0;
+}
+
+/*
+ * LSD radix sort, a byte per pass, tmp as large as values. Passes where
+ * every value has the same byte are skipped, intervals rarely need more
+ * than two.
+ */
+static void
+radix_sort_u32 (uint32_t *values, uint32_t *tmp, uint64_t cnt)
+{
+    uint64_t counts[256], pos, c, i;
+    uint32_t *src = values, *dst = tmp, *swap;
+    int shift, b;
+
+    for (shift = 0; shift < 32; shift += 8) {
+        memzero(counts, sizeof(counts));
+        for (i = 0; i < cnt; i++) {
+            counts[(src[i] >> shift) & 0xff]++;
+        }
+        if (counts[(src[0] >> shift) & 0xff] == cnt) {
+            continue;
+        }
+        for (b = 0, pos = 0; b < 256; b++) {
+            c = counts[b];
+            counts[b] = pos;
+            pos += c;
+        }
+        for (i = 0; i < cnt; i++) {
+            dst[counts[(src[i] >> shift) & 0xff]++] = src[i];
+        }
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != values) {
+        memcpy(values, src, cnt * sizeof(uint32_t));
+    }
+}
+
+static void
+print_percentiles (analyzer_t *analyzer, int kind)
+{
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    sample_list_t *list;
+    uint32_t *values;
+    uint64_t cnt = 0, n = 0;
+    uint32_t i, j;
+
+    for (i = 0; i < analyzer->senders_index.cnt; i++) {
+        cnt += analyzer->senders[i].samples[kind].cnt;
+    }
+    if (cnt == 0) {
+        return;
+    }
+    values = malloc(cnt * 2 * sizeof(uint32_t));
+    if (values == NULL) {
+        return;
+    }
+    for (i = 0; i < analyzer->senders_index.cnt; i++) {
+        list = &analyzer->senders[i].samples[kind];
+        for (j = 0; j < list->cnt; j++) {
+            values[n++] = list->samples[j].interval_ms;
+        }
+    }
+    radix_sort_u32(values, values + cnt, cnt);
+
+    printf("%s time ms, count %lu:", sample_names[kind], (unsigned long)cnt);
+    for (i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++) {
+        printf(" p%g %u", quantiles[i] * 100,
+               values[(uint64_t)(quantiles[i] * (cnt - 1))]);
+    }
+    printf(" max %u\n", values[cnt - 1]);
+    free(values);
+}
+
+static void
+analyzer_clean (analyzer_t *analyzer)
+{
+    uint32_t i;
+    int k;
+
+    for (i = 0; i < analyzer->senders_index.cnt; i++) {
+        for (k = 0; k < SAMPLE_KIND_CNT; k++) {
+            free(analyzer->senders[i].samples[k].samples);
+        }
+    }
+    free(analyzer->senders);
+    tid_table_clean(&analyzer->senders_index);
+}
+
+/*
+ * Split the log in chunk_cnt pieces ending on a line end and parse them
+ * in parallel.
+ */
+static int
+parse_log (const char *buf, uint64_t size, chunk_t *chunks, int chunk_cnt)
+{
+    const char *p = buf, *end = buf + size, *eol;
+    int i, rc = 0;
+
+    for (i = 0; i < chunk_cnt; i++) {
+        chunks[i].start = p;
+        if (i == chunk_cnt - 1) {
+            p = end;
+        } else {
+            p = MIN(p + size / chunk_cnt, end);
+            eol = p < end ? scan_find_eol(p, end - p) : NULL;
+            p = eol != NULL ? eol + 1 : end;
+        }
+        chunks[i].end = p;
+        if (tid_table_init(&chunks[i].table) != 0) {
+            return -1;
+        }
+    }
+
+    for (i = 0; i < chunk_cnt; i++) {
+        if (pthread_create(&chunks[i].thread_id, NULL, parse_chunk,
+                           &chunks[i]) == 0) {
+            chunks[i].started = True;
+        } else {
+            // no thread for it, parse it here
+            parse_chunk(&chunks[i]);
+        }
+    }
+    for (i = 0; i < chunk_cnt; i++) {
+        if (chunks[i].started) {
+            pthread_join(chunks[i].thread_id, NULL);
+        }
+        if (chunks[i].rc != 0) {
+            rc = -1;
+        }
+    }
+    return rc;
+}
+
+static void
+usage (void)
+{
+    printf("analyze_post_log [-j <thread_count>] [-t <spoiler_ms>] "
+           "[post.log]\n");
+}
+
+int main (int argc, char **argv)
+{
+    const char *path = DEFAULT_LOG_FILE;
+    analyzer_t analyzer;
+    chunk_t *chunks;
+    struct stat st;
+    uint64_t line_cnt = 0;
+    long cpu_cnt;
+    char *buf;
+    int opt, fd, i, k, rc, thread_cnt = 0;
+
+    memzero(&analyzer, sizeof(analyzer_t));
+    analyzer.spoiler_ms = DEFAULT_SPOILER_MS;
+
+    while ((opt = getopt(argc, argv, "j:t:h")) != -1) {
+        switch (opt) {
+        case 'j':
+            thread_cnt = atoi(optarg);
+            if (thread_cnt <= 0) {
+                printf("thread count should be a positive integer.\n");
+                return -1;
+            }
+            break;
+        case 't':
+            analyzer.spoiler_ms = atoi(optarg);
+            break;
+        default:
+            usage();
+            return -1;
+        }
+    }
+    if (optind < argc) {
+        path = argv[optind];
+    }
+    if (thread_cnt == 0) {
+        cpu_cnt = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_cnt = cpu_cnt > 0 ? cpu_cnt : 1;
+    }
+    thread_cnt = MIN(thread_cnt, MAX_PARSE_THREADS);
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Fail to open %s, %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (buf == MAP_FAILED) {
+        fprintf(stderr, "Fail to mmap %s, %s\n", path, strerror(errno));
+        return -1;
+    }
+    // advice values are not flags, one call each
+    madvise(buf, st.st_size, MADV_SEQUENTIAL);
+    madvise(buf, st.st_size, MADV_WILLNEED);
+
+    // small logs aren't worth a thread per core
+    thread_cnt = MIN(thread_cnt, st.st_size / (1 << 20) + 1);
+    chunks = calloc(thread_cnt, sizeof(chunk_t));
+    if (chunks == NULL) {
+        munmap(buf, st.st_size);
+        return -1;
+    }
+
+    rc = parse_log(buf, st.st_size, chunks, thread_cnt);
+    if (rc == 0) {
+        rc = tid_table_init(&analyzer.senders_index);
+    }
+    if (rc == 0) {
+        rc = analyze_chunks(&analyzer, chunks, thread_cnt);
+    }
+    for (i = 0; i < thread_cnt; i++) {
+        line_cnt += chunks[i].line_cnt;
+        tid_table_clean(&chunks[i].table);
+    }
+    free(chunks);
+    munmap(buf, st.st_size);
+    if (rc != 0) {
+        fprintf(stderr, "Fail to analyze %s, out of memory.\n", path);
+        analyzer_clean(&analyzer);
+        return -1;
+    }
+
+    for (k = 0; k < SAMPLE_KIND_CNT && rc == 0; k++) {
+        rc = write_csv(&analyzer, k);
+    }
+    for (k = 0; k < SAMPLE_KIND_CNT; k++) {
+        print_percentiles(&analyzer, k);
+    }
+    printf("%lu lines, %u threads", (unsigned long)line_cnt,
+           analyzer.senders_index.cnt);
+    if (analyzer.invalid_cnt > 0) {
+        printf(", %lu invalid transitions", (unsigned long)analyzer.invalid_cnt);
+    }
+    printf("\n");
+
+    analyzer_clean(&analyzer);
+    return rc;
+}
@@ -0,0 +1,176 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "arena.h"
+
+__thread arena_t *arena_local;
+
+static arena_t *arena_threads;
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * chunk_size is rounded up to a multiple of ARENA_ALIGN, nothing is
+ * allocated before the first arena_alloc.
+ */
+void
+arena_init (arena_t *arena, uint32_t chunk_size)
+{
+    memzero(arena, sizeof(arena_t));
+    arena->chunk_size = (chunk_size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static void
+arena_free_large (arena_t *arena)
+{
+    arena_large_t *large;
+
+    while ((large = arena->large) != NULL) {
+        arena->large = large->next;
+        free(large);
+    }
+}
+
+void
+arena_clean (arena_t *arena)
+{
+    arena_chunk_t *chunk;
+
+    arena_free_large(arena);
+    while ((chunk = arena->chunks) != NULL) {
+        arena->chunks = chunk->next;
+        free(chunk);
+    }
+    arena->cur = NULL;
+    arena->pos = 0;
+    arena->used = 0;
+    arena->stats.chunks = 0;
+}
+
+/*
+ * The current chunk is full. Objects over half a chunk get a malloc of
+ * their own so they don't waste the rest of one, anything else moves on
+ * to the next chunk, kept from before the last reset or new.
+ */
+void *
+arena_alloc_slow (arena_t *arena, size_t size)
+{
+    arena_chunk_t *chunk;
+    arena_large_t *large;
+
+    if (size > arena->chunk_size / 2) {
+        large = malloc(sizeof(arena_large_t) + size);
+        if (large == NULL) {
+            logger(ERROR, "Fail to malloc %lu bytes in arena.",
+                   (unsigned long)size);
+            return NULL;
+        }
+        large->next = arena->large;
+        arena->large = large;
+        arena->stats.large_allocs++;
+        arena_account(arena, size);
+        return large->data;
+    }
+
+    chunk = arena->cur != NULL ? arena->cur->next : arena->chunks;
+    if (chunk == NULL) {
+        chunk = malloc(sizeof(arena_chunk_t) + arena->chunk_size);
+        if (chunk == NULL) {
+            logger(ERROR, "Fail to malloc arena chunk.");
+            return NULL;
+        }
+        chunk->next = NULL;
+        chunk->size = arena->chunk_size;
+        if (arena->cur != NULL) {
+            arena->cur->next = chunk;
+        } else {
+            arena->chunks = chunk;
+        }
+        arena->stats.chunks++;
+    }
+    arena->cur = chunk;
+    arena->pos = size;
+    arena_account(arena, size);
+    return chunk->data;
+}
+
+/*
+ * Free everything allocated since the last reset. Cheap when nothing was,
+ * so it can run after every request.
+ */
+void
+arena_reset (arena_t *arena)
+{
+    if (arena->used == 0 && arena->large == NULL) {
+        return;
+    }
+    arena_free_large(arena);
+    arena->cur = arena->chunks;
+    arena->pos = 0;
+    arena->used = 0;
+    arena->stats.resets++;
+}
+
+void
+arena_get_stats (arena_t *arena, arena_stats_t *stats)
+{
+    *stats = arena->stats;
+}
+
+/*
+ * Allocate the calling thread's arena, it stays linked until
+ * arena_threads_clean so the stats of exited threads are kept.
+ */
+arena_t *
+arena_thread_register (void)
+{
+    static __thread arena_t fallback;
+    arena_t *arena;
+
+    arena = malloc(sizeof(arena_t));
+    if (arena == NULL) {
+        // still usable, only missing from the stats
+        arena_init(&fallback, ARENA_CHUNK_SIZE);
+        arena_local = &fallback;
+        return &fallback;
+    }
+    arena_init(arena, ARENA_CHUNK_SIZE);
+
+    pthread_mutex_lock(&arena_lock);
+    arena->next = arena_threads;
+    arena_threads = arena;
+    pthread_mutex_unlock(&arena_lock);
+
+    arena_local = arena;
+    return arena;
+}
+
+/*
+ * fn may only read the stats, the owners keep using their arenas
+ * meanwhile and they may be seen half updated.
+ */
+void
+arena_threads_walk (void (*fn)(arena_t *arena, void *arg), void *arg)
+{
+    arena_t *arena;
+
+    pthread_mutex_lock(&arena_lock);
+    for (arena = arena_threads; arena != NULL; arena = arena->next) {
+        fn(arena, arg);
+    }
+    pthread_mutex_unlock(&arena_lock);
+}
+
+void
+arena_threads_clean (void)
+{
+    arena_t *arena;
+
+    pthread_mutex_lock(&arena_lock);
+    while ((arena = arena_threads) != NULL) {
+        arena_threads = arena->next;
+        arena_clean(arena);
+        free(arena);
+    }
+    arena_local = NULL;
+    pthread_mutex_unlock(&arena_lock);
+}
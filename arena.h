@@ -0,0 +1,114 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "util.h"
+
+#define ARENA_CHUNK_SIZE (64*1024)
+#define ARENA_ALIGN 16
+
+typedef struct arena_chunk_s {
+    struct arena_chunk_s *next;
+    uint32_t size;
+    char data[] __attribute__((aligned(ARENA_ALIGN)));
+} arena_chunk_t;
+
+// too large for a chunk, malloc'ed and freed on the next reset
+typedef struct arena_large_s {
+    struct arena_large_s *next;
+    char data[] __attribute__((aligned(ARENA_ALIGN)));
+} arena_large_t;
+
+typedef struct arena_stats_s {
+    uint64_t allocs;
+    uint64_t large_allocs;
+    uint64_t resets;
+    uint64_t chunks;      // held, they are kept across resets
+    uint64_t high_water;  // most bytes handed out between two resets
+} arena_stats_t;
+
+/*
+ * Bump allocator. Allocations are only freed all at once by a reset,
+ * which rewinds to the first chunk and keeps every chunk, so once it grew
+ * to its high water mark it never calls malloc again except for large
+ * objects. Not thread safe, an arena has a single owner.
+ */
+typedef struct arena_s {
+    arena_chunk_t *chunks;
+    arena_chunk_t *cur;   // NULL until the first allocation
+    uint32_t pos;
+    uint32_t chunk_size;
+    arena_large_t *large;
+    uint64_t used;        // since the last reset
+    arena_stats_t stats;
+    struct arena_s *next; // in the list of thread arenas
+} arena_t;
+
+extern __thread arena_t *arena_local;
+
+void
+arena_init(arena_t *arena, uint32_t chunk_size);
+
+void
+arena_clean(arena_t *arena);
+
+void *
+arena_alloc_slow(arena_t *arena, size_t size);
+
+void
+arena_reset(arena_t *arena);
+
+void
+arena_get_stats(arena_t *arena, arena_stats_t *stats);
+
+arena_t *
+arena_thread_register(void);
+
+void
+arena_threads_walk(void (*fn)(arena_t *arena, void *arg), void *arg);
+
+void
+arena_threads_clean(void);
+
+/*
+ * The calling thread's arena for request scoped memory, created on first
+ * use.
+ */
+static inline arena_t *
+arena_thread (void)
+{
+    if (__builtin_expect(arena_local == NULL, 0)) {
+        return arena_thread_register();
+    }
+    return arena_local;
+}
+
+static inline void
+arena_account (arena_t *arena, size_t size)
+{
+    arena->used += size;
+    arena->stats.allocs++;
+    if (arena->used > arena->stats.high_water) {
+        arena->stats.high_water = arena->used;
+    }
+}
+
+/*
+ * ARENA_ALIGN aligned memory, NULL only if malloc failed for a new chunk
+ * or a large object.
+ */
+static inline void *
+arena_alloc (arena_t *arena, size_t size)
+{
+    uint32_t pos = (arena->pos + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    // chunk sizes are ARENA_ALIGN multiples, pos never passes the end
+    if (arena->cur != NULL && size <= arena->cur->size - pos) {
+        arena->pos = pos + size;
+        arena_account(arena, size);
+        return arena->cur->data + pos;
+    }
+    return arena_alloc_slow(arena, size);
+}
+#endif //__ARENA_H__
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "arena.h"
+
+#define TEST_CHUNK_SIZE 1024
+#define TEST_ROUNDS 1000
+#define TEST_THREAD_CNT 4
+#define BENCH_ALLOCS 10000000
+
+/*
+ * Allocations are aligned and don't overlap, a chunk is filled before
+ * the next one, and once reset the same chunks are used again.
+ */
+static int
+test_reuse (void)
+{
+    arena_t arena;
+    arena_stats_t stats;
+    char *p[64];
+    int round, i;
+
+    arena_init(&arena, TEST_CHUNK_SIZE);
+    for (round = 0; round < TEST_ROUNDS; round++) {
+        for (i = 0; i < 64; i++) {
+            p[i] = arena_alloc(&arena, 1 + i % 40);
+            if (p[i] == NULL || (uintptr_t)p[i] % ARENA_ALIGN != 0) {
+                printf("FAIL: alloc %d\n", i);
+                arena_clean(&arena);
+                return -1;
+            }
+            memset(p[i], i, 1 + i % 40);
+        }
+        for (i = 0; i < 64; i++) {
+            if (p[i][i % 40] != (char)i) {
+                printf("FAIL: allocation %d overwritten\n", i);
+                arena_clean(&arena);
+                return -1;
+            }
+        }
+        arena_reset(&arena);
+    }
+    arena_get_stats(&arena, &stats);
+    arena_clean(&arena);
+
+    // 64 allocations of up to 40 bytes, 16 byte aligned, fill 2 chunks
+    if (stats.chunks != 2 || stats.resets != TEST_ROUNDS ||
+        stats.large_allocs != 0 || stats.allocs != 64 * TEST_ROUNDS) {
+        printf("FAIL: %lu chunks, %lu resets, %lu large\n",
+               (unsigned long)stats.chunks, (unsigned long)stats.resets,
+               (unsigned long)stats.large_allocs);
+        return -1;
+    }
+    printf("reuse: %lu chunks for %d rounds, high water %lu\n",
+           (unsigned long)stats.chunks, TEST_ROUNDS,
+           (unsigned long)stats.high_water);
+    return 0;
+}
+
+// over half a chunk gets its own malloc, freed on reset
+static int
+test_large (void)
+{
+    arena_t arena;
+    arena_stats_t stats;
+    char *small, *large;
+
+    arena_init(&arena, TEST_CHUNK_SIZE);
+    small = arena_alloc(&arena, 100);
+    large = arena_alloc(&arena, 64 * 1024);
+    if (small == NULL || large == NULL) {
+        arena_clean(&arena);
+        return -1;
+    }
+    memset(large, 1, 64 * 1024);
+    // the chunk still has room after the large one
+    if (arena_alloc(&arena, 100) != small + 112) {
+        printf("FAIL: chunk not bumped past the large object\n");
+        arena_clean(&arena);
+        return -1;
+    }
+    arena_reset(&arena);
+    arena_get_stats(&arena, &stats);
+    if (arena.large != NULL || stats.large_allocs != 1 ||
+        stats.chunks != 1 || stats.high_water != 100 + 64 * 1024 + 100) {
+        printf("FAIL: %lu large, %lu chunks, high water %lu\n",
+               (unsigned long)stats.large_allocs, (unsigned long)stats.chunks,
+               (unsigned long)stats.high_water);
+        arena_clean(&arena);
+        return -1;
+    }
+    arena_clean(&arena);
+    printf("large: ok\n");
+    return 0;
+}
+
+static void *
+thread_use_arena (void *arg)
+{
+    arena_t *arena = arena_thread();
+
+    if (arena_alloc(arena, 256) == NULL || arena_thread() != arena) {
+        *(int *)arg = -1;
+    }
+    arena_reset(arena);
+    return NULL;
+}
+
+static void
+count_arena (arena_t *arena, void *arg)
+{
+    if (arena->stats.resets == 1) {
+        (*(int *)arg)++;
+    }
+}
+
+// every thread gets an arena of its own, and they all can be walked
+static int
+test_threads (void)
+{
+    pthread_t threads[TEST_THREAD_CNT];
+    int i, rc = 0, cnt = 0;
+
+    for (i = 0; i < TEST_THREAD_CNT; i++) {
+        pthread_create(&threads[i], NULL, thread_use_arena, &rc);
+    }
+    for (i = 0; i < TEST_THREAD_CNT; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    arena_threads_walk(count_arena, &cnt);
+    arena_threads_clean();
+    if (rc != 0 || cnt != TEST_THREAD_CNT) {
+        printf("FAIL: %d thread arenas\n", cnt);
+        return -1;
+    }
+    printf("threads: ok\n");
+    return 0;
+}
+
+// a request's worth of allocations then a reset, against malloc and free
+static void
+bench (void)
+{
+    arena_t *arena = arena_thread();
+    void *p[4];
+    uint64_t start, arena_ns, malloc_ns;
+    int i, j;
+
+    start = monotonic_ns();
+    for (i = 0; i < BENCH_ALLOCS / 4; i++) {
+        for (j = 0; j < 4; j++) {
+            p[j] = arena_alloc(arena, 64 << j);
+        }
+        __asm__ volatile("" : : "r"(p) : "memory");
+        arena_reset(arena);
+    }
+    arena_ns = monotonic_ns() - start;
+
+    start = monotonic_ns();
+    for (i = 0; i < BENCH_ALLOCS / 4; i++) {
+        for (j = 0; j < 4; j++) {
+            p[j] = malloc(64 << j);
+        }
+        __asm__ volatile("" : : "r"(p) : "memory");
+        for (j = 0; j < 4; j++) {
+            free(p[j]);
+        }
+    }
+    malloc_ns = monotonic_ns() - start;
+    arena_threads_clean();
+    printf("alloc: arena %.1f ns, malloc %.1f ns\n",
+           (double)arena_ns / BENCH_ALLOCS, (double)malloc_ns / BENCH_ALLOCS);
+}
+
+int main (void)
+{
+    if (test_reuse() != 0 || test_large() != 0 || test_threads() != 0) {
+        printf("FAIL\n");
+        return -1;
+    }
+    bench();
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,528 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <strings.h>
+#include <pthread.h>
+#include "util.h"
+#include "blog.h"
+
+#define BLOG_RING_MASK (BLOG_RING_SIZE - 1)
+#define blog_align(len) (((len) + 7) & ~7U)
+
+/*
+ * Single producer, single consumer byte ring: the owner thread appends
+ * records at tail, the flusher thread consumes them from head. A record
+ * never wraps, the end of the ring is skipped with a padding record, or
+ * without one when not even a header fits there.
+ */
+typedef struct blog_ring_s {
+    uint64_t tail cache_aligned;
+    uint64_t dropped;
+    uint64_t head cache_aligned;
+    uint64_t flush_tail; // tail seen by the flusher, see blog_flush
+    uint32_t tid;
+    char *buf;
+    struct blog_ring_s *next;
+} blog_ring_t;
+
+typedef struct blog_arg_s {
+    uint32_t len;
+    union {
+        int i;
+        long l;
+        double d;
+        void *p;
+        const char *s;
+    } v;
+} blog_arg_t;
+
+typedef struct blog_s {
+    FILE *file;
+    pthread_t thread_id;
+    bool running;
+    bool stop;
+    // guards the ring and format lists
+    pthread_mutex_t lock;
+    blog_ring_t *rings;
+    blog_fmt_t *fmts;
+    blog_fmt_t **fmts_tail;
+    blog_fmt_t **fmts_next; // next one to write to the file
+    uint32_t fmt_cnt;
+} blog_t;
+
+int blog_level = BLOG_OFF;
+
+static __thread blog_ring_t *blog_local;
+
+static blog_t blog = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .fmts_tail = &blog.fmts,
+    .fmts_next = &blog.fmts,
+};
+
+static const char *level_names[] = {
+    [BLOG_DEBUG] = "debug",
+    [BLOG_INFO] = "info",
+    [BLOG_WARN] = "warn",
+    [BLOG_ERROR] = "error",
+    [BLOG_OFF] = "off",
+};
+
+int
+blog_parse_level (const char *s)
+{
+    int i;
+
+    for (i = BLOG_DEBUG; i <= BLOG_OFF; i++) {
+        if (strcasecmp(s, level_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void
+blog_set_level (int level)
+{
+    __atomic_store_n(&blog_level, level, __ATOMIC_RELAXED);
+}
+
+#define blog_add_type(type) \
+do {\
+    if (argc >= max_cnt) {\
+        return -1;\
+    }\
+    types[argc++] = (type);\
+} while (0)
+
+/*
+ * Fill types with the argument types of a printf format, return their
+ * count, -1 for a conversion which can't be encoded (%n, %m, long double,
+ * wide strings) or too many arguments.
+ */
+int
+blog_parse_format (const char *fmt, uint8_t *types, uint32_t max_cnt)
+{
+    const char *p;
+    uint32_t argc = 0;
+    bool long_arg, prec_star;
+
+    for (p = fmt; *p != '\0'; p++) {
+        if (*p != '%') {
+            continue;
+        }
+        p++;
+        if (*p == '%') {
+            continue;
+        }
+
+        while (*p != '\0' && strchr("-+ #0'", *p) != NULL) {
+            p++;
+        }
+        if (*p == '*') {
+            blog_add_type(BLOG_ARG_INT);
+            p++;
+        }
+        while (*p >= '0' && *p <= '9') {
+            p++;
+        }
+        prec_star = False;
+        if (*p == '.') {
+            p++;
+            if (*p == '*') {
+                blog_add_type(BLOG_ARG_INT);
+                prec_star = True;
+                p++;
+            }
+            while (*p >= '0' && *p <= '9') {
+                p++;
+            }
+        }
+
+        long_arg = False;
+        if (*p == 'h') {
+            p += (p[1] == 'h') ? 2 : 1;
+        } else if (*p == 'l') {
+            long_arg = True;
+            p += (p[1] == 'l') ? 2 : 1;
+        } else if (*p == 'z' || *p == 'j' || *p == 't') {
+            long_arg = True;
+            p++;
+        }
+
+        switch (*p) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+            blog_add_type(long_arg ? BLOG_ARG_LONG : BLOG_ARG_INT);
+            break;
+        case 'c':
+            blog_add_type(BLOG_ARG_INT);
+            break;
+        case 'e': case 'E': case 'f': case 'F':
+        case 'g': case 'G': case 'a': case 'A':
+            blog_add_type(BLOG_ARG_DOUBLE);
+            break;
+        case 's':
+            if (long_arg) {
+                return -1;
+            }
+            blog_add_type(prec_star ? BLOG_ARG_STR_PREC : BLOG_ARG_STR);
+            break;
+        case 'p':
+            blog_add_type(BLOG_ARG_PTR);
+            break;
+        default:
+            return -1;
+        }
+    }
+    return argc;
+}
+
+static void
+blog_register_format (blog_fmt_t *f)
+{
+    int argc;
+
+    pthread_mutex_lock(&blog.lock);
+    if (f->id == 0) {
+        argc = blog_parse_format(f->fmt, f->types, BLOG_MAX_ARGS);
+        f->raw = (argc < 0);
+        f->argc = argc < 0 ? 0 : argc;
+        *blog.fmts_tail = f;
+        blog.fmts_tail = &f->next;
+        __atomic_store_n(&f->id, ++blog.fmt_cnt, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&blog.lock);
+}
+
+static blog_ring_t *
+blog_ring_register (void)
+{
+    blog_ring_t *ring;
+
+    if (posix_memalign((void **)&ring, CACHE_LINE_SIZE,
+                       sizeof(blog_ring_t)) != 0) {
+        return NULL;
+    }
+    memzero(ring, sizeof(blog_ring_t));
+    ring->buf = malloc(BLOG_RING_SIZE);
+    if (ring->buf == NULL) {
+        free(ring);
+        return NULL;
+    }
+    ring->tid = syscall(__NR_gettid);
+
+    pthread_mutex_lock(&blog.lock);
+    ring->next = blog.rings;
+    blog.rings = ring;
+    pthread_mutex_unlock(&blog.lock);
+
+    blog_local = ring;
+    return ring;
+}
+
+/*
+ * Room for a record of len bytes, NULL if the flusher is too far behind,
+ * the record is then dropped. *tail is where the ring's tail goes once
+ * the record is written.
+ */
+static char *
+blog_ring_reserve (blog_ring_t *ring, uint32_t len, uint64_t *tail)
+{
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t off = ring->tail & BLOG_RING_MASK, pad = 0;
+    blog_rec_t *rec;
+
+    if (off + len > BLOG_RING_SIZE) {
+        pad = BLOG_RING_SIZE - off;
+    }
+    if (ring->tail + pad + len - head > BLOG_RING_SIZE) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    if (pad >= sizeof(blog_rec_t)) {
+        rec = (blog_rec_t *)(ring->buf + off);
+        rec->len = pad;
+        rec->type = BLOG_REC_PAD;
+    }
+    *tail = ring->tail + pad + len;
+    return ring->buf + ((ring->tail + pad) & BLOG_RING_MASK);
+}
+
+void
+blog_write (blog_fmt_t *f, const char *fmt, ...)
+{
+    blog_arg_t args[BLOG_MAX_ARGS];
+    blog_ring_t *ring = blog_local;
+    blog_rec_t *rec;
+    struct timespec ts;
+    uint64_t tail;
+    uint32_t len, i, max_len;
+    va_list ap;
+    char *p;
+
+    if (__atomic_load_n(&f->id, __ATOMIC_ACQUIRE) == 0) {
+        blog_register_format(f);
+    }
+    if (ring == NULL) {
+        ring = blog_ring_register();
+        if (ring == NULL) {
+            return;
+        }
+    }
+
+    len = sizeof(blog_rec_t);
+    va_start(ap, fmt);
+    for (i = 0; i < f->argc; i++) {
+        switch (f->types[i]) {
+        case BLOG_ARG_INT:
+            args[i].v.i = va_arg(ap, int);
+            len += sizeof(int);
+            break;
+        case BLOG_ARG_LONG:
+            args[i].v.l = va_arg(ap, long);
+            len += sizeof(long);
+            break;
+        case BLOG_ARG_DOUBLE:
+            args[i].v.d = va_arg(ap, double);
+            len += sizeof(double);
+            break;
+        case BLOG_ARG_PTR:
+            args[i].v.p = va_arg(ap, void *);
+            len += sizeof(void *);
+            break;
+        default:
+            args[i].v.s = va_arg(ap, const char *);
+            if (args[i].v.s == NULL) {
+                args[i].v.s = "(null)";
+            }
+            max_len = BLOG_MAX_STR_LEN;
+            // the precision is the int right before
+            if (f->types[i] == BLOG_ARG_STR_PREC && args[i-1].v.i >= 0 &&
+                args[i-1].v.i < BLOG_MAX_STR_LEN) {
+                max_len = args[i-1].v.i;
+            }
+            args[i].len = strnlen(args[i].v.s, max_len);
+            len += sizeof(uint32_t) + args[i].len;
+            break;
+        }
+    }
+    va_end(ap);
+    len = blog_align(len);
+
+    p = blog_ring_reserve(ring, len, &tail);
+    if (p == NULL) {
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    rec = (blog_rec_t *)p;
+    rec->len = len;
+    rec->type = BLOG_REC_LOG;
+    rec->level = f->level;
+    rec->fmt_id = f->id;
+    rec->tid = ring->tid;
+    rec->ts_ns = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    p += sizeof(blog_rec_t);
+
+    for (i = 0; i < f->argc; i++) {
+        switch (f->types[i]) {
+        case BLOG_ARG_INT:
+            memcpy(p, &args[i].v.i, sizeof(int));
+            p += sizeof(int);
+            break;
+        case BLOG_ARG_LONG:
+        case BLOG_ARG_DOUBLE:
+        case BLOG_ARG_PTR:
+            memcpy(p, &args[i].v, sizeof(uint64_t));
+            p += sizeof(uint64_t);
+            break;
+        default:
+            memcpy(p, &args[i].len, sizeof(uint32_t));
+            memcpy(p + sizeof(uint32_t), args[i].v.s, args[i].len);
+            p += sizeof(uint32_t) + args[i].len;
+            break;
+        }
+    }
+
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+}
+
+static void
+blog_write_format (FILE *file, blog_fmt_t *f)
+{
+    static const char zeros[8];
+    blog_rec_t rec;
+    uint32_t hdr[2] = { f->line, f->argc };
+    uint8_t raw = f->raw;
+    uint32_t len, file_len, fmt_len;
+
+    file_len = strlen(f->file) + 1;
+    fmt_len = strlen(f->fmt) + 1;
+    len = sizeof(blog_rec_t) + sizeof(hdr) + 1 + f->argc + file_len + fmt_len;
+
+    memzero(&rec, sizeof(blog_rec_t));
+    rec.len = blog_align(len);
+    rec.type = BLOG_REC_FORMAT;
+    rec.level = f->level;
+    rec.fmt_id = f->id;
+    fwrite(&rec, sizeof(blog_rec_t), 1, file);
+    fwrite(hdr, sizeof(hdr), 1, file);
+    fwrite(&raw, 1, 1, file);
+    fwrite(f->types, 1, f->argc, file);
+    fwrite(f->file, 1, file_len, file);
+    fwrite(f->fmt, 1, fmt_len, file);
+    fwrite(zeros, 1, rec.len - len, file);
+}
+
+static uint64_t
+blog_ring_drain (blog_ring_t *ring, FILE *file)
+{
+    uint64_t head = ring->head, start = head;
+    uint32_t off;
+    blog_rec_t *rec;
+
+    while (head < ring->flush_tail) {
+        off = head & BLOG_RING_MASK;
+        if (BLOG_RING_SIZE - off < sizeof(blog_rec_t)) {
+            head += BLOG_RING_SIZE - off;
+            continue;
+        }
+        rec = (blog_rec_t *)(ring->buf + off);
+        if (rec->type != BLOG_REC_PAD) {
+            fwrite(rec, rec->len, 1, file);
+        }
+        head += rec->len;
+    }
+    __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+    return head - start;
+}
+
+/*
+ * The tails are taken before the formats are written, every record up to
+ * them refers to a format registered by then, so the file always has a
+ * format before its first use. Return whether anything was written.
+ */
+static bool
+blog_flush (void)
+{
+    blog_ring_t *rings, *ring;
+    bool written = False;
+
+    pthread_mutex_lock(&blog.lock);
+    rings = blog.rings;
+    for (ring = rings; ring != NULL; ring = ring->next) {
+        ring->flush_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    }
+    while (*blog.fmts_next != NULL) {
+        blog_write_format(blog.file, *blog.fmts_next);
+        blog.fmts_next = &(*blog.fmts_next)->next;
+        written = True;
+    }
+    pthread_mutex_unlock(&blog.lock);
+
+    // rings are only ever added at the head, the snapshot stays valid
+    for (ring = rings; ring != NULL; ring = ring->next) {
+        if (blog_ring_drain(ring, blog.file) > 0) {
+            written = True;
+        }
+    }
+    return written;
+}
+
+static void *
+blog_flush_thread (void *args)
+{
+    bool stop;
+
+    for (;;) {
+        stop = __atomic_load_n(&blog.stop, __ATOMIC_ACQUIRE);
+        if (blog_flush()) {
+            continue;
+        }
+        fflush(blog.file);
+        if (stop) {
+            break;
+        }
+        usleep(BLOG_FLUSH_INTERVAL_US);
+    }
+    return NULL;
+}
+
+int
+blog_init (const char *path, int level)
+{
+    int rc;
+
+    blog.file = fopen(path, "w");
+    if (blog.file == NULL) {
+        fprintf(stderr, "Fail to open binary log %s.\n", path);
+        return -1;
+    }
+    fwrite(BLOG_MAGIC, 1, BLOG_MAGIC_LEN, blog.file);
+
+    rc = pthread_create(&blog.thread_id, NULL, blog_flush_thread, NULL);
+    if (rc != 0) {
+        fprintf(stderr, "Fail to create binary log flush thread.\n");
+        fclose(blog.file);
+        blog.file = NULL;
+        return -1;
+    }
+    blog.running = True;
+    blog_set_level(level);
+    return 0;
+}
+
+/*
+ * Log to $BLOG_FILE, default_path if unset, at $BLOG_LEVEL, info if
+ * unset.
+ */
+int
+blog_init_env (const char *default_path)
+{
+    const char *path = getenv("BLOG_FILE");
+    const char *level_name = getenv("BLOG_LEVEL");
+    int level = BLOG_INFO;
+
+    if (level_name != NULL) {
+        level = blog_parse_level(level_name);
+        if (level < 0) {
+            fprintf(stderr, "Unsupported BLOG_LEVEL %s.\n", level_name);
+            return -1;
+        }
+    }
+    return blog_init(path != NULL ? path : default_path, level);
+}
+
+/*
+ * Stop recording and write out what is left. The rings are kept, threads
+ * still running may be in the middle of a record.
+ */
+void
+blog_clean (void)
+{
+    if (!blog.running) {
+        return;
+    }
+    blog_set_level(BLOG_OFF);
+    __atomic_store_n(&blog.stop, True, __ATOMIC_RELEASE);
+    pthread_join(blog.thread_id, NULL);
+    fclose(blog.file);
+    blog.file = NULL;
+    blog.running = False;
+}
+
+uint64_t
+blog_get_dropped (void)
+{
+    blog_ring_t *ring;
+    uint64_t dropped = 0;
+
+    pthread_mutex_lock(&blog.lock);
+    for (ring = blog.rings; ring != NULL; ring = ring->next) {
+        dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&blog.lock);
+    return dropped;
+}
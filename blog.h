@@ -0,0 +1,114 @@
+#ifndef __BLOG_H__
+#define __BLOG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BLOG_RING_SIZE (1 << 20)
+#define BLOG_MAX_ARGS 16
+#define BLOG_MAX_STR_LEN 4096
+#define BLOG_FLUSH_INTERVAL_US 1000
+#define BLOG_MAGIC "BLOG0001"
+#define BLOG_MAGIC_LEN 8
+
+enum {
+    BLOG_DEBUG = 0,
+    BLOG_INFO,
+    BLOG_WARN,
+    BLOG_ERROR,
+    BLOG_OFF,
+};
+
+enum {
+    BLOG_REC_PAD = 0,
+    BLOG_REC_LOG,
+    BLOG_REC_FORMAT,
+};
+
+/*
+ * Argument types, from the printf conversions of the format. A string
+ * whose precision is given by a '*' is bounded by the int before it, it
+ * may not be NUL terminated.
+ */
+enum {
+    BLOG_ARG_INT = 1,
+    BLOG_ARG_LONG,
+    BLOG_ARG_DOUBLE,
+    BLOG_ARG_PTR,
+    BLOG_ARG_STR,
+    BLOG_ARG_STR_PREC,
+};
+
+/*
+ * Header of every record, in the rings and in the file. A log record is
+ * followed by its arguments packed in format order: ints as 4 bytes,
+ * longs, doubles and pointers as 8, strings as a 4 bytes length and the
+ * bytes. A format record, written to the file once before the first log
+ * record using it, is followed by line, argc, raw, the argument types,
+ * then file and format as C strings. len covers the header and is a
+ * multiple of 8.
+ */
+typedef struct blog_rec_s {
+    uint32_t len;
+    uint16_t type;
+    uint16_t level;
+    uint32_t fmt_id;
+    uint32_t tid;
+    uint64_t ts_ns; // CLOCK_REALTIME
+} blog_rec_t;
+
+/*
+ * One per call site, registered on its first record. A raw format has a
+ * conversion the logger can't encode, it is logged as plain text.
+ */
+typedef struct blog_fmt_s {
+    int level;
+    const char *fmt;
+    const char *file;
+    int line;
+    uint32_t id; // 0 until registered
+    uint32_t argc;
+    bool raw;
+    uint8_t types[BLOG_MAX_ARGS];
+    struct blog_fmt_s *next;
+} blog_fmt_t;
+
+/*
+ * Records below it are dropped before touching their arguments. BLOG_OFF
+ * until blog_init.
+ */
+extern int blog_level;
+
+#define blog(level, fmt, args...) \
+do {\
+    static blog_fmt_t __blog_fmt = { BLOG_##level, fmt, __FILE__, __LINE__ };\
+    if (BLOG_##level >= blog_level) {\
+        blog_write(&__blog_fmt, fmt, ##args);\
+    }\
+} while (0)
+
+int
+blog_init(const char *path, int level);
+
+int
+blog_init_env(const char *default_path);
+
+void
+blog_clean(void);
+
+void
+blog_set_level(int level);
+
+int
+blog_parse_level(const char *s);
+
+uint64_t
+blog_get_dropped(void);
+
+int
+blog_parse_format(const char *fmt, uint8_t *types, uint32_t max_cnt);
+
+void
+blog_write(blog_fmt_t *f, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+#endif //__BLOG_H__
@@ -0,0 +1,395 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "blog.h"
+
+#define BLOG_SPEC_MAX_LEN 32
+
+static const char *level_tokens[] = {
+    [BLOG_DEBUG] = "DEBUG",
+    [BLOG_INFO] = "INFO",
+    [BLOG_WARN] = "WARN",
+    [BLOG_ERROR] = "ERROR",
+    [BLOG_OFF] = "OFF",
+};
+
+typedef struct decode_fmt_s {
+    int level;
+    uint32_t argc;
+    bool raw;
+    const uint8_t *types;
+    const char *file;
+    const char *fmt;
+} decode_fmt_t;
+
+typedef struct decoder_s {
+    decode_fmt_t *fmts;
+    uint32_t fmt_cnt;
+    int min_level;
+} decoder_t;
+
+/*
+ * One argument out of a log record, strings are copied to be NUL
+ * terminated for printf.
+ */
+typedef struct decode_arg_s {
+    uint8_t type;
+    union {
+        int i;
+        long l;
+        double d;
+        void *p;
+    } v;
+    char *s;
+} decode_arg_t;
+
+/*
+ * Every field is checked against the end of the record before it is
+ * read, and the types against those blog_parse_format finds in the
+ * format. A format which doesn't fit is left unregistered, the log
+ * records using it then print as of an unknown format.
+ */
+static int
+decode_format (decoder_t *dec, const blog_rec_t *rec)
+{
+    const char *p = (const char *)(rec + 1);
+    const char *end = (const char *)rec + rec->len;
+    const char *file, *fmt;
+    const uint8_t *types;
+    uint8_t parsed[BLOG_MAX_ARGS];
+    decode_fmt_t *fmts, *f;
+    uint32_t hdr[2];
+    int argc;
+    bool raw;
+
+    if (sizeof(hdr) + 1 > end - p) {
+        goto corrupted;
+    }
+    memcpy(hdr, p, sizeof(hdr));
+    p += sizeof(hdr);
+    raw = *p++;
+    if (hdr[1] > BLOG_MAX_ARGS || hdr[1] > end - p) {
+        goto corrupted;
+    }
+    types = (const uint8_t *)p;
+    file = p + hdr[1];
+    fmt = memchr(file, '\0', end - file);
+    if (fmt == NULL) {
+        goto corrupted;
+    }
+    fmt++;
+    if (memchr(fmt, '\0', end - fmt) == NULL) {
+        goto corrupted;
+    }
+    // the arguments are printed with the conversions of fmt, they must
+    // be what the logger would have recorded for it
+    argc = blog_parse_format(fmt, parsed, BLOG_MAX_ARGS);
+    if (raw ? argc >= 0 || hdr[1] != 0 :
+              (uint32_t)argc != hdr[1] || memcmp(parsed, types, argc) != 0) {
+        goto corrupted;
+    }
+
+    if (rec->fmt_id >= dec->fmt_cnt) {
+        fmts = realloc(dec->fmts, (rec->fmt_id + 1) * sizeof(decode_fmt_t));
+        if (fmts == NULL) {
+            return -1;
+        }
+        memzero(fmts + dec->fmt_cnt,
+                (rec->fmt_id + 1 - dec->fmt_cnt) * sizeof(decode_fmt_t));
+        dec->fmts = fmts;
+        dec->fmt_cnt = rec->fmt_id + 1;
+    }
+
+    f = &dec->fmts[rec->fmt_id];
+    f->level = rec->level;
+    f->argc = hdr[1];
+    f->raw = raw;
+    f->types = types;
+    f->file = file;
+    f->fmt = fmt;
+    return 0;
+
+corrupted:
+    fprintf(stderr, "Corrupted format %u.\n", rec->fmt_id);
+    return 0;
+}
+
+static void
+free_args (decode_arg_t *args, uint32_t cnt)
+{
+    uint32_t i;
+
+    for (i = 0; i < cnt; i++) {
+        free(args[i].s);
+    }
+}
+
+/*
+ * Every read is checked against the end of the record first, the last
+ * record of a torn file may be cut anywhere. On failure nothing is left
+ * allocated.
+ */
+static int
+decode_args (const decode_fmt_t *f, const blog_rec_t *rec, decode_arg_t *args)
+{
+    const char *p = (const char *)(rec + 1);
+    const char *end = (const char *)rec + rec->len;
+    uint32_t i, size, len;
+
+    for (i = 0; i < f->argc; i++) {
+        args[i].type = f->types[i];
+        args[i].s = NULL;
+        size = f->types[i] == BLOG_ARG_INT ? sizeof(int) :
+               f->types[i] == BLOG_ARG_LONG ||
+               f->types[i] == BLOG_ARG_DOUBLE ||
+               f->types[i] == BLOG_ARG_PTR ? sizeof(uint64_t) :
+                                             sizeof(uint32_t);
+        if (size > end - p) {
+            free_args(args, i);
+            return -1;
+        }
+        switch (f->types[i]) {
+        case BLOG_ARG_INT:
+            memcpy(&args[i].v.i, p, sizeof(int));
+            break;
+        case BLOG_ARG_LONG:
+        case BLOG_ARG_DOUBLE:
+        case BLOG_ARG_PTR:
+            memcpy(&args[i].v, p, sizeof(uint64_t));
+            break;
+        default:
+            memcpy(&len, p, sizeof(uint32_t));
+            if (len > end - p - size) {
+                free_args(args, i);
+                return -1;
+            }
+            args[i].s = strndup(p + size, len);
+            size += len;
+            break;
+        }
+        p += size;
+    }
+    return 0;
+}
+
+/*
+ * Print one conversion spec with its arguments, the '*' ones first.
+ */
+static void
+print_spec (const char *spec, decode_arg_t *stars, int star_cnt,
+            decode_arg_t *arg)
+{
+    int a = star_cnt > 0 ? stars[0].v.i : 0;
+    int b = star_cnt > 1 ? stars[1].v.i : 0;
+
+#define print_value(value) \
+do {\
+    if (star_cnt == 0) {\
+        printf(spec, value);\
+    } else if (star_cnt == 1) {\
+        printf(spec, a, value);\
+    } else {\
+        printf(spec, a, b, value);\
+    }\
+} while (0)
+
+    switch (arg->type) {
+    case BLOG_ARG_INT:
+        print_value(arg->v.i);
+        break;
+    case BLOG_ARG_LONG:
+        print_value(arg->v.l);
+        break;
+    case BLOG_ARG_DOUBLE:
+        print_value(arg->v.d);
+        break;
+    case BLOG_ARG_PTR:
+        print_value(arg->v.p);
+        break;
+    default:
+        print_value(arg->s);
+        break;
+    }
+#undef print_value
+}
+
+/*
+ * Walk the format as blog_parse_format does, literal text is printed as
+ * is and every conversion with the arguments it took.
+ */
+static void
+print_message (const decode_fmt_t *f, decode_arg_t *args)
+{
+    const char *p = f->fmt, *start;
+    char spec[BLOG_SPEC_MAX_LEN+1];
+    uint32_t n = 0, spec_len;
+    int star_cnt;
+
+    while (*p != '\0') {
+        if (*p != '%') {
+            putchar(*p++);
+            continue;
+        }
+        if (p[1] == '%') {
+            putchar('%');
+            p += 2;
+            continue;
+        }
+
+        start = p++;
+        star_cnt = 0;
+        while (*p != '\0' && strchr("-+ #0'.*0123456789hlzjt", *p) != NULL) {
+            if (*p == '*') {
+                star_cnt++;
+            }
+            p++;
+        }
+        if (*p != '\0') {
+            p++;
+        }
+        spec_len = p - start;
+        if (spec_len > BLOG_SPEC_MAX_LEN || n + star_cnt >= f->argc) {
+            printf("%.*s", (int)spec_len, start);
+            continue;
+        }
+        memcpy(spec, start, spec_len);
+        spec[spec_len] = '\0';
+        print_spec(spec, &args[n], star_cnt, &args[n + star_cnt]);
+        n += star_cnt + 1;
+    }
+}
+
+/*
+ * Same layout as the text logger: time, thread id, level, message.
+ */
+static void
+print_record (decoder_t *dec, const blog_rec_t *rec)
+{
+    decode_arg_t args[BLOG_MAX_ARGS];
+    const decode_fmt_t *f;
+    struct tm tm;
+    time_t sec;
+    char ts[16];
+
+    if (rec->level < dec->min_level) {
+        return;
+    }
+    if (rec->fmt_id >= dec->fmt_cnt || dec->fmts[rec->fmt_id].fmt == NULL) {
+        fprintf(stderr, "Unknown format %u.\n", rec->fmt_id);
+        return;
+    }
+    f = &dec->fmts[rec->fmt_id];
+    if (decode_args(f, rec, args) != 0) {
+        fprintf(stderr, "Corrupted record of format %u.\n", rec->fmt_id);
+        return;
+    }
+
+    sec = rec->ts_ns / 1000000000;
+    localtime_r(&sec, &tm);
+    strftime(ts, sizeof(ts), "%T", &tm);
+    printf("%s.%03d <%04x> %s ", ts, (int)(rec->ts_ns % 1000000000 / 1000000),
+           rec->tid, rec->level <= BLOG_OFF ? level_tokens[rec->level] : "?");
+    if (f->raw) {
+        fputs(f->fmt, stdout);
+    } else {
+        print_message(f, args);
+    }
+    putchar('\n');
+    free_args(args, f->argc);
+}
+
+static int
+decode_file (decoder_t *dec, const char *path)
+{
+    const blog_rec_t *rec;
+    const char *buf, *p, *end;
+    struct stat st;
+    int fd, rc = 0;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Fail to open %s.\n", path);
+        return -1;
+    }
+    if (st.st_size < BLOG_MAGIC_LEN) {
+        fprintf(stderr, "%s is not a binary log.\n", path);
+        close(fd);
+        return -1;
+    }
+    buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (buf == MAP_FAILED) {
+        fprintf(stderr, "Fail to mmap %s.\n", path);
+        return -1;
+    }
+    if (memcmp(buf, BLOG_MAGIC, BLOG_MAGIC_LEN) != 0) {
+        fprintf(stderr, "%s is not a binary log.\n", path);
+        munmap((void *)buf, st.st_size);
+        return -1;
+    }
+
+    end = buf + st.st_size;
+    for (p = buf + BLOG_MAGIC_LEN; p + sizeof(blog_rec_t) <= end;
+         p += rec->len) {
+        rec = (const blog_rec_t *)p;
+        // the tail of a log still being written may be partial
+        if (rec->len < sizeof(blog_rec_t) || p + rec->len > end) {
+            break;
+        }
+        if (rec->type == BLOG_REC_FORMAT) {
+            rc = decode_format(dec, rec);
+            if (rc != 0) {
+                break;
+            }
+        } else if (rec->type == BLOG_REC_LOG) {
+            print_record(dec, rec);
+        }
+    }
+
+    fflush(stdout);
+    munmap((void *)buf, st.st_size);
+    return rc;
+}
+
+static void
+usage (void)
+{
+    printf("blog_decode [-l debug|info|warn|error] <binary_log>\n");
+}
+
+int main (int argc, char **argv)
+{
+    decoder_t dec;
+    int opt, rc;
+
+    memzero(&dec, sizeof(decoder_t));
+    dec.min_level = BLOG_DEBUG;
+
+    while ((opt = getopt(argc, argv, "l:h")) != -1) {
+        switch (opt) {
+        case 'l':
+            dec.min_level = blog_parse_level(optarg);
+            if (dec.min_level < 0) {
+                printf("Unsupported level %s.\n", optarg);
+                return -1;
+            }
+            break;
+        default:
+            usage();
+            return -1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+        return -1;
+    }
+
+    rc = decode_file(&dec, argv[optind]);
+    free(dec.fmts);
+    return rc;
+}
@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "util.h"
+#include "blog.h"
+
+#define BLOG_DECODE "./blog_decode"
+#define TEST_FILE_MAX_LEN 4096
+#define TEST_OUTPUT_MAX_LEN 4096
+
+static char test_path[] = "/tmp/blog_decode_test.XXXXXX";
+
+typedef struct test_file_s {
+    char buf[TEST_FILE_MAX_LEN];
+    uint32_t len;
+} test_file_t;
+
+/*
+ * Append a record of the given payload, padded to a multiple of 8 as
+ * the logger writes them.
+ */
+static void
+add_rec (test_file_t *tf, uint16_t type, uint32_t fmt_id, const void *data,
+         uint32_t len)
+{
+    blog_rec_t rec;
+
+    memzero(&rec, sizeof(blog_rec_t));
+    rec.len = (sizeof(blog_rec_t) + len + 7) & ~7U;
+    rec.type = type;
+    rec.level = BLOG_INFO;
+    rec.fmt_id = fmt_id;
+    rec.ts_ns = 1000000000ULL;
+    memcpy(tf->buf + tf->len, &rec, sizeof(blog_rec_t));
+    memcpy(tf->buf + tf->len + sizeof(blog_rec_t), data, len);
+    memzero(tf->buf + tf->len + sizeof(blog_rec_t) + len,
+            rec.len - sizeof(blog_rec_t) - len);
+    tf->len += rec.len;
+}
+
+/*
+ * Format payload as blog_write_format lays it out, argc is written as
+ * given whatever the number of types.
+ */
+static uint32_t
+build_format (char *p, uint32_t argc, const uint8_t *types,
+              uint32_t type_cnt, const char *file, const char *fmt)
+{
+    uint32_t hdr[2] = { 1, argc }, len = 0;
+
+    memcpy(p, hdr, sizeof(hdr));
+    len += sizeof(hdr);
+    p[len++] = 0;
+    memcpy(p + len, types, type_cnt);
+    len += type_cnt;
+    memcpy(p + len, file, strlen(file) + 1);
+    len += strlen(file) + 1;
+    memcpy(p + len, fmt, strlen(fmt) + 1);
+    len += strlen(fmt) + 1;
+    return len;
+}
+
+/*
+ * Overwrite the last cnt bytes and the padding the record would get with
+ * 'x', so no NUL is left there. Returns the padded length.
+ */
+static uint32_t
+unterminate (char *p, uint32_t len, uint32_t cnt)
+{
+    uint32_t padded = ((sizeof(blog_rec_t) + len + 7) & ~7U) -
+                      sizeof(blog_rec_t);
+
+    memset(p + len - cnt, 'x', padded - len + cnt);
+    return padded;
+}
+
+/*
+ * An int 7 and the string "seven".
+ */
+static uint32_t
+build_args (char *p)
+{
+    int i = 7;
+    uint32_t len = 5;
+
+    memcpy(p, &i, sizeof(int));
+    memcpy(p + sizeof(int), &len, sizeof(uint32_t));
+    memcpy(p + sizeof(int) + sizeof(uint32_t), "seven", len);
+    return sizeof(int) + sizeof(uint32_t) + len;
+}
+
+/*
+ * Decode the file and check stdout and stderr hold every expected line,
+ * and nothing of the message when expect_msg is False.
+ */
+static int
+check_decode (const char *name, test_file_t *tf, const char **expected,
+              bool expect_msg)
+{
+    char cmd[128], out[TEST_OUTPUT_MAX_LEN];
+    size_t len;
+    FILE *file;
+    int i;
+
+    file = fopen(test_path, "w");
+    if (file == NULL || fwrite(tf->buf, 1, tf->len, file) != tf->len) {
+        printf("FAIL: %s: write %s\n", name, test_path);
+        return -1;
+    }
+    fclose(file);
+
+    snprintf(cmd, sizeof(cmd), "%s %s 2>&1", BLOG_DECODE, test_path);
+    file = popen(cmd, "r");
+    if (file == NULL) {
+        printf("FAIL: %s: run %s\n", name, BLOG_DECODE);
+        return -1;
+    }
+    len = fread(out, 1, sizeof(out) - 1, file);
+    out[len] = '\0';
+    if (pclose(file) != 0) {
+        printf("FAIL: %s: %s failed:\n%s", name, BLOG_DECODE, out);
+        return -1;
+    }
+
+    for (i = 0; expected[i] != NULL; i++) {
+        if (strstr(out, expected[i]) == NULL) {
+            printf("FAIL: %s: no \"%s\" in:\n%s", name, expected[i], out);
+            return -1;
+        }
+    }
+    if ((strstr(out, "n=7 s=seven") != NULL) != expect_msg) {
+        printf("FAIL: %s: message %s:\n%s", name,
+               expect_msg ? "missing" : "printed", out);
+        return -1;
+    }
+    return 0;
+}
+
+static void
+init_file (test_file_t *tf)
+{
+    memcpy(tf->buf, BLOG_MAGIC, BLOG_MAGIC_LEN);
+    tf->len = BLOG_MAGIC_LEN;
+}
+
+static int
+test_valid (void)
+{
+    static const uint8_t types[] = { BLOG_ARG_INT, BLOG_ARG_STR };
+    static const char *expected[] = { "INFO n=7 s=seven", NULL };
+    test_file_t tf;
+    char data[256];
+    uint32_t len;
+
+    init_file(&tf);
+    len = build_format(data, 2, types, 2, "test.c", "n=%d s=%s");
+    add_rec(&tf, BLOG_REC_FORMAT, 1, data, len);
+    add_rec(&tf, BLOG_REC_LOG, 1, data, build_args(data));
+    return check_decode("valid", &tf, expected, True);
+}
+
+/*
+ * More arguments than a log record may have, every one of a valid type
+ * and all in the record.
+ */
+static int
+test_too_many_args (void)
+{
+    static const char *expected[] = {
+        "Corrupted format 1.", "Unknown format 1.", NULL
+    };
+    uint8_t types[40];
+    test_file_t tf;
+    char data[512];
+    uint32_t i, len;
+
+    for (i = 0; i < sizeof(types); i++) {
+        types[i] = BLOG_ARG_INT;
+    }
+    init_file(&tf);
+    len = build_format(data, sizeof(types), types, sizeof(types), "test.c",
+                       "n=%d s=%s");
+    add_rec(&tf, BLOG_REC_FORMAT, 1, data, len);
+    memzero(data, sizeof(types) * sizeof(int));
+    add_rec(&tf, BLOG_REC_LOG, 1, data, sizeof(types) * sizeof(int));
+    return check_decode("too many args", &tf, expected, False);
+}
+
+/*
+ * argc larger than what is left of the record for the types.
+ */
+static int
+test_types_past_end (void)
+{
+    static const uint8_t types[] = { BLOG_ARG_INT, BLOG_ARG_STR };
+    static const char *expected[] = {
+        "Corrupted format 1.", "Unknown format 1.", NULL
+    };
+    test_file_t tf;
+    char data[256];
+
+    init_file(&tf);
+    build_format(data, BLOG_MAX_ARGS, types, 2, "test.c", "n=%d s=%s");
+    // the record ends right after raw, the types are cut off
+    add_rec(&tf, BLOG_REC_FORMAT, 1, data, 2 * sizeof(uint32_t) + 1);
+    add_rec(&tf, BLOG_REC_LOG, 1, data, build_args(data));
+    return check_decode("types past end", &tf, expected, False);
+}
+
+static int
+test_bad_type (void)
+{
+    static const uint8_t types[] = { BLOG_ARG_INT, 0xff };
+    static const char *expected[] = {
+        "Corrupted format 1.", "Unknown format 1.", NULL
+    };
+    test_file_t tf;
+    char data[256];
+    uint32_t len;
+
+    init_file(&tf);
+    len = build_format(data, 2, types, 2, "test.c", "n=%d s=%s");
+    add_rec(&tf, BLOG_REC_FORMAT, 1, data, len);
+    add_rec(&tf, BLOG_REC_LOG, 1, data, build_args(data));
+    return check_decode("bad type", &tf, expected, False);
+}
+
+/*
+ * Types in range and in the record, but not those of the conversions of
+ * the format: a %s given an int, and a conversion with no type at all.
+ */
+static int
+test_mismatched_types (void)
+{
+    static const uint8_t types[] = { BLOG_ARG_INT };
+    static const char *expected[] = {
+        "Corrupted format 1.", "Unknown format 1.",
+        "Corrupted format 2.", "Unknown format 2.", NULL
+    };
+    test_file_t tf;
+    char data[256];
+    uint32_t len;
+    int i = 7;
+
+    init_file(&tf);
+    len = build_format(data, 1, types, 1, "test.c", "val %s");
+    add_rec(&tf, BLOG_REC_FORMAT, 1, data, len);
+    len = build_format(data, 1, types, 1, "test.c", "n=%d s=%s");
+    add_rec(&tf, BLOG_REC_FORMAT, 2, data, len);
+    add_rec(&tf, BLOG_REC_LOG, 1, &i, sizeof(int));
+    add_rec(&tf, BLOG_REC_LOG, 2, &i, sizeof(int));
+    return check_decode("mismatched types", &tf, expected, False);
+}
+
+/*
+ * The format string runs up to the end of the record without its NUL,
+ * and the file string with no format at all.
+ */
+static int
+test_unterminated_strings (void)
+{
+    static const uint8_t types[] = { BLOG_ARG_INT, BLOG_ARG_STR };
+    static const char *expected[] = {
+        "Corrupted format 1.", "Unknown format 1.",
+        "Corrupted format 2.", "Unknown format 2.", NULL
+    };
+    test_file_t tf;
+    char data[256];
+    uint32_t len;
+
+    init_file(&tf);
+    len = build_format(data, 2, types, 2, "test.c", "n=%d s=%s");
+    add_rec(&tf, BLOG_REC_FORMAT, 1, data, unterminate(data, len, 1));
+    len = build_format(data, 2, types, 2, "test.c", "");
+    add_rec(&tf, BLOG_REC_FORMAT, 2, data, unterminate(data, len, 2));
+    add_rec(&tf, BLOG_REC_LOG, 1, data, build_args(data));
+    add_rec(&tf, BLOG_REC_LOG, 2, data, build_args(data));
+    return check_decode("unterminated strings", &tf, expected, False);
+}
+
+/*
+ * A valid format with its log record cut inside the string argument.
+ */
+static int
+test_short_record (void)
+{
+    static const uint8_t types[] = { BLOG_ARG_INT, BLOG_ARG_STR };
+    static const char *expected[] = { "Corrupted record of format 1.", NULL };
+    test_file_t tf;
+    char data[256];
+    uint32_t len;
+
+    init_file(&tf);
+    len = build_format(data, 2, types, 2, "test.c", "n=%d s=%s");
+    add_rec(&tf, BLOG_REC_FORMAT, 1, data, len);
+    build_args(data);
+    add_rec(&tf, BLOG_REC_LOG, 1, data, sizeof(int) + sizeof(uint32_t));
+    return check_decode("short record", &tf, expected, False);
+}
+
+/*
+ * Corrupted records are reported and skipped, the decoder never reads
+ * past them. Needs blog_decode built in the current directory.
+ */
+int main (void)
+{
+    int fd, rc;
+
+    fd = mkstemp(test_path);
+    if (fd < 0) {
+        printf("FAIL: mkstemp\n");
+        return -1;
+    }
+    close(fd);
+
+    rc = test_valid();
+    if (rc == 0) {
+        rc = test_too_many_args();
+    }
+    if (rc == 0) {
+        rc = test_types_past_end();
+    }
+    if (rc == 0) {
+        rc = test_bad_type();
+    }
+    if (rc == 0) {
+        rc = test_mismatched_types();
+    }
+    if (rc == 0) {
+        rc = test_unterminated_strings();
+    }
+    if (rc == 0) {
+        rc = test_short_record();
+    }
+    unlink(test_path);
+
+    if (rc != 0) {
+        printf("FAIL\n");
+        return -1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -23,6 +23,7 @@
 #include <netinet/tcp.h>
 #include "util.h"
 #include "task_queue.h"
+#include "affinity.h"
 #include "server_common.h"
 
 #define RESP_MAX_BUF_LEN 1023
@@ -429,6 +430,8 @@ sender_thread (void *arg)
     char *msg;
     int rc;
 
+    // before sender_init, so its memory comes from the node it runs on
+    affinity_pin(affinity_pick(AFFINITY_ROLE_SENDER));
     sender_ctrl = sender_init(sender_env);
     if (!sender_ctrl) {
         return NULL;
@@ -525,6 +528,7 @@ producer_thread (void *arg)
     int port = sender_env->port;
     uint32_t msg_cnt = sender_env->msg_cnt;
 
+    affinity_pin(affinity_pick(AFFINITY_ROLE_PRODUCER));
     for (i = 0; i < msg_cnt; i++) {
         msg = generate_msg(ip, port, i);
         if (!msg) {
@@ -866,6 +870,7 @@ counter_thread (void *arg)
     uint32_t msg_cnt = sender_env->msg_cnt;
     struct timeval start_ts;
 
+    affinity_pin(affinity_pick(AFFINITY_ROLE_COUNTER));
     printf("%s\n", g_column_mgr.header);
     printf("%s\n", g_column_mgr.seperator);
 
@@ -936,7 +941,9 @@ prepare_env (sender_env_t *sender_env)
 static void
 usage (void)
 {
-    printf("post_data [msg_count] -j <thread_count>\n");
+    printf("post_data [msg_count] [-j <thread_count>]\n"
+           "          [-a auto|nic=<interface>|<role>=<cpu_list>]...\n"
+           "roles: io, producer, sender, counter\n");
 }
 
 static bool
@@ -954,6 +961,8 @@ is_digit_string (char *s)
 static int
 parse_args (int argc, char **argv, sender_env_t *sender_env)
 {
+    int i;
+
     sender_env->msg_cnt = SEND_MSG_CNT;
     sender_env->sender_cnt = SENDER_THREAD_CNT;
 
@@ -970,23 +979,25 @@ parse_args (int argc, char **argv, sender_env_t *sender_env)
         sender_env->msg_cnt = atoi(argv[1]);
     }
 
-    if (argc == 2) {
-        return 0;
-    } else if (argc < 4) {
-        printf("Should follow option with job count.\n");
-        return -1;
-    }
-
-    if (strcmp(argv[2], "-j") != 0) {
-        printf("Unsupported option %s.\n", argv[2]);
-        return -1;
-    }
-
-    if (!is_digit_string(argv[3])) {
-        printf("job count should be a integer.\n");
-        return -1;
-    } else {
-        sender_env->sender_cnt = atoi(argv[3]);
+    for (i = 2; i < argc; i += 2) {
+        if (i + 1 == argc) {
+            printf("Should follow option %s with a value.\n", argv[i]);
+            return -1;
+        }
+        if (strcmp(argv[i], "-j") == 0) {
+            if (!is_digit_string(argv[i+1])) {
+                printf("job count should be a integer.\n");
+                return -1;
+            }
+            sender_env->sender_cnt = atoi(argv[i+1]);
+        } else if (strcmp(argv[i], "-a") == 0) {
+            if (affinity_parse(argv[i+1]) != 0) {
+                return -1;
+            }
+        } else {
+            printf("Unsupported option %s.\n", argv[i]);
+            return -1;
+        }
     }
 
     return 0;
@@ -1082,11 +1093,18 @@ test_connection (void)
 
 int main (int argc, char **argv)
 {
-    int rc, ready;
+    int rc, ready, io_cpu;
     sender_env_t sender_env;
     struct epoll_event evlist[EPOLL_WAIT_MAX_EVENTS];
     pthread_t counter_thread_id;
 
+#ifdef _BINARY_LOGGER_
+    rc = blog_init_env("post.blog");
+    if (rc != 0) {
+        return -1;
+    }
+#endif
+
     rc = test_connection();
     if (rc != 0) {
         return -1;
@@ -1097,11 +1115,17 @@ int main (int argc, char **argv)
         return -1;
     }
 
+    rc = affinity_init(NULL);
+    if (rc != 0) {
+        return -1;
+    }
     rc = parse_args(argc, argv, &sender_env);
     if (rc != 0) {
         usage();
         return -1;
     }
+    affinity_print();
+    io_cpu = affinity_pick(AFFINITY_ROLE_IO);
 
     rc = create_sender_threads(&sender_env);
     if (rc != 0) {
@@ -1117,6 +1141,8 @@ int main (int argc, char **argv)
     if (rc != 0) {
         return -1;
     }
+    // only once the others are created, they would inherit its mask
+    affinity_pin(io_cpu);
 
     for (;;) {
         ready = epoll_wait(sender_env.epfd, evlist,
@@ -1138,6 +1164,9 @@ int main (int argc, char **argv)
     pthread_join(counter_thread_id, NULL);
 
     clean_env(&sender_env);
+#ifdef _BINARY_LOGGER_
+    blog_clean();
+#endif
     printf("\nPost done.\n");
     return 0;
 }
@@ -0,0 +1,109 @@
+#include <string.h>
+#include "util.h"
+#include "codel.h"
+
+void
+codel_init (codel_t *codel, uint64_t target_ns, uint64_t interval_ns)
+{
+    memzero(codel, sizeof(codel_t));
+    pthread_mutex_init(&codel->lock, NULL);
+    codel->target_ns = target_ns;
+    codel->interval_ns = interval_ns;
+}
+
+void
+codel_clean (codel_t *codel)
+{
+    pthread_mutex_destroy(&codel->lock);
+}
+
+static uint64_t
+codel_isqrt (uint64_t v)
+{
+    uint64_t r = 0, bit = (uint64_t)1 << 62;
+
+    while (bit > v) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (v >= r + bit) {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return r;
+}
+
+// t + interval / sqrt(count), with 3 decimal digits of the root
+static uint64_t
+codel_control_law (codel_t *codel, uint64_t t)
+{
+    return t + codel->interval_ns * 1000 /
+               codel_isqrt((uint64_t)codel->count * 1000000);
+}
+
+/*
+ * Called for every item dequeued with how long it waited, True if it is
+ * to be shed.
+ */
+bool
+codel_should_shed (codel_t *codel, uint64_t sojourn_ns, uint64_t now_ns)
+{
+    bool ok_to_drop = False, shed = False;
+    uint32_t delta;
+
+    pthread_mutex_lock(&codel->lock);
+    if (sojourn_ns < codel->target_ns) {
+        codel->first_above_ns = 0;
+    } else if (codel->first_above_ns == 0) {
+        codel->first_above_ns = now_ns + codel->interval_ns;
+    } else if (now_ns >= codel->first_above_ns) {
+        ok_to_drop = True;
+    }
+
+    if (codel->dropping) {
+        if (!ok_to_drop) {
+            codel->dropping = False;
+        } else if (now_ns >= codel->drop_next_ns) {
+            shed = True;
+            codel->count++;
+            codel->drop_next_ns = codel_control_law(codel,
+                                                    codel->drop_next_ns);
+        }
+    } else if (ok_to_drop) {
+        shed = True;
+        codel->dropping = True;
+        /*
+         * Back soon after the last episode, go on at about its rate. Signed
+         * as drop_next may not have been reached when that one ended.
+         */
+        delta = codel->count - codel->last_count;
+        if (delta > 1 && (int64_t)(now_ns - codel->drop_next_ns) <
+                         (int64_t)(16 * codel->interval_ns)) {
+            codel->count = delta;
+        } else {
+            codel->count = 1;
+        }
+        codel->last_count = codel->count;
+        codel->drop_next_ns = codel_control_law(codel, now_ns);
+    }
+    if (shed) {
+        codel->shed++;
+    }
+    pthread_mutex_unlock(&codel->lock);
+    return shed;
+}
+
+uint64_t
+codel_get_shed (codel_t *codel)
+{
+    uint64_t shed;
+
+    pthread_mutex_lock(&codel->lock);
+    shed = codel->shed;
+    pthread_mutex_unlock(&codel->lock);
+    return shed;
+}
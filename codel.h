@@ -0,0 +1,43 @@
+#ifndef __CODEL_H__
+#define __CODEL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "util.h"
+
+#define CODEL_TARGET_US 5000
+#define CODEL_INTERVAL_MS 100
+
+/*
+ * CoDel (RFC 8289) over the time items wait in a queue. Once every item
+ * dequeued for a whole interval waited more than target, items are shed,
+ * the next one after interval / sqrt(count) so shedding speeds up until
+ * the wait is back under target. A standing queue is shed, a burst which
+ * drains within an interval is not. Each consumer may keep its own, its
+ * lock is then never contended.
+ */
+typedef struct codel_s {
+    pthread_mutex_t lock;
+    uint64_t target_ns;
+    uint64_t interval_ns;
+    uint64_t first_above_ns; // when the wait may have been high long enough
+    uint64_t drop_next_ns;
+    uint32_t count;          // sheds since shedding started
+    uint32_t last_count;
+    bool dropping;
+    uint64_t shed;
+} cache_aligned codel_t;
+
+void
+codel_init(codel_t *codel, uint64_t target_ns, uint64_t interval_ns);
+
+void
+codel_clean(codel_t *codel);
+
+bool
+codel_should_shed(codel_t *codel, uint64_t sojourn_ns, uint64_t now_ns);
+
+uint64_t
+codel_get_shed(codel_t *codel);
+#endif //__CODEL_H__
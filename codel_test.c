@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "codel.h"
+
+#define TEST_TARGET_NS (5*1000*1000ULL)
+#define TEST_INTERVAL_NS (100*1000*1000ULL)
+#define TEST_STEP_NS (1000*1000ULL)
+
+/*
+ * Dequeue one item every step for duration with the given wait, return
+ * how many were shed.
+ */
+static uint32_t
+run (codel_t *codel, uint64_t *now, uint64_t duration, uint64_t sojourn)
+{
+    uint64_t end = *now + duration;
+    uint32_t shed = 0;
+
+    for (; *now < end; *now += TEST_STEP_NS) {
+        shed += codel_should_shed(codel, sojourn, *now);
+    }
+    return shed;
+}
+
+// a burst over target shorter than an interval is left alone
+static int
+test_burst (void)
+{
+    codel_t codel;
+    uint64_t now = TEST_STEP_NS;
+    uint32_t shed;
+
+    codel_init(&codel, TEST_TARGET_NS, TEST_INTERVAL_NS);
+    shed = run(&codel, &now, TEST_INTERVAL_NS / 2, TEST_TARGET_NS * 10);
+    shed += run(&codel, &now, TEST_INTERVAL_NS, 0);
+    shed += run(&codel, &now, TEST_INTERVAL_NS / 2, TEST_TARGET_NS * 10);
+    codel_clean(&codel);
+
+    if (shed != 0) {
+        printf("FAIL: %u shed out of bursts\n", shed);
+        return -1;
+    }
+    printf("burst: nothing shed\n");
+    return 0;
+}
+
+/*
+ * A standing queue starts shedding after an interval and sheds faster
+ * and faster, shedding stops as soon as the wait is under target.
+ */
+static int
+test_standing (void)
+{
+    codel_t codel;
+    uint64_t now = TEST_STEP_NS;
+    uint32_t first, second, after;
+
+    codel_init(&codel, TEST_TARGET_NS, TEST_INTERVAL_NS);
+    first = run(&codel, &now, TEST_INTERVAL_NS * 2, TEST_TARGET_NS * 2);
+    second = run(&codel, &now, TEST_INTERVAL_NS * 2, TEST_TARGET_NS * 2);
+    after = run(&codel, &now, TEST_INTERVAL_NS, TEST_TARGET_NS / 2);
+    if (first == 0 || second <= first || after != 0 ||
+        codel_get_shed(&codel) != first + second) {
+        printf("FAIL: shed %u then %u then %u\n", first, second, after);
+        codel_clean(&codel);
+        return -1;
+    }
+    codel_clean(&codel);
+    printf("standing: shed %u then %u then %u\n", first, second, after);
+    return 0;
+}
+
+// back over target right after an episode, it resumes near its rate
+static int
+test_resume (void)
+{
+    codel_t codel;
+    uint64_t now = TEST_STEP_NS;
+    uint32_t fresh, resumed;
+
+    codel_init(&codel, TEST_TARGET_NS, TEST_INTERVAL_NS);
+    fresh = run(&codel, &now, TEST_INTERVAL_NS * 3, TEST_TARGET_NS * 2);
+    run(&codel, &now, TEST_STEP_NS, 0);
+    resumed = run(&codel, &now, TEST_INTERVAL_NS * 3, TEST_TARGET_NS * 2);
+    codel_clean(&codel);
+
+    if (resumed <= fresh) {
+        printf("FAIL: shed %u fresh, %u resumed\n", fresh, resumed);
+        return -1;
+    }
+    printf("resume: shed %u fresh, %u resumed\n", fresh, resumed);
+    return 0;
+}
+
+/*
+ * A consumer whose clock was read long before takes the wait as not high
+ * for an interval yet and stops shedding, the next one goes straight back
+ * to it before drop_next and must keep the rate.
+ */
+static int
+test_reenter (void)
+{
+    codel_t codel;
+    uint64_t now = TEST_STEP_NS;
+    uint32_t count;
+
+    codel_init(&codel, TEST_TARGET_NS, TEST_INTERVAL_NS);
+    run(&codel, &now, TEST_INTERVAL_NS * 3, TEST_TARGET_NS * 2);
+    while (!codel_should_shed(&codel, TEST_TARGET_NS * 2, now)) {
+        now += TEST_STEP_NS;
+    }
+    count = codel.count;
+    codel_should_shed(&codel, TEST_TARGET_NS * 2, TEST_STEP_NS);
+    now += TEST_STEP_NS;
+    if (codel.dropping || now >= codel.drop_next_ns ||
+        !codel_should_shed(&codel, TEST_TARGET_NS * 2, now) ||
+        codel.count <= 1) {
+        printf("FAIL: count %u before leaving, %u on reentry\n", count,
+               codel.count);
+        codel_clean(&codel);
+        return -1;
+    }
+    printf("reenter: count %u before leaving, %u on reentry\n", count,
+           codel.count);
+    codel_clean(&codel);
+    return 0;
+}
+
+int main (void)
+{
+    if (test_burst() != 0 || test_standing() != 0 || test_resume() != 0 ||
+        test_reenter() != 0) {
+        printf("FAIL\n");
+        return -1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,329 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "util.h"
+#include "coro.h"
+
+// the coroutine running on this thread, NULL on the scheduler's stack
+static __thread coro_t *coro_local;
+
+void
+coro_main(coro_t *co) __attribute__((used, noreturn, visibility("hidden")));
+
+#if defined(__x86_64__)
+
+void
+coro_switch(void **save_sp, void *load_sp)
+    __attribute__((visibility("hidden")));
+
+void
+coro_trampoline(void) __attribute__((visibility("hidden")));
+
+/*
+ * Only what the SysV ABI says a callee preserves is saved. MXCSR and the
+ * x87 control word are left alone, nothing here changes them.
+ */
+__asm__(
+    ".text\n"
+    ".type coro_switch, @function\n"
+    "coro_switch:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size coro_switch, .-coro_switch\n"
+    // first switch to a coroutine lands here with it in rbx
+    ".type coro_trampoline, @function\n"
+    "coro_trampoline:\n"
+    "    movq %rbx, %rdi\n"
+    "    call coro_main\n"
+    "    ud2\n"
+    ".size coro_trampoline, .-coro_trampoline\n"
+);
+
+/*
+ * Lay out the stack as if coro_switch had saved it, returning into
+ * coro_trampoline with rbx holding the coroutine and the stack 16 byte
+ * aligned for its call.
+ */
+static void
+coro_ctx_init (coro_t *co, void *top)
+{
+    void **sp = (void **)((uintptr_t)top & ~(uintptr_t)15);
+
+    *--sp = (void *)coro_trampoline;
+    *--sp = NULL; // rbp, ends the frame chain
+    *--sp = co;   // rbx
+    *--sp = NULL; // r12
+    *--sp = NULL; // r13
+    *--sp = NULL; // r14
+    *--sp = NULL; // r15
+    co->ctx.sp = sp;
+}
+
+static inline void
+coro_ctx_switch (coro_ctx_t *from, coro_ctx_t *to)
+{
+    coro_switch(&from->sp, to->sp);
+}
+
+#else
+
+// makecontext only passes int arguments, the coroutine comes through here
+static __thread coro_t *coro_starting;
+
+static void
+coro_uc_entry (void)
+{
+    coro_main(coro_starting);
+}
+
+static void
+coro_ctx_init (coro_t *co, void *top)
+{
+    char *base = (char *)co->map + co->sched->page_size;
+
+    getcontext(&co->ctx.uc);
+    co->ctx.uc.uc_stack.ss_sp = base;
+    co->ctx.uc.uc_stack.ss_size = (char *)top - base;
+    co->ctx.uc.uc_link = NULL;
+    makecontext(&co->ctx.uc, coro_uc_entry, 0);
+}
+
+static inline void
+coro_ctx_switch (coro_ctx_t *from, coro_ctx_t *to)
+{
+    coro_starting = coro_local;
+    swapcontext(&from->uc, &to->uc);
+}
+
+#endif
+
+void
+coro_main (coro_t *co)
+{
+    co->fn(co->arg);
+    co->done = True;
+    coro_ctx_switch(&co->ctx, &co->sched->main);
+    abort();
+}
+
+/*
+ * stack_size is rounded up to whole pages, 0 for CORO_STACK_SIZE.
+ */
+void
+coro_sched_init (coro_sched_t *sched, uint32_t stack_size)
+{
+    long page = sysconf(_SC_PAGESIZE);
+
+    memzero(sched, sizeof(coro_sched_t));
+    sched->page_size = page > 0 ? page : 4096;
+    if (stack_size == 0) {
+        stack_size = CORO_STACK_SIZE;
+    }
+    sched->stack_size = (stack_size + sched->page_size - 1) &
+                        ~(sched->page_size - 1);
+}
+
+static void
+coro_unmap (coro_sched_t *sched, coro_t *co)
+{
+    munmap(co->map, sched->stack_size + sched->page_size);
+    sched->stats.mapped--;
+}
+
+/*
+ * Only the pooled coroutines are released, live ones belong to whoever
+ * created them.
+ */
+void
+coro_sched_clean (coro_sched_t *sched)
+{
+    coro_t *co;
+
+    while ((co = sched->pool) != NULL) {
+        sched->pool = co->next;
+        coro_unmap(sched, co);
+    }
+    sched->pool_cnt = 0;
+}
+
+/*
+ * The stack is mapped without reserving swap, only the pages a coroutine
+ * touches take memory, and the guard page below it turns an overflow
+ * into SIGSEGV.
+ */
+static coro_t *
+coro_map (coro_sched_t *sched)
+{
+    size_t len = sched->stack_size + sched->page_size;
+    coro_t *co;
+    void *map;
+
+    map = mmap(NULL, len, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED) {
+        logger(ERROR, "Fail to map coroutine stack, %d", errno);
+        return NULL;
+    }
+    if (mprotect(map, sched->page_size, PROT_NONE) != 0) {
+        logger(ERROR, "Fail to protect coroutine guard page, %d", errno);
+        munmap(map, len);
+        return NULL;
+    }
+    co = (coro_t *)(((uintptr_t)map + len - sizeof(coro_t)) &
+                    ~(uintptr_t)(CACHE_LINE_SIZE - 1));
+    co->map = map;
+    sched->stats.mapped++;
+    return co;
+}
+
+/*
+ * The coroutine doesn't run until resumed. Once fn returns it is pooled
+ * or unmapped, the caller must not touch it after that resume.
+ */
+coro_t *
+coro_create (coro_sched_t *sched, coro_fn_t fn, void *arg)
+{
+    coro_t *co;
+
+    if (sched->pool != NULL) {
+        co = sched->pool;
+        sched->pool = co->next;
+        sched->pool_cnt--;
+    } else {
+        co = coro_map(sched);
+        if (co == NULL) {
+            return NULL;
+        }
+    }
+    co->sched = sched;
+    co->fn = fn;
+    co->arg = arg;
+    co->wait = CORO_WAIT_NONE;
+    co->done = False;
+    co->next = NULL;
+    coro_ctx_init(co, co);
+    sched->stats.created++;
+    sched->stats.live++;
+    return co;
+}
+
+/*
+ * From the scheduler's stack only, run co until it yields or returns.
+ */
+void
+coro_resume (coro_t *co)
+{
+    coro_sched_t *sched = co->sched;
+
+    co->wait = CORO_WAIT_NONE;
+    sched->current = co;
+    coro_local = co;
+    sched->stats.switches++;
+    coro_ctx_switch(&sched->main, &co->ctx);
+    coro_local = NULL;
+    sched->current = NULL;
+
+    if (!co->done) {
+        return;
+    }
+    sched->stats.live--;
+    if (sched->pool_cnt < CORO_POOL_MAX) {
+        co->next = sched->pool;
+        sched->pool = co;
+        sched->pool_cnt++;
+    } else {
+        coro_unmap(sched, co);
+    }
+}
+
+/*
+ * Back to the scheduler, wait tells the event loop what to resume the
+ * coroutine on.
+ */
+void
+coro_yield (uint32_t wait)
+{
+    coro_t *co = coro_local;
+
+    co->wait = wait;
+    co->sched->stats.switches++;
+    coro_ctx_switch(&co->ctx, &co->sched->main);
+}
+
+coro_t *
+coro_current (void)
+{
+    return coro_local;
+}
+
+/*
+ * read on a non-blocking fd that yields for CORO_WAIT_READ instead of
+ * failing with EAGAIN. Return what read returns once it has something,
+ * outside a coroutine it is a plain read.
+ */
+ssize_t
+co_read (int fd, void *buf, size_t len)
+{
+    ssize_t n;
+
+    for (;;) {
+        n = read(fd, buf, len);
+        if (n >= 0) {
+            return n;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if ((errno != EAGAIN && errno != EWOULDBLOCK) || coro_local == NULL) {
+            return -1;
+        }
+        coro_yield(CORO_WAIT_READ);
+    }
+}
+
+/*
+ * Write all of buf, yielding for CORO_WAIT_WRITE whenever the socket is
+ * full. Return len, or -1 on error with part of it maybe written.
+ */
+ssize_t
+co_write (int fd, const void *buf, size_t len)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < len) {
+        n = write(fd, (const char *)buf + done, len - done);
+        if (n >= 0) {
+            done += n;
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if ((errno != EAGAIN && errno != EWOULDBLOCK) || coro_local == NULL) {
+            return -1;
+        }
+        coro_yield(CORO_WAIT_WRITE);
+    }
+    return len;
+}
+
+void
+coro_sched_get_stats (coro_sched_t *sched, coro_sched_stats_t *stats)
+{
+    *stats = sched->stats;
+}
@@ -0,0 +1,104 @@
+#ifndef __CORO_H__
+#define __CORO_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#if !defined(__x86_64__)
+#include <ucontext.h>
+#endif
+
+// usable stack, a guard page below it is not counted
+#define CORO_STACK_SIZE (64*1024)
+// finished coroutines kept with their stack for reuse, per scheduler
+#define CORO_POOL_MAX 256
+
+// what a coroutine yielded for, see co_read and co_write
+enum {
+    CORO_WAIT_NONE = 0,
+    CORO_WAIT_READ = 1,
+    CORO_WAIT_WRITE = 2,
+};
+
+/*
+ * Saved context of a coroutine switched out. On x86-64 the callee-saved
+ * registers are pushed on its own stack and only the stack pointer is
+ * kept, elsewhere it falls back to ucontext, which also saves the signal
+ * mask with a system call on every switch.
+ */
+typedef struct coro_ctx_s {
+#if defined(__x86_64__)
+    void *sp;
+#else
+    ucontext_t uc;
+#endif
+} coro_ctx_t;
+
+typedef void (*coro_fn_t)(void *arg);
+
+struct coro_sched_s;
+
+/*
+ * Lives at the top of its own stack mapping, so a coroutine is a single
+ * mmap with the guard page at its low end.
+ */
+typedef struct coro_s {
+    coro_ctx_t ctx;
+    struct coro_sched_s *sched;
+    coro_fn_t fn;
+    void *arg;
+    void *map;
+    uint32_t wait;
+    bool done;
+    struct coro_s *next;  // in the pool once done
+} coro_t;
+
+typedef struct coro_sched_stats_s {
+    uint64_t created;
+    uint64_t live;
+    uint64_t mapped;      // stacks mapped, live and pooled ones
+    uint64_t switches;
+} coro_sched_stats_t;
+
+/*
+ * Runs coroutines of one thread. They only switch back to the scheduler,
+ * which resumes whichever one the event loop says is ready, and are
+ * never moved to another thread.
+ */
+typedef struct coro_sched_s {
+    coro_ctx_t main;
+    coro_t *current;
+    coro_t *pool;
+    uint32_t pool_cnt;
+    uint32_t stack_size;
+    uint32_t page_size;
+    coro_sched_stats_t stats;
+} coro_sched_t;
+
+void
+coro_sched_init(coro_sched_t *sched, uint32_t stack_size);
+
+void
+coro_sched_clean(coro_sched_t *sched);
+
+coro_t *
+coro_create(coro_sched_t *sched, coro_fn_t fn, void *arg);
+
+void
+coro_resume(coro_t *co);
+
+void
+coro_yield(uint32_t wait);
+
+coro_t *
+coro_current(void);
+
+ssize_t
+co_read(int fd, void *buf, size_t len);
+
+ssize_t
+co_write(int fd, const void *buf, size_t len);
+
+void
+coro_sched_get_stats(coro_sched_t *sched, coro_sched_stats_t *stats);
+#endif //__CORO_H__
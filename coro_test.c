@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include "util.h"
+#include "coro.h"
+
+#define TEST_SWITCH_CNT 10000000
+#define TEST_IO_LEN (4*1024*1024)
+#define TEST_LIVE_CNT 10000
+
+static void
+yield_forever (void *arg)
+{
+    uint64_t *cnt = arg;
+
+    for (;;) {
+        (*cnt)++;
+        coro_yield(CORO_WAIT_NONE);
+    }
+}
+
+// a resume and a yield are two switches
+static int
+bench_switch (void)
+{
+    coro_sched_t sched;
+    coro_t *co;
+    uint64_t cnt = 0, start, ns;
+    uint32_t i;
+
+    coro_sched_init(&sched, 0);
+    co = coro_create(&sched, yield_forever, &cnt);
+    if (co == NULL) {
+        return -1;
+    }
+    start = monotonic_ns();
+    for (i = 0; i < TEST_SWITCH_CNT / 2; i++) {
+        coro_resume(co);
+    }
+    ns = monotonic_ns() - start;
+    if (cnt != TEST_SWITCH_CNT / 2) {
+        printf("FAIL: ran %lu times\n", (unsigned long)cnt);
+        return -1;
+    }
+    // never finished, its stack is left mapped
+    printf("switch: %.1f ns\n", (double)ns / TEST_SWITCH_CNT);
+    return 0;
+}
+
+typedef struct io_ctx_s {
+    int fd;
+    char *buf;
+    ssize_t rc;
+    bool finished;
+} io_ctx_t;
+
+static void
+writer (void *arg)
+{
+    io_ctx_t *ctx = arg;
+
+    ctx->rc = co_write(ctx->fd, ctx->buf, TEST_IO_LEN);
+    close(ctx->fd);
+    ctx->finished = True;
+}
+
+static void
+reader (void *arg)
+{
+    io_ctx_t *ctx = arg;
+    ssize_t n;
+
+    ctx->rc = 0;
+    while ((n = co_read(ctx->fd, ctx->buf + ctx->rc,
+                        TEST_IO_LEN - ctx->rc)) > 0) {
+        ctx->rc += n;
+    }
+    ctx->finished = True;
+}
+
+/*
+ * Both ends of a socketpair in coroutines of one thread, far more data
+ * than the socket buffers hold, so each blocks on the other many times.
+ */
+static int
+test_io (void)
+{
+    coro_sched_t sched;
+    coro_sched_stats_t stats;
+    io_ctx_t w, r;
+    coro_t *wco, *rco;
+    int fds[2], i;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) != 0) {
+        return -1;
+    }
+    w.fd = fds[0];
+    r.fd = fds[1];
+    w.finished = r.finished = False;
+    w.buf = malloc(TEST_IO_LEN);
+    r.buf = malloc(TEST_IO_LEN);
+    for (i = 0; i < TEST_IO_LEN; i++) {
+        w.buf[i] = i * 7;
+    }
+
+    coro_sched_init(&sched, 0);
+    wco = coro_create(&sched, writer, &w);
+    rco = coro_create(&sched, reader, &r);
+    // stands in for the event loop, resume whoever is not done
+    while (!w.finished || !r.finished) {
+        if (!w.finished) {
+            coro_resume(wco);
+        }
+        if (!r.finished) {
+            coro_resume(rco);
+        }
+    }
+    coro_sched_get_stats(&sched, &stats);
+    coro_sched_clean(&sched);
+    close(r.fd);
+
+    if (w.rc != TEST_IO_LEN || r.rc != TEST_IO_LEN ||
+        memcmp(w.buf, r.buf, TEST_IO_LEN) != 0) {
+        printf("FAIL: wrote %ld, read %ld\n", (long)w.rc, (long)r.rc);
+        free(w.buf);
+        free(r.buf);
+        return -1;
+    }
+    free(w.buf);
+    free(r.buf);
+    printf("io: %d bytes in %lu switches\n", TEST_IO_LEN,
+           (unsigned long)stats.switches);
+    return 0;
+}
+
+static void
+wait_once (void *arg)
+{
+    coro_yield(CORO_WAIT_NONE);
+}
+
+/*
+ * Many live coroutines at once, and their stacks are reused once they
+ * are done instead of being mapped again.
+ */
+static int
+test_pool (void)
+{
+    coro_sched_t sched;
+    coro_t **cos;
+    uint64_t mapped;
+    int i;
+
+    cos = calloc(TEST_LIVE_CNT, sizeof(coro_t *));
+    coro_sched_init(&sched, 16 * 1024);
+    for (i = 0; i < TEST_LIVE_CNT; i++) {
+        cos[i] = coro_create(&sched, wait_once, NULL);
+        if (cos[i] == NULL) {
+            printf("FAIL: create %d\n", i);
+            return -1;
+        }
+        coro_resume(cos[i]);
+    }
+    if (sched.stats.live != TEST_LIVE_CNT) {
+        printf("FAIL: %lu live\n", (unsigned long)sched.stats.live);
+        return -1;
+    }
+    for (i = 0; i < TEST_LIVE_CNT; i++) {
+        coro_resume(cos[i]);
+    }
+    mapped = sched.stats.mapped;
+    for (i = 0; i < TEST_LIVE_CNT; i++) {
+        cos[0] = coro_create(&sched, wait_once, NULL);
+        coro_resume(cos[0]);
+        coro_resume(cos[0]);
+    }
+    if (sched.stats.live != 0 || mapped != CORO_POOL_MAX ||
+        sched.stats.mapped != CORO_POOL_MAX) {
+        printf("FAIL: %lu live, %lu then %lu mapped\n",
+               (unsigned long)sched.stats.live, (unsigned long)mapped,
+               (unsigned long)sched.stats.mapped);
+        return -1;
+    }
+    coro_sched_clean(&sched);
+    free(cos);
+    printf("pool: %d live at once, %d stacks kept\n", TEST_LIVE_CNT,
+           CORO_POOL_MAX);
+    return 0;
+}
+
+static int
+recurse (int depth)
+{
+    volatile char pad[512];
+
+    pad[0] = depth;
+    if (depth == INT32_MAX) {
+        return 0;
+    }
+    return recurse(depth + 1) + pad[0];
+}
+
+static void
+overflow (void *arg)
+{
+    recurse(0);
+}
+
+// overflowing the stack hits the guard page, in a child process
+static int
+test_guard (void)
+{
+    coro_sched_t sched;
+    pid_t pid;
+    int status;
+
+    pid = fork();
+    if (pid == 0) {
+        coro_sched_init(&sched, 0);
+        coro_resume(coro_create(&sched, overflow, NULL));
+        _exit(0);
+    }
+    if (pid == -1 || waitpid(pid, &status, 0) != pid) {
+        return -1;
+    }
+    if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGSEGV) {
+        printf("FAIL: overflow didn't fault\n");
+        return -1;
+    }
+    printf("guard: overflow faults\n");
+    return 0;
+}
+
+int main (void)
+{
+    if (bench_switch() != 0 || test_io() != 0 || test_pool() != 0 ||
+        test_guard() != 0) {
+        printf("FAIL\n");
+        return -1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -47,6 +47,17 @@ dlist_append_left (dlist_header_t *head, dlist_header_t *entry)
     head->next = entry;
 }
 
+/*
+ * Unlink entry from whatever list it is on, leaving it as an empty list.
+ */
+static inline void
+dlist_remove (dlist_header_t *entry)
+{
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    dlist_init(entry);
+}
+
 static inline dlist_header_t *
 dlist_pop (dlist_header_t *head)
 {
@@ -0,0 +1,213 @@
+#include <string.h>
+#include <strings.h>
+#include "util.h"
+#include "scan.h"
+#include "http_parser.h"
+
+void
+http_parser_init (http_parser_t *parser)
+{
+    memzero(parser, sizeof(http_parser_t));
+    parser->state = HTTP_PARSER_REQUEST_LINE;
+}
+
+/*
+ * Return the length of the next line starting at buf[pos] without its
+ * terminator, and the offset right after the terminator in *next.
+ * -1 means the line is not complete yet.
+ */
+static int
+next_line (const char *buf, uint32_t pos, uint32_t len, uint32_t *next)
+{
+    const char *p;
+    uint32_t line_len;
+
+    p = scan_find_eol(buf + pos, len - pos);
+    if (p == NULL) {
+        return -1;
+    }
+
+    line_len = p - (buf + pos);
+    *next = pos + line_len + 1;
+    if (line_len > 0 && buf[pos + line_len - 1] == '\r') {
+        line_len--;
+    }
+    return line_len;
+}
+
+static void
+trim_str (const char *buf, http_str_t *s)
+{
+    while (s->len > 0 && (buf[s->off] == ' ' || buf[s->off] == '\t')) {
+        s->off++;
+        s->len--;
+    }
+    while (s->len > 0 && (buf[s->off + s->len - 1] == ' ' ||
+                          buf[s->off + s->len - 1] == '\t')) {
+        s->len--;
+    }
+}
+
+static int
+parse_request_line (http_request_t *req, const char *buf,
+                    uint32_t pos, uint32_t line_len)
+{
+    const char *line = buf + pos, *sp1, *sp2;
+
+    sp1 = memchr(line, ' ', line_len);
+    if (sp1 == NULL || sp1 == line) {
+        return -1;
+    }
+    sp2 = memchr(sp1 + 1, ' ', line_len - (sp1 + 1 - line));
+    if (sp2 == NULL || sp2 == sp1 + 1) {
+        return -1;
+    }
+
+    req->method.off = pos;
+    req->method.len = sp1 - line;
+    req->path.off = pos + (sp1 + 1 - line);
+    req->path.len = sp2 - (sp1 + 1);
+    req->version.off = pos + (sp2 + 1 - line);
+    req->version.len = line_len - (sp2 + 1 - line);
+
+    if (req->version.len != 8 ||
+        memcmp(buf + req->version.off, "HTTP/1.", 7) != 0) {
+        return -1;
+    }
+    req->keep_alive = (buf[req->version.off + 7] == '1');
+    return 0;
+}
+
+static bool
+header_name_is (const char *buf, http_header_t *h, const char *name)
+{
+    return h->name.len == strlen(name) &&
+           strncasecmp(buf + h->name.off, name, h->name.len) == 0;
+}
+
+static bool
+header_value_is (const char *buf, http_header_t *h, const char *value)
+{
+    return h->value.len == strlen(value) &&
+           strncasecmp(buf + h->value.off, value, h->value.len) == 0;
+}
+
+/*
+ * A repeated Content-Length must have the same value, else the request
+ * can't be framed reliably (RFC 9112 section 6.3) and is rejected.
+ */
+static int
+parse_content_length (http_request_t *req, const char *buf, http_str_t *s)
+{
+    uint64_t n = 0;
+    uint32_t i;
+
+    if (s->len == 0) {
+        return -1;
+    }
+    for (i = 0; i < s->len; i++) {
+        if (buf[s->off + i] < '0' || buf[s->off + i] > '9') {
+            return -1;
+        }
+        n = n * 10 + (buf[s->off + i] - '0');
+        if (n > HTTP_MAX_BODY_SIZE) {
+            return -1;
+        }
+    }
+    if (req->has_content_length && req->content_length != n) {
+        return -1;
+    }
+    req->content_length = n;
+    req->has_content_length = True;
+    return 0;
+}
+
+static int
+parse_header_line (http_request_t *req, const char *buf,
+                   uint32_t pos, uint32_t line_len)
+{
+    const char *line = buf + pos, *colon;
+    http_header_t *h;
+
+    if (req->header_cnt == HTTP_MAX_HEADERS) {
+        return -1;
+    }
+
+    colon = scan_find_colon(line, line_len);
+    if (colon == NULL || colon == line) {
+        return -1;
+    }
+
+    h = &req->headers[req->header_cnt++];
+    h->name.off = pos;
+    h->name.len = colon - line;
+    h->value.off = pos + (colon + 1 - line);
+    h->value.len = line_len - (colon + 1 - line);
+    trim_str(buf, &h->value);
+
+    if (header_name_is(buf, h, "Content-Length")) {
+        return parse_content_length(req, buf, &h->value);
+    } else if (header_name_is(buf, h, "Transfer-Encoding")) {
+        return -1; // chunked bodies are not supported
+    } else if (header_name_is(buf, h, "Connection")) {
+        if (header_value_is(buf, h, "close")) {
+            req->keep_alive = False;
+        } else if (header_value_is(buf, h, "keep-alive")) {
+            req->keep_alive = True;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Feed the parser with the whole buffered request so far, buf pointing to
+ * the first byte of the request. Scanning resumes where the previous call
+ * stopped, so a request arriving in many fragments is scanned once.
+ */
+int
+http_parser_execute (http_parser_t *parser, const char *buf, uint32_t len)
+{
+    http_request_t *req = &parser->req;
+    uint32_t next;
+    int line_len;
+
+    while (parser->state == HTTP_PARSER_REQUEST_LINE ||
+           parser->state == HTTP_PARSER_HEADERS) {
+        line_len = next_line(buf, parser->pos, len, &next);
+        if (line_len < 0) {
+            if (len > HTTP_MAX_HEADER_SIZE) {
+                return HTTP_PARSE_ERROR;
+            }
+            return HTTP_PARSE_AGAIN;
+        }
+
+        if (parser->state == HTTP_PARSER_REQUEST_LINE) {
+            if (parse_request_line(req, buf, parser->pos, line_len) != 0) {
+                return HTTP_PARSE_ERROR;
+            }
+            parser->state = HTTP_PARSER_HEADERS;
+        } else if (line_len == 0) {
+            req->header_len = next;
+            parser->state = HTTP_PARSER_BODY;
+        } else if (parse_header_line(req, buf, parser->pos, line_len) != 0) {
+            return HTTP_PARSE_ERROR;
+        }
+
+        parser->pos = next;
+        if (parser->pos > HTTP_MAX_HEADER_SIZE) {
+            return HTTP_PARSE_ERROR;
+        }
+    }
+
+    if (parser->state == HTTP_PARSER_BODY) {
+        if (len - req->header_len < req->content_length) {
+            return HTTP_PARSE_AGAIN;
+        }
+        req->body.off = req->header_len;
+        req->body.len = req->content_length;
+        req->len = req->header_len + req->content_length;
+        parser->pos = req->len;
+        parser->state = HTTP_PARSER_DONE;
+    }
+    return HTTP_PARSE_DONE;
+}
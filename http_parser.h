@@ -0,0 +1,77 @@
+#ifndef __HTTP_PARSER_H__
+#define __HTTP_PARSER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define HTTP_MAX_HEADERS 32
+#define HTTP_MAX_HEADER_SIZE 8192
+#define HTTP_MAX_BODY_SIZE (1024*1024)
+
+enum {
+    HTTP_PARSE_ERROR = -1,
+    HTTP_PARSE_AGAIN = 0,
+    HTTP_PARSE_DONE = 1,
+};
+
+enum {
+    HTTP_PARSER_REQUEST_LINE = 0,
+    HTTP_PARSER_HEADERS,
+    HTTP_PARSER_BODY,
+    HTTP_PARSER_DONE,
+};
+
+/*
+ * All strings are offsets into the caller's buffer, relative to the first
+ * byte of the request, so nothing is copied and they survive the buffer
+ * being compacted or grown between two calls.
+ */
+typedef struct http_str_s {
+    uint32_t off;
+    uint32_t len;
+} http_str_t;
+
+typedef struct http_header_s {
+    http_str_t name;
+    http_str_t value;
+} http_header_t;
+
+typedef struct http_request_s {
+    http_str_t method;
+    http_str_t path;
+    http_str_t version;
+    http_header_t headers[HTTP_MAX_HEADERS];
+    uint32_t header_cnt;
+    uint32_t header_len;
+    uint32_t content_length;
+    bool has_content_length;
+    http_str_t body;
+    uint32_t len;
+    bool keep_alive;
+} http_request_t;
+
+typedef struct http_parser_s {
+    int state;
+    uint32_t pos;
+    http_request_t req;
+} http_parser_t;
+
+void
+http_parser_init(http_parser_t *parser);
+
+int
+http_parser_execute(http_parser_t *parser, const char *buf, uint32_t len);
+
+static inline const char *
+http_str_ptr (const char *buf, http_str_t *s)
+{
+    return buf + s->off;
+}
+
+static inline bool
+http_str_eq (const char *buf, http_str_t *s, const char *lit)
+{
+    return s->len == strlen(lit) && memcmp(buf + s->off, lit, s->len) == 0;
+}
+#endif //__HTTP_PARSER_H__
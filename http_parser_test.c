@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <string.h>
+#include "http_parser.h"
+
+static const char *
+request = "POST /graph/ HTTP/1.1\r\n"
+          "Content-length: 30\r\n"
+          "Host: 127.0.0.1:9999\r\n"
+          "Content-type: application/json\r\n"
+          "\r\n"
+          "{\"txn_id\": \"txn_1500000000_1\"}";
+
+static void
+dump_request (http_request_t *req, const char *buf)
+{
+    uint32_t i;
+
+    printf("%.*s %.*s %.*s, keep-alive %d\n",
+           (int)req->method.len, http_str_ptr(buf, &req->method),
+           (int)req->path.len, http_str_ptr(buf, &req->path),
+           (int)req->version.len, http_str_ptr(buf, &req->version),
+           req->keep_alive);
+    for (i = 0; i < req->header_cnt; i++) {
+        printf("  [%.*s] = [%.*s]\n",
+               (int)req->headers[i].name.len,
+               http_str_ptr(buf, &req->headers[i].name),
+               (int)req->headers[i].value.len,
+               http_str_ptr(buf, &req->headers[i].value));
+    }
+    printf("  body [%.*s], len %u\n",
+           (int)req->body.len, http_str_ptr(buf, &req->body), req->len);
+}
+
+static int
+test_fragmented (void)
+{
+    http_parser_t parser;
+    uint32_t len = strlen(request), i;
+    int rc = HTTP_PARSE_AGAIN;
+
+    printf("Fragmented:\n");
+    http_parser_init(&parser);
+    for (i = 1; i <= len; i++) {
+        rc = http_parser_execute(&parser, request, i);
+        if (rc != HTTP_PARSE_AGAIN) {
+            break;
+        }
+    }
+    if (rc != HTTP_PARSE_DONE || i != len) {
+        printf("FAIL: rc %d after %u of %u bytes\n", rc, i, len);
+        return -1;
+    }
+    dump_request(&parser.req, request);
+    return 0;
+}
+
+static int
+test_pipelined (void)
+{
+    char buf[1024];
+    http_parser_t parser;
+    uint32_t off = 0, len, cnt = 0;
+    int rc;
+
+    printf("Pipelined:\n");
+    len = snprintf(buf, sizeof(buf), "%s%s%s", request, request, request);
+    http_parser_init(&parser);
+    while (off < len) {
+        rc = http_parser_execute(&parser, buf + off, len - off);
+        if (rc != HTTP_PARSE_DONE) {
+            printf("FAIL: rc %d at offset %u\n", rc, off);
+            return -1;
+        }
+        off += parser.req.len;
+        cnt++;
+        http_parser_init(&parser);
+    }
+    printf("  %u requests\n", cnt);
+    return cnt == 3 ? 0 : -1;
+}
+
+static int
+test_bad_request (void)
+{
+    const char *bad[] = {
+        "GARBAGE\r\n\r\n",
+        "GET / HTTP/2.0\r\n\r\n",
+        "GET / HTTP/1.1\r\nNoColon\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: abc\r\n\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: 5\r\n"
+        "Content-Length: 50\r\n\r\nhello",
+    };
+    http_parser_t parser;
+    uint32_t i;
+    int rc;
+
+    printf("Bad requests:\n");
+    for (i = 0; i < sizeof(bad)/sizeof(bad[0]); i++) {
+        http_parser_init(&parser);
+        rc = http_parser_execute(&parser, bad[i], strlen(bad[i]));
+        printf("  #%u rc %d\n", i, rc);
+        if (rc != HTTP_PARSE_ERROR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// the same length given twice still frames the request
+static int
+test_repeated_length (void)
+{
+    const char *req = "POST / HTTP/1.1\r\nContent-Length: 5\r\n"
+                      "content-length: 5\r\n\r\nhello";
+    http_parser_t parser;
+    int rc;
+
+    printf("Repeated Content-Length:\n");
+    http_parser_init(&parser);
+    rc = http_parser_execute(&parser, req, strlen(req));
+    if (rc != HTTP_PARSE_DONE || parser.req.body.len != 5) {
+        printf("FAIL: rc %d\n", rc);
+        return -1;
+    }
+    printf("  body len %u\n", parser.req.body.len);
+    return 0;
+}
+
+int main (void)
+{
+    int rc = 0;
+
+    rc |= test_fragmented();
+    rc |= test_pipelined();
+    rc |= test_bad_request();
+    rc |= test_repeated_length();
+    printf("%s\n", rc == 0 ? "PASS" : "FAIL");
+    return rc;
+}
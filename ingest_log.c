@@ -0,0 +1,626 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "ingest_log.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define INGEST_LOG_X86
+#endif
+
+#define INGEST_LOG_CRC_POLY 0x82f63b78 // CRC-32C, reflected
+#define INGEST_LOG_NAME_PREFIX "ingest-"
+#define INGEST_LOG_NAME_SUFFIX ".log"
+
+static uint32_t crc_table[256];
+static bool crc_hw;
+
+static uint32_t
+crc_sw (uint32_t crc, const uint8_t *p, uint32_t len)
+{
+    for (; len > 0; p++, len--) {
+        crc = crc_table[(crc ^ *p) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef INGEST_LOG_X86
+__attribute__((target("sse4.2")))
+static uint32_t
+crc_hw_sse42 (uint32_t crc, const uint8_t *p, uint32_t len)
+{
+    uint64_t c = crc, v;
+
+    for (; len >= 8; p += 8, len -= 8) {
+        memcpy(&v, p, sizeof(v));
+        c = _mm_crc32_u64(c, v);
+    }
+    crc = (uint32_t)c;
+    for (; len > 0; p++, len--) {
+        crc = _mm_crc32_u8(crc, *p);
+    }
+    return crc;
+}
+#endif
+
+__attribute__((constructor))
+static void
+ingest_log_crc_init (void)
+{
+    uint32_t i, k, c;
+
+    for (i = 0; i < 256; i++) {
+        c = i;
+        for (k = 0; k < 8; k++) {
+            c = (c & 1) ? (c >> 1) ^ INGEST_LOG_CRC_POLY : c >> 1;
+        }
+        crc_table[i] = c;
+    }
+#ifdef INGEST_LOG_X86
+    __builtin_cpu_init();
+    crc_hw = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+uint32_t
+ingest_log_crc (const void *data, uint32_t len)
+{
+#ifdef INGEST_LOG_X86
+    if (crc_hw) {
+        return ~crc_hw_sse42(~0U, data, len);
+    }
+#endif
+    return ~crc_sw(~0U, data, len);
+}
+
+static int
+ingest_log_is_segment (const struct dirent *d)
+{
+    return strlen(d->d_name) == INGEST_LOG_NAME_LEN &&
+           strncmp(d->d_name, INGEST_LOG_NAME_PREFIX,
+                   strlen(INGEST_LOG_NAME_PREFIX)) == 0 &&
+           strcmp(d->d_name + INGEST_LOG_NAME_LEN -
+                  strlen(INGEST_LOG_NAME_SUFFIX),
+                  INGEST_LOG_NAME_SUFFIX) == 0;
+}
+
+static int
+ingest_log_write (ingest_log_t *log, const char *data, uint32_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        n = pwrite(log->fd, data, len, log->seg_off);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            logger(ERROR, "Fail to write ingest log, %d.", errno);
+            return -1;
+        }
+        data += n;
+        len -= n;
+        log->seg_off += n;
+    }
+    return 0;
+}
+
+static int
+ingest_log_sync (ingest_log_t *log)
+{
+    if (fdatasync(log->fd) != 0) {
+        logger(ERROR, "Fail to sync ingest log, %d.", errno);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Create the segment starting at first_seq with all its blocks allocated,
+ * so appends don't allocate and fdatasync doesn't have to write metadata
+ * for them. The directory is synced for the new name to survive a crash.
+ */
+static int
+ingest_log_open_segment (ingest_log_t *log, uint64_t first_seq)
+{
+    char name[INGEST_LOG_NAME_LEN+1];
+    int fd, rc;
+
+    snprintf(name, sizeof(name), INGEST_LOG_NAME_FMT,
+             (unsigned long)first_seq);
+    fd = openat(log->dir_fd, name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                0644);
+    if (fd == -1) {
+        logger(ERROR, "Fail to create ingest log segment %s, %d.",
+               name, errno);
+        return -1;
+    }
+    rc = posix_fallocate(fd, 0, log->conf.segment_size);
+    if (rc != 0) {
+        logger(ERROR, "Fail to preallocate ingest log segment %s, %d.",
+               name, rc);
+        close(fd);
+        unlinkat(log->dir_fd, name, 0);
+        return -1;
+    }
+    if (fsync(log->dir_fd) != 0) {
+        logger(ERROR, "Fail to sync ingest log directory, %d.", errno);
+        close(fd);
+        return -1;
+    }
+
+    if (log->fd != -1) {
+        close(log->fd);
+    }
+    log->fd = fd;
+    log->seg_off = 0;
+    pthread_mutex_lock(&log->lock);
+    log->stats.segments++;
+    pthread_mutex_unlock(&log->lock);
+    return 0;
+}
+
+/*
+ * Replay the records of a segment from its start while each is the next
+ * one expected, whole and matching its CRC. What comes after is the zero
+ * fill, or a batch torn by a crash which was never acknowledged. Return
+ * the end of the last valid record in end.
+ */
+static int
+ingest_log_scan_segment (int fd, uint64_t *seq, uint64_t *end,
+                         ingest_replay_t replay, void *arg)
+{
+    const ingest_rec_t *rec;
+    const char *buf;
+    struct stat st;
+    uint64_t off = 0;
+
+    *end = 0;
+    if (fstat(fd, &st) != 0) {
+        return -1;
+    }
+    if (st.st_size == 0) {
+        return 0;
+    }
+    buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (buf == MAP_FAILED) {
+        return -1;
+    }
+
+    while (off + sizeof(ingest_rec_t) <= (uint64_t)st.st_size) {
+        rec = (const ingest_rec_t *)(buf + off);
+        if (rec->magic != INGEST_LOG_MAGIC || rec->seq != *seq ||
+            rec->len > st.st_size - off - sizeof(ingest_rec_t) ||
+            ingest_log_crc(rec + 1, rec->len) != rec->crc) {
+            break;
+        }
+        if (replay != NULL) {
+            replay(rec->seq, (const char *)(rec + 1), rec->len, arg);
+        }
+        (*seq)++;
+        off += ingest_rec_size(rec->len);
+    }
+
+    munmap((void *)buf, st.st_size);
+    *end = MIN(off, (uint64_t)st.st_size);
+    return 0;
+}
+
+/*
+ * Scan every segment in order and go on appending after the last valid
+ * record. Segments have to follow each other without a gap, a missing
+ * one is left for the operator rather than silently skipped. The tail of
+ * the last segment is cut and allocated again as zeros, so a torn batch
+ * can't be taken for records later.
+ */
+static int
+ingest_log_recover (ingest_log_t *log, ingest_replay_t replay, void *arg)
+{
+    struct dirent **names;
+    uint64_t first, seq = 1, end = 0;
+    int i, cnt, fd, rc = 0;
+
+    cnt = scandir(log->dir, &names, ingest_log_is_segment, alphasort);
+    if (cnt < 0) {
+        logger(ERROR, "Fail to list ingest log directory %s.", log->dir);
+        return -1;
+    }
+
+    for (i = 0; i < cnt && rc == 0; i++) {
+        first = strtoull(names[i]->d_name + strlen(INGEST_LOG_NAME_PREFIX),
+                         NULL, 16);
+        if (first != seq) {
+            logger(ERROR, "Ingest log segment %s doesn't follow record %lu.",
+                   names[i]->d_name, (unsigned long)(seq - 1));
+            rc = -1;
+            break;
+        }
+        fd = openat(log->dir_fd, names[i]->d_name, O_RDWR | O_CLOEXEC);
+        if (fd == -1) {
+            logger(ERROR, "Fail to open ingest log segment %s.",
+                   names[i]->d_name);
+            rc = -1;
+            break;
+        }
+        rc = ingest_log_scan_segment(fd, &seq, &end, replay, arg);
+        if (log->fd != -1) {
+            close(log->fd);
+        }
+        log->fd = fd;
+        log->stats.segments++;
+    }
+    for (i = 0; i < cnt; i++) {
+        free(names[i]);
+    }
+    free(names);
+    if (rc != 0) {
+        return -1;
+    }
+
+    log->next_seq = seq;
+    log->durable_seq = seq - 1;
+    log->stats.recovered = seq - 1;
+    log->stats.durable_seq = seq - 1;
+    if (log->fd == -1) {
+        return ingest_log_open_segment(log, seq);
+    }
+
+    if (ftruncate(log->fd, end) != 0 ||
+        posix_fallocate(log->fd, 0, MAX(end, log->conf.segment_size)) != 0 ||
+        fdatasync(log->fd) != 0) {
+        logger(ERROR, "Fail to reset the tail of the ingest log.");
+        return -1;
+    }
+    log->seg_off = end;
+    return 0;
+}
+
+/*
+ * Write a batch of whole records, a record which doesn't fit in the rest
+ * of the current segment starts the next one. The segment left is synced
+ * before it is closed, the last one once the batch is written.
+ */
+static int
+ingest_log_write_batch (ingest_log_t *log, iobuf_t *batch)
+{
+    const char *start = iobuf_head(batch), *p = start;
+    const char *end = start + iobuf_len(batch);
+    const ingest_rec_t *rec;
+    uint64_t off = log->seg_off;
+    uint32_t rec_len;
+
+    while (p < end) {
+        rec = (const ingest_rec_t *)p;
+        rec_len = ingest_rec_size(rec->len);
+        if (off > 0 && off + rec_len > log->conf.segment_size) {
+            if (ingest_log_write(log, start, p - start) != 0 ||
+                ingest_log_sync(log) != 0 ||
+                ingest_log_open_segment(log, rec->seq) != 0) {
+                return -1;
+            }
+            start = p;
+            off = 0;
+        }
+        off += rec_len;
+        p += rec_len;
+    }
+
+    if (ingest_log_write(log, start, p - start) != 0) {
+        return -1;
+    }
+    return ingest_log_sync(log);
+}
+
+static void
+ingest_log_wait_batch (ingest_log_t *log, iobuf_t *buf)
+{
+    struct timespec ts;
+    uint64_t deadline;
+
+    deadline = log->first_ns + (uint64_t)log->conf.batch_wait_us * 1000;
+    while (!log->stop && iobuf_len(buf) < log->conf.batch_bytes &&
+           monotonic_ns() < deadline) {
+        ts.tv_sec = deadline / 1000000000;
+        ts.tv_nsec = deadline % 1000000000;
+        pthread_cond_timedwait(&log->cond, &log->lock, &ts);
+    }
+}
+
+/*
+ * Take the active buffer once it holds batch_bytes or its first record
+ * waited batch_wait_us, appenders go on into the other one meanwhile.
+ * Once the batch is durable, or failed to be, the waiters it covers are
+ * called outside the lock. A failed log rejects every record after.
+ */
+static void *
+ingest_log_flush_thread (void *args)
+{
+    ingest_log_t *log = (ingest_log_t *)args;
+    ingest_waiter_t *ready, *waiter, **pp;
+    uint64_t last_seq, start, elapsed;
+    uint32_t len;
+    iobuf_t *batch;
+    int rc;
+
+    pthread_mutex_lock(&log->lock);
+    for (;;) {
+        batch = &log->bufs[log->active];
+        while (iobuf_is_empty(batch) && !log->stop) {
+            pthread_cond_wait(&log->cond, &log->lock);
+        }
+        if (iobuf_is_empty(batch)) {
+            break;
+        }
+        ingest_log_wait_batch(log, batch);
+        log->active ^= 1;
+        last_seq = log->next_seq - 1;
+        pthread_mutex_unlock(&log->lock);
+
+        start = monotonic_ns();
+        rc = log->failed ? -1 : ingest_log_write_batch(log, batch);
+        elapsed = monotonic_ns() - start;
+        len = iobuf_len(batch);
+        iobuf_consume(batch, len);
+
+        ready = NULL;
+        pthread_mutex_lock(&log->lock);
+        if (rc == 0) {
+            log->durable_seq = last_seq;
+            log->stats.durable_seq = last_seq;
+            log->stats.batches++;
+            log->stats.bytes += len;
+            log->stats.sync_ns += elapsed;
+        } else if (!log->failed) {
+            logger(ERROR, "Ingest log failed at record %lu.",
+                   (unsigned long)(log->durable_seq + 1));
+            log->failed = True;
+            log->stats.failed = True;
+        }
+        pp = &log->waiters;
+        while ((waiter = *pp) != NULL) {
+            if (waiter->seq <= log->durable_seq || log->failed) {
+                *pp = waiter->next;
+                waiter->next = ready;
+                ready = waiter;
+            } else {
+                pp = &waiter->next;
+            }
+        }
+        pthread_mutex_unlock(&log->lock);
+
+        while ((waiter = ready) != NULL) {
+            // done may hand the waiter to a thread which waits again
+            ready = waiter->next;
+            waiter->done(waiter);
+        }
+        pthread_mutex_lock(&log->lock);
+    }
+    pthread_mutex_unlock(&log->lock);
+    return NULL;
+}
+
+static void
+ingest_log_release (ingest_log_t *log)
+{
+    if (log->fd != -1) {
+        close(log->fd);
+        log->fd = -1;
+    }
+    if (log->dir_fd != -1) {
+        close(log->dir_fd);
+        log->dir_fd = -1;
+    }
+    iobuf_clean(&log->bufs[0]);
+    iobuf_clean(&log->bufs[1]);
+    pthread_cond_destroy(&log->cond);
+    pthread_mutex_destroy(&log->lock);
+}
+
+/*
+ * Open the log in conf->dir, created if missing, replaying the records
+ * it already holds, then start the flusher. 0 in conf takes the default.
+ */
+int
+ingest_log_init (ingest_log_t *log, const ingest_log_conf_t *conf,
+                 ingest_replay_t replay, void *arg)
+{
+    pthread_condattr_t attr;
+    int rc;
+
+    memzero(log, sizeof(ingest_log_t));
+    log->conf = *conf;
+    if (log->conf.segment_size == 0) {
+        log->conf.segment_size = INGEST_LOG_SEGMENT_SIZE;
+    }
+    if (log->conf.batch_bytes == 0) {
+        log->conf.batch_bytes = INGEST_LOG_BATCH_BYTES;
+    }
+    strncpy(log->dir, conf->dir, PATH_MAX - 1);
+    log->conf.dir = log->dir;
+    log->fd = -1;
+    log->dir_fd = -1;
+
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&log->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (iobuf_init(&log->bufs[0], INGEST_LOG_BUF_SIZE) != 0 ||
+        iobuf_init(&log->bufs[1], INGEST_LOG_BUF_SIZE) != 0) {
+        ingest_log_release(log);
+        return -1;
+    }
+
+    if (mkdir(log->dir, 0755) != 0 && errno != EEXIST) {
+        logger(ERROR, "Fail to create ingest log directory %s.", log->dir);
+        ingest_log_release(log);
+        return -1;
+    }
+    log->dir_fd = open(log->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (log->dir_fd == -1) {
+        logger(ERROR, "Fail to open ingest log directory %s.", log->dir);
+        ingest_log_release(log);
+        return -1;
+    }
+
+    rc = ingest_log_recover(log, replay, arg);
+    if (rc != 0) {
+        ingest_log_release(log);
+        return -1;
+    }
+
+    rc = pthread_create(&log->thread_id, NULL, ingest_log_flush_thread, log);
+    if (rc != 0) {
+        logger(ERROR, "Fail to create ingest log flush thread.");
+        ingest_log_release(log);
+        return -1;
+    }
+    log->running = True;
+    return 0;
+}
+
+/*
+ * Stop appends, let the flusher commit what is left, then close.
+ */
+void
+ingest_log_clean (ingest_log_t *log)
+{
+    if (!log->running) {
+        return;
+    }
+    pthread_mutex_lock(&log->lock);
+    log->stop = True;
+    pthread_cond_signal(&log->cond);
+    pthread_mutex_unlock(&log->lock);
+    pthread_join(log->thread_id, NULL);
+    log->running = False;
+    ingest_log_release(log);
+}
+
+/*
+ * Copy a record into the active buffer and return its sequence number in
+ * seq. It is durable once ingest_log_wait says so. Fails when the record
+ * can't fit in a segment, the flusher is INGEST_LOG_PENDING_MAX_LEN
+ * behind, or the log failed.
+ */
+int
+ingest_log_append (ingest_log_t *log, const void *data, uint32_t len,
+                   uint64_t *seq)
+{
+    uint32_t rec_len = ingest_rec_size(len), crc, used;
+    ingest_rec_t *rec;
+    iobuf_t *buf;
+
+    if (rec_len < len || rec_len > log->conf.segment_size) {
+        logger(ERROR, "Ingest record of %u bytes is too large.", len);
+        return -1;
+    }
+    crc = ingest_log_crc(data, len);
+
+    pthread_mutex_lock(&log->lock);
+    buf = &log->bufs[log->active];
+    used = iobuf_len(buf);
+    if (log->failed || log->stop ||
+        used + rec_len > INGEST_LOG_PENDING_MAX_LEN ||
+        iobuf_reserve(buf, rec_len) != 0) {
+        log->stats.rejected++;
+        pthread_mutex_unlock(&log->lock);
+        return -1;
+    }
+
+    rec = (ingest_rec_t *)iobuf_tail(buf);
+    rec->magic = INGEST_LOG_MAGIC;
+    rec->len = len;
+    rec->crc = crc;
+    rec->pad = 0;
+    rec->seq = log->next_seq++;
+    memcpy(rec + 1, data, len);
+    memzero((char *)(rec + 1) + len, rec_len - sizeof(ingest_rec_t) - len);
+    iobuf_produce(buf, rec_len);
+    *seq = rec->seq;
+    log->stats.appended++;
+
+    if (used == 0) {
+        log->first_ns = monotonic_ns();
+        pthread_cond_signal(&log->cond);
+    } else if (used < log->conf.batch_bytes &&
+               used + rec_len >= log->conf.batch_bytes) {
+        pthread_cond_signal(&log->cond);
+    }
+    pthread_mutex_unlock(&log->lock);
+    return 0;
+}
+
+/*
+ * Sequence number of the last record appended, 0 if there is none.
+ */
+uint64_t
+ingest_log_last_seq (ingest_log_t *log)
+{
+    uint64_t seq;
+
+    pthread_mutex_lock(&log->lock);
+    seq = log->next_seq - 1;
+    pthread_mutex_unlock(&log->lock);
+    return seq;
+}
+
+// called with the lock held
+static int
+ingest_log_status (ingest_log_t *log, uint64_t seq)
+{
+    if (seq <= log->durable_seq) {
+        return INGEST_LOG_DURABLE;
+    }
+    return log->failed ? -1 : INGEST_LOG_PENDING;
+}
+
+/*
+ * INGEST_LOG_DURABLE if seq is on disk, -1 if the log failed before it
+ * was, INGEST_LOG_PENDING otherwise.
+ */
+int
+ingest_log_check (ingest_log_t *log, uint64_t seq)
+{
+    int rc;
+
+    pthread_mutex_lock(&log->lock);
+    rc = ingest_log_status(log, seq);
+    pthread_mutex_unlock(&log->lock);
+    return rc;
+}
+
+/*
+ * As ingest_log_check, but a pending waiter is queued: waiter->done is
+ * called once the batch of waiter->seq is committed or failed, and may
+ * run before this returns.
+ */
+int
+ingest_log_wait (ingest_log_t *log, ingest_waiter_t *waiter)
+{
+    int rc;
+
+    pthread_mutex_lock(&log->lock);
+    rc = ingest_log_status(log, waiter->seq);
+    if (rc == INGEST_LOG_PENDING) {
+        waiter->next = log->waiters;
+        log->waiters = waiter;
+    }
+    pthread_mutex_unlock(&log->lock);
+    return rc;
+}
+
+void
+ingest_log_get_stats (ingest_log_t *log, ingest_log_stats_t *stats)
+{
+    pthread_mutex_lock(&log->lock);
+    *stats = log->stats;
+    pthread_mutex_unlock(&log->lock);
+}
@@ -0,0 +1,138 @@
+#ifndef __INGEST_LOG_H__
+#define __INGEST_LOG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
+#include "iobuf.h"
+
+#define INGEST_LOG_SEGMENT_SIZE (64*1024*1024)
+#define INGEST_LOG_BATCH_BYTES (256*1024)
+// records arriving during a sync already make up the next batch
+#define INGEST_LOG_BATCH_WAIT_US 0
+// appends fail once this much is waiting for the flusher
+#define INGEST_LOG_PENDING_MAX_LEN (64*1024*1024)
+#define INGEST_LOG_BUF_SIZE (64*1024)
+#define INGEST_LOG_MAGIC 0x474f4c49 // "ILOG"
+#define INGEST_LOG_NAME_FMT "ingest-%016lx.log"
+#define INGEST_LOG_NAME_LEN 27
+
+enum {
+    INGEST_LOG_DURABLE = 0,
+    INGEST_LOG_PENDING,
+};
+
+/*
+ * Header of every record, followed by len bytes of payload and padded to
+ * a multiple of 8. Records never span segments, the rest of a segment
+ * after its last record is zero. Sequence numbers start at 1 and go on
+ * from one segment to the next, a segment is named after its first one.
+ */
+typedef struct ingest_rec_s {
+    uint32_t magic;
+    uint32_t len;
+    uint32_t crc;  // CRC-32C of the payload
+    uint32_t pad;
+    uint64_t seq;
+} ingest_rec_t;
+
+static inline uint32_t
+ingest_rec_size (uint32_t len)
+{
+    return (sizeof(ingest_rec_t) + len + 7) & ~7U;
+}
+
+/*
+ * Waits for seq to be durable. done is called once from the flusher
+ * thread when it is, or when the log failed, ingest_log_check then tells
+ * which.
+ */
+typedef struct ingest_waiter_s {
+    uint64_t seq;
+    void (*done)(struct ingest_waiter_s *waiter);
+    struct ingest_waiter_s *next;
+} ingest_waiter_t;
+
+// called on every record found by the recovery scan, in order
+typedef void (*ingest_replay_t)(uint64_t seq, const char *data,
+                                uint32_t len, void *arg);
+
+/*
+ * batch_bytes: the flusher commits as soon as this much is appended.
+ * batch_wait_us: how long the first record of a batch waits for others
+ *                to join it, 0 to commit whatever is there right away.
+ */
+typedef struct ingest_log_conf_s {
+    const char *dir;
+    uint64_t segment_size;
+    uint32_t batch_bytes;
+    uint32_t batch_wait_us;
+} ingest_log_conf_t;
+
+typedef struct ingest_log_stats_s {
+    uint64_t appended;
+    uint64_t durable_seq;
+    uint64_t batches;
+    uint64_t bytes;
+    uint64_t sync_ns; // total time in write and fdatasync
+    uint64_t segments;
+    uint64_t recovered;
+    uint64_t rejected;
+    bool failed;
+} ingest_log_stats_t;
+
+/*
+ * Append-only log of segment files preallocated in dir. Appenders copy
+ * their record into the active buffer under the lock, the flusher thread
+ * swaps buffers and writes the whole batch with one fdatasync, so the
+ * sync cost is shared by every record that came in meanwhile.
+ */
+typedef struct ingest_log_s {
+    ingest_log_conf_t conf;
+    char dir[PATH_MAX];
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    iobuf_t bufs[2];
+    int active;
+    uint64_t first_ns;    // first append into the active buffer
+    uint64_t next_seq;
+    uint64_t durable_seq;
+    ingest_waiter_t *waiters;
+    bool failed;
+    bool stop;
+    ingest_log_stats_t stats;
+    // flusher thread only
+    int dir_fd;
+    int fd;
+    uint64_t seg_off;
+    pthread_t thread_id;
+    bool running;
+} ingest_log_t;
+
+int
+ingest_log_init(ingest_log_t *log, const ingest_log_conf_t *conf,
+                ingest_replay_t replay, void *arg);
+
+void
+ingest_log_clean(ingest_log_t *log);
+
+int
+ingest_log_append(ingest_log_t *log, const void *data, uint32_t len,
+                  uint64_t *seq);
+
+uint64_t
+ingest_log_last_seq(ingest_log_t *log);
+
+int
+ingest_log_check(ingest_log_t *log, uint64_t seq);
+
+int
+ingest_log_wait(ingest_log_t *log, ingest_waiter_t *waiter);
+
+void
+ingest_log_get_stats(ingest_log_t *log, ingest_log_stats_t *stats);
+
+uint32_t
+ingest_log_crc(const void *data, uint32_t len);
+#endif //__INGEST_LOG_H__
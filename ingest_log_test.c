@@ -0,0 +1,430 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "ingest_log.h"
+
+#define TEST_THREAD_CNT 4
+#define TEST_RECS_PER_THREAD 2000
+#define TEST_SEGMENT_SIZE (64*1024)
+#define TEST_REC_MAX_LEN 600
+#define BENCH_RECS_PER_THREAD 2000
+#define BENCH_REC_LEN 256
+#define BENCH_WAIT_US 200
+
+static char test_dir[] = "/tmp/ingest_log_test.XXXXXX";
+
+/*
+ * A thread blocks until its record is durable, as a client waiting for
+ * the acknowledgement would.
+ */
+typedef struct sync_waiter_s {
+    ingest_waiter_t waiter;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool done;
+} sync_waiter_t;
+
+static void
+sync_waiter_done (ingest_waiter_t *waiter)
+{
+    sync_waiter_t *w = (sync_waiter_t *)waiter;
+
+    pthread_mutex_lock(&w->lock);
+    w->done = True;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+static int
+append_and_wait (ingest_log_t *log, sync_waiter_t *w, const char *data,
+                 uint32_t len)
+{
+    int rc;
+
+    if (ingest_log_append(log, data, len, &w->waiter.seq) != 0) {
+        return -1;
+    }
+    w->done = False;
+    rc = ingest_log_wait(log, &w->waiter);
+    if (rc != INGEST_LOG_PENDING) {
+        return rc;
+    }
+    pthread_mutex_lock(&w->lock);
+    while (!w->done) {
+        pthread_cond_wait(&w->cond, &w->lock);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return ingest_log_check(log, w->waiter.seq);
+}
+
+// length and content follow from the thread and the index
+static uint32_t
+fill_record (char *buf, uint32_t id, uint32_t i)
+{
+    uint32_t len = 16 + (i * 37 + id * 101) % (TEST_REC_MAX_LEN - 16), k;
+
+    for (k = 0; k < len; k++) {
+        buf[k] = 'a' + (id + i + k) % 26;
+    }
+    memcpy(buf, &id, sizeof(id));
+    memcpy(buf + 4, &i, sizeof(i));
+    return len;
+}
+
+typedef struct test_arg_s {
+    ingest_log_t *log;
+    uint32_t id;
+    uint32_t cnt;
+    uint32_t len; // fixed record length, 0 for fill_record
+    int rc;
+} test_arg_t;
+
+static void *
+append_thread (void *args)
+{
+    test_arg_t *arg = args;
+    char buf[TEST_REC_MAX_LEN];
+    sync_waiter_t w;
+    uint32_t i, len;
+
+    memzero(&w, sizeof(w));
+    w.waiter.done = sync_waiter_done;
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.cond, NULL);
+    memset(buf, 'x', sizeof(buf));
+    for (i = 0; i < arg->cnt && arg->rc == 0; i++) {
+        len = arg->len ? arg->len : fill_record(buf, arg->id, i);
+        if (append_and_wait(arg->log, &w, buf, len) != INGEST_LOG_DURABLE) {
+            arg->rc = -1;
+        }
+    }
+    // the flusher may still hold the lock right after the last signal
+    pthread_mutex_lock(&w.lock);
+    pthread_mutex_unlock(&w.lock);
+    pthread_cond_destroy(&w.cond);
+    pthread_mutex_destroy(&w.lock);
+    return NULL;
+}
+
+static int
+run_appenders (ingest_log_t *log, int thread_cnt, uint32_t cnt,
+               uint32_t len)
+{
+    test_arg_t args[TEST_THREAD_CNT];
+    pthread_t threads[TEST_THREAD_CNT];
+    int i, rc = 0;
+
+    for (i = 0; i < thread_cnt; i++) {
+        args[i].log = log;
+        args[i].id = i;
+        args[i].cnt = cnt;
+        args[i].len = len;
+        args[i].rc = 0;
+        pthread_create(&threads[i], NULL, append_thread, &args[i]);
+    }
+    for (i = 0; i < thread_cnt; i++) {
+        pthread_join(threads[i], NULL);
+        rc |= args[i].rc;
+    }
+    return rc;
+}
+
+/*
+ * Every record of a thread comes back in its order, intact.
+ */
+typedef struct replay_state_s {
+    uint32_t next[TEST_THREAD_CNT];
+    uint64_t cnt;
+    uint64_t last_seq;
+    bool bad;
+} replay_state_t;
+
+static void
+check_record (uint64_t seq, const char *data, uint32_t len, void *arg)
+{
+    replay_state_t *state = arg;
+    char buf[TEST_REC_MAX_LEN];
+    uint32_t id, i;
+
+    state->cnt++;
+    if (seq != state->last_seq + 1 || len < 8) {
+        state->bad = True;
+        return;
+    }
+    state->last_seq = seq;
+    memcpy(&id, data, sizeof(id));
+    memcpy(&i, data + 4, sizeof(i));
+    if (id >= TEST_THREAD_CNT || i != state->next[id] ||
+        fill_record(buf, id, i) != len || memcmp(buf, data, len) != 0) {
+        state->bad = True;
+        return;
+    }
+    state->next[id]++;
+}
+
+static int
+open_log (ingest_log_t *log, replay_state_t *state)
+{
+    ingest_log_conf_t conf = { test_dir, TEST_SEGMENT_SIZE, 0, 0 };
+
+    memzero(state, sizeof(replay_state_t));
+    return ingest_log_init(log, &conf, check_record, state);
+}
+
+static int
+test_append_replay (void)
+{
+    ingest_log_stats_t stats;
+    replay_state_t state;
+    ingest_log_t log;
+
+    if (open_log(&log, &state) != 0) {
+        printf("FAIL: open %s\n", test_dir);
+        return -1;
+    }
+    if (run_appenders(&log, TEST_THREAD_CNT, TEST_RECS_PER_THREAD, 0) != 0) {
+        printf("FAIL: append\n");
+        ingest_log_clean(&log);
+        return -1;
+    }
+    ingest_log_get_stats(&log, &stats);
+    ingest_log_clean(&log);
+
+    if (open_log(&log, &state) != 0) {
+        printf("FAIL: reopen %s\n", test_dir);
+        return -1;
+    }
+    ingest_log_clean(&log);
+    if (state.bad || state.cnt != TEST_THREAD_CNT * TEST_RECS_PER_THREAD) {
+        printf("FAIL: replayed %lu of %u records%s\n",
+               (unsigned long)state.cnt, TEST_THREAD_CNT * TEST_RECS_PER_THREAD,
+               state.bad ? ", some out of order or corrupted" : "");
+        return -1;
+    }
+    if (stats.segments < 2) {
+        printf("FAIL: no rotation in %lu bytes\n", (unsigned long)stats.bytes);
+        return -1;
+    }
+    printf("append/replay: %lu records, %lu batches, %lu segments\n",
+           (unsigned long)state.cnt, (unsigned long)stats.batches,
+           (unsigned long)stats.segments);
+    return 0;
+}
+
+static int
+last_segment (char *path, size_t size)
+{
+    struct dirent **names;
+    int i, cnt;
+
+    cnt = scandir(test_dir, &names, NULL, alphasort);
+    if (cnt <= 0) {
+        return -1;
+    }
+    snprintf(path, size, "%s/%s", test_dir, names[cnt - 1]->d_name);
+    for (i = 0; i < cnt; i++) {
+        free(names[i]);
+    }
+    free(names);
+    return 0;
+}
+
+/*
+ * Write a record header whose payload never made it right after the last
+ * record of the last segment, as a crash in the middle of a batch leaves.
+ */
+static int
+tear_tail (uint64_t seq)
+{
+    ingest_rec_t rec = { INGEST_LOG_MAGIC, 100, 1, 0, seq };
+    ingest_rec_t *p;
+    char path[PATH_MAX];
+    uint64_t off = 0;
+    char *data;
+    int fd, rc = -1;
+    ssize_t n;
+
+    if (last_segment(path, sizeof(path)) != 0) {
+        return -1;
+    }
+    fd = open(path, O_RDWR);
+    if (fd == -1) {
+        return -1;
+    }
+    data = malloc(TEST_SEGMENT_SIZE);
+    n = data ? pread(fd, data, TEST_SEGMENT_SIZE, 0) : -1;
+    if (n > 0) {
+        p = (ingest_rec_t *)data;
+        while (off + sizeof(ingest_rec_t) <= (uint64_t)n &&
+               p->magic == INGEST_LOG_MAGIC) {
+            off += ingest_rec_size(p->len);
+            p = (ingest_rec_t *)(data + off);
+        }
+        if (pwrite(fd, &rec, sizeof(rec), off) == sizeof(rec)) {
+            rc = 0;
+        }
+    }
+    free(data);
+    close(fd);
+    return rc;
+}
+
+/*
+ * The torn record is dropped on recovery and appends go on where it
+ * started.
+ */
+static int
+test_torn_tail (void)
+{
+    ingest_log_stats_t stats;
+    replay_state_t state;
+    ingest_log_t log;
+    char buf[TEST_REC_MAX_LEN];
+    sync_waiter_t w;
+    uint64_t before;
+    uint32_t len;
+    int rc;
+
+    if (open_log(&log, &state) != 0) {
+        return -1;
+    }
+    ingest_log_clean(&log);
+    before = state.cnt;
+    if (tear_tail(before + 1) != 0) {
+        printf("FAIL: tear the last segment\n");
+        return -1;
+    }
+
+    if (open_log(&log, &state) != 0) {
+        printf("FAIL: recover a torn tail\n");
+        return -1;
+    }
+    if (state.bad || state.cnt != before) {
+        printf("FAIL: %lu records replayed, %lu expected\n",
+               (unsigned long)state.cnt, (unsigned long)before);
+        ingest_log_clean(&log);
+        return -1;
+    }
+    memzero(&w, sizeof(w));
+    w.waiter.done = sync_waiter_done;
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.cond, NULL);
+    len = fill_record(buf, 0, state.next[0]);
+    rc = append_and_wait(&log, &w, buf, len);
+    ingest_log_get_stats(&log, &stats);
+    ingest_log_clean(&log);
+    pthread_cond_destroy(&w.cond);
+    pthread_mutex_destroy(&w.lock);
+    if (rc != INGEST_LOG_DURABLE || stats.recovered != before) {
+        printf("FAIL: append after recovering %lu records\n",
+               (unsigned long)stats.recovered);
+        return -1;
+    }
+
+    if (open_log(&log, &state) != 0) {
+        return -1;
+    }
+    ingest_log_clean(&log);
+    if (state.bad || state.cnt != before + 1) {
+        printf("FAIL: %lu records after recovery, %lu expected\n",
+               (unsigned long)state.cnt, (unsigned long)before + 1);
+        return -1;
+    }
+    printf("torn tail: dropped, %lu records\n", (unsigned long)state.cnt);
+    return 0;
+}
+
+static void
+remove_test_dir (void)
+{
+    struct dirent **names;
+    char path[PATH_MAX];
+    int i, cnt;
+
+    cnt = scandir(test_dir, &names, NULL, alphasort);
+    for (i = 0; i < cnt; i++) {
+        if (names[i]->d_name[0] != '.') {
+            snprintf(path, sizeof(path), "%s/%s", test_dir, names[i]->d_name);
+            unlink(path);
+        }
+        free(names[i]);
+    }
+    if (cnt >= 0) {
+        free(names);
+    }
+    rmdir(test_dir);
+}
+
+/*
+ * Threads each waiting for their record before the next, so a batch
+ * holds at most one record per thread: the group commit is what keeps
+ * the fdatasync count below the record count.
+ */
+static int
+bench_group_commit (int thread_cnt, uint32_t wait_us)
+{
+    ingest_log_conf_t conf = { test_dir, 0, 0, wait_us };
+    ingest_log_stats_t stats;
+    ingest_log_t log;
+    uint64_t start, ns;
+
+    remove_test_dir();
+    if (mkdir(test_dir, 0755) != 0 ||
+        ingest_log_init(&log, &conf, NULL, NULL) != 0) {
+        return -1;
+    }
+    start = monotonic_ns();
+    if (run_appenders(&log, thread_cnt, BENCH_RECS_PER_THREAD,
+                      BENCH_REC_LEN) != 0) {
+        ingest_log_clean(&log);
+        return -1;
+    }
+    ns = monotonic_ns() - start;
+    ingest_log_get_stats(&log, &stats);
+    ingest_log_clean(&log);
+
+    printf("bench: %d threads, wait %uus, %.0f records/s, "
+           "%.1f records per sync, %.1f us per sync\n",
+           thread_cnt, wait_us,
+           (double)stats.appended * 1000000000 / ns,
+           (double)stats.appended / stats.batches,
+           (double)stats.sync_ns / stats.batches / 1000);
+    return 0;
+}
+
+int main (void)
+{
+    int rc;
+
+    if (mkdtemp(test_dir) == NULL) {
+        printf("FAIL: mkdtemp\n");
+        return -1;
+    }
+    rc = test_append_replay();
+    if (rc == 0) {
+        rc = test_torn_tail();
+    }
+    if (rc == 0) {
+        rc = bench_group_commit(1, 0);
+    }
+    if (rc == 0) {
+        rc = bench_group_commit(TEST_THREAD_CNT, 0);
+    }
+    if (rc == 0) {
+        rc = bench_group_commit(TEST_THREAD_CNT, BENCH_WAIT_US);
+    }
+    remove_test_dir();
+
+    if (rc != 0) {
+        printf("FAIL\n");
+        return -1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+#include "iobuf.h"
+
+int
+iobuf_init (iobuf_t *buf, uint32_t cap)
+{
+    memzero(buf, sizeof(iobuf_t));
+
+    buf->data = malloc(cap);
+    if (buf->data == NULL) {
+        logger(ERROR, "Fail to malloc iobuf.");
+        return -1;
+    }
+    buf->cap = cap;
+    return 0;
+}
+
+/*
+ * Like iobuf_init with a buffer of the slab's object size taken from it.
+ * Once grown past that it moves to malloc, a buffer cleaned and used again
+ * starts from the slab anew.
+ */
+int
+iobuf_init_slab (iobuf_t *buf, slab_t *slab)
+{
+    memzero(buf, sizeof(iobuf_t));
+    buf->slab = slab;
+    return iobuf_reserve(buf, slab->size);
+}
+
+// growth doubles the capacity, only a buffer from the slab has its size
+static inline bool
+iobuf_from_slab (iobuf_t *buf)
+{
+    return buf->slab != NULL && buf->cap == buf->slab->size;
+}
+
+void
+iobuf_clean (iobuf_t *buf)
+{
+    slab_t *slab = buf->slab;
+
+    if (iobuf_from_slab(buf)) {
+        slab_free(slab, buf->data);
+    } else if (buf->data) {
+        free(buf->data);
+    }
+    memzero(buf, sizeof(iobuf_t));
+    buf->slab = slab;
+}
+
+/*
+ * Make sure there are at least len free bytes after the tail. Consumed
+ * bytes at the front are reclaimed first, the buffer only grows when that
+ * is not enough, so a buffer sized for the common request never reallocs.
+ */
+int
+iobuf_reserve (iobuf_t *buf, uint32_t len)
+{
+    uint32_t used, cap;
+    char *data;
+
+    if (iobuf_tail_room(buf) >= len) {
+        return 0;
+    }
+
+    if (buf->cap == 0 && buf->slab != NULL && len <= buf->slab->size) {
+        buf->data = slab_alloc(buf->slab);
+        if (buf->data == NULL) {
+            return -1;
+        }
+        buf->cap = buf->slab->size;
+        return 0;
+    }
+
+    used = iobuf_len(buf);
+    if (buf->start > 0 && buf->cap - used >= len) {
+        memmove(buf->data, buf->data + buf->start, used);
+        buf->start = 0;
+        buf->end = used;
+        return 0;
+    }
+
+    cap = buf->cap ? buf->cap : 1;
+    while (cap - used < len) {
+        cap *= 2;
+    }
+
+    if (buf->start > 0) {
+        memmove(buf->data, buf->data + buf->start, used);
+        buf->start = 0;
+        buf->end = used;
+    }
+
+    if (iobuf_from_slab(buf)) {
+        data = malloc(cap);
+        if (data != NULL) {
+            memcpy(data, buf->data, used);
+            slab_free(buf->slab, buf->data);
+        }
+    } else {
+        data = realloc(buf->data, cap);
+    }
+    if (data == NULL) {
+        logger(ERROR, "Fail to grow iobuf to %u.", cap);
+        return -1;
+    }
+    buf->data = data;
+    buf->cap = cap;
+    return 0;
+}
+
+void
+iobuf_consume (iobuf_t *buf, uint32_t len)
+{
+    buf->start += len;
+    if (buf->start >= buf->end) {
+        buf->start = 0;
+        buf->end = 0;
+    }
+}
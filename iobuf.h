@@ -0,0 +1,71 @@
+#ifndef __IOBUF_H__
+#define __IOBUF_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "slab.h"
+
+/*
+ * Growable byte buffer. Valid bytes live in [start, end), producers append
+ * at end and consumers advance start. Offsets relative to the head stay
+ * valid across compaction and growth, pointers do not.
+ */
+typedef struct iobuf_s {
+    char *data;
+    uint32_t start;
+    uint32_t end;
+    uint32_t cap;
+    slab_t *slab;  // where data of one object's size comes from, or NULL
+} iobuf_t;
+
+int
+iobuf_init(iobuf_t *buf, uint32_t cap);
+
+int
+iobuf_init_slab(iobuf_t *buf, slab_t *slab);
+
+void
+iobuf_clean(iobuf_t *buf);
+
+int
+iobuf_reserve(iobuf_t *buf, uint32_t len);
+
+void
+iobuf_consume(iobuf_t *buf, uint32_t len);
+
+static inline char *
+iobuf_head (iobuf_t *buf)
+{
+    return buf->data + buf->start;
+}
+
+static inline uint32_t
+iobuf_len (iobuf_t *buf)
+{
+    return buf->end - buf->start;
+}
+
+static inline char *
+iobuf_tail (iobuf_t *buf)
+{
+    return buf->data + buf->end;
+}
+
+static inline uint32_t
+iobuf_tail_room (iobuf_t *buf)
+{
+    return buf->cap - buf->end;
+}
+
+static inline void
+iobuf_produce (iobuf_t *buf, uint32_t len)
+{
+    buf->end += len;
+}
+
+static inline bool
+iobuf_is_empty (iobuf_t *buf)
+{
+    return buf->start == buf->end;
+}
+#endif //__IOBUF_H__
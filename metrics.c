@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "metrics.h"
+
+__thread metrics_thread_t *metrics_local;
+
+static metrics_thread_t *metrics_threads;
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *hist_names[METRICS_HIST_CNT] = {
+    [METRICS_HIST_ACCEPT_READABLE] = "accept_to_readable_ns",
+    [METRICS_HIST_QUEUE_WAIT] = "queue_wait_ns",
+    [METRICS_HIST_PARSE] = "parse_ns",
+    [METRICS_HIST_WRITE] = "write_ns",
+};
+
+static const char *counter_names[METRICS_COUNTER_CNT] = {
+    [METRICS_REQUESTS] = "requests_total",
+    [METRICS_BAD_REQUESTS] = "bad_requests_total",
+    [METRICS_DUPLICATE_TXNS] = "duplicate_txns_total",
+    [METRICS_BYTES_IN] = "bytes_in_total",
+    [METRICS_BYTES_OUT] = "bytes_out_total",
+    [METRICS_SESSIONS_OPENED] = "sessions_opened_total",
+    [METRICS_SESSIONS_CLOSED] = "sessions_closed_total",
+    [METRICS_QUEUE_PUT] = "queue_put_total",
+    [METRICS_QUEUE_GET] = "queue_get_total",
+    [METRICS_SHED_QUEUE_FULL] = "shed_queue_full_total",
+    [METRICS_SHED_CODEL] = "shed_codel_total",
+    [METRICS_SHED_REQUESTS] = "shed_requests_total",
+};
+
+static const double quantiles[METRICS_QUANTILE_CNT] = {
+    0.5, 0.9, 0.99, 0.999,
+};
+
+/*
+ * Allocate the calling thread's metrics on its first record, they stay
+ * linked until metrics_clean so counts of exited threads are kept.
+ */
+metrics_thread_t *
+metrics_thread_register (void)
+{
+    metrics_thread_t *m;
+
+    if (posix_memalign((void **)&m, CACHE_LINE_SIZE,
+                       sizeof(metrics_thread_t)) != 0) {
+        // nowhere to record, better than failing the request
+        static metrics_thread_t discard;
+        return &discard;
+    }
+    memzero(m, sizeof(metrics_thread_t));
+
+    pthread_mutex_lock(&metrics_lock);
+    m->next = metrics_threads;
+    metrics_threads = m;
+    pthread_mutex_unlock(&metrics_lock);
+
+    metrics_local = m;
+    return m;
+}
+
+void
+metrics_clean (void)
+{
+    metrics_thread_t *m;
+
+    pthread_mutex_lock(&metrics_lock);
+    while ((m = metrics_threads) != NULL) {
+        metrics_threads = m->next;
+        free(m);
+    }
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+static uint64_t
+load (uint64_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+/*
+ * Highest value of the bucket, so a quantile is never under-reported.
+ */
+static uint64_t
+bucket_upper (uint32_t b)
+{
+    uint32_t shift;
+
+    if (b < METRICS_SUB_CNT) {
+        return b;
+    }
+    shift = b / METRICS_SUB_CNT - 1;
+    return (((uint64_t)(b % METRICS_SUB_CNT + METRICS_SUB_CNT + 1)) << shift)
+           - 1;
+}
+
+static uint64_t
+hist_quantile (metrics_hist_t *h, double q)
+{
+    uint64_t rank, seen = 0;
+    uint32_t b;
+
+    if (h->count == 0) {
+        return 0;
+    }
+    rank = (uint64_t)(q * h->count);
+    if (rank >= h->count) {
+        rank = h->count - 1;
+    }
+    for (b = 0; b < METRICS_BUCKET_CNT; b++) {
+        seen += h->buckets[b];
+        if (seen > rank) {
+            return MIN(bucket_upper(b), h->max);
+        }
+    }
+    return h->max;
+}
+
+static void
+metrics_sum (metrics_thread_t *total)
+{
+    metrics_thread_t *m;
+    metrics_hist_t *h, *t;
+    uint64_t max;
+    int i, j;
+
+    memzero(total, sizeof(metrics_thread_t));
+    pthread_mutex_lock(&metrics_lock);
+    for (m = metrics_threads; m != NULL; m = m->next) {
+        for (i = 0; i < METRICS_COUNTER_CNT; i++) {
+            total->counters[i] += load(&m->counters[i]);
+        }
+        for (i = 0; i < METRICS_HIST_CNT; i++) {
+            h = &m->hists[i];
+            t = &total->hists[i];
+            t->sum += load(&h->sum);
+            max = load(&h->max);
+            t->max = MAX(t->max, max);
+            for (j = 0; j < METRICS_BUCKET_CNT; j++) {
+                t->buckets[j] += load(&h->buckets[j]);
+            }
+        }
+    }
+    pthread_mutex_unlock(&metrics_lock);
+
+    // counted from the buckets so quantiles stay consistent with them
+    for (i = 0; i < METRICS_HIST_CNT; i++) {
+        t = &total->hists[i];
+        for (j = 0; j < METRICS_BUCKET_CNT; j++) {
+            t->count += t->buckets[j];
+        }
+    }
+}
+
+/*
+ * Sum all threads into scratch, METRICS_SCRATCH_SIZE bytes, and print
+ * them as text, one "name value" per line, in the Prometheus exposition
+ * format. Return the length written, -1 if it does not fit in size.
+ */
+int
+metrics_format (void *scratch, char *buf, uint32_t size)
+{
+    metrics_thread_t *total;
+    metrics_hist_t *h;
+    uint32_t len = 0, i, j;
+
+#define metrics_printf(fmt, args...) \
+do {\
+    if (len < size) {\
+        len += snprintf(buf + len, size - len, fmt, ##args);\
+    }\
+} while (0)
+
+    total = (metrics_thread_t *)(((uintptr_t)scratch + CACHE_LINE_SIZE - 1) &
+                                 ~(uintptr_t)(CACHE_LINE_SIZE - 1));
+    metrics_sum(total);
+
+    for (i = 0; i < METRICS_COUNTER_CNT; i++) {
+        metrics_printf("%s %lu\n", counter_names[i],
+                       (unsigned long)total->counters[i]);
+    }
+    metrics_printf("sessions_open %ld\n",
+                   (long)(total->counters[METRICS_SESSIONS_OPENED] -
+                          total->counters[METRICS_SESSIONS_CLOSED]));
+    metrics_printf("queue_depth %ld\n",
+                   (long)(total->counters[METRICS_QUEUE_PUT] -
+                          total->counters[METRICS_QUEUE_GET]));
+
+    for (i = 0; i < METRICS_HIST_CNT; i++) {
+        h = &total->hists[i];
+        for (j = 0; j < METRICS_QUANTILE_CNT; j++) {
+            metrics_printf("%s{quantile=\"%g\"} %lu\n", hist_names[i],
+                           quantiles[j],
+                           (unsigned long)hist_quantile(h, quantiles[j]));
+        }
+        metrics_printf("%s_max %lu\n", hist_names[i], (unsigned long)h->max);
+        metrics_printf("%s_sum %lu\n", hist_names[i], (unsigned long)h->sum);
+        metrics_printf("%s_count %lu\n", hist_names[i],
+                       (unsigned long)h->count);
+    }
+#undef metrics_printf
+
+    return len < size ? (int)len : -1;
+}
@@ -0,0 +1,134 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "util.h"
+
+/*
+ * Log-linear buckets as in HDR histograms: values below 16 have a bucket
+ * each, every power of two above is split in 16, so a bucket is at most
+ * 1/16 of its value wide. Values are clamped to 2^40 ns, about 18 min.
+ */
+#define METRICS_SUB_BITS 4
+#define METRICS_SUB_CNT (1 << METRICS_SUB_BITS)
+#define METRICS_MAX_BITS 40
+#define METRICS_BUCKET_CNT \
+    ((METRICS_MAX_BITS - METRICS_SUB_BITS + 1) * METRICS_SUB_CNT)
+#define METRICS_QUANTILE_CNT 4
+
+enum {
+    METRICS_HIST_ACCEPT_READABLE = 0,
+    METRICS_HIST_QUEUE_WAIT,
+    METRICS_HIST_PARSE,
+    METRICS_HIST_WRITE,
+    METRICS_HIST_CNT,
+};
+
+enum {
+    METRICS_REQUESTS = 0,
+    METRICS_BAD_REQUESTS,
+    METRICS_DUPLICATE_TXNS,
+    METRICS_BYTES_IN,
+    METRICS_BYTES_OUT,
+    METRICS_SESSIONS_OPENED,
+    METRICS_SESSIONS_CLOSED,
+    METRICS_QUEUE_PUT,
+    METRICS_QUEUE_GET,
+    METRICS_SHED_QUEUE_FULL,
+    METRICS_SHED_CODEL,
+    METRICS_SHED_REQUESTS,
+    METRICS_COUNTER_CNT,
+};
+
+typedef struct metrics_hist_s {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[METRICS_BUCKET_CNT];
+} metrics_hist_t;
+
+/*
+ * Metrics of one thread, only ever written by it, so recording is a few
+ * plain increments. Readers sum every thread's copy on demand and may see
+ * a record half done, which is fine for monitoring.
+ */
+typedef struct metrics_thread_s {
+    metrics_hist_t hists[METRICS_HIST_CNT];
+    uint64_t counters[METRICS_COUNTER_CNT];
+    struct metrics_thread_s *next;
+} cache_aligned metrics_thread_t;
+
+extern __thread metrics_thread_t *metrics_local;
+
+/*
+ * Upper bound of the metrics_format text: a line per counter, two gauges,
+ * and per histogram its quantiles, max, sum and count. No name and value
+ * take more than METRICS_LINE_MAX_LEN.
+ */
+#define METRICS_LINE_MAX_LEN 80
+#define METRICS_TEXT_MAX_LEN \
+    ((METRICS_COUNTER_CNT + 2 + \
+      METRICS_HIST_CNT * (METRICS_QUANTILE_CNT + 3)) * METRICS_LINE_MAX_LEN)
+// scratch metrics_format sums into, room to align a metrics_thread_t
+#define METRICS_SCRATCH_SIZE (sizeof(metrics_thread_t) + CACHE_LINE_SIZE)
+
+metrics_thread_t *
+metrics_thread_register(void);
+
+void
+metrics_clean(void);
+
+int
+metrics_format(void *scratch, char *buf, uint32_t size);
+
+static inline metrics_thread_t *
+metrics_thread (void)
+{
+    if (__builtin_expect(metrics_local == NULL, 0)) {
+        return metrics_thread_register();
+    }
+    return metrics_local;
+}
+
+static inline void
+metrics_inc (uint64_t *p, uint64_t v)
+{
+    __atomic_store_n(p, *p + v, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t
+metrics_bucket (uint64_t v)
+{
+    uint32_t e;
+
+    if (v < METRICS_SUB_CNT) {
+        return v;
+    }
+    if (v >= ((uint64_t)1 << METRICS_MAX_BITS)) {
+        v = ((uint64_t)1 << METRICS_MAX_BITS) - 1;
+    }
+    e = 63 - __builtin_clzl(v);
+    return (e - METRICS_SUB_BITS + 1) * METRICS_SUB_CNT +
+           ((v >> (e - METRICS_SUB_BITS)) & (METRICS_SUB_CNT - 1));
+}
+
+static inline void
+metrics_record (int hist, uint64_t ns)
+{
+    metrics_hist_t *h = &metrics_thread()->hists[hist];
+
+    metrics_inc(&h->buckets[metrics_bucket(ns)], 1);
+    metrics_inc(&h->count, 1);
+    metrics_inc(&h->sum, ns);
+    if (ns > h->max) {
+        __atomic_store_n(&h->max, ns, __ATOMIC_RELAXED);
+    }
+}
+
+static inline void
+metrics_add (int counter, uint64_t v)
+{
+    metrics_inc(&metrics_thread()->counters[counter], v);
+}
+#endif //__METRICS_H__
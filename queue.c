@@ -10,10 +10,15 @@
 typedef struct queue_entry_s {
     dlist_header_t header;
     void *data;
-    bool free_for_use;
-    bool from_pool;
+    struct queue_entry_s *next_free;
 } queue_entry_t;
 
+typedef struct queue_slab_s {
+    struct queue_slab_s *next;
+    uint32_t entry_cnt;
+    queue_entry_t entries[];
+} queue_slab_t;
+
 void
 queue_init (queue_t *queue)
 {
@@ -27,41 +32,73 @@ queue_set_max_size (queue_t *queue, uint32_t max_size)
     queue->max_size = max_size;
 }
 
-int
-queue_set_pool (queue_t *queue, uint32_t pool_size)
+static void
+free_slabs (queue_t *queue)
 {
-    queue_entry_t *pool;
-    int i;
+    queue_slab_t *slab;
 
-    if (queue->size > 0) {
+    while (queue->slabs) {
+        slab = queue->slabs;
+        queue->slabs = slab->next;
+        free(slab);
+    }
+    queue->free_list = NULL;
+    queue->pool_stats.slab_cnt = 0;
+    queue->pool_stats.entry_cnt = 0;
+}
+
+static int
+grow_pool (queue_t *queue, uint32_t entry_cnt)
+{
+    queue_slab_t *slab;
+    uint32_t i;
+
+    slab = malloc(sizeof(queue_slab_t) + entry_cnt * sizeof(queue_entry_t));
+    if (slab == NULL) {
         return -1;
     }
+    slab->entry_cnt = entry_cnt;
+    slab->next = queue->slabs;
+    queue->slabs = slab;
 
-    if (queue->pool != NULL) {
-        free(queue->pool);
+    for (i = 0; i < entry_cnt; i++) {
+        slab->entries[i].next_free = queue->free_list;
+        queue->free_list = &slab->entries[i];
     }
+    queue->pool_stats.slab_cnt++;
+    queue->pool_stats.entry_cnt += entry_cnt;
+    return 0;
+}
 
-    queue->pool = calloc(pool_size, sizeof(queue_entry_t));
-    if (queue->pool == NULL) {
+/*
+ * pool_size is both the number of entries preallocated now and the
+ * number added each time the pool runs dry.
+ */
+int
+queue_set_pool (queue_t *queue, uint32_t pool_size)
+{
+    if (queue->size > 0) {
         return -1;
     }
 
+    free_slabs(queue);
     queue->pool_size = pool_size;
-
-    pool = queue->pool;
-    for (i = 0; i < pool_size; i++) {
-        pool[i].free_for_use = True;
-        pool[i].from_pool = True;
+    if (pool_size == 0) {
+        return 0;
     }
-    return 0;
+    return grow_pool(queue, pool_size);
 }
 
 void
 queue_clean (queue_t *queue)
 {
-    if (queue->pool) {
-        free(queue->pool);
-    }
+    free_slabs(queue);
+}
+
+void
+queue_get_pool_stats (queue_t *queue, queue_pool_stats_t *stats)
+{
+    *stats = queue->pool_stats;
 }
 
 uint32_t
@@ -93,40 +130,25 @@ queue_is_full (queue_t *queue)
     }
 }
 
-static queue_entry_t *
-get_queue_entry_from_pool (queue_t *queue)
-{
-    queue_entry_t *pool;
-    int i;
-
-    pool = queue->pool;
-    for (i = 0; i < queue->pool_size; i++) {
-        if (!pool[i].free_for_use) {
-            continue;
-        }
-        pool[i].free_for_use = False;
-        return &pool[i];
-    }
-    return NULL;
-}
-
 static queue_entry_t *
 get_queue_entry (queue_t *queue)
 {
-    queue_entry_t *entry = NULL;
+    queue_entry_t *entry;
+    uint32_t slab_size;
 
-    if (queue->pool != NULL) {
-        entry = get_queue_entry_from_pool(queue);
-    }
-    if (entry != NULL) {
-        return entry;
+    if (queue->free_list != NULL) {
+        queue->pool_stats.hits++;
+    } else {
+        slab_size = queue->pool_size ? queue->pool_size
+                                     : QUEUE_SLAB_DEFAULT_SIZE;
+        if (grow_pool(queue, slab_size) != 0) {
+            return NULL;
+        }
+        queue->pool_stats.misses++;
     }
 
-    entry = calloc(1, sizeof(queue_entry_t));
-    if (entry == NULL) {
-        return NULL;
-    }
-    entry->from_pool = False;
+    entry = queue->free_list;
+    queue->free_list = entry->next_free;
     return entry;
 }
 
@@ -155,13 +177,10 @@ queue_enqueue (queue_t *queue, void *data)
 }
 
 static void
-free_queue_entry (queue_entry_t *entry)
+free_queue_entry (queue_t *queue, queue_entry_t *entry)
 {
-    if (entry->from_pool) {
-        entry->free_for_use = True;
-    } else {
-        free(entry);
-    }
+    entry->next_free = queue->free_list;
+    queue->free_list = entry;
 }
 
 void *
@@ -179,7 +198,7 @@ queue_dequeue (queue_t *queue)
     entry = get_entry_from_header(dlist_header);
     queue->size--;
     data = entry->data;
-    free_queue_entry(entry);
+    free_queue_entry(queue, entry);
     return data;
 }
 
@@ -215,7 +234,7 @@ queue_remove (queue_t *queue, void *data)
     dlist_header->next->prev = dlist_header->prev;
     dlist_header->prev->next = dlist_header->next;
     queue->size--;
-    free_queue_entry(entry);
+    free_queue_entry(queue, entry);
 }
 
 void
@@ -4,14 +4,32 @@
 #include <stdint.h>
 #include "dlist.h"
 
+#define QUEUE_SLAB_DEFAULT_SIZE 64
+
 struct queue_entry_s;
+struct queue_slab_s;
+
+/*
+ * Entries come from an intrusive free list refilled a slab at a time, so
+ * enqueue and dequeue are O(1) and stop allocating once the pool has
+ * grown to the queue's working depth. A miss is an entry that needed a
+ * new slab.
+ */
+typedef struct queue_pool_stats_s {
+    uint64_t hits;
+    uint64_t misses;
+    uint32_t slab_cnt;
+    uint32_t entry_cnt;
+} queue_pool_stats_t;
 
 typedef struct queue_s {
     dlist_header_t head;
     uint32_t size;
     uint32_t max_size;
     uint32_t pool_size;
-    struct queue_entry_s *pool;
+    struct queue_entry_s *free_list;
+    struct queue_slab_s *slabs;
+    queue_pool_stats_t pool_stats;
     dlist_header_t *pos;
 } queue_t;
 
@@ -30,6 +48,9 @@ queue_set_pool(queue_t *queue, uint32_t pool_size);
 uint32_t
 queue_get_size(queue_t *queue);
 
+void
+queue_get_pool_stats(queue_t *queue, queue_pool_stats_t *stats);
+
 bool
 queue_is_empty(queue_t *queue);
 
@@ -23,6 +23,7 @@ static void
 test_queue (void)
 {
     int data[DATA_CNT], i, *p, rc;
+    queue_pool_stats_t stats;
     queue_t queue;
 
     for (i = 0; i < DATA_CNT; i++) {
@@ -47,6 +48,10 @@ test_queue (void)
     printf("\n");
     dump_queue(&queue);
     printf("Queu size: %d\n", queue_get_size(&queue));
+    queue_get_pool_stats(&queue, &stats);
+    printf("Pool hits %lu, misses %lu, %u slabs, %u entries\n",
+           (unsigned long)stats.hits, (unsigned long)stats.misses,
+           stats.slab_cnt, stats.entry_cnt);
     queue_clean(&queue);
     return;
 }
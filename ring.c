@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include "util.h"
+#include "ring.h"
+
+/*
+ * size is rounded up to a power of two.
+ */
+int
+mpmc_ring_init (mpmc_ring_t *ring, uint32_t size)
+{
+    uint64_t cap, i;
+
+    memzero(ring, sizeof(mpmc_ring_t));
+
+    for (cap = 2; cap < size; cap <<= 1);
+
+    ring->cells = calloc(cap, sizeof(mpmc_ring_cell_t));
+    if (ring->cells == NULL) {
+        logger(ERROR, "Fail to calloc ring cells.");
+        return -1;
+    }
+    for (i = 0; i < cap; i++) {
+        ring->cells[i].seq = i;
+    }
+    ring->mask = cap - 1;
+    return 0;
+}
+
+void
+mpmc_ring_clean (mpmc_ring_t *ring)
+{
+    if (ring->cells) {
+        free(ring->cells);
+        ring->cells = NULL;
+    }
+}
+
+uint32_t
+mpmc_ring_get_capacity (mpmc_ring_t *ring)
+{
+    return ring->mask + 1;
+}
+
+/*
+ * Only a snapshot, other threads may be moving both ends.
+ */
+uint32_t
+mpmc_ring_get_size (mpmc_ring_t *ring)
+{
+    uint64_t enq, deq;
+
+    deq = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    enq = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+    return enq > deq ? enq - deq : 0;
+}
+
+bool
+mpmc_ring_try_enqueue (mpmc_ring_t *ring, void *data)
+{
+    mpmc_ring_cell_t *cell;
+    uint64_t pos, seq;
+    int64_t diff;
+
+    pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        cell = &ring->cells[pos & ring->mask];
+        seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        diff = (int64_t)seq - (int64_t)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring->enqueue_pos, &pos, pos + 1,
+                                            True, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return False; // full
+        } else {
+            pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->data = data;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return True;
+}
+
+bool
+mpmc_ring_try_dequeue (mpmc_ring_t *ring, void **data)
+{
+    mpmc_ring_cell_t *cell;
+    uint64_t pos, seq;
+    int64_t diff;
+
+    pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        cell = &ring->cells[pos & ring->mask];
+        seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        diff = (int64_t)seq - (int64_t)(pos + 1);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring->dequeue_pos, &pos, pos + 1,
+                                            True, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return False; // empty
+        } else {
+            pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    *data = cell->data;
+    __atomic_store_n(&cell->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+    return True;
+}
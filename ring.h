@@ -0,0 +1,44 @@
+#ifndef __RING_H__
+#define __RING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "util.h"
+
+/*
+ * Bounded lock-free multi-producer multi-consumer ring (D. Vyukov's
+ * design). Each cell carries a sequence number telling whether it is
+ * ready for the next enqueue or dequeue, so producers and consumers only
+ * contend on their own position counter, which sit on separate cache
+ * lines.
+ */
+typedef struct mpmc_ring_cell_s {
+    uint64_t seq;
+    void *data;
+} mpmc_ring_cell_t;
+
+typedef struct mpmc_ring_s {
+    mpmc_ring_cell_t *cells;
+    uint64_t mask;
+    uint64_t enqueue_pos cache_aligned;
+    uint64_t dequeue_pos cache_aligned;
+} mpmc_ring_t;
+
+int
+mpmc_ring_init(mpmc_ring_t *ring, uint32_t size);
+
+void
+mpmc_ring_clean(mpmc_ring_t *ring);
+
+uint32_t
+mpmc_ring_get_capacity(mpmc_ring_t *ring);
+
+uint32_t
+mpmc_ring_get_size(mpmc_ring_t *ring);
+
+bool
+mpmc_ring_try_enqueue(mpmc_ring_t *ring, void *data);
+
+bool
+mpmc_ring_try_dequeue(mpmc_ring_t *ring, void **data);
+#endif //__RING_H__
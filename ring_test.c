@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "ring.h"
+
+#define RING_SIZE 1024
+#define PRODUCER_CNT 4
+#define CONSUMER_CNT 4
+#define ITEM_PER_PRODUCER 200000
+
+static mpmc_ring_t ring;
+static uint64_t consumed_sum[CONSUMER_CNT];
+static uint64_t consumed_cnt[CONSUMER_CNT];
+
+static void *
+producer (void *arg)
+{
+    uintptr_t base = (uintptr_t)arg * ITEM_PER_PRODUCER;
+    uintptr_t i;
+
+    for (i = 1; i <= ITEM_PER_PRODUCER; i++) {
+        while (!mpmc_ring_try_enqueue(&ring, (void *)(base + i))) {
+            cpu_relax();
+        }
+    }
+    return NULL;
+}
+
+static void *
+consumer (void *arg)
+{
+    uintptr_t id = (uintptr_t)arg;
+    void *data;
+
+    for (;;) {
+        if (!mpmc_ring_try_dequeue(&ring, &data)) {
+            cpu_relax();
+            continue;
+        }
+        if (data == NULL) {
+            break; // poison
+        }
+        consumed_sum[id] += (uintptr_t)data;
+        consumed_cnt[id]++;
+    }
+    return NULL;
+}
+
+static int
+test_single_thread (void)
+{
+    void *data;
+    uintptr_t i;
+
+    mpmc_ring_init(&ring, 5);
+    printf("Capacity %u\n", mpmc_ring_get_capacity(&ring));
+    for (i = 1; mpmc_ring_try_enqueue(&ring, (void *)i); i++);
+    printf("Enqueued %lu before full, size %u\n",
+           (unsigned long)(i - 1), mpmc_ring_get_size(&ring));
+    for (i = 1; mpmc_ring_try_dequeue(&ring, &data); i++) {
+        if ((uintptr_t)data != i) {
+            printf("FAIL: got %lu, expect %lu\n",
+                   (unsigned long)(uintptr_t)data, (unsigned long)i);
+            return -1;
+        }
+    }
+    mpmc_ring_clean(&ring);
+    return 0;
+}
+
+static int
+test_multi_thread (void)
+{
+    pthread_t producers[PRODUCER_CNT], consumers[CONSUMER_CNT];
+    uint64_t sum = 0, cnt = 0, n, expect;
+    uintptr_t i;
+
+    mpmc_ring_init(&ring, RING_SIZE);
+    for (i = 0; i < CONSUMER_CNT; i++) {
+        pthread_create(&consumers[i], NULL, consumer, (void *)i);
+    }
+    for (i = 0; i < PRODUCER_CNT; i++) {
+        pthread_create(&producers[i], NULL, producer, (void *)i);
+    }
+    for (i = 0; i < PRODUCER_CNT; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    for (i = 0; i < CONSUMER_CNT; i++) {
+        while (!mpmc_ring_try_enqueue(&ring, NULL)) {
+            cpu_relax();
+        }
+    }
+    for (i = 0; i < CONSUMER_CNT; i++) {
+        pthread_join(consumers[i], NULL);
+        sum += consumed_sum[i];
+        cnt += consumed_cnt[i];
+    }
+    mpmc_ring_clean(&ring);
+
+    n = (uint64_t)PRODUCER_CNT * ITEM_PER_PRODUCER;
+    expect = n * (n + 1) / 2;
+    printf("Consumed %lu items, sum %lu, expect %lu\n",
+           (unsigned long)cnt, (unsigned long)sum, (unsigned long)expect);
+    return sum == expect && cnt == n ? 0 : -1;
+}
+
+int main (void)
+{
+    int rc = 0;
+
+    rc |= test_single_thread();
+    rc |= test_multi_thread();
+    printf("%s\n", rc == 0 ? "PASS" : "FAIL");
+    return rc;
+}
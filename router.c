@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+#include "router.h"
+
+#define ROUTER_MIN_SLOTS 8
+#define ROUTER_SEED_TRIES 1024
+
+/*
+ * FNV-1a over method and path, the seed replaces the offset basis. The
+ * method is followed by a space, as in the request line, so "GE" "T/x"
+ * and "GET" "/x" don't collide by construction.
+ */
+static inline uint32_t
+route_hash (uint32_t seed, const char *method, uint32_t method_len,
+            const char *path, uint32_t path_len)
+{
+    uint32_t h = seed ^ 2166136261u;
+    uint32_t i;
+
+    for (i = 0; i < method_len; i++) {
+        h = (h ^ (uint8_t)method[i]) * 16777619u;
+    }
+    h = (h ^ ' ') * 16777619u;
+    for (i = 0; i < path_len; i++) {
+        h = (h ^ (uint8_t)path[i]) * 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+static inline bool
+route_eq (const route_t *route, const char *method, uint32_t method_len,
+          const char *path, uint32_t path_len)
+{
+    return route->method_len == method_len && route->path_len == path_len &&
+           memcmp(route->path, path, path_len) == 0 &&
+           memcmp(route->method, method, method_len) == 0;
+}
+
+void
+router_init (router_t *router, route_handler_t default_handler, void *arg)
+{
+    memzero(router, sizeof(router_t));
+    router->default_route.method = "";
+    router->default_route.path = "";
+    router->default_route.handler = default_handler;
+    router->default_route.arg = arg;
+}
+
+void
+router_clean (router_t *router)
+{
+    free(router->slots);
+    router->slots = NULL;
+    router->slot_mask = 0;
+}
+
+int
+router_add (router_t *router, const char *method, const char *path,
+            route_handler_t handler, void *arg)
+{
+    route_t *route;
+    uint32_t i;
+
+    if (router->route_cnt >= ROUTER_MAX_ROUTES) {
+        logger(ERROR, "Too many routes, fail to add %s %s.", method, path);
+        return -1;
+    }
+    for (i = 0; i < router->route_cnt; i++) {
+        if (route_eq(&router->routes[i], method, strlen(method),
+                     path, strlen(path))) {
+            logger(ERROR, "Route %s %s already added.", method, path);
+            return -1;
+        }
+    }
+
+    route = &router->routes[router->route_cnt++];
+    route->method = method;
+    route->path = path;
+    route->method_len = strlen(method);
+    route->path_len = strlen(path);
+    route->handler = handler;
+    route->arg = arg;
+    return 0;
+}
+
+/*
+ * Try seeds until every route has a slot of its own, doubling the table
+ * when a size has no such seed. At most 64 routes in at least twice as
+ * many slots, a seed is found after a few tries.
+ */
+int
+router_compile (router_t *router)
+{
+    route_t *route;
+    uint8_t *slots;
+    uint32_t size, seed, i, h;
+
+    size = ROUTER_MIN_SLOTS;
+    while (size < router->route_cnt * 2) {
+        size <<= 1;
+    }
+
+    for (; size <= ROUTER_MAX_SLOTS; size <<= 1) {
+        slots = malloc(size);
+        if (slots == NULL) {
+            logger(ERROR, "Fail to malloc route slots.");
+            return -1;
+        }
+        for (seed = 1; seed <= ROUTER_SEED_TRIES; seed++) {
+            memzero(slots, size);
+            for (i = 0; i < router->route_cnt; i++) {
+                route = &router->routes[i];
+                h = route_hash(seed, route->method, route->method_len,
+                               route->path, route->path_len) & (size - 1);
+                if (slots[h] != 0) {
+                    break;
+                }
+                slots[h] = i + 1;
+            }
+            if (i == router->route_cnt) {
+                free(router->slots);
+                router->slots = slots;
+                router->slot_mask = size - 1;
+                router->seed = seed;
+                logger(DEBUG, "%u routes in %u slots, seed %u.",
+                       router->route_cnt, size, seed);
+                return 0;
+            }
+        }
+        free(slots);
+    }
+
+    logger(ERROR, "Fail to find a perfect hash for %u routes.",
+           router->route_cnt);
+    return -1;
+}
+
+const route_t *
+router_match (router_t *router, const char *method, uint32_t method_len,
+              const char *path, uint32_t path_len)
+{
+    const route_t *route;
+    uint32_t h;
+    uint8_t idx;
+
+    if (router->slots == NULL) {
+        return &router->default_route;
+    }
+
+    h = route_hash(router->seed, method, method_len, path, path_len);
+    idx = router->slots[h & router->slot_mask];
+    if (idx == 0) {
+        return &router->default_route;
+    }
+    route = &router->routes[idx - 1];
+    if (!route_eq(route, method, method_len, path, path_len)) {
+        return &router->default_route;
+    }
+    return route;
+}
@@ -0,0 +1,83 @@
+#ifndef __ROUTER_H__
+#define __ROUTER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "http_parser.h"
+
+#define ROUTER_MAX_ROUTES 64
+#define ROUTER_MAX_SLOTS 4096
+
+/*
+ * Called with the request and the buffer its strings are offsets into.
+ * ctx is whatever the caller of the dispatch passes, arg the one given at
+ * registration. The return value is handed back to the caller as is.
+ */
+typedef int (*route_handler_t)(void *ctx, http_request_t *req,
+                               const char *buf, void *arg);
+
+typedef struct route_s {
+    const char *method;
+    const char *path;
+    uint32_t method_len;
+    uint32_t path_len;
+    route_handler_t handler;
+    void *arg;
+} route_t;
+
+/*
+ * Exact method and path matches, compiled into a perfect hash: the seed
+ * is searched until every route lands in a slot of its own, so a lookup
+ * is one hash of the request line and at most one compare. Routes are
+ * registered then compiled once before serving, lookups are lock free
+ * after that. Method and path strings are not copied, they must outlive
+ * the router.
+ */
+typedef struct router_s {
+    route_t routes[ROUTER_MAX_ROUTES];
+    uint32_t route_cnt;
+    route_t default_route;
+    uint8_t *slots; // route index + 1, 0 for an empty slot
+    uint32_t slot_mask;
+    uint32_t seed;
+} router_t;
+
+void
+router_init(router_t *router, route_handler_t default_handler, void *arg);
+
+void
+router_clean(router_t *router);
+
+int
+router_add(router_t *router, const char *method, const char *path,
+           route_handler_t handler, void *arg);
+
+int
+router_compile(router_t *router);
+
+const route_t *
+router_match(router_t *router, const char *method, uint32_t method_len,
+             const char *path, uint32_t path_len);
+
+/*
+ * Match the request line of req, the query string is not part of the path,
+ * and run the handler of the route, the default one if nothing matches.
+ */
+static inline int
+router_dispatch (router_t *router, void *ctx, http_request_t *req,
+                 const char *buf)
+{
+    const char *path = http_str_ptr(buf, &req->path);
+    const char *query;
+    const route_t *route;
+    uint32_t path_len = req->path.len;
+
+    query = memchr(path, '?', path_len);
+    if (query != NULL) {
+        path_len = query - path;
+    }
+    route = router_match(router, http_str_ptr(buf, &req->method),
+                         req->method.len, path, path_len);
+    return route->handler(ctx, req, buf, route->arg);
+}
+#endif //__ROUTER_H__
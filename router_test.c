@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <string.h>
+#include "router.h"
+
+#define TEST_ROUTE_CNT ROUTER_MAX_ROUTES
+
+static char paths[TEST_ROUTE_CNT][32];
+
+static int
+handle_route (void *ctx, http_request_t *req, const char *buf, void *arg)
+{
+    return (int)(long)arg;
+}
+
+static int
+handle_default (void *ctx, http_request_t *req, const char *buf, void *arg)
+{
+    return -1;
+}
+
+static int
+match (router_t *router, const char *method, const char *path)
+{
+    const route_t *route;
+
+    route = router_match(router, method, strlen(method), path, strlen(path));
+    return route->handler(NULL, NULL, NULL, route->arg);
+}
+
+/*
+ * Every registered route is found, anything else, including a prefix or
+ * the wrong method of a registered path, goes to the default route.
+ */
+int main (void)
+{
+    router_t router;
+    char path[40];
+    int i, rc, failed = 0;
+
+    router_init(&router, handle_default, NULL);
+    for (i = 0; i < TEST_ROUTE_CNT; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "/api/v1/item%d/", i);
+        rc = router_add(&router, i % 2 ? "GET" : "POST", paths[i],
+                        handle_route, (void *)(long)i);
+        if (rc != 0) {
+            printf("FAIL: add route %d\n", i);
+            return -1;
+        }
+    }
+    if (router_add(&router, "GET", "/extra", handle_route, NULL) == 0) {
+        printf("FAIL: added more than %d routes\n", ROUTER_MAX_ROUTES);
+        return -1;
+    }
+    if (router_compile(&router) != 0) {
+        printf("FAIL: compile\n");
+        return -1;
+    }
+
+    for (i = 0; i < TEST_ROUTE_CNT; i++) {
+        if (match(&router, i % 2 ? "GET" : "POST", paths[i]) != i) {
+            printf("FAIL: route %d not matched\n", i);
+            failed++;
+        }
+        if (match(&router, i % 2 ? "POST" : "GET", paths[i]) != -1) {
+            printf("FAIL: route %d matched with the wrong method\n", i);
+            failed++;
+        }
+        snprintf(path, sizeof(path), "%.*s", (int)strlen(paths[i]) - 1,
+                 paths[i]);
+        if (match(&router, i % 2 ? "GET" : "POST", path) != -1) {
+            printf("FAIL: prefix of route %d matched\n", i);
+            failed++;
+        }
+    }
+    if (match(&router, "GET", "/") != -1) {
+        printf("FAIL: / matched\n");
+        failed++;
+    }
+
+    router_clean(&router);
+    printf("%s\n", failed ? "FAIL" : "PASS");
+    return failed ? -1 : 0;
+}
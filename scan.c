@@ -0,0 +1,285 @@
+#include <string.h>
+#include "util.h"
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+static const char *
+scalar_find_char (const char *s, uint32_t len, char c)
+{
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        if (s[i] == c) {
+            return s + i;
+        }
+    }
+    return NULL;
+}
+
+static const char *
+scalar_find_str (const char *s, uint32_t len, const char *key,
+                 uint32_t key_len)
+{
+    uint32_t i;
+
+    if (key_len == 0) {
+        return s;
+    }
+    for (i = 0; i + key_len <= len; i++) {
+        if (s[i] == key[0] && memcmp(s + i + 1, key + 1, key_len - 1) == 0) {
+            return s + i;
+        }
+    }
+    return NULL;
+}
+
+#ifdef SCAN_X86
+/*
+ * The SIMD kernels handle the tail with one more load ending at the last
+ * byte, overlapping what was already scanned, and only fall back to the
+ * scalar loops for inputs shorter than a vector. Candidate keys are
+ * compared inline, a call out of AVX code would pay for the transition.
+ */
+static inline bool
+scan_bytes_eq (const char *a, const char *b, uint32_t len)
+{
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        if (a[i] != b[i]) {
+            return False;
+        }
+    }
+    return True;
+}
+
+__attribute__((target("sse2")))
+static const char *
+sse2_find_char (const char *s, uint32_t len, char c)
+{
+    __m128i needle = _mm_set1_epi8(c);
+    uint32_t i;
+    int mask;
+
+    if (len < 16) {
+        return scalar_find_char(s, len, c);
+    }
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+                   _mm_loadu_si128((const __m128i *)(s + i)), needle));
+        if (mask != 0) {
+            return s + i + __builtin_ctz(mask);
+        }
+    }
+    if (i < len) {
+        i = len - 16;
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+                   _mm_loadu_si128((const __m128i *)(s + i)), needle));
+        if (mask != 0) {
+            return s + i + __builtin_ctz(mask);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Compare the first and last byte of the key at 16 positions at once, only
+ * the candidates matching both get a full compare.
+ */
+__attribute__((target("sse2")))
+static const char *
+sse2_find_str (const char *s, uint32_t len, const char *key,
+               uint32_t key_len)
+{
+    __m128i first, last;
+    uint32_t i, span;
+    int mask, bit;
+
+    if (key_len < 2) {
+        return key_len == 0 ? s : sse2_find_char(s, len, key[0]);
+    }
+    span = key_len - 1 + 16;
+    if (len < span) {
+        return scalar_find_str(s, len, key, key_len);
+    }
+
+    first = _mm_set1_epi8(key[0]);
+    last = _mm_set1_epi8(key[key_len - 1]);
+    for (i = 0; ; i += 16) {
+        if (i + span > len) {
+            // last round, overlapping the previous one
+            i = len - span;
+        }
+        mask = _mm_movemask_epi8(_mm_and_si128(
+                   _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(s + i)),
+                                  first),
+                   _mm_cmpeq_epi8(_mm_loadu_si128(
+                                      (const __m128i *)(s + i + key_len - 1)),
+                                  last)));
+        while (mask != 0) {
+            bit = __builtin_ctz(mask);
+            if (scan_bytes_eq(s + i + bit + 1, key + 1, key_len - 2)) {
+                return s + i + bit;
+            }
+            mask &= mask - 1;
+        }
+        if (i + span == len) {
+            return NULL;
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static const char *
+avx2_find_char (const char *s, uint32_t len, char c)
+{
+    __m256i needle = _mm256_set1_epi8(c);
+    __m128i needle16;
+    uint32_t i, mask;
+
+    if (len < 32) {
+        if (len < 16) {
+            return scalar_find_char(s, len, c);
+        }
+        needle16 = _mm256_castsi256_si128(needle);
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+                   _mm_loadu_si128((const __m128i *)s), needle16));
+        if (mask != 0) {
+            return s + __builtin_ctz(mask);
+        }
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+                   _mm_loadu_si128((const __m128i *)(s + len - 16)),
+                   needle16));
+        return mask != 0 ? s + len - 16 + __builtin_ctz(mask) : NULL;
+    }
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                   _mm256_loadu_si256((const __m256i *)(s + i)), needle));
+        if (mask != 0) {
+            return s + i + __builtin_ctz(mask);
+        }
+    }
+    if (i < len) {
+        i = len - 32;
+        mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                   _mm256_loadu_si256((const __m256i *)(s + i)), needle));
+        if (mask != 0) {
+            return s + i + __builtin_ctz(mask);
+        }
+    }
+    return NULL;
+}
+
+__attribute__((target("avx2")))
+static const char *
+avx2_find_str (const char *s, uint32_t len, const char *key,
+               uint32_t key_len)
+{
+    __m256i first, last;
+    uint32_t i, span, mask;
+    int bit;
+
+    if (key_len < 2) {
+        return key_len == 0 ? s : avx2_find_char(s, len, key[0]);
+    }
+    span = key_len - 1 + 32;
+    if (len < span) {
+        return scalar_find_str(s, len, key, key_len);
+    }
+
+    first = _mm256_set1_epi8(key[0]);
+    last = _mm256_set1_epi8(key[key_len - 1]);
+    for (i = 0; ; i += 32) {
+        if (i + span > len) {
+            i = len - span;
+        }
+        mask = _mm256_movemask_epi8(_mm256_and_si256(
+                   _mm256_cmpeq_epi8(
+                       _mm256_loadu_si256((const __m256i *)(s + i)), first),
+                   _mm256_cmpeq_epi8(
+                       _mm256_loadu_si256(
+                           (const __m256i *)(s + i + key_len - 1)), last)));
+        while (mask != 0) {
+            bit = __builtin_ctz(mask);
+            if (scan_bytes_eq(s + i + bit + 1, key + 1, key_len - 2)) {
+                return s + i + bit;
+            }
+            mask &= mask - 1;
+        }
+        if (i + span == len) {
+            return NULL;
+        }
+    }
+}
+#endif
+
+static const scan_ops_t scan_impls[SCAN_IMPL_CNT] = {
+    [SCAN_IMPL_SCALAR] = {"scalar", scalar_find_char, scalar_find_str},
+#ifdef SCAN_X86
+    [SCAN_IMPL_SSE2] = {"sse2", sse2_find_char, sse2_find_str},
+    [SCAN_IMPL_AVX2] = {"avx2", avx2_find_char, avx2_find_str},
+#endif
+};
+
+const scan_ops_t *scan_ops = &scan_impls[SCAN_IMPL_SCALAR];
+
+static bool
+scan_impl_supported (int impl)
+{
+    if (impl < 0 || impl >= SCAN_IMPL_CNT || scan_impls[impl].name == NULL) {
+        return False;
+    }
+#ifdef SCAN_X86
+    if (impl == SCAN_IMPL_AVX2) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (impl == SCAN_IMPL_SSE2) {
+        return __builtin_cpu_supports("sse2");
+    }
+#endif
+    return True;
+}
+
+/*
+ * NULL if the implementation is not built in or the CPU lacks it.
+ */
+const scan_ops_t *
+scan_get_ops (int impl)
+{
+    return scan_impl_supported(impl) ? &scan_impls[impl] : NULL;
+}
+
+/*
+ * Force an implementation, for benchmarks and tests.
+ */
+int
+scan_set_impl (int impl)
+{
+    if (!scan_impl_supported(impl)) {
+        return -1;
+    }
+    scan_ops = &scan_impls[impl];
+    return 0;
+}
+
+__attribute__((constructor))
+static void
+scan_dispatch (void)
+{
+    int impl;
+
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+#endif
+    for (impl = SCAN_IMPL_CNT - 1; impl > SCAN_IMPL_SCALAR; impl--) {
+        if (scan_set_impl(impl) == 0) {
+            return;
+        }
+    }
+}
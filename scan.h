@@ -0,0 +1,63 @@
+#ifndef __SCAN_H__
+#define __SCAN_H__
+
+#include <stdint.h>
+
+/*
+ * Byte and substring search kernels for request parsing. The widest
+ * implementation the CPU supports is picked at startup, AVX2 or SSE2 on
+ * x86-64 and plain loops elsewhere.
+ */
+enum {
+    SCAN_IMPL_SCALAR = 0,
+    SCAN_IMPL_SSE2,
+    SCAN_IMPL_AVX2,
+    SCAN_IMPL_CNT,
+};
+
+typedef struct scan_ops_s {
+    const char *name;
+    const char *(*find_char)(const char *s, uint32_t len, char c);
+    const char *(*find_str)(const char *s, uint32_t len,
+                            const char *key, uint32_t key_len);
+} scan_ops_t;
+
+extern const scan_ops_t *scan_ops;
+
+int
+scan_set_impl(int impl);
+
+const scan_ops_t *
+scan_get_ops(int impl);
+
+/*
+ * First c in s[0, len), NULL if there is none.
+ */
+static inline const char *
+scan_find_char (const char *s, uint32_t len, char c)
+{
+    return scan_ops->find_char(s, len, c);
+}
+
+/*
+ * First occurrence of key in s[0, len), NULL if there is none.
+ */
+static inline const char *
+scan_find_str (const char *s, uint32_t len, const char *key,
+               uint32_t key_len)
+{
+    return scan_ops->find_str(s, len, key, key_len);
+}
+
+static inline const char *
+scan_find_eol (const char *s, uint32_t len)
+{
+    return scan_find_char(s, len, '\n');
+}
+
+static inline const char *
+scan_find_colon (const char *s, uint32_t len)
+{
+    return scan_find_char(s, len, ':');
+}
+#endif //__SCAN_H__
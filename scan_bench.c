@@ -0,0 +1,239 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+#include "scan.h"
+
+#define BENCH_ROUNDS 200000
+#define CHECK_ROUNDS 20000
+#define CHECK_BUF_SIZE 300
+#define TXN_ID_KEY "\"txn_id\""
+
+typedef struct bench_req_s {
+    const char *name;
+    char *buf;
+    uint32_t len;
+    uint32_t header_len;
+} bench_req_t;
+
+static const char *
+libc_find_char (const char *s, uint32_t len, char c)
+{
+    return memchr(s, c, len);
+}
+
+static const char *
+libc_find_str (const char *s, uint32_t len, const char *key,
+               uint32_t key_len)
+{
+    return memmem(s, len, key, key_len);
+}
+
+static const scan_ops_t libc_ops = {"libc", libc_find_char, libc_find_str};
+
+/*
+ * What the server did before scanning the body for the key: take the last
+ * line with strlen and a backward loop, then strchr for ':'.
+ */
+__attribute__((noinline))
+static const char *
+orig_find_txn_id (char *s)
+{
+    char *p = s + strlen(s);
+
+    while (p > s && *(p - 1) != '\n') {
+        p--;
+    }
+    return strchr(p, ':');
+}
+
+/*
+ * The scans of one request: every line end and header delimiter, then the
+ * txn_id value in the body. Return a checksum of the offsets found.
+ */
+static uint64_t
+scan_request (const scan_ops_t *ops, bench_req_t *req)
+{
+    const char *p = req->buf, *end = req->buf + req->header_len, *eol, *colon;
+    uint64_t sum = 0;
+
+    while (p < end) {
+        eol = ops->find_char(p, end - p, '\n');
+        if (eol == NULL) {
+            break;
+        }
+        colon = ops->find_char(p, eol - p, ':');
+        if (colon != NULL) {
+            sum += colon - req->buf;
+        }
+        sum += eol - req->buf;
+        p = eol + 1;
+    }
+
+    p = ops->find_str(end, req->len - req->header_len,
+                      TXN_ID_KEY, strlen(TXN_ID_KEY));
+    if (p != NULL) {
+        p = ops->find_char(p, req->buf + req->len - p, ':');
+        sum += p - req->buf;
+    }
+    return sum;
+}
+
+static void
+bench_one (const scan_ops_t *ops, bench_req_t *req)
+{
+    uint64_t start, elapsed, sum = 0;
+    struct timespec ts;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    start = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        sum += scan_request(ops, req);
+        __asm__ __volatile__("" ::: "memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    elapsed = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec - start;
+
+    printf("  %-8s %8.1f ns/request %8.2f GB/s  (%lu)\n", ops->name,
+           (double)elapsed / BENCH_ROUNDS,
+           (double)req->len * BENCH_ROUNDS / elapsed,
+           (unsigned long)(sum / BENCH_ROUNDS));
+}
+
+static void
+bench_orig (bench_req_t *req)
+{
+    uint64_t start, elapsed, sum = 0;
+    struct timespec ts;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    start = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        sum += orig_find_txn_id(req->buf) - req->buf;
+        __asm__ __volatile__("" ::: "memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    elapsed = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec - start;
+
+    printf("  %-8s %8.1f ns/request, txn_id only  (%lu)\n", "orig",
+           (double)elapsed / BENCH_ROUNDS, (unsigned long)(sum / BENCH_ROUNDS));
+}
+
+static void
+make_req (bench_req_t *req, const char *name, int extra_headers,
+          int body_pad)
+{
+    char *header, *body, *pad;
+    int i, len;
+
+    pad = malloc(body_pad + 1);
+    for (i = 0; i < body_pad; i++) {
+        pad[i] = 'a' + i % 26;
+    }
+    pad[body_pad] = '\0';
+
+    len = asprintf(&body, "{\"payload\": \"%s\", \"txn_id\": \"txn_1_42\"}",
+                   pad);
+    asprintf(&header, "POST /graph/ HTTP/1.1\r\n"
+                      "Content-length: %d\r\n"
+                      "Host: 127.0.0.1:9999\r\n"
+                      "Content-type: application/json\r\n"
+                      "%s"
+                      "\r\n", len,
+             extra_headers ?
+             "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+             "(KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+             "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+             "image/avif,image/webp,*/*;q=0.8\r\n"
+             "Accept-Language: en-US,en;q=0.9\r\n"
+             "Accept-Encoding: gzip, deflate, br\r\n"
+             "Cookie: session=0123456789abcdef0123456789abcdef; "
+             "theme=dark; tracking=a1b2c3d4e5f6\r\n"
+             "Cache-Control: no-cache\r\n" : "");
+
+    req->name = name;
+    req->header_len = strlen(header);
+    req->len = req->header_len + len;
+    asprintf(&req->buf, "%s%s", header, body);
+    free(header);
+    free(body);
+    free(pad);
+}
+
+/*
+ * Every implementation finds the same thing as libc on random short
+ * buffers, where matches fall on all alignments and tails.
+ */
+static int
+check_impls (void)
+{
+    static const char alphabet[] = "ab:\n\"txn_id";
+    char buf[CHECK_BUF_SIZE];
+    const scan_ops_t *ops;
+    const char *expect, *got;
+    uint32_t len, key_len;
+    int impl, i, j;
+
+    srand(1);
+    for (i = 0; i < CHECK_ROUNDS; i++) {
+        len = rand() % CHECK_BUF_SIZE;
+        for (j = 0; j < (int)len; j++) {
+            buf[j] = alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+        key_len = 1 + rand() % strlen(TXN_ID_KEY);
+
+        for (impl = 0; impl < SCAN_IMPL_CNT; impl++) {
+            ops = scan_get_ops(impl);
+            if (ops == NULL) {
+                continue;
+            }
+            expect = libc_find_char(buf, len, ':');
+            got = ops->find_char(buf, len, ':');
+            if (got != expect) {
+                printf("FAIL: %s find_char at %d\n", ops->name, i);
+                return -1;
+            }
+            expect = libc_find_str(buf, len, TXN_ID_KEY, key_len);
+            got = ops->find_str(buf, len, TXN_ID_KEY, key_len);
+            if (got != expect) {
+                printf("FAIL: %s find_str at %d\n", ops->name, i);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main (void)
+{
+    bench_req_t reqs[3];
+    const scan_ops_t *ops;
+    int i, impl;
+
+    if (check_impls() != 0) {
+        return -1;
+    }
+
+    make_req(&reqs[0], "client request", 0, 0);
+    make_req(&reqs[1], "browser headers, 1KB body", 1, 1024);
+    make_req(&reqs[2], "browser headers, 16KB body", 1, 16 * 1024);
+
+    printf("Dispatched to %s\n", scan_ops->name);
+    for (i = 0; i < 3; i++) {
+        printf("%s, %u bytes:\n", reqs[i].name, reqs[i].len);
+        bench_orig(&reqs[i]);
+        bench_one(&libc_ops, &reqs[i]);
+        for (impl = 0; impl < SCAN_IMPL_CNT; impl++) {
+            ops = scan_get_ops(impl);
+            if (ops != NULL) {
+                bench_one(ops, &reqs[i]);
+            }
+        }
+        free(reqs[i].buf);
+    }
+    return 0;
+}
@@ -1,24 +1,112 @@
+#define _GNU_SOURCE
+
 #include <errno.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <signal.h>
 #include <strings.h>
 #include <pthread.h>
+#include <sys/time.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <sys/uio.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include "util.h"
-#include "queue.h"
-#include "task_queue.h"
+#include "iobuf.h"
+#include "session_table.h"
+#include "worker_pool.h"
+#include "http_parser.h"
+#include "scan.h"
+#include "router.h"
+#include "metrics.h"
+#include "txn_set.h"
+#include "ingest_log.h"
+#include "codel.h"
 #include "server_common.h"
+#include "uring.h"
+#include "timer_wheel.h"
+#include "coro.h"
+#include "affinity.h"
+#include "arena.h"
+#include "slab.h"
 
 #define SERVER_LISTEN_PORT 9999
 
 #define WORKER_THREAD_CNT 4
-#define EPOLL_WAIT_MAX_EVENTS WORKER_THREAD_CNT
-#define BUF_MAX_LEN 1023
+#define EPOLL_WAIT_MAX_EVENTS 64
+#define REQUEST_QUEUE_MAX_SIZE 1024
+#define REACTOR_WAIT_MAX_EVENTS 64
+#define ACCEPT_REPORT_INTERVAL 1 //seconds
+#define SESSION_BUF_SIZE 1024
+#define SESSION_READ_SIZE 512
+#define SESSION_ARENA_CHUNK_SIZE 1024
+#define SESSION_OUT_HIGH_WATER (64*1024)
+#define SESSION_IN_HIGH_WATER (64*1024)
+#define SESSION_TIMER_TICK_MS 100
+#define SESSION_IDLE_TIMEOUT_MS (60*1000)
+#define SESSION_HEADER_TIMEOUT_MS (10*1000)
+#define SESSION_WRITE_TIMEOUT_MS (30*1000)
+#define RESP_HEADER_MAX_LEN 128
+#define RESP_BATCH_MAX_IOV 64
+#define RESP_BATCH_BUF_SIZE 4096
+#define RESP_BATCH_FULL 1
+#define RESP_WAIT_DURABLE 2
+#define URING_ENTRIES 1024
+#define URING_BUF_GROUP_ID 0
+#define URING_BUF_CNT 512
+#define URING_BUF_SIZE 2048
+
+/*
+ * SERVER_MODE_PIPELINE: one epoll thread hands readable sessions to the
+ *                       worker threads through worker_pool, each to the
+ *                       worker which handled it last.
+ * SERVER_MODE_REACTOR:  N shared-nothing reactor threads, each owns a
+ *                       SO_REUSEPORT listen socket, an epoll instance and
+ *                       its sessions, and handles requests inline.
+ * SERVER_MODE_URING:    same layout as SERVER_MODE_REACTOR, but each
+ *                       reactor drives its sockets through an io_uring
+ *                       instance instead of epoll. Falls back to
+ *                       SERVER_MODE_REACTOR when io_uring is unavailable.
+ * SERVER_MODE_CORO:     same layout as SERVER_MODE_REACTOR, but each
+ *                       session runs in a coroutine of its reactor as a
+ *                       blocking read, handle, write loop.
+ */
+enum {
+    SERVER_MODE_PIPELINE = 0,
+    SERVER_MODE_REACTOR,
+    SERVER_MODE_URING,
+    SERVER_MODE_CORO,
+};
+
+/*
+ * Operation of an io_uring completion, kept in the low bits of user_data,
+ * the rest is the reactor or session pointer, both 8 bytes aligned. 0 is
+ * for completions which need no handling.
+ */
+enum {
+    URING_OP_NONE = 0,
+    URING_OP_ACCEPT,
+    URING_OP_RECV,
+    URING_OP_SEND,
+    URING_OP_WAKE,
+};
+#define URING_OP_MASK 7UL
+
+/*
+ * What a session is waiting for, each with its own deadline: the next
+ * request on an idle keep-alive connection, the rest of a partial request,
+ * or the peer to read pending output.
+ */
+enum {
+    SESSION_TIMEOUT_IDLE = 0,
+    SESSION_TIMEOUT_HEADER,
+    SESSION_TIMEOUT_WRITE,
+    SESSION_TIMEOUT_KIND_CNT,
+};
 
 #define dump_one_session(session) \
 do {\
@@ -26,373 +114,2742 @@ do {\
            (session)->sockfd, (session)->client_ip, (session)->client_port);\
 } while (0)
 
+#define SESSION_DUMP_SIGNAL SIGUSR1
+
+typedef struct reactor_s {
+    int id;
+    int cpu;          // its thread is pinned to, -1 for none
+    int epoll_fd;
+    int listen_fd;
+    uint64_t accepted;
+    session_table_t session_table;
+    // only shared with the workers in pipeline mode, see reactor_timer_lock
+    pthread_mutex_t timer_lock;
+    timer_wheel_t timer_wheel;
+    uint64_t timeouts[SESSION_TIMEOUT_KIND_CNT];
+    uring_t ring;
+    uring_buf_ring_t buf_ring;
+    // sessions woken by the ingest log flusher, signalled through wake_fd
+    int wake_fd;
+    uint64_t wake_cnt;
+    pthread_mutex_t wake_lock;
+    struct session_s *wake_list;
+    coro_sched_t coro_sched;
+    pthread_t thread_id;
+} reactor_t;
+
+/*
+ * Responses of one wakeup, flushed with a single writev. Header and body
+ * of each response are separate iovecs pointing into buf.
+ *
+ * A deferred batch belongs to an io_uring session and is sent
+ * asynchronously, so every body is copied into buf and nothing is written
+ * on flush, the batch is submitted once the buffered requests are handled.
+ */
+typedef struct resp_batch_s {
+    struct iovec iov[RESP_BATCH_MAX_IOV];
+    int iovcnt;
+    uint32_t used;
+    bool deferred;
+    char buf[RESP_BATCH_BUF_SIZE];
+} resp_batch_t;
+
 typedef struct session_s {
     int sockfd;
     char client_ip[INET_ADDRSTRLEN+1];
     int client_port;
+    reactor_t *reactor;
+    iobuf_t inbuf;
+    http_parser_t parser;
+    // output the socket didn't take yet, flushed on EPOLLOUT
+    iobuf_t outbuf;
+    uint32_t epoll_events;
+    bool closing;
+    // deadline_ms may be later than the armed timer, see session_touch
+    tw_timer_t timer;
+    uint64_t timer_ms;
+    uint64_t deadline_ms;
+    int timeout_kind;
+    bool progress;
+    // metrics timestamps, accept_ns is cleared once the first bytes arrive
+    uint64_t accept_ns;
+    uint64_t queued_ns;
+    uint64_t parse_ns;
+    uint64_t send_ns;
+    // pipeline mode, the worker it goes back to, -1 for none yet
+    int worker;
+    /*
+     * A POST /graph/ handled again, once its ingest log record is durable
+     * or there is room in the deferred batch, keeps what it did the first
+     * time. A parked session isn't read or handled until the flusher
+     * wakes it.
+     */
+    bool post_started;
+    bool post_duplicate;
+    bool parked;
+    bool ingest_waiting;
+    ingest_waiter_t ingest_waiter;
+    struct session_s *wake_next;
+    // coroutine mode only
+    coro_t *co;
+    // what lives as long as the session, see session_alloc
+    arena_t arena;
+    // io_uring mode only
+    resp_batch_t *out;
+    uint32_t sends_inflight;
+    bool recv_active;
+    bool recv_paused;
 } session_t;
 
-static queue_t session_queue;
-static task_queue_t request_tqueue;
+typedef struct server_conf_s {
+    int mode;
+    int thread_cnt;
+    int backlog;
+    uint32_t txn_set_capacity; // 0 to accept duplicates
+    const char *ingest_dir;    // NULL to acknowledge without logging
+    uint32_t ingest_batch_bytes;
+    uint32_t ingest_batch_wait_us;
+    uint32_t queue_size;       // over all workers, 0 for no bound
+    uint32_t codel_target_us;  // 0 to never shed on queueing delay
+    slab_pages_t pages;        // backing the session slabs
+} server_conf_t;
 
-static int listen_fd;
-static int epoll_fd;
+static server_conf_t server_conf;
+
+// sessions and their buffers, recycled instead of going back to malloc
+static slab_t session_slab;
+static slab_t buffer_slab;
+
+static worker_pool_t worker_pool;
+
+/*
+ * Sheds sessions which waited too long in the worker deques, one per
+ * worker so none waits on another's lock.
+ */
+static codel_t *request_codels;
+
+/*
+ * In pipeline mode there is a single reactor driven by the epoll thread,
+ * in reactor mode there is one per reactor thread.
+ */
+static reactor_t *reactors;
+static int reactor_cnt;
+
+static router_t router;
+
+// txn_ids already handled, a retried transaction is answered as such
+static txn_set_t txn_set;
+
+// POST bodies are acknowledged once they are durable in it
+static ingest_log_t ingest_log;
 
 static void
 close_session(session_t *);
 
-#define TXN_ID_MAX_LEN 31
+static void
+reactor_handle_wake(reactor_t *);
 
-static char *
-switch_to_last_line (char *s)
-{
-    char *p;
+static void
+reactor_accept(reactor_t *);
 
-    p = s + strlen(s);
-    for (; p > s; p--) {
-        if (*p == '\n') {
-            return p+1;
-        }
-    }
-    return p;
-}
+static int
+uring_session_start(session_t *);
 
 static void
-extract_txn_id (char *s, char *txn_id)
+uring_session_process(session_t *);
+
+static void
+uring_close_session(session_t *);
+
+#define TXN_ID_MAX_LEN 31
+#define TXN_ID_KEY "\"txn_id\""
+
+/*
+ * Copy the value of the "txn_id" key of the JSON body into txn_id, "??"
+ * if there is none. False unless a whole non-empty id was copied, an id
+ * cut to TXN_ID_MAX_LEN could be another's, so it is never deduplicated.
+ */
+static bool
+extract_txn_id (const char *s, uint32_t len, char *txn_id)
 {
-    char *p;
+    const char *p, *end = s + len;
+    bool quoted;
+    int i;
 
     memzero(txn_id, TXN_ID_MAX_LEN+1);
 
-    s = switch_to_last_line(s);
-
-    p = strchr(s, ':');
+    p = scan_find_str(s, len, TXN_ID_KEY, strlen(TXN_ID_KEY));
+    if (p != NULL) {
+        p = scan_find_colon(p, end - p);
+    }
     if (p == NULL) {
         strncpy(txn_id, "??", TXN_ID_MAX_LEN);
-        return;
+        return False;
     }
 
     p++;
-    while (*p && (*p == ' ' || *p == '\"')) {
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    quoted = p < end && *p == '\"';
+    if (quoted) {
         p++;
     }
 
-    for (; *p && *p != '\"'; p++, txn_id++) {
-        *txn_id = *p;
+    for (i = 0; p < end && *p != '\"' && i < TXN_ID_MAX_LEN; p++, i++) {
+        txn_id[i] = *p;
     }
+    return quoted && i > 0 && p < end && *p == '\"';
 }
 
-static void *
-worker_thread (void *args)
+static void
+resp_batch_init (resp_batch_t *batch)
 {
-    task_queue_data_t data;
-    session_t *session;
-    char buf[BUF_MAX_LEN+1];
-    char txn_id[TXN_ID_MAX_LEN+1];
-    int n;
+    batch->iovcnt = 0;
+    batch->used = 0;
+}
 
-    for (;;) {
-        task_queue_get(&request_tqueue, &data);
-        session = (session_t *)data.p;
-        memzero(buf, BUF_MAX_LEN+1);
-        n = read(session->sockfd, buf, BUF_MAX_LEN);
-        if (n == -1) {
-            logger(ERROR, "Fail to read from socket %d", session->sockfd);
-            continue;
-        } else if (n == 0) {
-            close_session(session);
-            continue;
-        }
-        logger(DEBUG, "Request msg:\n%s", buf);
-        extract_txn_id(buf, txn_id);
-        snprintf(buf, BUF_MAX_LEN+1, "Get txn_id %s\n", txn_id);
-        logger(DEBUG, "Response msg:\n%s", buf);
-        n = write(session->sockfd, buf, strlen(buf));
-        if (n == -1) {
-            logger(ERROR, "Fail to write to socket %d", session->sockfd);
-            continue;
-        }
-    }
-    return NULL;
+static bool
+session_output_full (session_t *session)
+{
+    return iobuf_len(&session->outbuf) >= SESSION_OUT_HIGH_WATER;
 }
 
+/*
+ * Write out as much pending output as the socket takes without blocking.
+ * A drained buffer which grew past the usual size is released, so only
+ * slow readers hold output memory.
+ */
 static int
-start_worker_threads (void)
+session_flush_output (session_t *session)
 {
-    pthread_t thread_id;
-    int i, rc;
+    iobuf_t *outbuf = &session->outbuf;
+    uint64_t start;
+    ssize_t n;
 
-    for (i = 0; i < WORKER_THREAD_CNT; i++) {
-        rc = pthread_create(&thread_id, NULL, worker_thread, NULL);
-        if (rc != 0) {
-            logger(ERROR, "Fail to create worker thread");
+    if (iobuf_is_empty(outbuf)) {
+        goto release;
+    }
+
+    start = monotonic_ns();
+    while (!iobuf_is_empty(outbuf)) {
+        n = write(session->sockfd, iobuf_head(outbuf), iobuf_len(outbuf));
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            logger(ERROR, "Fail to write to socket %d", session->sockfd);
             return -1;
         }
+        iobuf_consume(outbuf, n);
+        metrics_add(METRICS_BYTES_OUT, n);
+        session->progress = True;
+    }
+    metrics_record(METRICS_HIST_WRITE, monotonic_ns() - start);
+    if (!iobuf_is_empty(outbuf)) {
+        return 0;
+    }
+
+release:
+    if (outbuf->cap > SESSION_BUF_SIZE) {
+        iobuf_clean(outbuf);
     }
     return 0;
 }
 
-static void
-notify_epoll_events (struct epoll_event *evlist,  int ready)
+static int
+session_buffer_output (session_t *session, struct iovec *iov, int iovcnt)
 {
-    task_queue_data_t data;
+    iobuf_t *outbuf = &session->outbuf;
     int i;
 
-    logger(DEBUG, "There are %d events to notify.", ready);
-    for (i = 0; i < ready; i++) {
-        logger(DEBUG, "Epoll event %d", evlist[i].events);
-        if (evlist[i].events & EPOLLIN) {
-            data.p = (session_t *)evlist[i].data.ptr;
-            task_queue_put(&request_tqueue, &data);
+    for (i = 0; i < iovcnt; i++) {
+        if (iobuf_reserve(outbuf, iov[i].iov_len) != 0) {
+            return -1;
         }
+        memcpy(iobuf_tail(outbuf), iov[i].iov_base, iov[i].iov_len);
+        iobuf_produce(outbuf, iov[i].iov_len);
     }
+    return 0;
 }
 
-static void *
-epoll_thread (void *args)
+/*
+ * Write out every queued response with a single writev, keeping them in
+ * the order they were queued. What the socket doesn't take is kept in
+ * the session's output buffer until EPOLLOUT, as is the whole batch when
+ * earlier output is still pending.
+ */
+static int
+resp_batch_flush (session_t *session, resp_batch_t *batch)
 {
-    int ready;
-    struct epoll_event evlist[EPOLL_WAIT_MAX_EVENTS];
+    struct iovec *iov = batch->iov;
+    int iovcnt = batch->iovcnt;
+    uint64_t start;
+    ssize_t n;
+    int rc;
 
-    for (;;) {
-        ready = epoll_wait(epoll_fd, evlist,
-                           EPOLL_WAIT_MAX_EVENTS, -1);
-        if (ready == -1) {
+    if (batch->deferred || iovcnt == 0) {
+        return 0;
+    }
+
+    if (!iobuf_is_empty(&session->outbuf)) {
+        rc = session_buffer_output(session, iov, iovcnt);
+        resp_batch_init(batch);
+        if (rc != 0) {
+            return -1;
+        }
+        return session_flush_output(session);
+    }
+
+    start = monotonic_ns();
+    while (iovcnt > 0) {
+        n = writev(session->sockfd, iov, iovcnt);
+        if (n == -1) {
             if (errno == EINTR) {
                 continue;
-            } else {
-                logger(ERROR, "Fail on epoll_wait");
-                return NULL;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
             }
+            logger(ERROR, "Fail to write to socket %d", session->sockfd);
+            resp_batch_init(batch);
+            return -1;
         }
-        notify_epoll_events(evlist, ready);
-    }
-    return NULL;
-}
-
-static int
-start_epoll_thread (void)
-{
-    pthread_t thread_id;
-    int rc;
+        metrics_add(METRICS_BYTES_OUT, n);
 
-    rc = pthread_create(&thread_id, NULL, epoll_thread, NULL);
-    if (rc != 0) {
-        logger(ERROR, "Fail to create epoll thread");
-        return -1;
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
     }
-    return 0;
+    metrics_record(METRICS_HIST_WRITE, monotonic_ns() - start);
+
+    rc = session_buffer_output(session, iov, iovcnt);
+    resp_batch_init(batch);
+    return rc;
 }
 
 static void
-save_session (session_t *session)
+resp_batch_add_iov (resp_batch_t *batch, const void *base, uint32_t len)
 {
-    struct epoll_event ev;
-    int rc;
-
-    queue_enqueue(&session_queue, session);
-
-    ev.events = EPOLLIN | EPOLLET;
-    ev.data.ptr = session;
-
-    rc = epoll_ctl(epoll_fd, EPOLL_CTL_ADD,
-                   session->sockfd, &ev);
-    if (rc != 0) {
-        logger(ERROR, "Fail on epoll_ctl.");
+    if (len == 0) {
         return;
     }
+    batch->iov[batch->iovcnt].iov_base = (void *)base;
+    batch->iov[batch->iovcnt].iov_len = len;
+    batch->iovcnt++;
 }
 
-static void
-dump_all_sessions (void)
+/*
+ * Queue one response. Header and body go in as separate iovecs, small
+ * bodies are copied into the batch buffer, a body too large for it is
+ * referenced in place and the batch is flushed before returning.
+ * A full deferred batch can't be flushed here, RESP_BATCH_FULL is
+ * returned with nothing queued.
+ */
+static int
+send_response (session_t *session, resp_batch_t *batch, int status,
+               const char *reason, const char *body, uint32_t body_len,
+               bool keep_alive)
 {
-    session_t *session;
+    bool copy_body = (batch->deferred || body_len <= RESP_BATCH_BUF_SIZE/2);
+    uint32_t need;
+    char *p;
+    int len;
 
-    logger(DEBUG, "Remaining sessions:");
-    queue_seek_head(&session_queue);
-    for (;;) {
-        session = queue_get_next(&session_queue);
-        if (!session) {
-            break;
+    need = RESP_HEADER_MAX_LEN + (copy_body ? body_len : 0);
+    if (batch->iovcnt + 2 > RESP_BATCH_MAX_IOV ||
+        RESP_BATCH_BUF_SIZE - batch->used < need) {
+        if (batch->deferred) {
+            return batch->iovcnt > 0 ? RESP_BATCH_FULL : -1;
+        }
+        if (resp_batch_flush(session, batch) != 0) {
+            return -1;
         }
-        dump_one_session(session);
     }
-}
 
-static void
-close_session (session_t *session)
-{
-    logger(DEBUG, "Close session:");
-    dump_one_session(session);
-    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, session->sockfd, NULL);
-    close(session->sockfd);
-    queue_remove(&session_queue, session);
-    free(session); 
-    dump_all_sessions();
+    p = batch->buf + batch->used;
+    len = snprintf(p, RESP_HEADER_MAX_LEN,
+                   "HTTP/1.1 %d %s\r\n"
+                   "Content-Length: %u\r\n"
+                   "%s"
+                   "\r\n",
+                   status, reason, body_len,
+                   keep_alive ? "" : "Connection: close\r\n");
+    if (len >= RESP_HEADER_MAX_LEN) {
+        len = RESP_HEADER_MAX_LEN - 1;
+    }
+    batch->used += len;
+    resp_batch_add_iov(batch, p, len);
+    logger(DEBUG, "Response msg:\n%.*s%.*s", len, p, (int)body_len, body);
+
+    if (!copy_body) {
+        resp_batch_add_iov(batch, body, body_len);
+        return resp_batch_flush(session, batch);
+    }
+
+    p = batch->buf + batch->used;
+    memcpy(p, body, body_len);
+    batch->used += body_len;
+    resp_batch_add_iov(batch, p, body_len);
+    return 0;
 }
 
-static void
-handle_accepted_connection (int sockfd, struct sockaddr_in *sockaddr)
-{
+/*
+ * What a route handler gets as ctx: the session the request came on, the
+ * batch to queue its response in, and the thread's arena for scratch
+ * memory, reset once the handler returned. send_response copies or
+ * writes out the body before returning, so it may live there.
+ */
+typedef struct request_ctx_s {
     session_t *session;
+    resp_batch_t *batch;
+    arena_t *arena;
+} request_ctx_t;
 
-    session = calloc(1, sizeof(session_t));
-    if (session == NULL) {
-        return;
+/*
+ * Look the txn_id up and append the body to the ingest log. A duplicate
+ * isn't logged again, it waits for what is logged so far, its first copy
+ * included, to be durable. An id whose body can't be logged is forgotten
+ * so the retry is taken as new.
+ */
+static int
+start_graph_post (session_t *session, const char *data, uint32_t len,
+                  const char *txn_id, bool found)
+{
+    uint64_t *seq = &session->ingest_waiter.seq;
+    bool dedup = found && server_conf.txn_set_capacity > 0;
+
+    session->post_duplicate = dedup &&
+        txn_set_insert(&txn_set, txn_id, strlen(txn_id)) == TXN_SET_EXISTS;
+    if (session->post_duplicate) {
+        metrics_add(METRICS_DUPLICATE_TXNS, 1);
     }
 
-    inet_ntop(AF_INET, &sockaddr->sin_addr,
-              session->client_ip, INET_ADDRSTRLEN+1);
-    session->client_port = sockaddr->sin_port;
-    session->sockfd = sockfd;
-    logger(DEBUG, "Accept sockfd %d from %s:%d",
-           sockfd, session->client_ip, session->client_port);
-    save_session(session);
+    if (server_conf.ingest_dir != NULL) {
+        if (session->post_duplicate) {
+            *seq = ingest_log_last_seq(&ingest_log);
+        } else if (ingest_log_append(&ingest_log, data, len, seq) != 0) {
+            if (dedup) {
+                txn_set_remove(&txn_set, txn_id, strlen(txn_id));
+            }
+            return -1;
+        }
+    }
+    session->post_started = True;
+    return 0;
 }
 
+/*
+ * With the ingest log the response waits for the body to be durable: the
+ * session parks with the request left buffered, see session_park, and
+ * handles it again once the flusher committed its batch.
+ */
 static int
-create_listen_socket (void)
+handle_graph_post (void *ctx, http_request_t *req, const char *buf,
+                   void *arg)
 {
-    int rc, one, sockfd;
-    struct sockaddr_in sockaddr;
+    request_ctx_t *rctx = ctx;
+    session_t *session = rctx->session;
+    const char *data = http_str_ptr(buf, &req->body);
+    char txn_id[TXN_ID_MAX_LEN+1];
+    char body[TXN_ID_MAX_LEN+24];
+    bool found;
+    int len, rc = 0;
 
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0) {
-        logger(ERROR, "Fail to open socket.");
-        return -1;
+    found = extract_txn_id(data, req->body.len, txn_id);
+    if (!session->post_started) {
+        rc = start_graph_post(session, data, req->body.len, txn_id, found);
     }
-    logger(DEBUG, "Create listen sockfd %d", sockfd);
-
-    one = 1;
-    rc = setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY,
-                    &one, sizeof(one));
-    if (rc != 0) {
-        logger(ERROR, "Fail to set sockopt");
-        close(sockfd);
-        return -1;
+    if (rc == 0 && server_conf.ingest_dir != NULL) {
+        rc = ingest_log_check(&ingest_log, session->ingest_waiter.seq);
+        if (rc == INGEST_LOG_PENDING) {
+            session->parked = True;
+            return RESP_WAIT_DURABLE;
+        }
+        if (rc != 0 && found && server_conf.txn_set_capacity > 0 &&
+            !session->post_duplicate) {
+            txn_set_remove(&txn_set, txn_id, strlen(txn_id));
+        }
     }
 
-    bzero((char *)&sockaddr, sizeof(struct sockaddr_in));
-    sockaddr.sin_family = AF_INET;
-    sockaddr.sin_addr.s_addr = INADDR_ANY;
-    sockaddr.sin_port = htons(SERVER_PORT);
-
-    rc = bind(sockfd, (struct sockaddr *)&sockaddr, sizeof(struct sockaddr_in));
     if (rc != 0) {
-        logger(ERROR, "Fail to bind to port %d", SERVER_PORT);
-        printf("Fail to bind to port %d.\n", SERVER_PORT);
-        return -1;
+        rc = send_response(session, rctx->batch, 503, "Service Unavailable",
+                           "Ingest log unavailable\n", 23, req->keep_alive);
+    } else {
+        if (session->post_duplicate) {
+            len = snprintf(body, sizeof(body), "Duplicate txn_id %s\n",
+                           txn_id);
+        } else {
+            len = snprintf(body, sizeof(body), "Get txn_id %s\n", txn_id);
+        }
+        rc = send_response(session, rctx->batch, 200, "OK", body, len,
+                           req->keep_alive);
     }
-
-    return sockfd;
+    if (rc != RESP_BATCH_FULL) {
+        session->post_started = False;
+    }
+    return rc;
 }
 
 static int
-server_init (void)
+handle_health (void *ctx, http_request_t *req, const char *buf, void *arg)
 {
-    int rc;
-    char *err;
+    request_ctx_t *rctx = ctx;
 
-    queue_init(&session_queue);
+    return send_response(rctx->session, rctx->batch, 200, "OK", "OK\n", 3,
+                         req->keep_alive);
+}
 
-    rc = task_queue_init(&request_tqueue);
-    if (rc != 0) {
-        task_queue_clean(&request_tqueue);
-        return -1;
-    }
-    task_queue_set_max_size(&request_tqueue, 0);
+static int
+handle_not_found (void *ctx, http_request_t *req, const char *buf,
+                  void *arg)
+{
+    request_ctx_t *rctx = ctx;
 
-    epoll_fd = epoll_create1(0);
-    if (epoll_fd == -1) {
-        logger(ERROR, "Fail to create epfd.");
-        task_queue_clean(&request_tqueue);
-        return -1;
-    }
+    return send_response(rctx->session, rctx->batch, 404, "Not Found",
+                         "Not Found\n", 10, req->keep_alive);
+}
 
-    listen_fd = create_listen_socket();
-    if (listen_fd == -1) {
-        err = strerror(errno);
-        printf("Fail to create listen socket, %s.\n", err);
-        task_queue_clean(&request_tqueue);
-        close(epoll_fd);
-        return -1;
-    }
+static int
+handle_metrics (void *ctx, http_request_t *req, const char *buf, void *arg)
+{
+    request_ctx_t *rctx = ctx;
+    void *scratch;
+    char *body;
+    int len = -1;
 
-    rc = listen(listen_fd, 0);
-    if (rc != 0) {
-        err = strerror(errno);
-        printf("Fail to listen to socket, %s.\n", err);
-        task_queue_clean(&request_tqueue);
-        close(epoll_fd);
-        close(listen_fd);
-        return -1;
+    // both fit in a chunk, no malloc once the arena has one
+    scratch = arena_alloc(rctx->arena, METRICS_SCRATCH_SIZE);
+    body = arena_alloc(rctx->arena, METRICS_TEXT_MAX_LEN);
+    if (scratch != NULL && body != NULL) {
+        len = metrics_format(scratch, body, METRICS_TEXT_MAX_LEN);
     }
-
-    return 0;
+    if (len < 0) {
+        return send_response(rctx->session, rctx->batch, 500,
+                             "Internal Server Error", "", 0, req->keep_alive);
+    }
+    return send_response(rctx->session, rctx->batch, 200, "OK", body, len,
+                         req->keep_alive);
 }
 
 static int
-start_threads (void)
+router_setup (void)
 {
     int rc;
 
-    rc = start_epoll_thread();
-    if (rc != 0) {
-        return -1;
+    router_init(&router, handle_not_found, NULL);
+    rc = router_add(&router, "POST", "/graph/", handle_graph_post, NULL);
+    if (rc == 0) {
+        rc = router_add(&router, "GET", "/health", handle_health, NULL);
+    }
+    if (rc == 0) {
+        rc = router_add(&router, "GET", "/metrics", handle_metrics, NULL);
+    }
+    if (rc == 0) {
+        rc = router_compile(&router);
     }
-    rc = start_worker_threads();
     if (rc != 0) {
-        return -1;
+        router_clean(&router);
     }
-    return 0;
+    return rc;
 }
 
+/*
+ * Account received bytes, the first ones close the accept to readable
+ * interval.
+ */
 static void
-wait_on_client_connection (void)
+session_note_input (session_t *session, uint32_t len)
 {
-    int sockfd, addr_len;
-    struct sockaddr_storage sockaddr_accpet;
-    struct sockaddr_in *sockaddr_p;
-    char *err;
-
-    for (;;) {
-        addr_len = sizeof(struct sockaddr_storage);
-        sockfd = accept(listen_fd,
-                        (struct sockaddr *)&sockaddr_accpet,
-                        (socklen_t *)&addr_len);
-        if (sockfd == -1) {
-            logger(ERROR, "Fail on accept, %d, %d", errno, listen_fd);
-            err = strerror(errno);
-            printf("Fail to accept incoming connection, %s.\n", err);
-            break;
-        }
-
-        if (addr_len != sizeof(struct sockaddr_in)) {
-            logger(INFO, "Drop NON-IPV4 peer.");
-            continue;
-        }
-
-        sockaddr_p = (struct sockaddr_in *)&sockaddr_accpet;
-        handle_accepted_connection(sockfd, sockaddr_p);
+    if (session->accept_ns != 0) {
+        metrics_record(METRICS_HIST_ACCEPT_READABLE,
+                       monotonic_ns() - session->accept_ns);
+        session->accept_ns = 0;
     }
+    metrics_add(METRICS_BYTES_IN, len);
 }
 
-static void
-server_clean (void)
+static int
+handle_http_request (session_t *session, resp_batch_t *batch,
+                     http_request_t *req, const char *buf)
 {
-    task_queue_clean(&request_tqueue);
-    close(epoll_fd);
-    close(listen_fd);
+    request_ctx_t ctx = { session, batch, arena_thread() };
+    int rc;
+
+    logger(DEBUG, "Request msg:\n%.*s", (int)req->len, buf);
+    rc = router_dispatch(&router, &ctx, req, buf);
+    arena_reset(ctx.arena);
+    return rc;
 }
 
-int main (void)
+/*
+ * Handle every complete request in the session buffer, queueing their
+ * responses in batch. A partial request stays buffered together with the
+ * parser state until more bytes arrive, so does a request whose response
+ * didn't fit in a full deferred batch or waits for its ingest log record
+ * to be durable, and every request once the output of the session is over
+ * its high-water mark. Return -1 if the session has to be closed, after
+ * flushing what is queued.
+ *
+ * When shed, requests are answered 503 without being routed, except a
+ * POST already appended to the ingest log, it is seen through.
+ */
+static int
+handle_buffered_requests (session_t *session, resp_batch_t *batch, bool shed)
 {
+    iobuf_t *inbuf = &session->inbuf;
+    http_parser_t *parser = &session->parser;
+    uint64_t start;
+    bool keep_alive;
     int rc;
 
-    rc = server_init();
-    if (rc != 0) {
-        return -1;
-    }
+    while (!session->parked && !iobuf_is_empty(inbuf) &&
+           !session_output_full(session)) {
+        // a request already parsed waited for room or durability
+        if (parser->state != HTTP_PARSER_DONE) {
+            start = monotonic_ns();
+            rc = http_parser_execute(parser, iobuf_head(inbuf),
+                                     iobuf_len(inbuf));
+            session->parse_ns += monotonic_ns() - start;
+            if (rc == HTTP_PARSE_DONE) {
+                metrics_record(METRICS_HIST_PARSE, session->parse_ns);
+                metrics_add(METRICS_REQUESTS, 1);
+                session->parse_ns = 0;
+            }
+        } else {
+            rc = HTTP_PARSE_DONE;
+        }
+        if (rc == HTTP_PARSE_AGAIN) {
+            return 0;
+        } else if (rc == HTTP_PARSE_ERROR) {
+            logger(ERROR, "Bad request on socket %d", session->sockfd);
+            metrics_add(METRICS_BAD_REQUESTS, 1);
+            session->parse_ns = 0;
+            rc = send_response(session, batch, 400, "Bad Request", "", 0,
+                               False);
+            if (rc == RESP_BATCH_FULL) {
+                return 0;
+            }
+            resp_batch_flush(session, batch);
+            return -1;
+        }
+
+        if (shed && !session->post_started) {
+            rc = send_response(session, batch, 503, "Service Unavailable",
+                               "Server overloaded\n", 18,
+                               parser->req.keep_alive);
+            if (rc != RESP_BATCH_FULL) {
+                metrics_add(METRICS_SHED_REQUESTS, 1);
+            }
+        } else {
+            rc = handle_http_request(session, batch, &parser->req,
+                                     iobuf_head(inbuf));
+        }
+        if (rc == RESP_BATCH_FULL || rc == RESP_WAIT_DURABLE) {
+            return 0;
+        }
+        keep_alive = parser->req.keep_alive;
+        iobuf_consume(inbuf, parser->req.len);
+        session->progress = True;
+        http_parser_init(parser);
+        if (rc != 0) {
+            return -1;
+        }
+        if (!keep_alive) {
+            resp_batch_flush(session, batch);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static uint32_t
+session_epoll_events (session_t *session)
+{
+    uint32_t events = EPOLLIN | EPOLLET;
+
+    if (server_conf.mode == SERVER_MODE_CORO) {
+        // the coroutine decides what it waits for, see coro_session_event
+        return events | EPOLLOUT;
+    }
+    if (!iobuf_is_empty(&session->outbuf)) {
+        events |= EPOLLOUT;
+    }
+    if (server_conf.mode == SERVER_MODE_PIPELINE) {
+        // one worker at a time owns the session until it is re-armed
+        events |= EPOLLONESHOT;
+    }
+    return events;
+}
+
+/*
+ * Re-arm the one-shot registration in pipeline mode, in reactor mode only
+ * EPOLLOUT interest changes when output starts or stops being pending.
+ */
+static void
+rearm_session (session_t *session)
+{
+    struct epoll_event ev;
+    int rc;
+
+    ev.events = session_epoll_events(session);
+    if (server_conf.mode == SERVER_MODE_REACTOR &&
+        ev.events == session->epoll_events) {
+        return;
+    }
+
+    ev.data.ptr = session;
+    rc = epoll_ctl(session->reactor->epoll_fd, EPOLL_CTL_MOD,
+                   session->sockfd, &ev);
+    if (rc != 0) {
+        logger(ERROR, "Fail to re-arm socket %d", session->sockfd);
+        close_session(session);
+        return;
+    }
+    session->epoll_events = ev.events;
+}
+
+/*
+ * In pipeline mode the workers arm and remove timers of the epoll
+ * thread's wheel, elsewhere the wheel belongs to the reactor thread.
+ */
+static void
+reactor_timer_lock (reactor_t *reactor)
+{
+    if (server_conf.mode == SERVER_MODE_PIPELINE) {
+        pthread_mutex_lock(&reactor->timer_lock);
+    }
+}
+
+static void
+reactor_timer_unlock (reactor_t *reactor)
+{
+    if (server_conf.mode == SERVER_MODE_PIPELINE) {
+        pthread_mutex_unlock(&reactor->timer_lock);
+    }
+}
+
+// called with the timer lock held
+static void
+session_arm_timer (session_t *session, uint64_t expire_ms)
+{
+    timer_wheel_add(&session->reactor->timer_wheel, &session->timer,
+                    expire_ms);
+    __atomic_store_n(&session->timer_ms, expire_ms, __ATOMIC_RELAXED);
+}
+
+static void
+session_start_timer (session_t *session)
+{
+    reactor_t *reactor = session->reactor;
+
+    timer_wheel_timer_init(&session->timer);
+    session->timeout_kind = SESSION_TIMEOUT_IDLE;
+    session->deadline_ms = monotonic_ms() + SESSION_IDLE_TIMEOUT_MS;
+
+    reactor_timer_lock(reactor);
+    session_arm_timer(session, session->deadline_ms);
+    reactor_timer_unlock(reactor);
+}
+
+static void
+session_stop_timer (session_t *session)
+{
+    reactor_t *reactor = session->reactor;
+
+    reactor_timer_lock(reactor);
+    timer_wheel_del(&reactor->timer_wheel, &session->timer);
+    reactor_timer_unlock(reactor);
+}
+
+/*
+ * Set the deadline for what the session now waits for. It restarts when
+ * the session starts waiting for something else, or when a request
+ * completed or output was written since. A later deadline is only stored
+ * and picked up when the armed timer fires, so busy sessions don't touch
+ * the wheel, an earlier one re-arms the timer.
+ */
+static void
+session_touch (session_t *session)
+{
+    reactor_t *reactor = session->reactor;
+    uint64_t deadline;
+    int kind, timeout;
+
+    if (!iobuf_is_empty(&session->outbuf) || session->sends_inflight > 0) {
+        kind = SESSION_TIMEOUT_WRITE;
+        timeout = SESSION_WRITE_TIMEOUT_MS;
+    } else if (!iobuf_is_empty(&session->inbuf)) {
+        kind = SESSION_TIMEOUT_HEADER;
+        timeout = SESSION_HEADER_TIMEOUT_MS;
+    } else {
+        kind = SESSION_TIMEOUT_IDLE;
+        timeout = SESSION_IDLE_TIMEOUT_MS;
+    }
+
+    if (kind == session->timeout_kind && !session->progress) {
+        return;
+    }
+    session->progress = False;
+    session->timeout_kind = kind;
+    deadline = monotonic_ms() + timeout;
+    __atomic_store_n(&session->deadline_ms, deadline, __ATOMIC_RELAXED);
+
+    if (deadline >= __atomic_load_n(&session->timer_ms, __ATOMIC_RELAXED)) {
+        return;
+    }
+    reactor_timer_lock(reactor);
+    if (deadline < session->timer_ms) {
+        session_arm_timer(session, deadline);
+    }
+    reactor_timer_unlock(reactor);
+}
+
+/*
+ * Expire the timers due. A session whose deadline moved since its timer
+ * was armed is re-armed, the others timed out and are shut down, their
+ * owner closes them on the resulting EPOLLHUP or failed I/O. In pipeline
+ * mode this happens under the timer lock, which a closing worker takes to
+ * remove the timer before the fd is closed.
+ */
+static void
+reactor_expire_timers (reactor_t *reactor)
+{
+    dlist_header_t expired, *header;
+    session_t *session;
+    uint64_t now, deadline;
+
+    dlist_init(&expired);
+    now = monotonic_ms();
+
+    reactor_timer_lock(reactor);
+    timer_wheel_advance(&reactor->timer_wheel, now, &expired);
+    while ((header = dlist_pop_left(&expired)) != NULL) {
+        session = dlist_get_entry(header, session_t, timer.header);
+        deadline = __atomic_load_n(&session->deadline_ms, __ATOMIC_RELAXED);
+        if (deadline > now) {
+            session_arm_timer(session, deadline);
+            continue;
+        }
+        reactor->timeouts[session->timeout_kind]++;
+        logger(DEBUG, "Session of socket %d timed out, %d",
+               session->sockfd, session->timeout_kind);
+        shutdown(session->sockfd, SHUT_RDWR);
+    }
+    reactor_timer_unlock(reactor);
+}
+
+static int
+reactor_get_timeout (reactor_t *reactor)
+{
+    int timeout;
+
+    reactor_timer_lock(reactor);
+    timeout = timer_wheel_get_timeout(&reactor->timer_wheel, monotonic_ms());
+    reactor_timer_unlock(reactor);
+    return timeout;
+}
+
+/*
+ * Called by the ingest log flusher once the record a parked session waits
+ * for is durable, or the log failed. The session goes on the wake list of
+ * its reactor, in pipeline mode the epoll thread, the only one pushing to
+ * the worker deques, then hands it back to a worker, its one-shot
+ * registration wasn't re-armed.
+ */
+static void
+session_ingest_done (ingest_waiter_t *waiter)
+{
+    session_t *session = dlist_get_entry(waiter, session_t, ingest_waiter);
+    reactor_t *reactor = session->reactor;
+    uint64_t one = 1;
+
+    pthread_mutex_lock(&reactor->wake_lock);
+    session->wake_next = reactor->wake_list;
+    reactor->wake_list = session;
+    pthread_mutex_unlock(&reactor->wake_lock);
+    if (write(reactor->wake_fd, &one, sizeof(one)) != sizeof(one)) {
+        logger(ERROR, "Fail to wake reactor %d", reactor->id);
+    }
+}
+
+/*
+ * Hand a session parked by its POST to the ingest log, once the thread
+ * handling it is done with it: in pipeline mode the epoll thread may hand
+ * it to another worker as soon as the flusher wakes it. False if the
+ * record became durable meanwhile, the session is to be handled again.
+ */
+static bool
+session_park (session_t *session)
+{
+    int rc;
+
+    if (session->ingest_waiting) {
+        return True;
+    }
+    session->ingest_waiter.done = session_ingest_done;
+    session->ingest_waiting = True;
+    rc = ingest_log_wait(&ingest_log, &session->ingest_waiter);
+    if (rc == INGEST_LOG_PENDING) {
+        return True;
+    }
+    session->ingest_waiting = False;
+    session->parked = False;
+    return False;
+}
+
+/*
+ * Pending output goes first. The socket is edge triggered, so then drain
+ * it until EAGAIN, handling the requests as they complete to keep the
+ * buffer bounded. Responses of all the requests of one wakeup go out
+ * together once the socket is drained. A session whose output is over the
+ * high-water mark isn't read until EPOLLOUT drains it, and a session to be
+ * closed waits for its output to be flushed. A parked session is left
+ * alone, in pipeline mode without re-arming it, until the ingest log
+ * flusher wakes it, it then reads what came meanwhile. A shed session gets
+ * its requests of this wakeup answered 503, see handle_buffered_requests.
+ */
+static void
+handle_session_request (session_t *session, bool shed)
+{
+    iobuf_t *inbuf = &session->inbuf;
+    resp_batch_t batch;
+    int n, rc;
+
+    if (session->parked) {
+        return;
+    }
+again:
+    resp_batch_init(&batch);
+
+    rc = session_flush_output(session);
+    if (rc != 0) {
+        close_session(session);
+        return;
+    }
+    if (session->closing) {
+        if (iobuf_is_empty(&session->outbuf)) {
+            close_session(session);
+        } else {
+            session_touch(session);
+            rearm_session(session);
+        }
+        return;
+    }
+
+    // requests left buffered while the output was full
+    rc = handle_buffered_requests(session, &batch, shed);
+    if (rc != 0) {
+        goto close_after_flush;
+    }
+
+    while (!session_output_full(session) && !session->parked) {
+        rc = iobuf_reserve(inbuf, SESSION_READ_SIZE);
+        if (rc != 0) {
+            close_session(session);
+            return;
+        }
+
+        n = read(session->sockfd, iobuf_tail(inbuf), iobuf_tail_room(inbuf));
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            logger(ERROR, "Fail to read from socket %d", session->sockfd);
+            close_session(session);
+            return;
+        } else if (n == 0) {
+            close_session(session);
+            return;
+        }
+        iobuf_produce(inbuf, n);
+        session_note_input(session, n);
+
+        rc = handle_buffered_requests(session, &batch, shed);
+        if (rc != 0) {
+            goto close_after_flush;
+        }
+    }
+
+    rc = resp_batch_flush(session, &batch);
+    if (rc != 0) {
+        close_session(session);
+        return;
+    }
+    session_touch(session);
+    if (session->parked) {
+        if (!session_park(session)) {
+            goto again;
+        }
+        if (server_conf.mode == SERVER_MODE_PIPELINE) {
+            return;
+        }
+    }
+    rearm_session(session);
+    return;
+
+close_after_flush:
+    if (iobuf_is_empty(&session->outbuf)) {
+        close_session(session);
+        return;
+    }
+    session->closing = True;
+    session_touch(session);
+    rearm_session(session);
+}
+
+/*
+ * A session which sat in a deque past the CoDel target for long enough is
+ * answered 503 right away, what it asked for would come too late.
+ */
+static bool
+worker_should_shed (session_t *session, uint64_t now)
+{
+    if (server_conf.codel_target_us == 0) {
+        return False;
+    }
+    if (!codel_should_shed(&request_codels[session->worker],
+                           now - session->queued_ns, now)) {
+        return False;
+    }
+    metrics_add(METRICS_SHED_CODEL, 1);
+    return True;
+}
+
+static void
+worker_handle_session (void *item, int worker_id, void *arg)
+{
+    session_t *session = (session_t *)item;
+    uint64_t now = monotonic_ns();
+
+    metrics_add(METRICS_QUEUE_GET, 1);
+    metrics_record(METRICS_HIST_QUEUE_WAIT, now - session->queued_ns);
+    session->worker = worker_id;
+    handle_session_request(session, worker_should_shed(session, now));
+}
+
+/*
+ * Epoll thread only. A session goes back to the worker which handled it
+ * last, its data is likely still in that core's cache, another worker
+ * steals it if that one is busy. False if every deque is full.
+ */
+static bool
+dispatch_session (session_t *session, uint64_t now)
+{
+    session->queued_ns = now;
+    if (worker_pool_push(&worker_pool, session->worker, session) == -1) {
+        metrics_add(METRICS_SHED_QUEUE_FULL, 1);
+        return False;
+    }
+    metrics_add(METRICS_QUEUE_PUT, 1);
+    return True;
+}
+
+/*
+ * Sessions the bounded worker deques have no room for are shed by the
+ * epoll thread itself rather than waiting for room, reading them and
+ * answering 503 costs far less than what they would have waited.
+ */
+static void
+notify_epoll_events (reactor_t *reactor, struct epoll_event *evlist, int ready)
+{
+    session_t *shed[EPOLL_WAIT_MAX_EVENTS];
+    session_t *session;
+    uint64_t now = monotonic_ns();
+    int i, cnt = 0;
+
+    logger(DEBUG, "There are %d events to notify.", ready);
+    for (i = 0; i < ready; i++) {
+        logger(DEBUG, "Epoll event %d", evlist[i].events);
+        if (evlist[i].data.ptr == NULL) {
+            reactor_accept(reactor);
+        } else if (evlist[i].data.ptr == reactor) {
+            if (read(reactor->wake_fd, &reactor->wake_cnt,
+                     sizeof(uint64_t)) != sizeof(uint64_t)) {
+                logger(ERROR, "Fail to read wake fd %d", reactor->id);
+            }
+            reactor_handle_wake(reactor);
+        } else if (evlist[i].events &
+                   (EPOLLIN | EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+            session = (session_t *)evlist[i].data.ptr;
+            if (!dispatch_session(session, now)) {
+                shed[cnt++] = session;
+            }
+        }
+    }
+    for (i = 0; i < cnt; i++) {
+        handle_session_request(shed[i], True);
+    }
+}
+
+static void *
+epoll_thread (void *args)
+{
+    reactor_t *reactor = (reactor_t *)args;
+    int ready;
+    struct epoll_event evlist[EPOLL_WAIT_MAX_EVENTS];
+
+    affinity_pin(reactor->cpu);
+    for (;;) {
+        ready = epoll_wait(reactor->epoll_fd, evlist, EPOLL_WAIT_MAX_EVENTS,
+                           reactor_get_timeout(reactor));
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            } else {
+                logger(ERROR, "Fail on epoll_wait");
+                return NULL;
+            }
+        }
+        notify_epoll_events(reactor, evlist, ready);
+        reactor_expire_timers(reactor);
+    }
+    return NULL;
+}
+
+static int
+start_epoll_thread (void)
+{
+    pthread_t thread_id;
+    int rc;
+
+    rc = pthread_create(&thread_id, NULL, epoll_thread, &reactors[0]);
+    if (rc != 0) {
+        logger(ERROR, "Fail to create epoll thread");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Memory freed together with the session, nothing of it can be freed
+ * before. Owned by whichever thread handles the session, like the rest.
+ */
+static void *
+session_alloc (session_t *session, size_t size)
+{
+    return arena_alloc(&session->arena, size);
+}
+
+static void
+free_session (session_t *session)
+{
+    iobuf_clean(&session->inbuf);
+    iobuf_clean(&session->outbuf);
+    arena_clean(&session->arena);
+    slab_free(&session_slab, session);
+}
+
+static int
+save_session (session_t *session)
+{
+    reactor_t *reactor = session->reactor;
+    struct epoll_event ev;
+    int rc;
+
+    rc = session_table_insert(&reactor->session_table,
+                              session->sockfd, session);
+    if (rc != 0) {
+        logger(ERROR, "Fail to save session of socket %d.", session->sockfd);
+        return -1;
+    }
+    session_start_timer(session);
+
+    if (server_conf.mode == SERVER_MODE_URING) {
+        rc = uring_session_start(session);
+        if (rc != 0) {
+            logger(ERROR, "Fail to start recv on socket %d.", session->sockfd);
+            session_stop_timer(session);
+            session_table_remove(&reactor->session_table, session->sockfd);
+            return -1;
+        }
+        return 0;
+    }
+
+    ev.events = session_epoll_events(session);
+    ev.data.ptr = session;
+
+    rc = epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD,
+                   session->sockfd, &ev);
+    if (rc != 0) {
+        logger(ERROR, "Fail on epoll_ctl.");
+        session_stop_timer(session);
+        session_table_remove(&reactor->session_table, session->sockfd);
+        return -1;
+    }
+    session->epoll_events = ev.events;
+    return 0;
+}
+
+static void
+print_one_session (void *data, void *arg)
+{
+    session_t *session = (session_t *)data;
+
+    printf("  socket %d, %s:%d, %u bytes buffered, %u bytes to send%s\n",
+           session->sockfd, session->client_ip, session->client_port,
+           iobuf_len(&session->inbuf), iobuf_len(&session->outbuf),
+           session->parked ? ", parked" : "");
+}
+
+// arg counts the arenas, they are listed newest thread first
+static void
+print_one_arena (arena_t *arena, void *arg)
+{
+    arena_stats_t stats;
+
+    arena_get_stats(arena, &stats);
+    printf("Arena %d: high water %lu bytes, %lu chunks, %lu allocs, "
+           "%lu large, %lu resets\n", (*(int *)arg)++,
+           (unsigned long)stats.high_water, (unsigned long)stats.chunks,
+           (unsigned long)stats.allocs, (unsigned long)stats.large_allocs,
+           (unsigned long)stats.resets);
+}
+
+static void
+print_slab (slab_t *slab)
+{
+    slab_stats_t stats;
+
+    slab_get_stats(slab, &stats);
+    printf("Slab %s: %lu live, %lu free, %lu in thread caches, "
+           "%lu bytes reserved in %u regions, %u hugetlb\n", slab->name,
+           (unsigned long)stats.live, (unsigned long)stats.free,
+           (unsigned long)stats.cached, (unsigned long)stats.reserved,
+           stats.regions, stats.hugetlb_regions);
+}
+
+/*
+ * Full dump of every session, only run on demand, see SESSION_DUMP_SIGNAL.
+ */
+static void
+dump_all_sessions (void)
+{
+    worker_stats_t worker_stats;
+    coro_sched_stats_t coro_stats;
+    ingest_log_stats_t ingest_stats;
+    txn_set_stats_t txn_stats;
+    reactor_t *reactor;
+    uint64_t shed = 0;
+    int i;
+
+    if (server_conf.mode == SERVER_MODE_PIPELINE) {
+        for (i = 0; i < worker_pool.worker_cnt; i++) {
+            worker_pool_get_stats(&worker_pool, i, &worker_stats);
+            printf("Worker %d: %u queued, %lu local, %lu stolen, "
+                   "%lu aborts, %lu parks, idle %.1f ms\n", i,
+                   worker_pool_get_size(&worker_pool, i),
+                   (unsigned long)worker_stats.local,
+                   (unsigned long)worker_stats.stolen,
+                   (unsigned long)worker_stats.aborts,
+                   (unsigned long)worker_stats.parks,
+                   (double)worker_stats.idle_ns / 1000000);
+            shed += codel_get_shed(&request_codels[i]);
+        }
+        printf("Request queue: bound %u, shed by codel %lu\n",
+               server_conf.queue_size, (unsigned long)shed);
+    }
+
+    i = 0;
+    arena_threads_walk(print_one_arena, &i);
+    print_slab(&session_slab);
+    print_slab(&buffer_slab);
+
+    if (server_conf.txn_set_capacity > 0) {
+        txn_set_get_stats(&txn_set, &txn_stats);
+        printf("Txn set: added %lu, duplicates %lu, evicted %lu\n",
+               (unsigned long)txn_stats.added,
+               (unsigned long)txn_stats.duplicates,
+               (unsigned long)txn_stats.evicted);
+    }
+
+    if (server_conf.ingest_dir != NULL) {
+        ingest_log_get_stats(&ingest_log, &ingest_stats);
+        printf("Ingest log: appended %lu, durable up to %lu, %lu batches, "
+               "%lu bytes, %.1f us per sync, %lu segments, %lu rejected%s\n",
+               (unsigned long)ingest_stats.appended,
+               (unsigned long)ingest_stats.durable_seq,
+               (unsigned long)ingest_stats.batches,
+               (unsigned long)ingest_stats.bytes,
+               ingest_stats.batches ? (double)ingest_stats.sync_ns /
+                                      ingest_stats.batches / 1000 : 0.0,
+               (unsigned long)ingest_stats.segments,
+               (unsigned long)ingest_stats.rejected,
+               ingest_stats.failed ? ", FAILED" : "");
+    }
+
+    for (i = 0; i < reactor_cnt; i++) {
+        reactor = &reactors[i];
+        printf("Sessions of reactor %d: %u\n", reactor->id,
+               session_table_get_count(&reactor->session_table));
+        reactor_timer_lock(reactor);
+        printf("Timers of reactor %d: %u armed, %lu expired, timed out "
+               "idle %lu, header %lu, write %lu\n", reactor->id,
+               timer_wheel_get_count(&reactor->timer_wheel),
+               (unsigned long)reactor->timer_wheel.expired,
+               (unsigned long)reactor->timeouts[SESSION_TIMEOUT_IDLE],
+               (unsigned long)reactor->timeouts[SESSION_TIMEOUT_HEADER],
+               (unsigned long)reactor->timeouts[SESSION_TIMEOUT_WRITE]);
+        reactor_timer_unlock(reactor);
+        if (server_conf.mode == SERVER_MODE_CORO) {
+            coro_sched_get_stats(&reactor->coro_sched, &coro_stats);
+            printf("Coroutines of reactor %d: %lu live, %lu created, "
+                   "%lu stacks mapped, %lu switches\n", reactor->id,
+                   (unsigned long)coro_stats.live,
+                   (unsigned long)coro_stats.created,
+                   (unsigned long)coro_stats.mapped,
+                   (unsigned long)coro_stats.switches);
+        }
+        session_table_walk(&reactor->session_table, print_one_session, NULL);
+    }
+#ifdef _BINARY_LOGGER_
+    printf("Binary log records dropped: %lu\n",
+           (unsigned long)blog_get_dropped());
+#endif
+    fflush(stdout);
+}
+
+static void
+close_session (session_t *session)
+{
+    reactor_t *reactor = session->reactor;
+
+    logger(DEBUG, "Close session:");
+    dump_one_session(session);
+    // drop it from the wheel and the table before the fd can be reused
+    session_stop_timer(session);
+    session_table_remove(&reactor->session_table, session->sockfd);
+    epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, session->sockfd, NULL);
+    close(session->sockfd);
+    free_session(session);
+    metrics_add(METRICS_SESSIONS_CLOSED, 1);
+}
+
+/*
+ * Write out the pending output, blocking the coroutine until the peer
+ * took all of it.
+ */
+static int
+coro_session_flush (session_t *session)
+{
+    iobuf_t *outbuf = &session->outbuf;
+    uint32_t len;
+
+    while (!iobuf_is_empty(outbuf)) {
+        session_touch(session);
+        len = iobuf_len(outbuf);
+        if (co_write(session->sockfd, iobuf_head(outbuf), len) < 0) {
+            logger(ERROR, "Fail to write to socket %d", session->sockfd);
+            return -1;
+        }
+        iobuf_consume(outbuf, len);
+        metrics_add(METRICS_BYTES_OUT, len);
+        session->progress = True;
+    }
+    // only releases the buffer if it grew
+    return session_flush_output(session);
+}
+
+/*
+ * A session in coroutine mode, the same steps as handle_session_request
+ * as straight-line code. Requests are handled again without reading as
+ * long as some were, more may be complete in the buffer, and waiting for
+ * the ingest log only blocks this coroutine.
+ */
+static void
+coro_session_main (void *arg)
+{
+    session_t *session = (session_t *)arg;
+    iobuf_t *inbuf = &session->inbuf;
+    resp_batch_t batch;
+    uint32_t before;
+    ssize_t n;
+    int rc;
+
+    for (;;) {
+        before = iobuf_len(inbuf);
+        resp_batch_init(&batch);
+        rc = handle_buffered_requests(session, &batch, False);
+        if (resp_batch_flush(session, &batch) != 0 ||
+            coro_session_flush(session) != 0 || rc != 0) {
+            break;
+        }
+        if (session->parked) {
+            if (session_park(session)) {
+                // until reactor_handle_wake resumes it
+                coro_yield(CORO_WAIT_NONE);
+            }
+            continue;
+        }
+        if (iobuf_len(inbuf) != before) {
+            continue;
+        }
+
+        if (iobuf_reserve(inbuf, SESSION_READ_SIZE) != 0) {
+            break;
+        }
+        session_touch(session);
+        n = co_read(session->sockfd, iobuf_tail(inbuf),
+                    iobuf_tail_room(inbuf));
+        if (n <= 0) {
+            if (n == -1) {
+                logger(ERROR, "Fail to read from socket %d",
+                       session->sockfd);
+            }
+            break;
+        }
+        iobuf_produce(inbuf, n);
+        session_note_input(session, n);
+    }
+    close_session(session);
+}
+
+/*
+ * Resume the coroutine if the event is what it yielded for, a hangup or
+ * error ends any wait on the socket. The session may be gone after.
+ */
+static void
+coro_session_event (session_t *session, uint32_t events)
+{
+    uint32_t wait = session->co->wait;
+
+    if ((wait != CORO_WAIT_NONE && (events & (EPOLLHUP | EPOLLERR))) ||
+        (wait == CORO_WAIT_READ && (events & EPOLLIN)) ||
+        (wait == CORO_WAIT_WRITE && (events & EPOLLOUT))) {
+        coro_resume(session->co);
+    }
+}
+
+// runs it until it first blocks, reading what arrived with the accept
+static int
+coro_session_start (session_t *session)
+{
+    session->co = coro_create(&session->reactor->coro_sched,
+                              coro_session_main, session);
+    if (session->co == NULL) {
+        return -1;
+    }
+    coro_resume(session->co);
+    return 0;
+}
+
+static void
+handle_accepted_connection (reactor_t *reactor, int sockfd,
+                            struct sockaddr_in *sockaddr)
+{
+    session_t *session;
+
+    session = slab_alloc(&session_slab);
+    if (session == NULL) {
+        close(sockfd);
+        return;
+    }
+    memzero(session, sizeof(session_t));
+    arena_init(&session->arena, SESSION_ARENA_CHUNK_SIZE);
+
+    if (iobuf_init_slab(&session->inbuf, &buffer_slab) != 0) {
+        slab_free(&session_slab, session);
+        close(sockfd);
+        return;
+    }
+    session->outbuf.slab = &buffer_slab;
+    http_parser_init(&session->parser);
+
+    inet_ntop(AF_INET, &sockaddr->sin_addr,
+              session->client_ip, INET_ADDRSTRLEN+1);
+    session->client_port = sockaddr->sin_port;
+    session->sockfd = sockfd;
+    session->reactor = reactor;
+    session->accept_ns = monotonic_ns();
+    session->worker = -1;
+    logger(DEBUG, "Accept sockfd %d from %s:%d",
+           sockfd, session->client_ip, session->client_port);
+    if (save_session(session) != 0) {
+        close(sockfd);
+        free_session(session);
+        return;
+    }
+    metrics_add(METRICS_SESSIONS_OPENED, 1);
+    if (server_conf.mode == SERVER_MODE_CORO &&
+        coro_session_start(session) != 0) {
+        close_session(session);
+    }
+}
+
+static int
+create_listen_socket (bool reuseport)
+{
+    int rc, one, sockfd;
+    struct sockaddr_in sockaddr;
+
+    sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0) {
+        logger(ERROR, "Fail to open socket.");
+        return -1;
+    }
+    logger(DEBUG, "Create listen sockfd %d", sockfd);
+
+    one = 1;
+    rc = setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY,
+                    &one, sizeof(one));
+    if (rc != 0) {
+        logger(ERROR, "Fail to set sockopt");
+        close(sockfd);
+        return -1;
+    }
+
+    // sessions closed on timeout leave TIME_WAIT behind on our side
+    rc = setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR,
+                    &one, sizeof(one));
+    if (rc != 0) {
+        logger(ERROR, "Fail to set SO_REUSEADDR");
+        close(sockfd);
+        return -1;
+    }
+
+    if (reuseport) {
+        rc = setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT,
+                        &one, sizeof(one));
+        if (rc != 0) {
+            logger(ERROR, "Fail to set SO_REUSEPORT");
+            close(sockfd);
+            return -1;
+        }
+    }
+
+    bzero((char *)&sockaddr, sizeof(struct sockaddr_in));
+    sockaddr.sin_family = AF_INET;
+    sockaddr.sin_addr.s_addr = INADDR_ANY;
+    sockaddr.sin_port = htons(SERVER_PORT);
+
+    rc = bind(sockfd, (struct sockaddr *)&sockaddr, sizeof(struct sockaddr_in));
+    if (rc != 0) {
+        logger(ERROR, "Fail to bind to port %d", SERVER_PORT);
+        printf("Fail to bind to port %d.\n", SERVER_PORT);
+        return -1;
+    }
+
+    return sockfd;
+}
+
+static void
+uring_reactor_clean (reactor_t *reactor)
+{
+    uring_buf_ring_clean(&reactor->ring, &reactor->buf_ring);
+    uring_clean(&reactor->ring);
+}
+
+static int
+uring_arm_accept(reactor_t *);
+
+static int
+uring_arm_wake(reactor_t *);
+
+/*
+ * Set up the reactor's io_uring instance and provided buffer ring, and
+ * start the multishot accept on its listen socket.
+ */
+static int
+uring_reactor_init (reactor_t *reactor)
+{
+    int rc;
+
+    rc = uring_init(&reactor->ring, URING_ENTRIES);
+    if (rc != 0) {
+        logger(ERROR, "Fail to set up io_uring, %d.", errno);
+        return -1;
+    }
+
+    rc = uring_buf_ring_init(&reactor->ring, &reactor->buf_ring,
+                             URING_BUF_GROUP_ID, URING_BUF_CNT,
+                             URING_BUF_SIZE);
+    if (rc != 0) {
+        logger(ERROR, "Fail to register provided buffers, %d.", errno);
+        uring_clean(&reactor->ring);
+        return -1;
+    }
+    // not touched yet, the kernel fills them on the reactor's node
+    affinity_bind(reactor->buf_ring.bufs,
+                  (size_t)URING_BUF_CNT * URING_BUF_SIZE,
+                  affinity_get_node(reactor->cpu));
+
+    rc = uring_arm_accept(reactor);
+    if (rc == 0) {
+        rc = uring_arm_wake(reactor);
+    }
+    if (rc != 0) {
+        uring_reactor_clean(reactor);
+        return -1;
+    }
+    return 0;
+}
+
+static void
+reactor_clean (reactor_t *reactor)
+{
+    uring_reactor_clean(reactor);
+    coro_sched_clean(&reactor->coro_sched);
+    pthread_mutex_destroy(&reactor->timer_lock);
+    pthread_mutex_destroy(&reactor->wake_lock);
+    if (reactor->wake_fd != -1) {
+        close(reactor->wake_fd);
+    }
+    if (reactor->epoll_fd != -1) {
+        close(reactor->epoll_fd);
+    }
+    if (reactor->listen_fd != -1) {
+        close(reactor->listen_fd);
+    }
+    session_table_clean(&reactor->session_table);
+}
+
+static int
+reactor_init (reactor_t *reactor, int id)
+{
+    struct epoll_event ev;
+    bool reuseport;
+    char *err;
+    int rc;
+
+    memzero(reactor, sizeof(reactor_t));
+    reactor->id = id;
+    reactor->cpu = affinity_pick(AFFINITY_ROLE_IO);
+    reactor->epoll_fd = -1;
+    reactor->listen_fd = -1;
+    reactor->wake_fd = -1;
+    pthread_mutex_init(&reactor->timer_lock, NULL);
+    pthread_mutex_init(&reactor->wake_lock, NULL);
+    coro_sched_init(&reactor->coro_sched, CORO_STACK_SIZE);
+    timer_wheel_init(&reactor->timer_wheel, monotonic_ms(),
+                     SESSION_TIMER_TICK_MS);
+    rc = session_table_init(&reactor->session_table, 0);
+    if (rc != 0) {
+        pthread_mutex_destroy(&reactor->timer_lock);
+        pthread_mutex_destroy(&reactor->wake_lock);
+        return -1;
+    }
+
+    reuseport = (server_conf.mode != SERVER_MODE_PIPELINE);
+    reactor->listen_fd = create_listen_socket(reuseport);
+    if (reactor->listen_fd == -1) {
+        err = strerror(errno);
+        printf("Fail to create listen socket, %s.\n", err);
+        reactor_clean(reactor);
+        return -1;
+    }
+
+    rc = listen(reactor->listen_fd, server_conf.backlog);
+    if (rc != 0) {
+        err = strerror(errno);
+        printf("Fail to listen to socket, %s.\n", err);
+        reactor_clean(reactor);
+        return -1;
+    }
+
+    // only read once signalled, it can block for the io_uring read
+    reactor->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (reactor->wake_fd == -1) {
+        logger(ERROR, "Fail to create wake eventfd.");
+        reactor_clean(reactor);
+        return -1;
+    }
+
+    if (server_conf.mode == SERVER_MODE_URING) {
+        rc = uring_reactor_init(reactor);
+        if (rc == 0) {
+            return 0;
+        }
+        if (id != 0) {
+            reactor_clean(reactor);
+            return -1;
+        }
+        // the first reactor decides for all of them
+        printf("io_uring is not available, fall back to reactor mode.\n");
+        server_conf.mode = SERVER_MODE_REACTOR;
+    }
+
+    reactor->epoll_fd = epoll_create1(0);
+    if (reactor->epoll_fd == -1) {
+        logger(ERROR, "Fail to create epfd.");
+        reactor_clean(reactor);
+        return -1;
+    }
+
+    /*
+     * Connections are accepted from the reactor's epoll loop, by the epoll
+     * thread in pipeline mode.
+     */
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL; // NULL marks the listen socket
+    rc = epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD,
+                   reactor->listen_fd, &ev);
+    if (rc != 0) {
+        logger(ERROR, "Fail on epoll_ctl for listen socket.");
+        reactor_clean(reactor);
+        return -1;
+    }
+
+    if (reactor->wake_fd != -1) {
+        ev.events = EPOLLIN;
+        ev.data.ptr = reactor; // the reactor itself marks its wake fd
+        rc = epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD,
+                       reactor->wake_fd, &ev);
+        if (rc != 0) {
+            logger(ERROR, "Fail on epoll_ctl for wake fd.");
+            reactor_clean(reactor);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * txn_ids of the bodies already logged, so retries across a restart are
+ * still answered as duplicates.
+ */
+static void
+replay_ingest_record (uint64_t seq, const char *data, uint32_t len,
+                      void *arg)
+{
+    char txn_id[TXN_ID_MAX_LEN+1];
+
+    if (server_conf.txn_set_capacity > 0 &&
+        extract_txn_id(data, len, txn_id)) {
+        txn_set_insert(&txn_set, txn_id, strlen(txn_id));
+    }
+}
+
+static int
+ingest_log_open (void)
+{
+    ingest_log_conf_t conf;
+    ingest_log_stats_t stats;
+    int rc;
+
+    memzero(&conf, sizeof(conf));
+    conf.dir = server_conf.ingest_dir;
+    conf.batch_bytes = server_conf.ingest_batch_bytes;
+    conf.batch_wait_us = server_conf.ingest_batch_wait_us;
+    rc = ingest_log_init(&ingest_log, &conf, replay_ingest_record, NULL);
+    if (rc != 0) {
+        printf("Fail to open ingest log in %s.\n", server_conf.ingest_dir);
+        return -1;
+    }
+    ingest_log_get_stats(&ingest_log, &stats);
+    printf("Ingest log %s: %lu records recovered in %lu segments.\n",
+           server_conf.ingest_dir, (unsigned long)stats.recovered,
+           (unsigned long)stats.segments);
+    return 0;
+}
+
+static int
+request_codels_init (void)
+{
+    int i;
+
+    if (posix_memalign((void **)&request_codels, CACHE_LINE_SIZE,
+                       server_conf.thread_cnt * sizeof(codel_t)) != 0) {
+        logger(ERROR, "Fail to malloc request codels.");
+        request_codels = NULL;
+        return -1;
+    }
+    for (i = 0; i < server_conf.thread_cnt; i++) {
+        codel_init(&request_codels[i],
+                   (uint64_t)server_conf.codel_target_us * 1000,
+                   (uint64_t)CODEL_INTERVAL_MS * 1000000);
+    }
+    return 0;
+}
+
+static void
+request_codels_clean (void)
+{
+    int i;
+
+    if (request_codels == NULL) {
+        return;
+    }
+    for (i = 0; i < server_conf.thread_cnt; i++) {
+        codel_clean(&request_codels[i]);
+    }
+    free(request_codels);
+    request_codels = NULL;
+}
+
+static int
+server_init (void)
+{
+    int i, rc;
+
+    if (server_conf.mode == SERVER_MODE_PIPELINE) {
+        reactor_cnt = 1;
+    } else {
+        reactor_cnt = server_conf.thread_cnt;
+    }
+
+    rc = slab_init(&session_slab, "session", sizeof(session_t),
+                   server_conf.pages);
+    if (rc != 0) {
+        return -1;
+    }
+    rc = slab_init(&buffer_slab, "buffer", SESSION_BUF_SIZE,
+                   server_conf.pages);
+    if (rc != 0) {
+        slab_clean(&session_slab);
+        return -1;
+    }
+
+    rc = router_setup();
+    if (rc != 0) {
+        slab_clean(&buffer_slab);
+        slab_clean(&session_slab);
+        return -1;
+    }
+
+    if (server_conf.txn_set_capacity > 0) {
+        rc = txn_set_init(&txn_set, server_conf.txn_set_capacity);
+        if (rc != 0) {
+            router_clean(&router);
+            slab_clean(&buffer_slab);
+            slab_clean(&session_slab);
+            return -1;
+        }
+    }
+
+    if (server_conf.ingest_dir != NULL) {
+        rc = ingest_log_open();
+        if (rc != 0) {
+            txn_set_clean(&txn_set);
+            router_clean(&router);
+            slab_clean(&buffer_slab);
+            slab_clean(&session_slab);
+            return -1;
+        }
+    }
+
+    reactors = calloc(reactor_cnt, sizeof(reactor_t));
+    if (reactors == NULL) {
+        logger(ERROR, "Fail to calloc reactors.");
+        ingest_log_clean(&ingest_log);
+        txn_set_clean(&txn_set);
+        router_clean(&router);
+        slab_clean(&buffer_slab);
+        slab_clean(&session_slab);
+        return -1;
+    }
+
+    if (server_conf.mode == SERVER_MODE_PIPELINE) {
+        // the bound is split evenly, a full deque sends sessions elsewhere
+        rc = worker_pool_init(&worker_pool, server_conf.thread_cnt,
+                              (server_conf.queue_size +
+                               server_conf.thread_cnt - 1) /
+                              server_conf.thread_cnt,
+                              worker_handle_session, NULL);
+        if (rc == 0) {
+            rc = request_codels_init();
+            if (rc != 0) {
+                worker_pool_clean(&worker_pool);
+            }
+        }
+        if (rc != 0) {
+            free(reactors);
+            ingest_log_clean(&ingest_log);
+            txn_set_clean(&txn_set);
+            router_clean(&router);
+            slab_clean(&buffer_slab);
+            slab_clean(&session_slab);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < reactor_cnt; i++) {
+        rc = reactor_init(&reactors[i], i);
+        if (rc != 0) {
+            break;
+        }
+    }
+    if (i < reactor_cnt) {
+        while (--i >= 0) {
+            reactor_clean(&reactors[i]);
+        }
+        request_codels_clean();
+        worker_pool_clean(&worker_pool);
+        free(reactors);
+        ingest_log_clean(&ingest_log);
+        txn_set_clean(&txn_set);
+        router_clean(&router);
+        slab_clean(&buffer_slab);
+        slab_clean(&session_slab);
+        return -1;
+    }
+
+    // after the reactors, in auto mode the epoll thread picks first
+    if (server_conf.mode == SERVER_MODE_PIPELINE) {
+        for (i = 0; i < server_conf.thread_cnt; i++) {
+            worker_pool_set_cpu(&worker_pool, i,
+                                affinity_pick(AFFINITY_ROLE_WORKER));
+        }
+    }
+    return 0;
+}
+
+/*
+ * Drain the accept queue, accepted sockets come out non-blocking.
+ */
+static void
+reactor_accept (reactor_t *reactor)
+{
+    int sockfd, addr_len;
+    struct sockaddr_storage sockaddr_accpet;
+
+    for (;;) {
+        addr_len = sizeof(struct sockaddr_storage);
+        sockfd = accept4(reactor->listen_fd,
+                         (struct sockaddr *)&sockaddr_accpet,
+                         (socklen_t *)&addr_len,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sockfd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                logger(ERROR, "Fail on accept, %d, %d",
+                       errno, reactor->listen_fd);
+            }
+            return;
+        }
+        __atomic_add_fetch(&reactor->accepted, 1, __ATOMIC_RELAXED);
+
+        if (addr_len != sizeof(struct sockaddr_in)) {
+            logger(INFO, "Drop NON-IPV4 peer.");
+            close(sockfd);
+            continue;
+        }
+
+        handle_accepted_connection(reactor, sockfd,
+                                   (struct sockaddr_in *)&sockaddr_accpet);
+    }
+}
+
+/*
+ * Resume the sessions the ingest log flusher woke, their records are
+ * durable, in pipeline mode by handing them to the workers, in coroutine
+ * mode by resuming the coroutine. A session closed while parked in
+ * io_uring mode was only kept for this.
+ */
+static void
+reactor_handle_wake (reactor_t *reactor)
+{
+    session_t *session, *next;
+
+    pthread_mutex_lock(&reactor->wake_lock);
+    session = reactor->wake_list;
+    reactor->wake_list = NULL;
+    pthread_mutex_unlock(&reactor->wake_lock);
+
+    for (; session != NULL; session = next) {
+        next = session->wake_next;
+        session->parked = False;
+        session->ingest_waiting = False;
+        if (server_conf.mode == SERVER_MODE_PIPELINE) {
+            if (!dispatch_session(session, monotonic_ns())) {
+                handle_session_request(session, True);
+            }
+        } else if (server_conf.mode == SERVER_MODE_REACTOR) {
+            handle_session_request(session, False);
+        } else if (server_conf.mode == SERVER_MODE_CORO) {
+            coro_resume(session->co);
+        } else if (session->closing) {
+            uring_close_session(session);
+        } else {
+            uring_session_process(session);
+        }
+    }
+}
+
+static void *
+reactor_thread (void *args)
+{
+    reactor_t *reactor = (reactor_t *)args;
+    struct epoll_event evlist[REACTOR_WAIT_MAX_EVENTS];
+    int i, ready;
+
+    affinity_pin(reactor->cpu);
+    logger(DEBUG, "Reactor %d started.", reactor->id);
+    for (;;) {
+        ready = epoll_wait(reactor->epoll_fd, evlist, REACTOR_WAIT_MAX_EVENTS,
+                           reactor_get_timeout(reactor));
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            } else {
+                logger(ERROR, "Fail on epoll_wait");
+                return NULL;
+            }
+        }
+
+        for (i = 0; i < ready; i++) {
+            if (evlist[i].data.ptr == NULL) {
+                reactor_accept(reactor);
+                continue;
+            }
+            if (evlist[i].data.ptr == reactor) {
+                if (read(reactor->wake_fd, &reactor->wake_cnt,
+                         sizeof(uint64_t)) != sizeof(uint64_t)) {
+                    logger(ERROR, "Fail to read wake fd %d", reactor->id);
+                }
+                reactor_handle_wake(reactor);
+                continue;
+            }
+            if (server_conf.mode == SERVER_MODE_CORO) {
+                coro_session_event((session_t *)evlist[i].data.ptr,
+                                   evlist[i].events);
+            } else if (evlist[i].events &
+                       (EPOLLIN | EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+                handle_session_request((session_t *)evlist[i].data.ptr,
+                                       False);
+            }
+        }
+        reactor_expire_timers(reactor);
+    }
+    return NULL;
+}
+
+static uint64_t
+uring_user_data (void *ptr, unsigned long op)
+{
+    return (uint64_t)(uintptr_t)ptr | op;
+}
+
+static struct io_uring_sqe *
+uring_reactor_get_sqe (reactor_t *reactor)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = uring_get_sqe(&reactor->ring);
+    if (sqe == NULL) {
+        // submission queue is full, hand it to the kernel and retry
+        uring_submit_and_wait(&reactor->ring, 0);
+        sqe = uring_get_sqe(&reactor->ring);
+    }
+    if (sqe == NULL) {
+        logger(ERROR, "No free SQE on reactor %d", reactor->id);
+    }
+    return sqe;
+}
+
+static int
+uring_arm_accept (reactor_t *reactor)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = uring_reactor_get_sqe(reactor);
+    if (sqe == NULL) {
+        return -1;
+    }
+    uring_prep_accept_multishot(sqe, reactor->listen_fd, SOCK_CLOEXEC);
+    sqe->user_data = uring_user_data(reactor, URING_OP_ACCEPT);
+    return 0;
+}
+
+static int
+uring_arm_wake (reactor_t *reactor)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = uring_reactor_get_sqe(reactor);
+    if (sqe == NULL) {
+        return -1;
+    }
+    uring_prep_read(sqe, reactor->wake_fd, &reactor->wake_cnt,
+                    sizeof(uint64_t));
+    sqe->user_data = uring_user_data(reactor, URING_OP_WAKE);
+    return 0;
+}
+
+static int
+uring_arm_recv (session_t *session)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = uring_reactor_get_sqe(session->reactor);
+    if (sqe == NULL) {
+        return -1;
+    }
+    uring_prep_recv_multishot(sqe, session->sockfd, URING_BUF_GROUP_ID);
+    sqe->user_data = uring_user_data(session, URING_OP_RECV);
+    session->recv_active = True;
+    return 0;
+}
+
+static int
+uring_session_start (session_t *session)
+{
+    session->out = session_alloc(session, sizeof(resp_batch_t));
+    if (session->out == NULL) {
+        return -1;
+    }
+    resp_batch_init(session->out);
+    session->out->deferred = True;
+    return uring_arm_recv(session);
+}
+
+/*
+ * Submit the queued responses as linked SENDs, one per contiguous run of
+ * iovecs, so they go out in order. MSG_WAITALL has the kernel retry short
+ * sends, a failed one cancels the rest of the chain.
+ */
+static int
+uring_send_batch (session_t *session)
+{
+    reactor_t *reactor = session->reactor;
+    resp_batch_t *batch = session->out;
+    struct io_uring_sqe *sqe, *prev = NULL;
+    char *base;
+    uint32_t len;
+    int i;
+
+    // a chain has to be submitted at once
+    if (uring_sq_space_left(&reactor->ring) < (uint32_t)batch->iovcnt) {
+        uring_submit_and_wait(&reactor->ring, 0);
+    }
+
+    session->send_ns = monotonic_ns();
+    base = batch->iov[0].iov_base;
+    len = batch->iov[0].iov_len;
+    for (i = 1; i <= batch->iovcnt; i++) {
+        if (i < batch->iovcnt &&
+            (char *)batch->iov[i].iov_base == base + len) {
+            len += batch->iov[i].iov_len;
+            continue;
+        }
+
+        sqe = uring_get_sqe(&reactor->ring);
+        if (sqe == NULL) {
+            logger(ERROR, "No free SQE on reactor %d", reactor->id);
+            return -1;
+        }
+        if (prev != NULL) {
+            prev->flags |= IOSQE_IO_LINK;
+        }
+        uring_prep_send(sqe, session->sockfd, base, len,
+                        MSG_WAITALL | MSG_NOSIGNAL);
+        sqe->user_data = uring_user_data(session, URING_OP_SEND);
+        session->sends_inflight++;
+        prev = sqe;
+
+        if (i < batch->iovcnt) {
+            base = batch->iov[i].iov_base;
+            len = batch->iov[i].iov_len;
+        }
+    }
+    return 0;
+}
+
+static int
+uring_cancel_recv (session_t *session)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = uring_reactor_get_sqe(session->reactor);
+    if (sqe == NULL) {
+        return -1;
+    }
+    uring_prep_cancel(sqe, uring_user_data(session, URING_OP_RECV));
+    sqe->user_data = URING_OP_NONE;
+    return 0;
+}
+
+/*
+ * The session is freed once the kernel holds no operation of it any
+ * more, a multishot recv still armed is cancelled first, and the ingest
+ * log no waiter of it.
+ */
+static void
+uring_close_session (session_t *session)
+{
+    reactor_t *reactor = session->reactor;
+
+    if (!session->closing) {
+        session->closing = True;
+        if (session->recv_active && uring_cancel_recv(session) != 0) {
+            shutdown(session->sockfd, SHUT_RD);
+        }
+    }
+    if (session->recv_active || session->sends_inflight > 0 ||
+        session->ingest_waiting) {
+        return;
+    }
+
+    logger(DEBUG, "Close session:");
+    dump_one_session(session);
+    session_stop_timer(session);
+    session_table_remove(&reactor->session_table, session->sockfd);
+    close(session->sockfd);
+    free_session(session);
+    metrics_add(METRICS_SESSIONS_CLOSED, 1);
+}
+
+/*
+ * Handle the buffered requests unless the previous batch is still being
+ * sent, what is left is picked up once its sends complete. A recv paused
+ * for a full input buffer is resumed once the requests are handled. A
+ * session parked on the ingest log goes on receiving, the requests wait.
+ */
+static void
+uring_session_process (session_t *session)
+{
+    int rc;
+
+    if (session->closing) {
+        return;
+    }
+    if (session->sends_inflight > 0) {
+        session_touch(session);
+        return;
+    }
+
+    rc = handle_buffered_requests(session, session->out, False);
+    if (session->out->iovcnt > 0 && uring_send_batch(session) != 0) {
+        rc = -1;
+    }
+    if (rc == 0 && session->recv_paused && !session->recv_active &&
+        iobuf_len(&session->inbuf) < SESSION_IN_HIGH_WATER) {
+        session->recv_paused = False;
+        rc = uring_arm_recv(session);
+    }
+    if (rc != 0) {
+        uring_close_session(session);
+        return;
+    }
+    session_touch(session);
+    if (session->parked && !session_park(session)) {
+        uring_session_process(session);
+    }
+}
+
+static void
+uring_handle_accept (reactor_t *reactor, int res, uint32_t flags)
+{
+    struct sockaddr_storage sockaddr;
+    socklen_t addr_len;
+    int rc;
+
+    if (!(flags & IORING_CQE_F_MORE) && uring_arm_accept(reactor) != 0) {
+        logger(ERROR, "Fail to re-arm accept on reactor %d", reactor->id);
+    }
+    if (res < 0) {
+        logger(ERROR, "Fail on accept, %d, %d", -res, reactor->listen_fd);
+        return;
+    }
+    __atomic_add_fetch(&reactor->accepted, 1, __ATOMIC_RELAXED);
+
+    // multishot accept doesn't return the peer address
+    addr_len = sizeof(struct sockaddr_storage);
+    rc = getpeername(res, (struct sockaddr *)&sockaddr, &addr_len);
+    if (rc != 0 || addr_len != sizeof(struct sockaddr_in)) {
+        logger(INFO, "Drop NON-IPV4 peer.");
+        close(res);
+        return;
+    }
+
+    handle_accepted_connection(reactor, res, (struct sockaddr_in *)&sockaddr);
+}
+
+/*
+ * Copy the received bytes out of the provided buffer and give it back to
+ * the kernel right away, the request may stay partial for a while. The
+ * recv is cancelled while the input buffer is over its high-water mark,
+ * which only happens when the peer doesn't read its responses.
+ */
+static void
+uring_handle_recv (session_t *session, int res, uint32_t flags)
+{
+    reactor_t *reactor = session->reactor;
+    iobuf_t *inbuf = &session->inbuf;
+    uint16_t bid;
+    int rc = 0;
+
+    if (!(flags & IORING_CQE_F_MORE)) {
+        session->recv_active = False;
+    }
+
+    if (flags & IORING_CQE_F_BUFFER) {
+        bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        if (res > 0 && !session->closing) {
+            rc = iobuf_reserve(inbuf, res);
+            if (rc == 0) {
+                memcpy(iobuf_tail(inbuf),
+                       uring_buf_ring_get(&reactor->buf_ring, bid), res);
+                iobuf_produce(inbuf, res);
+                session_note_input(session, res);
+            }
+        }
+        uring_buf_ring_recycle(&reactor->buf_ring, bid);
+    }
+
+    if (res == -ECANCELED && session->recv_paused && !session->closing) {
+        uring_session_process(session);
+        return;
+    }
+
+    if (session->closing || rc != 0 || res == 0 ||
+        (res < 0 && res != -ENOBUFS)) {
+        if (res < 0 && res != -ECANCELED) {
+            logger(ERROR, "Fail to recv from socket %d, %d",
+                   session->sockfd, -res);
+        }
+        uring_close_session(session);
+        return;
+    }
+
+    if (iobuf_len(inbuf) >= SESSION_IN_HIGH_WATER && !session->recv_paused) {
+        session->recv_paused = True;
+        if (session->recv_active && uring_cancel_recv(session) != 0) {
+            uring_close_session(session);
+            return;
+        }
+    }
+
+    // out of provided buffers or the kernel ended the multishot
+    if (!session->recv_active && !session->recv_paused &&
+        uring_arm_recv(session) != 0) {
+        uring_close_session(session);
+        return;
+    }
+    uring_session_process(session);
+}
+
+static void
+uring_handle_send (session_t *session, int res)
+{
+    session->sends_inflight--;
+    if (res < 0) {
+        logger(ERROR, "Fail to send to socket %d, %d",
+               session->sockfd, -res);
+        uring_close_session(session);
+        return;
+    }
+    metrics_add(METRICS_BYTES_OUT, res);
+    session->progress = True;
+    if (session->closing) {
+        uring_close_session(session);
+        return;
+    }
+    if (session->sends_inflight > 0) {
+        return;
+    }
+
+    // submission to the last completion of the chain
+    metrics_record(METRICS_HIST_WRITE, monotonic_ns() - session->send_ns);
+    resp_batch_init(session->out);
+    uring_session_process(session);
+}
+
+static void
+uring_handle_wake (reactor_t *reactor, int res)
+{
+    if (res < 0) {
+        logger(ERROR, "Fail to read wake fd %d, %d", reactor->id, -res);
+    }
+    if (uring_arm_wake(reactor) != 0) {
+        logger(ERROR, "Fail to re-arm wake fd on reactor %d", reactor->id);
+    }
+    reactor_handle_wake(reactor);
+}
+
+/*
+ * One io_uring_enter per loop submits everything queued while handling
+ * the previous completions and waits for new ones, or the next timer
+ * tick.
+ */
+static void *
+uring_reactor_thread (void *args)
+{
+    reactor_t *reactor = (reactor_t *)args;
+    struct io_uring_cqe *cqe;
+    uint64_t user_data;
+    uint32_t flags;
+    void *ptr;
+    int rc, res;
+
+    affinity_pin(reactor->cpu);
+    logger(DEBUG, "Reactor %d started with io_uring.", reactor->id);
+    for (;;) {
+        rc = uring_submit_and_wait_timeout(&reactor->ring, 1,
+                                           reactor_get_timeout(reactor));
+        if (rc < 0 && errno != ETIME && errno != EBUSY && errno != EAGAIN) {
+            logger(ERROR, "Fail on io_uring_enter, %d", errno);
+            return NULL;
+        }
+
+        while ((cqe = uring_peek_cqe(&reactor->ring)) != NULL) {
+            user_data = cqe->user_data;
+            res = cqe->res;
+            flags = cqe->flags;
+            uring_cqe_seen(&reactor->ring);
+
+            ptr = (void *)(uintptr_t)(user_data & ~URING_OP_MASK);
+            switch (user_data & URING_OP_MASK) {
+            case URING_OP_ACCEPT:
+                uring_handle_accept((reactor_t *)ptr, res, flags);
+                break;
+            case URING_OP_RECV:
+                uring_handle_recv((session_t *)ptr, res, flags);
+                break;
+            case URING_OP_SEND:
+                uring_handle_send((session_t *)ptr, res);
+                break;
+            case URING_OP_WAKE:
+                uring_handle_wake((reactor_t *)ptr, res);
+                break;
+            default:
+                break;
+            }
+        }
+        reactor_expire_timers(reactor);
+    }
+    return NULL;
+}
+
+static int
+start_reactor_threads (void)
+{
+    void *(*thread_fn)(void *);
+    int i, rc;
+
+    if (server_conf.mode == SERVER_MODE_URING) {
+        thread_fn = uring_reactor_thread;
+    } else {
+        thread_fn = reactor_thread;
+    }
+
+    for (i = 0; i < reactor_cnt; i++) {
+        rc = pthread_create(&reactors[i].thread_id, NULL,
+                            thread_fn, &reactors[i]);
+        if (rc != 0) {
+            logger(ERROR, "Fail to create reactor thread");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void *
+signal_thread (void *args)
+{
+    sigset_t *sigset = (sigset_t *)args;
+    int sig;
+
+    for (;;) {
+        if (sigwait(sigset, &sig) != 0) {
+            continue;
+        }
+        if (sig == SESSION_DUMP_SIGNAL) {
+            dump_all_sessions();
+        }
+    }
+    return NULL;
+}
+
+static sigset_t diag_sigset;
+
+/*
+ * Diagnostic signals are blocked in every thread and handled synchronously
+ * by a dedicated thread, so they never interrupt the I/O threads. They are
+ * blocked before the first thread is created, the loggers' flushers
+ * included, which inherit the mask.
+ */
+static int
+block_diag_signals (void)
+{
+    int rc;
+
+    sigemptyset(&diag_sigset);
+    sigaddset(&diag_sigset, SESSION_DUMP_SIGNAL);
+    rc = pthread_sigmask(SIG_BLOCK, &diag_sigset, NULL);
+    if (rc != 0) {
+        logger(ERROR, "Fail to block signals");
+        return -1;
+    }
+    return 0;
+}
+
+static int
+start_signal_thread (void)
+{
+    pthread_t thread_id;
+    int rc;
+
+    rc = pthread_create(&thread_id, NULL, signal_thread, &diag_sigset);
+    if (rc != 0) {
+        logger(ERROR, "Fail to create signal thread");
+        return -1;
+    }
+    return 0;
+}
+
+static int
+start_threads (void)
+{
+    int rc;
+
+    rc = start_signal_thread();
+    if (rc != 0) {
+        return -1;
+    }
+
+    if (server_conf.mode != SERVER_MODE_PIPELINE) {
+        return start_reactor_threads();
+    }
+
+    rc = start_epoll_thread();
+    if (rc != 0) {
+        return -1;
+    }
+    rc = worker_pool_start(&worker_pool);
+    if (rc != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static uint64_t
+get_accepted_cnt (void)
+{
+    uint64_t total = 0;
+    int i;
+
+    for (i = 0; i < reactor_cnt; i++) {
+        total += __atomic_load_n(&reactors[i].accepted, __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+/*
+ * Print the accept throughput once per interval in which connections were
+ * accepted, while the I/O threads do the work.
+ */
+static void
+report_accept_rate (void)
+{
+    struct timeval last_tv, now_tv;
+    uint64_t last, now;
+    double elapsed;
+
+    last = get_accepted_cnt();
+    gettimeofday(&last_tv, NULL);
+    for (;;) {
+        sleep(ACCEPT_REPORT_INTERVAL);
+        now = get_accepted_cnt();
+        gettimeofday(&now_tv, NULL);
+        if (now != last) {
+            elapsed = (now_tv.tv_sec - last_tv.tv_sec) +
+                      (double)(now_tv.tv_usec - last_tv.tv_usec)/1000/1000;
+            printf("Accepted %lu connections, %.1f conn/s, total %lu\n",
+                   (unsigned long)(now - last), (now - last)/elapsed,
+                   (unsigned long)now);
+            fflush(stdout);
+        }
+        last = now;
+        last_tv = now_tv;
+    }
+}
+
+static void
+server_clean (void)
+{
+    int i;
+
+    request_codels_clean();
+    worker_pool_clean(&worker_pool);
+    for (i = 0; i < reactor_cnt; i++) {
+        reactor_clean(&reactors[i]);
+    }
+    free(reactors);
+    ingest_log_clean(&ingest_log);
+    txn_set_clean(&txn_set);
+    router_clean(&router);
+    metrics_clean();
+    arena_threads_clean();
+    slab_clean(&buffer_slab);
+    slab_clean(&session_slab);
+#ifdef _BINARY_LOGGER_
+    blog_clean();
+#endif
+}
+
+static void
+usage (void)
+{
+    printf("server [-m pipeline|reactor|uring|coro] [-j <thread_count>] "
+           "[-b <backlog>] [-d <txn_set_capacity>]\n"
+           "       [-l <ingest_log_dir> [-G <batch_bytes>] "
+           "[-g <batch_wait_us>]]\n"
+           "       [-q <queue_size>] [-t <codel_target_us>]\n"
+           "       [-a auto|nic=<interface>|<io|worker>=<cpu_list>]...\n"
+           "       [-H normal|thp|hugetlb]\n");
+}
+
+static int
+parse_args (int argc, char **argv)
+{
+    int opt;
+    long cpu_cnt;
+
+    server_conf.mode = SERVER_MODE_PIPELINE;
+    server_conf.thread_cnt = 0;
+    server_conf.backlog = SOMAXCONN;
+    server_conf.txn_set_capacity = TXN_SET_DEFAULT_CAPACITY;
+    server_conf.ingest_dir = NULL;
+    server_conf.ingest_batch_bytes = INGEST_LOG_BATCH_BYTES;
+    server_conf.ingest_batch_wait_us = INGEST_LOG_BATCH_WAIT_US;
+    server_conf.queue_size = REQUEST_QUEUE_MAX_SIZE;
+    server_conf.codel_target_us = CODEL_TARGET_US;
+    server_conf.pages = SLAB_PAGES_NORMAL;
+
+    while ((opt = getopt(argc, argv, "m:j:b:d:l:G:g:q:t:a:H:h")) != -1) {
+        switch (opt) {
+        case 'm':
+            if (strcmp(optarg, "pipeline") == 0) {
+                server_conf.mode = SERVER_MODE_PIPELINE;
+            } else if (strcmp(optarg, "reactor") == 0) {
+                server_conf.mode = SERVER_MODE_REACTOR;
+            } else if (strcmp(optarg, "uring") == 0) {
+                server_conf.mode = SERVER_MODE_URING;
+            } else if (strcmp(optarg, "coro") == 0) {
+                server_conf.mode = SERVER_MODE_CORO;
+            } else {
+                printf("Unsupported mode %s.\n", optarg);
+                return -1;
+            }
+            break;
+        case 'j':
+            server_conf.thread_cnt = atoi(optarg);
+            if (server_conf.thread_cnt <= 0) {
+                printf("thread count should be a positive integer.\n");
+                return -1;
+            }
+            break;
+        case 'b':
+            server_conf.backlog = atoi(optarg);
+            if (server_conf.backlog <= 0) {
+                printf("backlog should be a positive integer.\n");
+                return -1;
+            }
+            break;
+        case 'd':
+            if (atoi(optarg) < 0) {
+                printf("txn set capacity should not be negative.\n");
+                return -1;
+            }
+            server_conf.txn_set_capacity = atoi(optarg);
+            break;
+        case 'l':
+            server_conf.ingest_dir = optarg;
+            break;
+        case 'G':
+            if (atoi(optarg) <= 0) {
+                printf("batch bytes should be a positive integer.\n");
+                return -1;
+            }
+            server_conf.ingest_batch_bytes = atoi(optarg);
+            break;
+        case 'g':
+            if (atoi(optarg) < 0) {
+                printf("batch wait should not be negative.\n");
+                return -1;
+            }
+            server_conf.ingest_batch_wait_us = atoi(optarg);
+            break;
+        case 'q':
+            if (atoi(optarg) < 0) {
+                printf("queue size should not be negative.\n");
+                return -1;
+            }
+            server_conf.queue_size = atoi(optarg);
+            break;
+        case 't':
+            if (atoi(optarg) < 0) {
+                printf("codel target should not be negative.\n");
+                return -1;
+            }
+            server_conf.codel_target_us = atoi(optarg);
+            break;
+        case 'a':
+            if (affinity_parse(optarg) != 0) {
+                return -1;
+            }
+            break;
+        case 'H':
+            if (slab_parse_pages(optarg, &server_conf.pages) != 0) {
+                printf("Unsupported pages %s.\n", optarg);
+                return -1;
+            }
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    if (server_conf.thread_cnt != 0) {
+        return 0;
+    }
+
+    if (server_conf.mode == SERVER_MODE_PIPELINE) {
+        server_conf.thread_cnt = WORKER_THREAD_CNT;
+    } else {
+        cpu_cnt = sysconf(_SC_NPROCESSORS_ONLN);
+        server_conf.thread_cnt = cpu_cnt > 0 ? cpu_cnt : 1;
+    }
+    return 0;
+}
+
+int main (int argc, char **argv)
+{
+    int rc;
+
+    // before parse_args, which checks cpu lists against it
+    rc = affinity_init(NULL);
+    if (rc != 0) {
+        return -1;
+    }
+    rc = parse_args(argc, argv);
+    if (rc != 0) {
+        usage();
+        return -1;
+    }
+    affinity_print();
+
+    // a write to a peer gone, or shut down on timeout, fails with EPIPE
+    signal(SIGPIPE, SIG_IGN);
+    rc = block_diag_signals();
+    if (rc != 0) {
+        return -1;
+    }
+
+#ifdef _BINARY_LOGGER_
+    rc = blog_init_env("server.blog");
+    if (rc != 0) {
+        return -1;
+    }
+#endif
+
+    rc = server_init();
+    if (rc != 0) {
+        return -1;
+    }
+    // the topology and placements, before any traffic
+    fflush(stdout);
 
     rc = start_threads();
     if (rc != 0) {
@@ -400,8 +2857,7 @@ int main (void)
         return -1;
     }
 
-    wait_on_client_connection();
+    report_accept_rate();
     server_clean();
     return 0;
 }
-
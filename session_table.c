@@ -0,0 +1,199 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "util.h"
+#include "session_table.h"
+
+#define chunk_index(fd) ((uint32_t)(fd) >> SESSION_TABLE_CHUNK_BITS)
+#define slot_index(fd) ((uint32_t)(fd) & (SESSION_TABLE_CHUNK_SIZE - 1))
+
+/*
+ * max_fd 0 sizes the table after RLIMIT_NOFILE, no fd of the process can
+ * be beyond it.
+ */
+int
+session_table_init (session_table_t *table, uint32_t max_fd)
+{
+    struct rlimit rlim;
+    int rc;
+
+    memzero(table, sizeof(session_table_t));
+
+    if (max_fd == 0) {
+        max_fd = SESSION_TABLE_DEFAULT_MAX_FD;
+        if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 &&
+            rlim.rlim_cur != RLIM_INFINITY && rlim.rlim_cur < max_fd) {
+            max_fd = rlim.rlim_cur;
+        }
+    }
+
+    table->max_fd = max_fd;
+    table->chunk_cnt = (max_fd + SESSION_TABLE_CHUNK_SIZE - 1) >>
+                       SESSION_TABLE_CHUNK_BITS;
+    table->chunks = calloc(table->chunk_cnt, sizeof(session_table_chunk_t *));
+    if (table->chunks == NULL) {
+        logger(ERROR, "Fail to calloc session table.");
+        return -1;
+    }
+
+    rc = pthread_mutex_init(&table->grow_lock, NULL);
+    if (rc != 0) {
+        logger(ERROR, "Fail to init session table mutex.");
+        free(table->chunks);
+        table->chunks = NULL;
+        return rc;
+    }
+    return 0;
+}
+
+void
+session_table_clean (session_table_t *table)
+{
+    uint32_t i;
+
+    if (table->chunks == NULL) {
+        return;
+    }
+    for (i = 0; i < table->chunk_cnt; i++) {
+        if (table->chunks[i]) {
+            pthread_mutex_destroy(&table->chunks[i]->lock);
+            free(table->chunks[i]);
+        }
+    }
+    free(table->chunks);
+    table->chunks = NULL;
+    pthread_mutex_destroy(&table->grow_lock);
+}
+
+static session_table_chunk_t *
+get_chunk (session_table_t *table, int fd)
+{
+    if (fd < 0 || (uint32_t)fd >= table->max_fd) {
+        return NULL;
+    }
+    return __atomic_load_n(&table->chunks[chunk_index(fd)], __ATOMIC_ACQUIRE);
+}
+
+static session_table_chunk_t *
+get_or_create_chunk (session_table_t *table, int fd)
+{
+    session_table_chunk_t *chunk;
+
+    if (fd < 0 || (uint32_t)fd >= table->max_fd) {
+        logger(ERROR, "fd %d beyond session table.", fd);
+        return NULL;
+    }
+
+    chunk = get_chunk(table, fd);
+    if (chunk) {
+        return chunk;
+    }
+
+    pthread_mutex_lock(&table->grow_lock);
+    chunk = table->chunks[chunk_index(fd)];
+    if (chunk == NULL) {
+        chunk = calloc(1, sizeof(session_table_chunk_t));
+        if (chunk != NULL) {
+            pthread_mutex_init(&chunk->lock, NULL);
+            __atomic_store_n(&table->chunks[chunk_index(fd)], chunk,
+                             __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&table->grow_lock);
+    return chunk;
+}
+
+int
+session_table_insert (session_table_t *table, int fd, void *data)
+{
+    session_table_chunk_t *chunk;
+    void **slot;
+
+    chunk = get_or_create_chunk(table, fd);
+    if (chunk == NULL) {
+        return -1;
+    }
+
+    slot = &chunk->slots[slot_index(fd)];
+    pthread_mutex_lock(&chunk->lock);
+    if (*slot != NULL) {
+        pthread_mutex_unlock(&chunk->lock);
+        return -1;
+    }
+    __atomic_store_n(slot, data, __ATOMIC_RELEASE);
+    chunk->count++;
+    pthread_mutex_unlock(&chunk->lock);
+
+    __atomic_add_fetch(&table->count, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void *
+session_table_remove (session_table_t *table, int fd)
+{
+    session_table_chunk_t *chunk;
+    void **slot, *data;
+
+    chunk = get_chunk(table, fd);
+    if (chunk == NULL) {
+        return NULL;
+    }
+
+    slot = &chunk->slots[slot_index(fd)];
+    pthread_mutex_lock(&chunk->lock);
+    data = *slot;
+    if (data != NULL) {
+        __atomic_store_n(slot, NULL, __ATOMIC_RELEASE);
+        chunk->count--;
+    }
+    pthread_mutex_unlock(&chunk->lock);
+
+    if (data != NULL) {
+        __atomic_sub_fetch(&table->count, 1, __ATOMIC_RELAXED);
+    }
+    return data;
+}
+
+void *
+session_table_lookup (session_table_t *table, int fd)
+{
+    session_table_chunk_t *chunk;
+
+    chunk = get_chunk(table, fd);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    return __atomic_load_n(&chunk->slots[slot_index(fd)], __ATOMIC_ACQUIRE);
+}
+
+uint32_t
+session_table_get_count (session_table_t *table)
+{
+    return __atomic_load_n(&table->count, __ATOMIC_RELAXED);
+}
+
+/*
+ * Call walker on every session, in fd order. Each chunk is locked while it
+ * is walked, so it is meant for diagnostics, not for the hot path.
+ */
+void
+session_table_walk (session_table_t *table,
+                    session_table_walker_t walker, void *arg)
+{
+    session_table_chunk_t *chunk;
+    uint32_t i, j;
+
+    for (i = 0; i < table->chunk_cnt; i++) {
+        chunk = __atomic_load_n(&table->chunks[i], __ATOMIC_ACQUIRE);
+        if (chunk == NULL || chunk->count == 0) {
+            continue;
+        }
+        pthread_mutex_lock(&chunk->lock);
+        for (j = 0; j < SESSION_TABLE_CHUNK_SIZE; j++) {
+            if (chunk->slots[j]) {
+                walker(chunk->slots[j], arg);
+            }
+        }
+        pthread_mutex_unlock(&chunk->lock);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef __SESSION_TABLE_H__
+#define __SESSION_TABLE_H__
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define SESSION_TABLE_CHUNK_BITS 12
+#define SESSION_TABLE_CHUNK_SIZE (1 << SESSION_TABLE_CHUNK_BITS)
+#define SESSION_TABLE_DEFAULT_MAX_FD (1 << 20)
+
+/*
+ * Sessions indexed directly by their fd. Slots are grouped in chunks that
+ * are allocated the first time an fd in their range shows up, so the
+ * table costs one pointer per chunk until it is used. Lookup is lock
+ * free, insert/remove only take the lock of the fd's chunk, which also
+ * keeps a walk over the table from seeing a session being freed.
+ */
+typedef struct session_table_chunk_s {
+    pthread_mutex_t lock;
+    uint32_t count;
+    void *slots[SESSION_TABLE_CHUNK_SIZE];
+} session_table_chunk_t;
+
+typedef struct session_table_s {
+    session_table_chunk_t **chunks;
+    uint32_t chunk_cnt;
+    uint32_t max_fd;
+    uint32_t count;
+    pthread_mutex_t grow_lock;
+} session_table_t;
+
+typedef void (*session_table_walker_t)(void *data, void *arg);
+
+int
+session_table_init(session_table_t *table, uint32_t max_fd);
+
+void
+session_table_clean(session_table_t *table);
+
+int
+session_table_insert(session_table_t *table, int fd, void *data);
+
+void *
+session_table_remove(session_table_t *table, int fd);
+
+void *
+session_table_lookup(session_table_t *table, int fd);
+
+uint32_t
+session_table_get_count(session_table_t *table);
+
+void
+session_table_walk(session_table_t *table,
+                   session_table_walker_t walker, void *arg);
+#endif //__SESSION_TABLE_H__
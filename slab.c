@@ -0,0 +1,288 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "slab.h"
+
+__thread slab_cache_t *slab_local[SLAB_MAX];
+
+static int slab_next_id;
+
+/*
+ * size is rounded up to a cache line, so objects never share one. Nothing
+ * is mapped before the first slab_alloc.
+ */
+int
+slab_init (slab_t *slab, const char *name, uint32_t size, slab_pages_t pages)
+{
+    memzero(slab, sizeof(slab_t));
+    size = MAX(size, sizeof(slab_obj_t));
+    slab->size = (size + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
+    if (slab->size > SLAB_REGION_SIZE) {
+        logger(ERROR, "Slab %s objects of %u bytes don't fit a region.",
+               name, size);
+        return -1;
+    }
+    // never reused, threads may still point to caches of a cleaned slab
+    slab->id = __atomic_fetch_add(&slab_next_id, 1, __ATOMIC_RELAXED);
+    if (slab->id >= SLAB_MAX) {
+        logger(ERROR, "Too many slabs, at most %d.", SLAB_MAX);
+        return -1;
+    }
+    slab->name = name;
+    slab->pages = pages;
+    pthread_mutex_init(&slab->lock, NULL);
+    return 0;
+}
+
+void
+slab_clean (slab_t *slab)
+{
+    slab_cache_t *cache;
+    slab_region_t *region;
+
+    pthread_mutex_lock(&slab->lock);
+    while ((cache = slab->caches) != NULL) {
+        slab->caches = cache->next;
+        free(cache);
+    }
+    while ((region = slab->regions) != NULL) {
+        slab->regions = region->next;
+        munmap(region->base, SLAB_REGION_SIZE);
+        free(region);
+    }
+    slab->free = NULL;
+    slab->carve = NULL;
+    slab->carve_end = NULL;
+    slab->region_cnt = 0;
+    slab->hugetlb_cnt = 0;
+    pthread_mutex_unlock(&slab->lock);
+    pthread_mutex_destroy(&slab->lock);
+    slab_local[slab->id] = NULL;
+}
+
+/*
+ * Huge pages only back memory aligned to their size: a hugetlb mapping
+ * is, any other is mapped twice the size and trimmed to the aligned
+ * region within. Without reserved huge pages the slab moves on to THP.
+ */
+static void *
+slab_map (slab_t *slab, bool *hugetlb)
+{
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    char *p, *base;
+    uintptr_t off;
+
+    *hugetlb = False;
+    if (slab->pages == SLAB_PAGES_HUGETLB) {
+        p = mmap(NULL, SLAB_REGION_SIZE, PROT_READ | PROT_WRITE,
+                 flags | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            *hugetlb = True;
+            return p;
+        }
+        logger(INFO, "No huge pages for slab %s, fall back to THP.",
+               slab->name);
+        slab->pages = SLAB_PAGES_THP;
+    }
+
+    p = mmap(NULL, 2 * SLAB_REGION_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+    off = (uintptr_t)p & (SLAB_REGION_SIZE - 1);
+    base = off != 0 ? p + SLAB_REGION_SIZE - off : p;
+    if (base != p) {
+        munmap(p, base - p);
+    }
+    munmap(base + SLAB_REGION_SIZE, SLAB_REGION_SIZE - (base - p));
+    if (slab->pages == SLAB_PAGES_THP) {
+        madvise(base, SLAB_REGION_SIZE, MADV_HUGEPAGE);
+    }
+    return base;
+}
+
+// called with the lock held
+static int
+slab_grow (slab_t *slab)
+{
+    slab_region_t *region;
+
+    region = malloc(sizeof(slab_region_t));
+    if (region == NULL) {
+        logger(ERROR, "Fail to malloc slab region.");
+        return -1;
+    }
+    region->base = slab_map(slab, &region->hugetlb);
+    if (region->base == NULL) {
+        logger(ERROR, "Fail to map a region for slab %s.", slab->name);
+        free(region);
+        return -1;
+    }
+    region->next = slab->regions;
+    slab->regions = region;
+    slab->region_cnt++;
+    slab->hugetlb_cnt += region->hugetlb;
+
+    slab->carve = region->base;
+    slab->carve_end = slab->carve +
+                      SLAB_REGION_SIZE / slab->size * slab->size;
+    return 0;
+}
+
+static slab_cache_t *
+slab_cache_register (slab_t *slab)
+{
+    slab_cache_t *cache;
+
+    if (posix_memalign((void **)&cache, CACHE_LINE_SIZE,
+                       sizeof(slab_cache_t)) != 0) {
+        return NULL;
+    }
+    memzero(cache, sizeof(slab_cache_t));
+    cache->slab = slab;
+
+    pthread_mutex_lock(&slab->lock);
+    cache->next = slab->caches;
+    slab->caches = cache;
+    pthread_mutex_unlock(&slab->lock);
+
+    slab_local[slab->id] = cache;
+    return cache;
+}
+
+/*
+ * The thread cache ran dry, or there is none yet. Refill it with a batch
+ * from the free list, carving new objects once that is empty too. A
+ * thread which could not get a cache takes one object at a time.
+ */
+void *
+slab_alloc_slow (slab_t *slab)
+{
+    slab_cache_t *cache = slab_local[slab->id];
+    slab_obj_t *head = NULL, *obj;
+    uint32_t want, cnt = 0;
+
+    if (cache == NULL) {
+        cache = slab_cache_register(slab);
+    }
+    want = cache != NULL ? SLAB_CACHE_BATCH : 1;
+
+    pthread_mutex_lock(&slab->lock);
+    while (cnt < want) {
+        if (slab->free != NULL) {
+            obj = slab->free;
+            slab->free = obj->next;
+        } else if (slab->carve != slab->carve_end || slab_grow(slab) == 0) {
+            obj = (slab_obj_t *)slab->carve;
+            slab->carve += slab->size;
+        } else {
+            break;
+        }
+        obj->next = head;
+        head = obj;
+        cnt++;
+    }
+    if (cache == NULL && head != NULL) {
+        slab->allocs++;
+    }
+    pthread_mutex_unlock(&slab->lock);
+
+    if (head == NULL || cache == NULL) {
+        return head;
+    }
+    cache->free = head->next;
+    cache->cnt = cnt - 1;
+    cache->allocs++;
+    return head;
+}
+
+/*
+ * The thread cache is full, or there is none yet. It keeps a batch of
+ * the objects freed last, the rest goes back to the free list.
+ */
+void
+slab_free_slow (slab_t *slab, void *p)
+{
+    slab_cache_t *cache = slab_local[slab->id];
+    slab_obj_t *obj = p, *cold, *tail;
+    uint32_t i;
+
+    if (cache == NULL) {
+        cache = slab_cache_register(slab);
+    }
+    if (cache == NULL) {
+        pthread_mutex_lock(&slab->lock);
+        obj->next = slab->free;
+        slab->free = obj;
+        slab->frees++;
+        pthread_mutex_unlock(&slab->lock);
+        return;
+    }
+
+    obj->next = cache->free;
+    cache->free = obj;
+    cache->cnt++;
+    cache->frees++;
+    if (cache->cnt <= SLAB_CACHE_MAX) {
+        return;
+    }
+
+    tail = cache->free;
+    for (i = 1; i < SLAB_CACHE_BATCH; i++) {
+        tail = tail->next;
+    }
+    cold = tail->next;
+    tail->next = NULL;
+    cache->cnt = SLAB_CACHE_BATCH;
+    for (tail = cold; tail->next != NULL; tail = tail->next) {
+    }
+
+    pthread_mutex_lock(&slab->lock);
+    tail->next = slab->free;
+    slab->free = cold;
+    pthread_mutex_unlock(&slab->lock);
+}
+
+/*
+ * Thread caches are read while their owners use them, live may be off by
+ * the allocations and frees in flight.
+ */
+void
+slab_get_stats (slab_t *slab, slab_stats_t *stats)
+{
+    slab_cache_t *cache;
+    uint64_t allocs, frees, capacity;
+
+    memzero(stats, sizeof(slab_stats_t));
+    pthread_mutex_lock(&slab->lock);
+    allocs = slab->allocs;
+    frees = slab->frees;
+    for (cache = slab->caches; cache != NULL; cache = cache->next) {
+        allocs += cache->allocs;
+        frees += cache->frees;
+        stats->cached += cache->cnt;
+    }
+    stats->regions = slab->region_cnt;
+    stats->hugetlb_regions = slab->hugetlb_cnt;
+    pthread_mutex_unlock(&slab->lock);
+
+    stats->reserved = (uint64_t)stats->regions * SLAB_REGION_SIZE;
+    capacity = (uint64_t)stats->regions * (SLAB_REGION_SIZE / slab->size);
+    stats->live = allocs > frees ? allocs - frees : 0;
+    stats->free = capacity > stats->live ? capacity - stats->live : 0;
+}
+
+int
+slab_parse_pages (const char *name, slab_pages_t *pages)
+{
+    if (strcmp(name, "normal") == 0) {
+        *pages = SLAB_PAGES_NORMAL;
+    } else if (strcmp(name, "thp") == 0) {
+        *pages = SLAB_PAGES_THP;
+    } else if (strcmp(name, "hugetlb") == 0) {
+        *pages = SLAB_PAGES_HUGETLB;
+    } else {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,135 @@
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "util.h"
+
+// a huge page on x86-64 and aarch64 with 4KB pages
+#define SLAB_REGION_SIZE (2*1024*1024)
+// objects moved between a thread cache and the slab at once
+#define SLAB_CACHE_BATCH 32
+#define SLAB_CACHE_MAX (2*SLAB_CACHE_BATCH)
+// slabs a process may create, each takes a thread cache slot
+#define SLAB_MAX 16
+
+typedef enum slab_pages_e {
+    SLAB_PAGES_NORMAL,
+    SLAB_PAGES_THP,      // madvise'd for transparent huge pages
+    SLAB_PAGES_HUGETLB,  // MAP_HUGETLB, THP if none are reserved
+} slab_pages_t;
+
+typedef struct slab_obj_s {
+    struct slab_obj_s *next;
+} slab_obj_t;
+
+typedef struct slab_region_s {
+    struct slab_region_s *next;
+    void *base;
+    bool hugetlb;
+} slab_region_t;
+
+struct slab_s;
+
+/*
+ * Free objects a thread keeps to itself, most recently freed first so
+ * the next allocation gets the one most likely still in its cache. The
+ * counts are only written by the owner, readers may see them half
+ * updated.
+ */
+typedef struct slab_cache_s {
+    slab_obj_t *free;
+    uint32_t cnt;
+    uint64_t allocs;
+    uint64_t frees;
+    struct slab_s *slab;
+    struct slab_cache_s *next;
+} cache_aligned slab_cache_t;
+
+typedef struct slab_stats_s {
+    uint64_t live;
+    uint64_t free;         // carved or not, thread caches included
+    uint64_t cached;       // in thread caches
+    uint64_t reserved;     // bytes mapped
+    uint32_t regions;
+    uint32_t hugetlb_regions;
+} slab_stats_t;
+
+/*
+ * Pool of fixed size objects carved from SLAB_REGION_SIZE mappings,
+ * which are only unmapped by slab_clean. Each thread allocates from and
+ * frees to a cache of its own, the lock is only taken to move a batch
+ * between the cache and the shared free list, so an object may be freed
+ * by another thread than the one which allocated it.
+ */
+typedef struct slab_s {
+    const char *name;
+    uint32_t size;         // rounded up to a cache line
+    int id;                // slot of its thread caches
+    slab_pages_t pages;
+    pthread_mutex_t lock;
+    slab_obj_t *free;
+    char *carve;           // rest of the newest region
+    char *carve_end;
+    slab_region_t *regions;
+    uint32_t region_cnt;
+    uint32_t hugetlb_cnt;
+    uint64_t allocs;       // by threads without a cache
+    uint64_t frees;
+    slab_cache_t *caches;
+} slab_t;
+
+extern __thread slab_cache_t *slab_local[SLAB_MAX];
+
+int
+slab_init(slab_t *slab, const char *name, uint32_t size, slab_pages_t pages);
+
+void
+slab_clean(slab_t *slab);
+
+void *
+slab_alloc_slow(slab_t *slab);
+
+void
+slab_free_slow(slab_t *slab, void *p);
+
+void
+slab_get_stats(slab_t *slab, slab_stats_t *stats);
+
+int
+slab_parse_pages(const char *name, slab_pages_t *pages);
+
+// uninitialized memory, NULL only if a region could not be mapped
+static inline void *
+slab_alloc (slab_t *slab)
+{
+    slab_cache_t *cache = slab_local[slab->id];
+    slab_obj_t *obj;
+
+    if (__builtin_expect(cache != NULL && cache->free != NULL, 1)) {
+        obj = cache->free;
+        cache->free = obj->next;
+        cache->cnt--;
+        cache->allocs++;
+        return obj;
+    }
+    return slab_alloc_slow(slab);
+}
+
+static inline void
+slab_free (slab_t *slab, void *p)
+{
+    slab_cache_t *cache = slab_local[slab->id];
+    slab_obj_t *obj = p;
+
+    if (__builtin_expect(cache != NULL && cache->cnt < SLAB_CACHE_MAX, 1)) {
+        obj->next = cache->free;
+        cache->free = obj;
+        cache->cnt++;
+        cache->frees++;
+        return;
+    }
+    slab_free_slow(slab, p);
+}
+#endif //__SLAB_H__
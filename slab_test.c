@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "slab.h"
+
+#define TEST_OBJ_SIZE 200
+#define TEST_OBJ_CNT 10000
+#define TEST_THREAD_CNT 4
+#define BENCH_ROUNDS 1000000
+#define BENCH_LIVE 64
+
+static int
+check_stats (slab_t *slab, uint64_t live, uint32_t regions)
+{
+    slab_stats_t stats;
+
+    slab_get_stats(slab, &stats);
+    if (stats.live != live || stats.regions != regions ||
+        stats.reserved != (uint64_t)regions * SLAB_REGION_SIZE ||
+        stats.free != regions * (SLAB_REGION_SIZE / slab->size) - live) {
+        printf("FAIL: %lu live, %lu free, %u regions\n",
+               (unsigned long)stats.live, (unsigned long)stats.free,
+               stats.regions);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Objects are cache line aligned and don't overlap, and the one freed
+ * last is the next one handed out.
+ */
+static int
+test_reuse (void)
+{
+    slab_t slab;
+    char **p;
+    int i, rc = -1;
+
+    p = malloc(TEST_OBJ_CNT * sizeof(char *));
+    if (p == NULL || slab_init(&slab, "test", TEST_OBJ_SIZE,
+                               SLAB_PAGES_NORMAL) != 0) {
+        free(p);
+        return -1;
+    }
+    for (i = 0; i < TEST_OBJ_CNT; i++) {
+        p[i] = slab_alloc(&slab);
+        if (p[i] == NULL || (uintptr_t)p[i] % CACHE_LINE_SIZE != 0) {
+            printf("FAIL: alloc %d\n", i);
+            goto out;
+        }
+        memset(p[i], i, TEST_OBJ_SIZE);
+    }
+    for (i = 0; i < TEST_OBJ_CNT; i++) {
+        if (p[i][TEST_OBJ_SIZE-1] != (char)i) {
+            printf("FAIL: object %d overwritten\n", i);
+            goto out;
+        }
+    }
+    // 256 bytes each, 8192 to a region
+    if (check_stats(&slab, TEST_OBJ_CNT, 2) != 0) {
+        goto out;
+    }
+    for (i = 0; i < TEST_OBJ_CNT; i++) {
+        slab_free(&slab, p[i]);
+    }
+    if (slab_alloc(&slab) != p[TEST_OBJ_CNT-1]) {
+        printf("FAIL: not the object freed last\n");
+        goto out;
+    }
+    slab_free(&slab, p[TEST_OBJ_CNT-1]);
+    if (check_stats(&slab, 0, 2) != 0) {
+        goto out;
+    }
+    printf("reuse: ok\n");
+    rc = 0;
+out:
+    slab_clean(&slab);
+    free(p);
+    return rc;
+}
+
+typedef struct test_thread_s {
+    slab_t *slab;
+    void **objs;
+    int rc;
+} test_thread_t;
+
+static void *
+thread_alloc (void *arg)
+{
+    test_thread_t *t = arg;
+    int i;
+
+    for (i = 0; i < TEST_OBJ_CNT; i++) {
+        t->objs[i] = slab_alloc(t->slab);
+        if (t->objs[i] == NULL) {
+            t->rc = -1;
+            break;
+        }
+        memset(t->objs[i], 1, TEST_OBJ_SIZE);
+    }
+    return NULL;
+}
+
+static void *
+thread_free (void *arg)
+{
+    test_thread_t *t = arg;
+    int i;
+
+    for (i = 0; i < TEST_OBJ_CNT; i++) {
+        slab_free(t->slab, t->objs[i]);
+    }
+    return NULL;
+}
+
+// objects allocated by one thread are freed by another
+static int
+test_threads (void)
+{
+    slab_t slab;
+    slab_stats_t stats;
+    pthread_t threads[TEST_THREAD_CNT];
+    test_thread_t t[TEST_THREAD_CNT];
+    void **objs;
+    int i, rc = -1;
+
+    objs = malloc(TEST_THREAD_CNT * TEST_OBJ_CNT * sizeof(void *));
+    if (objs == NULL || slab_init(&slab, "threads", TEST_OBJ_SIZE,
+                                  SLAB_PAGES_THP) != 0) {
+        free(objs);
+        return -1;
+    }
+    for (i = 0; i < TEST_THREAD_CNT; i++) {
+        t[i].slab = &slab;
+        t[i].objs = objs + i * TEST_OBJ_CNT;
+        t[i].rc = 0;
+        pthread_create(&threads[i], NULL, thread_alloc, &t[i]);
+    }
+    for (i = 0; i < TEST_THREAD_CNT; i++) {
+        pthread_join(threads[i], NULL);
+        if (t[i].rc != 0) {
+            printf("FAIL: thread %d alloc\n", i);
+            goto out;
+        }
+    }
+    if (check_stats(&slab, TEST_THREAD_CNT * TEST_OBJ_CNT, 5) != 0) {
+        goto out;
+    }
+    for (i = 0; i < TEST_THREAD_CNT; i++) {
+        t[i].objs = objs + (i + 1) % TEST_THREAD_CNT * TEST_OBJ_CNT;
+        pthread_create(&threads[i], NULL, thread_free, &t[i]);
+    }
+    for (i = 0; i < TEST_THREAD_CNT; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    slab_get_stats(&slab, &stats);
+    if (check_stats(&slab, 0, 5) != 0 ||
+        stats.cached > TEST_THREAD_CNT * SLAB_CACHE_MAX) {
+        printf("FAIL: %lu cached\n", (unsigned long)stats.cached);
+        goto out;
+    }
+    printf("threads: ok, %lu cached\n", (unsigned long)stats.cached);
+    rc = 0;
+out:
+    slab_clean(&slab);
+    free(objs);
+    return rc;
+}
+
+// works with or without huge pages reserved
+static int
+test_hugetlb (void)
+{
+    slab_t slab;
+    slab_stats_t stats;
+    char *p;
+
+    if (slab_init(&slab, "hugetlb", TEST_OBJ_SIZE, SLAB_PAGES_HUGETLB) != 0) {
+        return -1;
+    }
+    p = slab_alloc(&slab);
+    if (p == NULL) {
+        printf("FAIL: hugetlb alloc\n");
+        slab_clean(&slab);
+        return -1;
+    }
+    memset(p, 1, TEST_OBJ_SIZE);
+    slab_free(&slab, p);
+    slab_get_stats(&slab, &stats);
+    slab_clean(&slab);
+    printf("hugetlb: ok, %u of %u regions on huge pages\n",
+           stats.hugetlb_regions, stats.regions);
+    return 0;
+}
+
+// connection churn: a few objects live at a time, against malloc and free
+static void
+bench (void)
+{
+    slab_t slab;
+    void *p[BENCH_LIVE];
+    uint64_t start, slab_ns, malloc_ns;
+    int i, j;
+
+    if (slab_init(&slab, "bench", TEST_OBJ_SIZE, SLAB_PAGES_NORMAL) != 0) {
+        return;
+    }
+    start = monotonic_ns();
+    for (i = 0; i < BENCH_ROUNDS / BENCH_LIVE; i++) {
+        for (j = 0; j < BENCH_LIVE; j++) {
+            p[j] = slab_alloc(&slab);
+        }
+        __asm__ volatile("" : : "r"(p) : "memory");
+        for (j = 0; j < BENCH_LIVE; j++) {
+            slab_free(&slab, p[j]);
+        }
+    }
+    slab_ns = monotonic_ns() - start;
+    slab_clean(&slab);
+
+    start = monotonic_ns();
+    for (i = 0; i < BENCH_ROUNDS / BENCH_LIVE; i++) {
+        for (j = 0; j < BENCH_LIVE; j++) {
+            p[j] = malloc(TEST_OBJ_SIZE);
+        }
+        __asm__ volatile("" : : "r"(p) : "memory");
+        for (j = 0; j < BENCH_LIVE; j++) {
+            free(p[j]);
+        }
+    }
+    malloc_ns = monotonic_ns() - start;
+    printf("alloc and free: slab %.1f ns, malloc %.1f ns\n",
+           (double)slab_ns / BENCH_ROUNDS, (double)malloc_ns / BENCH_ROUNDS);
+}
+
+int main (void)
+{
+    if (test_reuse() != 0 || test_threads() != 0 || test_hugetlb() != 0) {
+        printf("FAIL\n");
+        return -1;
+    }
+    bench();
+    printf("PASS\n");
+    return 0;
+}
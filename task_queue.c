@@ -6,6 +6,8 @@
 #include "queue.h"
 #include "task_queue.h"
 
+#ifndef _TASK_QUEUE_MPMC_
+
 int
 task_queue_init (task_queue_t *tqueue)
 {
@@ -75,6 +77,14 @@ task_queue_unlock (task_queue_t *tqueue)
     pthread_mutex_unlock(&tqueue->lock);
 }
 
+void
+task_queue_get_pool_stats (task_queue_t *tqueue, queue_pool_stats_t *stats)
+{
+    task_queue_lock(tqueue);
+    queue_get_pool_stats(&tqueue->queue, stats);
+    task_queue_unlock(tqueue);
+}
+
 static inline void
 task_queue_enqueue (task_queue_t *tqueue, task_queue_data_t *data)
 {
@@ -119,3 +129,69 @@ task_queue_put (task_queue_t *tqueue, task_queue_data_t *data)
     pthread_cond_broadcast(&tqueue->cond_sender);
 }
 
+static void
+task_queue_wakeup (pthread_cond_t *cond, uint32_t cnt)
+{
+    if (cnt == 1) {
+        pthread_cond_signal(cond);
+    } else if (cnt > 1) {
+        pthread_cond_broadcast(cond);
+    }
+}
+
+/*
+ * Dequeue up to max_cnt items under one lock acquisition, only waiting for
+ * the first one. Return the number of items got.
+ */
+uint32_t
+task_queue_get_batch (task_queue_t *tqueue, task_queue_data_t *data,
+                      uint32_t max_cnt)
+{
+    uint32_t cnt = 0;
+
+    task_queue_lock(tqueue);
+    for (;;) {
+        if (!queue_is_empty(&tqueue->queue)) {
+            break;
+        }
+        pthread_cond_wait(&tqueue->cond_sender, &tqueue->lock);
+    }
+
+    while (cnt < max_cnt && !queue_is_empty(&tqueue->queue)) {
+        task_queue_dequeue(tqueue, &data[cnt]);
+        cnt++;
+    }
+    task_queue_unlock(tqueue);
+    task_queue_wakeup(&tqueue->cond_producer, cnt);
+    return cnt;
+}
+
+/*
+ * Enqueue cnt items under one lock acquisition with a single wakeup. The
+ * lock is only given up when the queue fills, after waking consumers for
+ * what is already queued.
+ */
+void
+task_queue_put_batch (task_queue_t *tqueue, task_queue_data_t *data,
+                      uint32_t cnt)
+{
+    uint32_t i = 0, pending = 0;
+
+    task_queue_lock(tqueue);
+    for (;;) {
+        while (i < cnt && !queue_is_full(&tqueue->queue)) {
+            task_queue_enqueue(tqueue, &data[i]);
+            i++;
+            pending++;
+        }
+        if (i == cnt) {
+            break;
+        }
+        task_queue_wakeup(&tqueue->cond_sender, pending);
+        pending = 0;
+        pthread_cond_wait(&tqueue->cond_producer, &tqueue->lock);
+    }
+    task_queue_unlock(tqueue);
+    task_queue_wakeup(&tqueue->cond_sender, pending);
+}
+#endif //_TASK_QUEUE_MPMC_
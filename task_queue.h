@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <pthread.h>
 #include "queue.h"
+#include "ring.h"
 
 #define TASK_QUEUE_POOL_SIZE 50
 #define TASK_QUEUE_MAX_SIZE TASK_QUEUE_POOL_SIZE
@@ -13,6 +14,31 @@ typedef struct task_queue_data_s {
     void *p;
 } task_queue_data_t;
 
+/*
+ * Two backends share the API below, picked at build time:
+ * - default:            queue_t guarded by a mutex and condition variables
+ * - _TASK_QUEUE_MPMC_:  lock-free bounded ring, waiters spin briefly then
+ *                       park on a futex and are woken one at a time, its
+ *                       max size is rounded up to a power of two
+ */
+#ifdef _TASK_QUEUE_MPMC_
+
+#define TASK_QUEUE_MPMC_UNBOUNDED_SIZE 65536
+#define TASK_QUEUE_SPIN_CNT 128
+
+typedef struct task_queue_waitq_s {
+    uint32_t seq;
+    uint32_t waiters;
+} cache_aligned task_queue_waitq_t;
+
+typedef struct task_queue_s {
+    mpmc_ring_t ring;
+    task_queue_waitq_t not_empty;
+    task_queue_waitq_t not_full;
+} task_queue_t;
+
+#else
+
 typedef struct task_queue_s {
     queue_t queue;
     pthread_mutex_t lock;
@@ -20,6 +46,8 @@ typedef struct task_queue_s {
     pthread_cond_t cond_producer;
 } task_queue_t;
 
+#endif
+
 int
 task_queue_init(task_queue_t *tqueue);
 
@@ -29,9 +57,20 @@ task_queue_clean(task_queue_t *tqueue);
 void
 task_queue_set_max_size(task_queue_t *tqueue, uint32_t max_size);
 
+void
+task_queue_get_pool_stats(task_queue_t *tqueue, queue_pool_stats_t *stats);
+
 void
 task_queue_get(task_queue_t *tqueue, task_queue_data_t *data);
 
 void
 task_queue_put(task_queue_t *tqueue, task_queue_data_t *data);
+
+uint32_t
+task_queue_get_batch(task_queue_t *tqueue, task_queue_data_t *data,
+                     uint32_t max_cnt);
+
+void
+task_queue_put_batch(task_queue_t *tqueue, task_queue_data_t *data,
+                     uint32_t cnt);
 #endif //__TASK_QUEUE_H__
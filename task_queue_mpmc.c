@@ -0,0 +1,185 @@
+#include <unistd.h>
+#include <stdbool.h>
+#include "util.h"
+#include "ring.h"
+#include "task_queue.h"
+
+#ifdef _TASK_QUEUE_MPMC_
+
+/*
+ * Wake at most cnt parked waiters. The fence orders the ring update that
+ * made progress possible before the read of the waiter count, pairing
+ * with the waiter registering itself before its last retry.
+ */
+static void
+waitq_notify (task_queue_waitq_t *wq, int cnt)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&wq->waiters, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+    __atomic_add_fetch(&wq->seq, 1, __ATOMIC_RELEASE);
+    futex_wake(&wq->seq, cnt);
+}
+
+int
+task_queue_init (task_queue_t *tqueue)
+{
+    memzero(tqueue, sizeof(task_queue_t));
+    return mpmc_ring_init(&tqueue->ring, TASK_QUEUE_MAX_SIZE);
+}
+
+void
+task_queue_clean (task_queue_t *tqueue)
+{
+    mpmc_ring_clean(&tqueue->ring);
+}
+
+/*
+ * The ring is always bounded, max_size 0 gets a large fixed capacity, and
+ * its capacity is max_size rounded up to a power of two: the default 50
+ * holds 64. Like queue_set_pool, only valid while the queue is empty and
+ * idle. On failure the queue keeps its old ring.
+ */
+void
+task_queue_set_max_size (task_queue_t *tqueue, uint32_t max_size)
+{
+    mpmc_ring_t ring;
+
+    if (max_size == 0) {
+        max_size = TASK_QUEUE_MPMC_UNBOUNDED_SIZE;
+    }
+    if (mpmc_ring_init(&ring, max_size) != 0) {
+        logger(ERROR, "Fail to resize task queue to %u.", max_size);
+        return;
+    }
+    mpmc_ring_clean(&tqueue->ring);
+    tqueue->ring = ring;
+}
+
+/*
+ * Ring cells are preallocated, there is no entry pool to report.
+ */
+void
+task_queue_get_pool_stats (task_queue_t *tqueue, queue_pool_stats_t *stats)
+{
+    memzero(stats, sizeof(queue_pool_stats_t));
+    stats->entry_cnt = mpmc_ring_get_capacity(&tqueue->ring);
+}
+
+static void
+ring_dequeue_wait (task_queue_t *tqueue, task_queue_data_t *data)
+{
+    task_queue_waitq_t *wq = &tqueue->not_empty;
+    uint32_t seq;
+    int i;
+
+    for (;;) {
+        for (i = 0; i < TASK_QUEUE_SPIN_CNT; i++) {
+            if (mpmc_ring_try_dequeue(&tqueue->ring, &data->p)) {
+                return;
+            }
+            cpu_relax();
+        }
+
+        seq = __atomic_load_n(&wq->seq, __ATOMIC_ACQUIRE);
+        __atomic_add_fetch(&wq->waiters, 1, __ATOMIC_SEQ_CST);
+        if (mpmc_ring_try_dequeue(&tqueue->ring, &data->p)) {
+            __atomic_sub_fetch(&wq->waiters, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        futex_wait(&wq->seq, seq);
+        __atomic_sub_fetch(&wq->waiters, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void
+ring_enqueue_wait (task_queue_t *tqueue, task_queue_data_t *data)
+{
+    task_queue_waitq_t *wq = &tqueue->not_full;
+    uint32_t seq;
+    int i;
+
+    for (;;) {
+        for (i = 0; i < TASK_QUEUE_SPIN_CNT; i++) {
+            if (mpmc_ring_try_enqueue(&tqueue->ring, data->p)) {
+                return;
+            }
+            cpu_relax();
+        }
+
+        seq = __atomic_load_n(&wq->seq, __ATOMIC_ACQUIRE);
+        __atomic_add_fetch(&wq->waiters, 1, __ATOMIC_SEQ_CST);
+        if (mpmc_ring_try_enqueue(&tqueue->ring, data->p)) {
+            __atomic_sub_fetch(&wq->waiters, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        futex_wait(&wq->seq, seq);
+        __atomic_sub_fetch(&wq->waiters, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void
+task_queue_get (task_queue_t *tqueue, task_queue_data_t *data)
+{
+    ring_dequeue_wait(tqueue, data);
+    waitq_notify(&tqueue->not_full, 1);
+}
+
+void
+task_queue_put (task_queue_t *tqueue, task_queue_data_t *data)
+{
+    ring_enqueue_wait(tqueue, data);
+    waitq_notify(&tqueue->not_empty, 1);
+}
+
+/*
+ * Only wait for the first item, then take whatever else is ready, and
+ * wake as many producers as slots were freed.
+ */
+uint32_t
+task_queue_get_batch (task_queue_t *tqueue, task_queue_data_t *data,
+                      uint32_t max_cnt)
+{
+    uint32_t cnt = 1;
+
+    if (max_cnt == 0) {
+        return 0;
+    }
+
+    ring_dequeue_wait(tqueue, &data[0]);
+    while (cnt < max_cnt &&
+           mpmc_ring_try_dequeue(&tqueue->ring, &data[cnt].p)) {
+        cnt++;
+    }
+    waitq_notify(&tqueue->not_full, cnt);
+    return cnt;
+}
+
+/*
+ * Consumers are woken once for the whole batch, or before parking when
+ * the ring fills up so they can make room.
+ */
+void
+task_queue_put_batch (task_queue_t *tqueue, task_queue_data_t *data,
+                      uint32_t cnt)
+{
+    uint32_t i, pending = 0;
+
+    for (i = 0; i < cnt; i++) {
+        if (mpmc_ring_try_enqueue(&tqueue->ring, data[i].p)) {
+            pending++;
+            continue;
+        }
+        if (pending > 0) {
+            waitq_notify(&tqueue->not_empty, pending);
+            pending = 0;
+        }
+        ring_enqueue_wait(tqueue, &data[i]);
+        pending++;
+    }
+    if (pending > 0) {
+        waitq_notify(&tqueue->not_empty, pending);
+    }
+}
+#endif //_TASK_QUEUE_MPMC_
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "task_queue.h"
+
+// small enough for put_batch to fill the queue and wait
+#define QUEUE_SIZE 8
+#define PRODUCER_CNT 4
+#define CONSUMER_CNT 4
+#define ITEM_PER_PRODUCER 100000
+#define PUT_BATCH_MAX 13
+#define GET_BATCH_MAX 7
+#define TEST_TIMEOUT_S 60
+
+static task_queue_t tqueue;
+static uint8_t seen[PRODUCER_CNT * ITEM_PER_PRODUCER + 1];
+static uint64_t consumed_cnt[CONSUMER_CNT];
+// queue_t takes no NULL, the poison is an address no item has
+static char poison_mark;
+
+/*
+ * Items are numbered from 1 across producers. Batch sizes cycle from 1
+ * to PUT_BATCH_MAX, over the queue size.
+ */
+static void *
+producer (void *arg)
+{
+    uintptr_t base = (uintptr_t)arg * ITEM_PER_PRODUCER;
+    task_queue_data_t data[PUT_BATCH_MAX];
+    uintptr_t i = 1;
+    uint32_t cnt, size = 1;
+
+    while (i <= ITEM_PER_PRODUCER) {
+        for (cnt = 0; cnt < size && i <= ITEM_PER_PRODUCER; cnt++, i++) {
+            data[cnt].p = (void *)(base + i);
+        }
+        task_queue_put_batch(&tqueue, data, cnt);
+        size = size % PUT_BATCH_MAX + 1;
+    }
+    return NULL;
+}
+
+// poisons got beyond its own are put back for the other consumers
+static void *
+consumer (void *arg)
+{
+    uintptr_t id = (uintptr_t)arg;
+    task_queue_data_t data[GET_BATCH_MAX], poison = { &poison_mark };
+    uint32_t i, cnt, poisons = 0;
+
+    while (poisons == 0) {
+        cnt = task_queue_get_batch(&tqueue, data, GET_BATCH_MAX);
+        for (i = 0; i < cnt; i++) {
+            if (data[i].p == &poison_mark) {
+                poisons++;
+                continue;
+            }
+            __atomic_add_fetch(&seen[(uintptr_t)data[i].p], 1,
+                               __ATOMIC_RELAXED);
+            consumed_cnt[id]++;
+        }
+    }
+    while (--poisons > 0) {
+        task_queue_put(&tqueue, &poison);
+    }
+    return NULL;
+}
+
+static void
+on_timeout (int sig)
+{
+    static const char msg[] = "FAIL: hung\n";
+
+    if (write(STDOUT_FILENO, msg, sizeof(msg) - 1) < 0) {
+        _exit(2);
+    }
+    _exit(1);
+}
+
+int main (void)
+{
+    pthread_t producers[PRODUCER_CNT], consumers[CONSUMER_CNT];
+    task_queue_data_t poisons[CONSUMER_CNT];
+    uint64_t cnt = 0, lost = 0, duplicated = 0;
+    uintptr_t i;
+
+    signal(SIGALRM, on_timeout);
+    alarm(TEST_TIMEOUT_S);
+
+    if (task_queue_init(&tqueue) != 0) {
+        printf("FAIL: init\n");
+        return -1;
+    }
+    task_queue_set_max_size(&tqueue, QUEUE_SIZE);
+    for (i = 0; i < CONSUMER_CNT; i++) {
+        pthread_create(&consumers[i], NULL, consumer, (void *)i);
+    }
+    for (i = 0; i < PRODUCER_CNT; i++) {
+        pthread_create(&producers[i], NULL, producer, (void *)i);
+    }
+    for (i = 0; i < PRODUCER_CNT; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    for (i = 0; i < CONSUMER_CNT; i++) {
+        poisons[i].p = &poison_mark;
+    }
+    task_queue_put_batch(&tqueue, poisons, CONSUMER_CNT);
+    for (i = 0; i < CONSUMER_CNT; i++) {
+        pthread_join(consumers[i], NULL);
+        cnt += consumed_cnt[i];
+    }
+    task_queue_clean(&tqueue);
+
+    for (i = 1; i <= PRODUCER_CNT * ITEM_PER_PRODUCER; i++) {
+        lost += seen[i] == 0;
+        duplicated += seen[i] > 1;
+    }
+    printf("Consumed %lu items, %lu lost, %lu duplicated\n",
+           (unsigned long)cnt, (unsigned long)lost,
+           (unsigned long)duplicated);
+    if (lost != 0 || duplicated != 0) {
+        printf("FAIL\n");
+        return -1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,163 @@
+#include "util.h"
+#include "timer_wheel.h"
+
+void
+timer_wheel_init (timer_wheel_t *tw, uint64_t now_ms, uint32_t tick_ms)
+{
+    int i, j;
+
+    memzero(tw, sizeof(timer_wheel_t));
+    for (i = 0; i < TIMER_WHEEL_LEVEL_CNT; i++) {
+        for (j = 0; j < TIMER_WHEEL_LEVEL_SIZE; j++) {
+            dlist_init(&tw->slots[i][j]);
+        }
+    }
+    tw->base_ms = now_ms;
+    tw->tick_ms = tick_ms > 0 ? tick_ms : 1;
+}
+
+void
+timer_wheel_timer_init (tw_timer_t *timer)
+{
+    dlist_init(&timer->header);
+    timer->expire = 0;
+    timer->armed = False;
+}
+
+static void
+timer_wheel_link (timer_wheel_t *tw, tw_timer_t *timer)
+{
+    uint64_t delta;
+    int level, shift;
+
+    if (timer->expire < tw->tick) {
+        timer->expire = tw->tick;
+    }
+    delta = timer->expire - tw->tick;
+    if (delta >= TIMER_WHEEL_MAX_TICKS) {
+        delta = TIMER_WHEEL_MAX_TICKS - 1;
+        timer->expire = tw->tick + delta;
+    }
+
+    for (level = 0; level < TIMER_WHEEL_LEVEL_CNT - 1; level++) {
+        if (delta < ((uint64_t)1 << (TIMER_WHEEL_LEVEL_BITS * (level + 1)))) {
+            break;
+        }
+    }
+    shift = TIMER_WHEEL_LEVEL_BITS * level;
+    dlist_append(&tw->slots[level][(timer->expire >> shift) &
+                                   TIMER_WHEEL_LEVEL_MASK],
+                 &timer->header);
+}
+
+/*
+ * expire_ms is rounded up to a tick, a timer never fires early. Adding an
+ * armed timer moves it.
+ */
+void
+timer_wheel_add (timer_wheel_t *tw, tw_timer_t *timer, uint64_t expire_ms)
+{
+    if (timer->armed) {
+        dlist_remove(&timer->header);
+        tw->count--;
+    }
+
+    expire_ms = expire_ms > tw->base_ms ? expire_ms - tw->base_ms : 0;
+    timer->expire = (expire_ms + tw->tick_ms - 1) / tw->tick_ms;
+    timer->armed = True;
+    timer_wheel_link(tw, timer);
+    tw->count++;
+}
+
+void
+timer_wheel_del (timer_wheel_t *tw, tw_timer_t *timer)
+{
+    if (!timer->armed) {
+        return;
+    }
+    dlist_remove(&timer->header);
+    timer->armed = False;
+    tw->count--;
+}
+
+/*
+ * Re-insert every timer of a slot of an upper level, they all land in
+ * lower levels now. Return the slot index, 0 means the level wrapped too.
+ */
+static int
+timer_wheel_cascade (timer_wheel_t *tw, int level)
+{
+    dlist_header_t *slot, *header;
+    int idx;
+
+    idx = (tw->tick >> (TIMER_WHEEL_LEVEL_BITS * level)) &
+          TIMER_WHEEL_LEVEL_MASK;
+    slot = &tw->slots[level][idx];
+    while ((header = dlist_pop_left(slot)) != NULL) {
+        timer_wheel_link(tw, dlist_get_entry(header, tw_timer_t, header));
+    }
+    return idx;
+}
+
+/*
+ * Expire every tick up to now_ms, moving the timers due to the expired
+ * list, where they are disarmed and left for the caller to handle.
+ * Return how many expired.
+ */
+uint32_t
+timer_wheel_advance (timer_wheel_t *tw, uint64_t now_ms,
+                     dlist_header_t *expired)
+{
+    dlist_header_t *slot, *header;
+    tw_timer_t *timer;
+    uint64_t now_tick;
+    uint32_t cnt = 0;
+    int level, idx;
+
+    if (now_ms < tw->base_ms) {
+        return 0;
+    }
+    now_tick = (now_ms - tw->base_ms) / tw->tick_ms;
+
+    if (tw->count == 0 && tw->tick <= now_tick) {
+        // nothing to cascade, skip idle ticks at once
+        tw->tick = now_tick + 1;
+        return 0;
+    }
+
+    while (tw->tick <= now_tick) {
+        idx = tw->tick & TIMER_WHEEL_LEVEL_MASK;
+        for (level = 1; idx == 0 && level < TIMER_WHEEL_LEVEL_CNT; level++) {
+            idx = timer_wheel_cascade(tw, level);
+        }
+
+        slot = &tw->slots[0][tw->tick & TIMER_WHEEL_LEVEL_MASK];
+        while ((header = dlist_pop_left(slot)) != NULL) {
+            timer = dlist_get_entry(header, tw_timer_t, header);
+            timer->armed = False;
+            dlist_append(expired, header);
+            tw->count--;
+            cnt++;
+        }
+        tw->tick++;
+    }
+
+    tw->expired += cnt;
+    return cnt;
+}
+
+/*
+ * Milliseconds until the next tick, -1 when no timer is armed, for the
+ * timeout of epoll_wait.
+ */
+int
+timer_wheel_get_timeout (timer_wheel_t *tw, uint64_t now_ms)
+{
+    uint64_t next_ms;
+
+    if (tw->count == 0) {
+        return -1;
+    }
+    next_ms = tw->base_ms + tw->tick * tw->tick_ms;
+    return next_ms > now_ms ? (int)(next_ms - now_ms) : 0;
+}
@@ -0,0 +1,65 @@
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "dlist.h"
+
+#define TIMER_WHEEL_LEVEL_BITS 6
+#define TIMER_WHEEL_LEVEL_SIZE (1 << TIMER_WHEEL_LEVEL_BITS)
+#define TIMER_WHEEL_LEVEL_MASK (TIMER_WHEEL_LEVEL_SIZE - 1)
+#define TIMER_WHEEL_LEVEL_CNT 4
+#define TIMER_WHEEL_MAX_TICKS \
+    ((uint64_t)1 << (TIMER_WHEEL_LEVEL_BITS * TIMER_WHEEL_LEVEL_CNT))
+
+/*
+ * Timer embedded in its owner, found back with dlist_get_entry on the
+ * header.
+ */
+typedef struct tw_timer_s {
+    dlist_header_t header;
+    uint64_t expire; // in ticks
+    bool armed;
+} tw_timer_t;
+
+/*
+ * Hierarchical timing wheel. Level n has 64 slots of 64^n ticks each, a
+ * timer goes to the lowest level its distance fits in and is cascaded one
+ * level down each time the level below wraps, so add, delete and expiry
+ * are O(1) per timer. Four levels cover 64^4 ticks, later timers are
+ * clamped to that. Not thread safe, the owner serializes access.
+ */
+typedef struct timer_wheel_s {
+    dlist_header_t slots[TIMER_WHEEL_LEVEL_CNT][TIMER_WHEEL_LEVEL_SIZE];
+    uint64_t tick;   // next tick to expire
+    uint64_t base_ms;
+    uint32_t tick_ms;
+    uint32_t count;
+    uint64_t expired;
+} timer_wheel_t;
+
+void
+timer_wheel_init(timer_wheel_t *tw, uint64_t now_ms, uint32_t tick_ms);
+
+void
+timer_wheel_timer_init(tw_timer_t *timer);
+
+void
+timer_wheel_add(timer_wheel_t *tw, tw_timer_t *timer, uint64_t expire_ms);
+
+void
+timer_wheel_del(timer_wheel_t *tw, tw_timer_t *timer);
+
+uint32_t
+timer_wheel_advance(timer_wheel_t *tw, uint64_t now_ms,
+                    dlist_header_t *expired);
+
+int
+timer_wheel_get_timeout(timer_wheel_t *tw, uint64_t now_ms);
+
+static inline uint32_t
+timer_wheel_get_count (timer_wheel_t *tw)
+{
+    return tw->count;
+}
+#endif //__TIMER_WHEEL_H__
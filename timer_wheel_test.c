@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "timer_wheel.h"
+
+#define TICK_MS 10
+#define TIMER_CNT 100000
+#define MAX_EXPIRE_MS (TICK_MS * 300000)
+#define BENCH_TIMER_CNT 1000000
+
+typedef struct test_timer_s {
+    tw_timer_t timer;
+    uint64_t expire_ms;
+    bool deleted;
+    bool fired;
+} test_timer_t;
+
+/*
+ * Every timer fires within one tick after its expiration, never before,
+ * deleted ones never fire, across all levels of the wheel.
+ */
+static int
+test_expiry (void)
+{
+    test_timer_t *timers, *t;
+    dlist_header_t expired, *header;
+    timer_wheel_t tw;
+    uint64_t now;
+    uint32_t i, fired = 0, deleted = 0;
+    int rc = 0;
+
+    timers = calloc(TIMER_CNT, sizeof(test_timer_t));
+    if (timers == NULL) {
+        return -1;
+    }
+
+    srand(1);
+    timer_wheel_init(&tw, 1000, TICK_MS);
+    for (i = 0; i < TIMER_CNT; i++) {
+        t = &timers[i];
+        timer_wheel_timer_init(&t->timer);
+        t->expire_ms = 1000 + (uint64_t)rand() % MAX_EXPIRE_MS;
+        timer_wheel_add(&tw, &t->timer, t->expire_ms);
+    }
+    for (i = 0; i < TIMER_CNT; i += 7) {
+        timer_wheel_del(&tw, &timers[i].timer);
+        timers[i].deleted = True;
+        deleted++;
+    }
+    if (timer_wheel_get_count(&tw) != TIMER_CNT - deleted) {
+        printf("FAIL: %u timers armed, expect %u\n",
+               timer_wheel_get_count(&tw), TIMER_CNT - deleted);
+        free(timers);
+        return -1;
+    }
+
+    dlist_init(&expired);
+    for (now = 1000; now <= 1000 + MAX_EXPIRE_MS + TICK_MS; now += 3) {
+        timer_wheel_advance(&tw, now, &expired);
+        while ((header = dlist_pop_left(&expired)) != NULL) {
+            t = dlist_get_entry(header, test_timer_t, timer.header);
+            if (t->deleted || t->fired || now < t->expire_ms ||
+                now >= t->expire_ms + TICK_MS + 3) {
+                printf("FAIL: timer of %lu fired at %lu\n",
+                       (unsigned long)t->expire_ms, (unsigned long)now);
+                rc = -1;
+            }
+            t->fired = True;
+            fired++;
+        }
+    }
+
+    printf("Fired %u of %u timers, %u armed\n", fired, TIMER_CNT - deleted,
+           timer_wheel_get_count(&tw));
+    if (fired != TIMER_CNT - deleted || timer_wheel_get_count(&tw) != 0) {
+        rc = -1;
+    }
+    free(timers);
+    return rc;
+}
+
+/*
+ * Arm, move and expire a million timers.
+ */
+static int
+test_bench (void)
+{
+    dlist_header_t expired;
+    timer_wheel_t tw;
+    tw_timer_t *timers;
+    uint64_t start, now;
+    uint32_t i, fired;
+
+    timers = calloc(BENCH_TIMER_CNT, sizeof(tw_timer_t));
+    if (timers == NULL) {
+        return -1;
+    }
+
+    start = monotonic_ms();
+    timer_wheel_init(&tw, 0, TICK_MS);
+    for (i = 0; i < BENCH_TIMER_CNT; i++) {
+        timer_wheel_timer_init(&timers[i]);
+        timer_wheel_add(&tw, &timers[i], 60000 + i % 1000);
+    }
+    for (i = 0; i < BENCH_TIMER_CNT; i++) {
+        timer_wheel_add(&tw, &timers[i], 90000 + i % 1000);
+    }
+    dlist_init(&expired);
+    fired = 0;
+    for (now = 0; now <= 100000; now += TICK_MS) {
+        fired += timer_wheel_advance(&tw, now, &expired);
+        dlist_init(&expired);
+    }
+    printf("%u timers armed, moved and fired in %lu ms\n",
+           fired, (unsigned long)(monotonic_ms() - start));
+    free(timers);
+    return fired == BENCH_TIMER_CNT ? 0 : -1;
+}
+
+int main (void)
+{
+    int rc = 0;
+
+    rc |= test_expiry();
+    rc |= test_bench();
+    printf("%s\n", rc == 0 ? "PASS" : "FAIL");
+    return rc;
+}
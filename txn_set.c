@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <string.h>
+#include "txn_set.h"
+
+/*
+ * FNV-1a with a final mix, the low bits pick the bucket, the high ones
+ * are the tag.
+ */
+static inline uint64_t
+txn_set_hash (const char *key, uint32_t len)
+{
+    uint64_t h = 14695981039346656037UL;
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)key[i]) * 1099511628211UL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdUL;
+    h ^= h >> 33;
+    return h;
+}
+
+/*
+ * capacity is rounded up to a power of two buckets of TXN_SET_WAYS keys.
+ */
+int
+txn_set_init (txn_set_t *set, uint32_t capacity)
+{
+    uint32_t bucket_cnt = 1;
+    int i, rc;
+
+    memzero(set, sizeof(txn_set_t));
+
+    while (bucket_cnt * TXN_SET_WAYS < capacity) {
+        bucket_cnt <<= 1;
+    }
+    if (posix_memalign((void **)&set->buckets, CACHE_LINE_SIZE,
+                       bucket_cnt * sizeof(txn_set_bucket_t)) != 0) {
+        logger(ERROR, "Fail to alloc txn set buckets.");
+        set->buckets = NULL;
+        return -1;
+    }
+    memzero(set->buckets, bucket_cnt * sizeof(txn_set_bucket_t));
+    set->bucket_mask = bucket_cnt - 1;
+
+    for (i = 0; i < TXN_SET_STRIPE_CNT; i++) {
+        rc = pthread_mutex_init(&set->stripes[i].lock, NULL);
+        if (rc != 0) {
+            logger(ERROR, "Fail to init txn set mutex.");
+            while (--i >= 0) {
+                pthread_mutex_destroy(&set->stripes[i].lock);
+            }
+            free(set->buckets);
+            set->buckets = NULL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void
+txn_set_clean (txn_set_t *set)
+{
+    int i;
+
+    if (set->buckets == NULL) {
+        return;
+    }
+    for (i = 0; i < TXN_SET_STRIPE_CNT; i++) {
+        pthread_mutex_destroy(&set->stripes[i].lock);
+    }
+    free(set->buckets);
+    set->buckets = NULL;
+}
+
+/*
+ * Add key, return TXN_SET_EXISTS if it was already there. An empty key,
+ * or one over TXN_SET_KEY_MAX_LEN, is never kept, it is always new.
+ */
+int
+txn_set_insert (txn_set_t *set, const char *key, uint32_t len)
+{
+    uint64_t h;
+    uint32_t idx, tag, i, way = TXN_SET_WAYS;
+    txn_set_bucket_t *bucket;
+    txn_set_stripe_t *stripe;
+
+    if (len == 0 || len > TXN_SET_KEY_MAX_LEN) {
+        return TXN_SET_ADDED;
+    }
+    h = txn_set_hash(key, len);
+    idx = h & set->bucket_mask;
+    tag = (h >> 32) | 1;
+    bucket = &set->buckets[idx];
+    stripe = &set->stripes[idx % TXN_SET_STRIPE_CNT];
+
+    pthread_mutex_lock(&stripe->lock);
+    for (i = 0; i < TXN_SET_WAYS; i++) {
+        if (bucket->tags[i] == tag && bucket->lens[i] == len &&
+            memcmp(bucket->keys[i], key, len) == 0) {
+            bucket->referenced |= 1U << i;
+            stripe->duplicates++;
+            pthread_mutex_unlock(&stripe->lock);
+            return TXN_SET_EXISTS;
+        }
+        if (bucket->tags[i] == 0 && way == TXN_SET_WAYS) {
+            way = i;
+        }
+    }
+
+    if (way == TXN_SET_WAYS) {
+        while (bucket->referenced & (1U << bucket->hand)) {
+            bucket->referenced &= ~(1U << bucket->hand);
+            bucket->hand = (bucket->hand + 1) % TXN_SET_WAYS;
+        }
+        way = bucket->hand;
+        bucket->hand = (bucket->hand + 1) % TXN_SET_WAYS;
+        stripe->evicted++;
+    }
+
+    bucket->tags[way] = tag;
+    bucket->lens[way] = len;
+    bucket->referenced &= ~(1U << way);
+    memcpy(bucket->keys[way], key, len);
+    stripe->added++;
+    pthread_mutex_unlock(&stripe->lock);
+    return TXN_SET_ADDED;
+}
+
+/*
+ * Forget key, for an id whose transaction failed after it was added.
+ */
+void
+txn_set_remove (txn_set_t *set, const char *key, uint32_t len)
+{
+    uint64_t h;
+    uint32_t idx, tag, i;
+    txn_set_bucket_t *bucket;
+    txn_set_stripe_t *stripe;
+
+    if (len == 0 || len > TXN_SET_KEY_MAX_LEN) {
+        return;
+    }
+    h = txn_set_hash(key, len);
+    idx = h & set->bucket_mask;
+    tag = (h >> 32) | 1;
+    bucket = &set->buckets[idx];
+    stripe = &set->stripes[idx % TXN_SET_STRIPE_CNT];
+
+    pthread_mutex_lock(&stripe->lock);
+    for (i = 0; i < TXN_SET_WAYS; i++) {
+        if (bucket->tags[i] == tag && bucket->lens[i] == len &&
+            memcmp(bucket->keys[i], key, len) == 0) {
+            bucket->tags[i] = 0;
+            bucket->referenced &= ~(1U << i);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&stripe->lock);
+}
+
+void
+txn_set_get_stats (txn_set_t *set, txn_set_stats_t *stats)
+{
+    txn_set_stripe_t *stripe;
+    int i;
+
+    memzero(stats, sizeof(txn_set_stats_t));
+    for (i = 0; i < TXN_SET_STRIPE_CNT; i++) {
+        stripe = &set->stripes[i];
+        pthread_mutex_lock(&stripe->lock);
+        stats->added += stripe->added;
+        stats->duplicates += stripe->duplicates;
+        stats->evicted += stripe->evicted;
+        pthread_mutex_unlock(&stripe->lock);
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef __TXN_SET_H__
+#define __TXN_SET_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "util.h"
+
+#define TXN_SET_KEY_MAX_LEN 31
+#define TXN_SET_WAYS 16
+#define TXN_SET_STRIPE_CNT 256
+#define TXN_SET_DEFAULT_CAPACITY (256*1024)
+
+enum {
+    TXN_SET_ADDED = 0,
+    TXN_SET_EXISTS,
+};
+
+/*
+ * A key can only live in the ways of the bucket its hash picks. A full
+ * bucket evicts with CLOCK: the hand skips, and clears, ways referenced
+ * since it last passed, keys seen again survive a round longer. The tags
+ * fill the first cache line, keys are only read on a tag match.
+ */
+typedef struct txn_set_bucket_s {
+    uint32_t tags[TXN_SET_WAYS]; // high bits of the hash, 0 for empty
+    uint32_t referenced;         // a bit per way
+    uint32_t hand;
+    uint8_t lens[TXN_SET_WAYS];
+    char keys[TXN_SET_WAYS][TXN_SET_KEY_MAX_LEN+1];
+} cache_aligned txn_set_bucket_t;
+
+typedef struct txn_set_stripe_s {
+    pthread_mutex_t lock;
+    uint64_t added;
+    uint64_t duplicates;
+    uint64_t evicted;
+} cache_aligned txn_set_stripe_t;
+
+/*
+ * Set of the most recently seen transaction ids, bounded to capacity
+ * keys. Bucket i is guarded by stripe i % TXN_SET_STRIPE_CNT, so threads
+ * only contend on the same stripe and a lookup costs a hash, a lock and
+ * at most 16 tag compares.
+ */
+typedef struct txn_set_s {
+    txn_set_bucket_t *buckets;
+    uint32_t bucket_mask;
+    txn_set_stripe_t stripes[TXN_SET_STRIPE_CNT];
+} txn_set_t;
+
+typedef struct txn_set_stats_s {
+    uint64_t added;
+    uint64_t duplicates;
+    uint64_t evicted;
+} txn_set_stats_t;
+
+int
+txn_set_init(txn_set_t *set, uint32_t capacity);
+
+void
+txn_set_clean(txn_set_t *set);
+
+int
+txn_set_insert(txn_set_t *set, const char *key, uint32_t len);
+
+void
+txn_set_remove(txn_set_t *set, const char *key, uint32_t len);
+
+void
+txn_set_get_stats(txn_set_t *set, txn_set_stats_t *stats);
+#endif //__TXN_SET_H__
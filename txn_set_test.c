@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "txn_set.h"
+
+#define TEST_CAPACITY (64*1024)
+#define BENCH_THREAD_CNT 8
+#define BENCH_OPS_PER_THREAD 1000000
+
+static int
+test_insert (void)
+{
+    txn_set_t set;
+    txn_set_stats_t stats;
+    char key[32];
+    uint32_t i, found = 0;
+    int len;
+
+    if (txn_set_init(&set, TEST_CAPACITY) != 0) {
+        return -1;
+    }
+    for (i = 0; i < TEST_CAPACITY / 2; i++) {
+        len = snprintf(key, sizeof(key), "txn_%u", i);
+        if (txn_set_insert(&set, key, len) != TXN_SET_ADDED) {
+            printf("FAIL: txn_%u already in the set\n", i);
+            txn_set_clean(&set);
+            return -1;
+        }
+    }
+    for (i = 0; i < TEST_CAPACITY / 2; i++) {
+        len = snprintf(key, sizeof(key), "txn_%u", i);
+        found += (txn_set_insert(&set, key, len) == TXN_SET_EXISTS);
+    }
+    txn_set_get_stats(&set, &stats);
+    txn_set_clean(&set);
+
+    // a few buckets overflow at half capacity
+    if (found + stats.evicted < TEST_CAPACITY / 2 ||
+        found < TEST_CAPACITY / 2 * 95 / 100) {
+        printf("FAIL: %u of %u found again, %lu evicted\n",
+               found, TEST_CAPACITY / 2, (unsigned long)stats.evicted);
+        return -1;
+    }
+    printf("insert: %u of %u found again, %lu evicted\n",
+           found, TEST_CAPACITY / 2, (unsigned long)stats.evicted);
+    return 0;
+}
+
+/*
+ * Memory stays bounded while many more keys go through, and a key seen
+ * again between insertions outlives the ones seen once.
+ */
+static int
+test_eviction (void)
+{
+    txn_set_t set;
+    char key[32];
+    uint32_t i, hot_lost = 0;
+    int len;
+
+    if (txn_set_init(&set, TXN_SET_WAYS) != 0) {
+        return -1;
+    }
+    txn_set_insert(&set, "hot", 3);
+    for (i = 0; i < 1000; i++) {
+        len = snprintf(key, sizeof(key), "cold_%u", i);
+        txn_set_insert(&set, key, len);
+        if (txn_set_insert(&set, "hot", 3) != TXN_SET_EXISTS) {
+            hot_lost++;
+        }
+    }
+    len = snprintf(key, sizeof(key), "cold_%u", 0);
+    if (txn_set_insert(&set, key, len) != TXN_SET_ADDED) {
+        printf("FAIL: cold_0 survived 1000 insertions in %d ways\n",
+               TXN_SET_WAYS);
+        txn_set_clean(&set);
+        return -1;
+    }
+    txn_set_clean(&set);
+
+    if (hot_lost > 0) {
+        printf("FAIL: referenced key evicted %u times\n", hot_lost);
+        return -1;
+    }
+    printf("eviction: referenced key kept\n");
+    return 0;
+}
+
+static int
+test_remove (void)
+{
+    txn_set_t set;
+    int rc = 0;
+
+    if (txn_set_init(&set, TEST_CAPACITY) != 0) {
+        return -1;
+    }
+    txn_set_insert(&set, "kept", 4);
+    txn_set_insert(&set, "failed", 6);
+    txn_set_remove(&set, "failed", 6);
+    if (txn_set_insert(&set, "failed", 6) != TXN_SET_ADDED ||
+        txn_set_insert(&set, "kept", 4) != TXN_SET_EXISTS) {
+        printf("FAIL: remove\n");
+        rc = -1;
+    }
+    txn_set_clean(&set);
+    return rc;
+}
+
+// ids sharing their first TXN_SET_KEY_MAX_LEN bytes are not the same
+static int
+test_unkept (void)
+{
+    txn_set_t set;
+    char key[TXN_SET_KEY_MAX_LEN+2];
+    int rc = 0;
+
+    if (txn_set_init(&set, TEST_CAPACITY) != 0) {
+        return -1;
+    }
+    memset(key, 'a', sizeof(key));
+    txn_set_insert(&set, key, sizeof(key));
+    key[TXN_SET_KEY_MAX_LEN+1] = 'b';
+    if (txn_set_insert(&set, key, sizeof(key)) != TXN_SET_ADDED ||
+        txn_set_insert(&set, key, sizeof(key)) != TXN_SET_ADDED) {
+        printf("FAIL: long key kept\n");
+        rc = -1;
+    }
+    txn_set_insert(&set, "", 0);
+    if (txn_set_insert(&set, "", 0) != TXN_SET_ADDED) {
+        printf("FAIL: empty key kept\n");
+        rc = -1;
+    }
+    txn_set_clean(&set);
+    return rc;
+}
+
+typedef struct bench_arg_s {
+    txn_set_t *set;
+    uint32_t id;
+} bench_arg_t;
+
+static void *
+bench_thread (void *args)
+{
+    bench_arg_t *arg = args;
+    char key[32] = "txn_";
+    uint32_t i;
+
+    // distinct keys without snprintf in the loop
+    memcpy(key + 4, &arg->id, sizeof(uint32_t));
+    for (i = 0; i < BENCH_OPS_PER_THREAD; i++) {
+        memcpy(key + 8, &i, sizeof(uint32_t));
+        txn_set_insert(arg->set, key, 12);
+    }
+    return NULL;
+}
+
+/*
+ * Wall time per insert of thread_cnt threads inserting at once, each of
+ * them sees it times thread_cnt when there are fewer cores.
+ */
+static int
+bench_insert (int thread_cnt)
+{
+    bench_arg_t args[BENCH_THREAD_CNT];
+    pthread_t threads[BENCH_THREAD_CNT];
+    txn_set_t set;
+    uint64_t start, ns;
+    int i;
+
+    if (txn_set_init(&set, TXN_SET_DEFAULT_CAPACITY) != 0) {
+        return -1;
+    }
+    start = monotonic_ns();
+    for (i = 0; i < thread_cnt; i++) {
+        args[i].set = &set;
+        args[i].id = i;
+        pthread_create(&threads[i], NULL, bench_thread, &args[i]);
+    }
+    for (i = 0; i < thread_cnt; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    ns = monotonic_ns() - start;
+    txn_set_clean(&set);
+
+    printf("bench: %d threads, %.1f ns per insert\n", thread_cnt,
+           (double)ns / thread_cnt / BENCH_OPS_PER_THREAD);
+    return 0;
+}
+
+int main (void)
+{
+    if (test_insert() != 0 || test_eviction() != 0 ||
+        test_remove() != 0 || test_unkept() != 0 ||
+        bench_insert(1) != 0 || bench_insert(BENCH_THREAD_CNT) != 0) {
+        printf("FAIL\n");
+        return -1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,360 @@
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "util.h"
+#include "uring.h"
+
+static int
+io_uring_setup (uint32_t entries, struct io_uring_params *params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int
+io_uring_enter (int fd, uint32_t to_submit, uint32_t min_complete,
+                uint32_t flags, void *arg, size_t arg_size)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                   flags, arg, arg_size);
+}
+
+static int
+io_uring_register (int fd, uint32_t opcode, void *arg, uint32_t nr_args)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/*
+ * Return -1 with errno set when io_uring is not available, so the caller
+ * can fall back to epoll.
+ */
+int
+uring_init (uring_t *ring, uint32_t entries)
+{
+    struct io_uring_params params;
+    char *sq, *cq;
+
+    memzero(ring, sizeof(uring_t));
+    memzero(&params, sizeof(params));
+
+    ring->ring_fd = io_uring_setup(entries, &params);
+    if (ring->ring_fd < 0) {
+        return -1;
+    }
+    ring->features = params.features;
+
+    ring->sq_ring_size = params.sq_off.array +
+                         params.sq_entries * sizeof(uint32_t);
+    ring->cq_ring_size = params.cq_off.cqes +
+                         params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->sq_ring_size = MAX(ring->sq_ring_size, ring->cq_ring_size);
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    sq = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+        close(ring->ring_fd);
+        return -1;
+    }
+    ring->sq_ring_ptr = sq;
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq = sq;
+    } else {
+        cq = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring->ring_fd,
+                  IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED) {
+            munmap(sq, ring->sq_ring_size);
+            close(ring->ring_fd);
+            return -1;
+        }
+    }
+    ring->cq_ring_ptr = cq;
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->ring_fd,
+                      IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (cq != sq) {
+            munmap(cq, ring->cq_ring_size);
+        }
+        munmap(sq, ring->sq_ring_size);
+        close(ring->ring_fd);
+        return -1;
+    }
+
+    ring->sq_head = (uint32_t *)(sq + params.sq_off.head);
+    ring->sq_tail = (uint32_t *)(sq + params.sq_off.tail);
+    ring->sq_array = (uint32_t *)(sq + params.sq_off.array);
+    ring->sq_mask = *(uint32_t *)(sq + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->sqe_tail = *ring->sq_tail;
+    ring->sqe_submitted = ring->sqe_tail;
+
+    ring->cq_head = (uint32_t *)(cq + params.cq_off.head);
+    ring->cq_tail = (uint32_t *)(cq + params.cq_off.tail);
+    ring->cq_mask = *(uint32_t *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+void
+uring_clean (uring_t *ring)
+{
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring_ptr && ring->cq_ring_ptr != ring->sq_ring_ptr) {
+        munmap(ring->cq_ring_ptr, ring->cq_ring_size);
+    }
+    if (ring->sq_ring_ptr) {
+        munmap(ring->sq_ring_ptr, ring->sq_ring_size);
+    }
+    if (ring->ring_fd > 0) {
+        close(ring->ring_fd);
+    }
+    memzero(ring, sizeof(uring_t));
+}
+
+/*
+ * NULL when the submission queue is full, submit and retry.
+ */
+struct io_uring_sqe *
+uring_get_sqe (uring_t *ring)
+{
+    struct io_uring_sqe *sqe;
+    uint32_t head;
+
+    head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sqe_tail - head >= ring->sq_entries) {
+        return NULL;
+    }
+
+    sqe = &ring->sqes[ring->sqe_tail & ring->sq_mask];
+    ring->sq_array[ring->sqe_tail & ring->sq_mask] =
+        ring->sqe_tail & ring->sq_mask;
+    ring->sqe_tail++;
+    memzero(sqe, sizeof(struct io_uring_sqe));
+    return sqe;
+}
+
+/*
+ * Publish the prepared SQEs and wait for at least wait_nr completions in
+ * the same syscall.
+ */
+int
+uring_submit_and_wait (uring_t *ring, uint32_t wait_nr)
+{
+    return uring_submit_and_wait_timeout(ring, wait_nr, -1);
+}
+
+/*
+ * Same, giving up the wait after timeout_ms, -1 waits forever. Kernels
+ * without IORING_FEAT_EXT_ARG always wait forever. A timeout returns -1
+ * with errno ETIME.
+ */
+int
+uring_submit_and_wait_timeout (uring_t *ring, uint32_t wait_nr,
+                               int timeout_ms)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    uint32_t to_submit, flags = 0;
+    void *argp = NULL;
+    size_t arg_size = 0;
+    int rc;
+
+    to_submit = ring->sqe_tail - ring->sqe_submitted;
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+    ring->sqe_submitted = ring->sqe_tail;
+
+    if (to_submit == 0 && wait_nr == 0) {
+        return 0;
+    }
+
+    if (wait_nr > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+    }
+    if (wait_nr > 0 && timeout_ms >= 0 &&
+        (ring->features & IORING_FEAT_EXT_ARG)) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+        memzero(&arg, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+        flags |= IORING_ENTER_EXT_ARG;
+        argp = &arg;
+        arg_size = sizeof(arg);
+    }
+
+    for (;;) {
+        rc = io_uring_enter(ring->ring_fd, to_submit, wait_nr, flags,
+                            argp, arg_size);
+        if (rc >= 0 || errno != EINTR) {
+            return rc;
+        }
+        to_submit = 0;
+    }
+}
+
+struct io_uring_cqe *
+uring_peek_cqe (uring_t *ring)
+{
+    uint32_t head = *ring->cq_head;
+
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+void
+uring_cqe_seen (uring_t *ring)
+{
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Register buf_cnt buffers of buf_size bytes as provided buffer group bgid.
+ * buf_cnt must be a power of two.
+ */
+int
+uring_buf_ring_init (uring_t *ring, uring_buf_ring_t *buf_ring, uint16_t bgid,
+                     uint16_t buf_cnt, uint32_t buf_size)
+{
+    struct io_uring_buf_reg reg;
+    uint16_t i;
+    int rc;
+
+    memzero(buf_ring, sizeof(uring_buf_ring_t));
+
+    buf_ring->br_size = buf_cnt * sizeof(struct io_uring_buf);
+    buf_ring->br = mmap(NULL, buf_ring->br_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf_ring->br == MAP_FAILED) {
+        buf_ring->br = NULL;
+        return -1;
+    }
+
+    buf_ring->bufs = mmap(NULL, (size_t)buf_cnt * buf_size,
+                          PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf_ring->bufs == MAP_FAILED) {
+        munmap(buf_ring->br, buf_ring->br_size);
+        buf_ring->br = NULL;
+        buf_ring->bufs = NULL;
+        return -1;
+    }
+    buf_ring->buf_size = buf_size;
+    buf_ring->buf_cnt = buf_cnt;
+    buf_ring->bgid = bgid;
+    buf_ring->mask = buf_cnt - 1;
+
+    memzero(&reg, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)buf_ring->br;
+    reg.ring_entries = buf_cnt;
+    reg.bgid = bgid;
+    rc = io_uring_register(ring->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1);
+    if (rc != 0) {
+        uring_buf_ring_clean(NULL, buf_ring);
+        return -1;
+    }
+
+    for (i = 0; i < buf_cnt; i++) {
+        uring_buf_ring_recycle(buf_ring, i);
+    }
+    return 0;
+}
+
+void
+uring_buf_ring_clean (uring_t *ring, uring_buf_ring_t *buf_ring)
+{
+    struct io_uring_buf_reg reg;
+
+    if (ring && buf_ring->br) {
+        memzero(&reg, sizeof(reg));
+        reg.bgid = buf_ring->bgid;
+        io_uring_register(ring->ring_fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    }
+    if (buf_ring->bufs) {
+        munmap(buf_ring->bufs, (size_t)buf_ring->buf_cnt * buf_ring->buf_size);
+    }
+    if (buf_ring->br) {
+        munmap(buf_ring->br, buf_ring->br_size);
+    }
+    memzero(buf_ring, sizeof(uring_buf_ring_t));
+}
+
+/*
+ * Hand buffer bid back to the kernel once its data has been consumed.
+ */
+void
+uring_buf_ring_recycle (uring_buf_ring_t *buf_ring, uint16_t bid)
+{
+    struct io_uring_buf *buf;
+    uint16_t tail = buf_ring->br->tail;
+
+    buf = &buf_ring->br->bufs[tail & buf_ring->mask];
+    buf->addr = (uint64_t)(uintptr_t)uring_buf_ring_get(buf_ring, bid);
+    buf->len = buf_ring->buf_size;
+    buf->bid = bid;
+    __atomic_store_n(&buf_ring->br->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+void
+uring_prep_accept_multishot (struct io_uring_sqe *sqe, int fd, int flags)
+{
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = flags;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+}
+
+void
+uring_prep_recv_multishot (struct io_uring_sqe *sqe, int fd, uint16_t bgid)
+{
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bgid;
+}
+
+void
+uring_prep_send (struct io_uring_sqe *sqe, int fd, const void *buf,
+                 uint32_t len, int flags)
+{
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->msg_flags = flags;
+}
+
+/*
+ * Read at the current file position, for eventfds and pipes.
+ */
+void
+uring_prep_read (struct io_uring_sqe *sqe, int fd, void *buf, uint32_t len)
+{
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = (uint64_t)-1;
+}
+
+void
+uring_prep_cancel (struct io_uring_sqe *sqe, uint64_t user_data)
+{
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+}
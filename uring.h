@@ -0,0 +1,108 @@
+#ifndef __URING_H__
+#define __URING_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+/*
+ * Minimal io_uring plumbing on top of the raw syscalls: ring setup,
+ * SQE/CQE access and provided buffer rings, just what the server's
+ * io_uring engine needs without depending on liburing.
+ */
+typedef struct uring_s {
+    int ring_fd;
+    uint32_t features;
+
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_array;
+    uint32_t sq_mask;
+    uint32_t sq_entries;
+    uint32_t sqe_tail;
+    uint32_t sqe_submitted;
+    struct io_uring_sqe *sqes;
+
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring_ptr;
+    size_t sq_ring_size;
+    void *cq_ring_ptr;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} uring_t;
+
+typedef struct uring_buf_ring_s {
+    struct io_uring_buf_ring *br;
+    size_t br_size;
+    char *bufs;
+    uint32_t buf_size;
+    uint16_t buf_cnt;
+    uint16_t bgid;
+    uint16_t mask;
+} uring_buf_ring_t;
+
+int
+uring_init(uring_t *ring, uint32_t entries);
+
+void
+uring_clean(uring_t *ring);
+
+struct io_uring_sqe *
+uring_get_sqe(uring_t *ring);
+
+static inline uint32_t
+uring_sq_space_left (uring_t *ring)
+{
+    return ring->sq_entries -
+           (ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE));
+}
+
+int
+uring_submit_and_wait(uring_t *ring, uint32_t wait_nr);
+
+int
+uring_submit_and_wait_timeout(uring_t *ring, uint32_t wait_nr,
+                              int timeout_ms);
+
+struct io_uring_cqe *
+uring_peek_cqe(uring_t *ring);
+
+void
+uring_cqe_seen(uring_t *ring);
+
+int
+uring_buf_ring_init(uring_t *ring, uring_buf_ring_t *buf_ring, uint16_t bgid,
+                    uint16_t buf_cnt, uint32_t buf_size);
+
+void
+uring_buf_ring_clean(uring_t *ring, uring_buf_ring_t *buf_ring);
+
+void
+uring_buf_ring_recycle(uring_buf_ring_t *buf_ring, uint16_t bid);
+
+static inline char *
+uring_buf_ring_get (uring_buf_ring_t *buf_ring, uint16_t bid)
+{
+    return buf_ring->bufs + (size_t)bid * buf_ring->buf_size;
+}
+
+void
+uring_prep_accept_multishot(struct io_uring_sqe *sqe, int fd, int flags);
+
+void
+uring_prep_recv_multishot(struct io_uring_sqe *sqe, int fd, uint16_t bgid);
+
+void
+uring_prep_send(struct io_uring_sqe *sqe, int fd, const void *buf,
+                uint32_t len, int flags);
+
+void
+uring_prep_read(struct io_uring_sqe *sqe, int fd, void *buf, uint32_t len);
+
+void
+uring_prep_cancel(struct io_uring_sqe *sqe, uint64_t user_data);
+#endif //__URING_H__
@@ -10,8 +10,17 @@
 #include <stdbool.h>
 #include <sys/time.h>
 #include <sys/syscall.h>
+#include <linux/futex.h>
 
-#ifdef _DEBUG_MODE_
+/*
+ * _BINARY_LOGGER_ turns logger into blog, which only copies the arguments
+ * into a per-thread ring, its level is picked at runtime. Without it
+ * _DEBUG_MODE_ prints every record, and nothing is logged otherwise.
+ */
+#ifdef _BINARY_LOGGER_
+#include "blog.h"
+#define logger(level, fmt, args...) blog(level, fmt, ##args)
+#elif defined(_DEBUG_MODE_)
 #define LOGGER_TIME_TS_MAX_LEN 63
 #define gettid() syscall(__NR_gettid)
 #define logger(level, fmt, args...) \
@@ -39,6 +48,51 @@ do {\
 #endif
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+#define CACHE_LINE_SIZE 64
+#define cache_aligned __attribute__((aligned(CACHE_LINE_SIZE)))
+
+static inline void
+cpu_relax (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+static inline uint64_t
+monotonic_ms (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static inline uint64_t
+monotonic_ns (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// park while *addr is val, wakeups may be spurious
+static inline void
+futex_wait (uint32_t *addr, uint32_t val)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static inline void
+futex_wake (uint32_t *addr, int cnt)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, cnt, NULL, NULL, 0);
+}
 
 void memzero (void *p, uint32_t size);
 #endif //__UTIL_H__
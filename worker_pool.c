@@ -0,0 +1,330 @@
+#define _GNU_SOURCE
+
+#include <sched.h>
+#include <stdlib.h>
+#include "util.h"
+#include "worker_pool.h"
+
+static inline void
+worker_stat_add (uint64_t *p, uint64_t v)
+{
+    __atomic_store_n(p, *p + v, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t
+worker_rand (worker_t *w)
+{
+    w->rand ^= w->rand << 13;
+    w->rand ^= w->rand >> 17;
+    w->rand ^= w->rand << 5;
+    return w->rand;
+}
+
+/*
+ * max_size bounds the deque of each worker, 0 for no bound.
+ */
+int
+worker_pool_init (worker_pool_t *pool, int worker_cnt, uint32_t max_size,
+                  worker_pool_handler_t handler, void *arg)
+{
+    worker_t *w;
+    int i;
+
+    memzero(pool, sizeof(worker_pool_t));
+    pool->workers = aligned_alloc(CACHE_LINE_SIZE,
+                                  worker_cnt * sizeof(worker_t));
+    if (pool->workers == NULL) {
+        logger(ERROR, "Fail to alloc workers.");
+        return -1;
+    }
+    memzero(pool->workers, worker_cnt * sizeof(worker_t));
+    for (i = 0; i < worker_cnt; i++) {
+        w = &pool->workers[i];
+        w->pool = pool;
+        w->id = i;
+        w->rand = i + 1;
+        w->cpu = -1;
+        if (wsdeque_init(&w->deque, WSDEQUE_INIT_SIZE, max_size) != 0) {
+            while (--i >= 0) {
+                wsdeque_clean(&pool->workers[i].deque);
+            }
+            free(pool->workers);
+            pool->workers = NULL;
+            return -1;
+        }
+    }
+    pool->worker_cnt = worker_cnt;
+    pool->handler = handler;
+    pool->arg = arg;
+    return 0;
+}
+
+void
+worker_pool_clean (worker_pool_t *pool)
+{
+    int i;
+
+    if (pool->workers == NULL) {
+        return;
+    }
+    worker_pool_stop(pool);
+    for (i = 0; i < pool->worker_cnt; i++) {
+        wsdeque_clean(&pool->workers[i].deque);
+    }
+    free(pool->workers);
+    pool->workers = NULL;
+}
+
+static bool
+worker_pool_has_work (worker_pool_t *pool)
+{
+    int i;
+
+    for (i = 0; i < pool->worker_cnt; i++) {
+        if (wsdeque_get_size(&pool->workers[i].deque) > 0) {
+            return True;
+        }
+    }
+    return False;
+}
+
+/*
+ * Own deque first, then one pass over the others from a random one, so
+ * thieves spread over the busy workers.
+ */
+static bool
+worker_take (worker_t *w, void **item)
+{
+    worker_pool_t *pool = w->pool;
+    worker_t *victim;
+    int i, start, rc;
+
+    for (;;) {
+        rc = wsdeque_steal(&w->deque, item);
+        if (rc == WSDEQUE_OK) {
+            worker_stat_add(&w->stats.local, 1);
+            return True;
+        } else if (rc == WSDEQUE_EMPTY) {
+            break;
+        }
+        worker_stat_add(&w->stats.aborts, 1);
+    }
+
+    start = worker_rand(w) % pool->worker_cnt;
+    for (i = 0; i < pool->worker_cnt; i++) {
+        victim = &pool->workers[(start + i) % pool->worker_cnt];
+        if (victim == w) {
+            continue;
+        }
+        rc = wsdeque_steal(&victim->deque, item);
+        if (rc == WSDEQUE_OK) {
+            worker_stat_add(&w->stats.stolen, 1);
+            return True;
+        } else if (rc == WSDEQUE_ABORT) {
+            worker_stat_add(&w->stats.aborts, 1);
+        }
+    }
+    return False;
+}
+
+/*
+ * The fence orders sleeping before the last look for work, pairing with
+ * the one in worker_pool_notify between a push and its read of sleeping,
+ * so either the worker sees the item or the producer sees it asleep.
+ */
+static void
+worker_park (worker_t *w)
+{
+    worker_pool_t *pool = w->pool;
+    uint32_t seq;
+
+    seq = __atomic_load_n(&w->wake_seq, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&w->sleeping, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&pool->sleeping_cnt, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!worker_pool_has_work(pool) &&
+        !__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE)) {
+        worker_stat_add(&w->stats.parks, 1);
+        futex_wait(&w->wake_seq, seq);
+    }
+    __atomic_store_n(&w->sleeping, 0, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&pool->sleeping_cnt, 1, __ATOMIC_RELAXED);
+}
+
+// False once the pool stops
+static bool
+worker_wait (worker_t *w, void **item)
+{
+    uint64_t start = monotonic_ns();
+    int i;
+
+    for (i = 0; ; i++) {
+        if (worker_take(w, item)) {
+            worker_stat_add(&w->stats.idle_ns, monotonic_ns() - start);
+            return True;
+        }
+        if (__atomic_load_n(&w->pool->stop, __ATOMIC_ACQUIRE)) {
+            return False;
+        }
+        if (i < WORKER_POOL_SPIN_CNT) {
+            cpu_relax();
+        } else {
+            worker_park(w);
+        }
+    }
+}
+
+static void *
+worker_pool_thread (void *args)
+{
+    worker_t *w = (worker_t *)args;
+    worker_pool_t *pool = w->pool;
+    void *item;
+
+    while (worker_take(w, &item) || worker_wait(w, &item)) {
+        pool->handler(item, w->id, pool->arg);
+    }
+    return NULL;
+}
+
+int
+worker_pool_start (worker_pool_t *pool)
+{
+    pthread_attr_t attr;
+    cpu_set_t set;
+    worker_t *w;
+    int i, rc;
+
+    for (i = 0; i < pool->worker_cnt; i++) {
+        w = &pool->workers[i];
+        // pinned from its first instruction, its memory comes from there
+        pthread_attr_init(&attr);
+        if (w->cpu >= 0) {
+            CPU_ZERO(&set);
+            CPU_SET(w->cpu, &set);
+            pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        }
+        rc = pthread_create(&w->thread_id, &attr, worker_pool_thread, w);
+        pthread_attr_destroy(&attr);
+        if (rc != 0) {
+            logger(ERROR, "Fail to create worker thread");
+            return -1;
+        }
+        w->started = True;
+    }
+    return 0;
+}
+
+static void
+worker_wake (worker_t *w)
+{
+    __atomic_add_fetch(&w->wake_seq, 1, __ATOMIC_RELEASE);
+    futex_wake(&w->wake_seq, 1);
+}
+
+/*
+ * Wait for the workers to finish the item they are on, what is left in
+ * the deques is not handled.
+ */
+void
+worker_pool_stop (worker_pool_t *pool)
+{
+    worker_t *w;
+    int i;
+
+    __atomic_store_n(&pool->stop, True, __ATOMIC_RELEASE);
+    for (i = 0; i < pool->worker_cnt; i++) {
+        w = &pool->workers[i];
+        if (w->started) {
+            worker_wake(w);
+            pthread_join(w->thread_id, NULL);
+            w->started = False;
+        }
+    }
+}
+
+/*
+ * Wake the worker an item went to if it sleeps. If it is busy and items
+ * pile up behind it, wake a sleeping one to steal them.
+ */
+static void
+worker_pool_notify (worker_pool_t *pool, worker_t *w)
+{
+    int i;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&w->sleeping, __ATOMIC_RELAXED)) {
+        worker_wake(w);
+        return;
+    }
+    if (__atomic_load_n(&pool->sleeping_cnt, __ATOMIC_RELAXED) == 0 ||
+        wsdeque_get_size(&w->deque) < 2) {
+        return;
+    }
+    for (i = 0; i < pool->worker_cnt; i++) {
+        if (__atomic_load_n(&pool->workers[i].sleeping, __ATOMIC_RELAXED)) {
+            worker_wake(&pool->workers[i]);
+            return;
+        }
+    }
+}
+
+/*
+ * Producer thread only. The item goes to worker hint, round-robin if hint
+ * is -1, or to the least loaded worker if that deque is full. Return the
+ * worker it went to, -1 if every deque is full.
+ */
+int
+worker_pool_push (worker_pool_t *pool, int hint, void *item)
+{
+    worker_t *w;
+    uint32_t size, min_size = UINT32_MAX;
+    int i, id = -1;
+
+    if (hint < 0 || hint >= pool->worker_cnt) {
+        hint = pool->next;
+        pool->next = (pool->next + 1) % pool->worker_cnt;
+    }
+    w = &pool->workers[hint];
+    if (wsdeque_push(&w->deque, item) == 0) {
+        worker_pool_notify(pool, w);
+        return hint;
+    }
+
+    for (i = 0; i < pool->worker_cnt; i++) {
+        size = wsdeque_get_size(&pool->workers[i].deque);
+        if (i != hint && size < min_size) {
+            min_size = size;
+            id = i;
+        }
+    }
+    if (id == -1) {
+        return -1;
+    }
+    w = &pool->workers[id];
+    if (wsdeque_push(&w->deque, item) != 0) {
+        return -1;
+    }
+    worker_pool_notify(pool, w);
+    return id;
+}
+
+// before worker_pool_start, -1 leaves the thread unpinned
+void
+worker_pool_set_cpu (worker_pool_t *pool, int worker_id, int cpu)
+{
+    pool->workers[worker_id].cpu = cpu;
+}
+
+uint32_t
+worker_pool_get_size (worker_pool_t *pool, int worker_id)
+{
+    return wsdeque_get_size(&pool->workers[worker_id].deque);
+}
+
+void
+worker_pool_get_stats (worker_pool_t *pool, int worker_id,
+                       worker_stats_t *stats)
+{
+    *stats = pool->workers[worker_id].stats;
+}
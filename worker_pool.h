@@ -0,0 +1,84 @@
+#ifndef __WORKER_POOL_H__
+#define __WORKER_POOL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "wsdeque.h"
+
+// steal rounds over the other workers before parking
+#define WORKER_POOL_SPIN_CNT 64
+
+typedef void (*worker_pool_handler_t)(void *item, int worker_id, void *arg);
+
+typedef struct worker_stats_s {
+    uint64_t local;    // items taken from its own deque
+    uint64_t stolen;   // items taken from another worker's
+    uint64_t aborts;   // takes lost to another thread
+    uint64_t parks;
+    uint64_t idle_ns;  // from running out of items to getting one
+} worker_stats_t;
+
+struct worker_pool_s;
+
+/*
+ * Stats are only written by the worker itself, readers may see them half
+ * updated.
+ */
+typedef struct worker_s {
+    struct worker_pool_s *pool;
+    int id;
+    wsdeque_t deque;
+    uint32_t wake_seq cache_aligned;
+    uint32_t sleeping;
+    uint32_t rand;
+    worker_stats_t stats;
+    int cpu;             // to pin the thread to, -1 for none
+    pthread_t thread_id;
+    bool started;
+} cache_aligned worker_t;
+
+/*
+ * Worker threads with a work-stealing deque each. A single producer
+ * thread owns the bottom of every deque and pushes items to the worker
+ * given, each worker takes the oldest item of its own deque and, once it
+ * runs dry, steals from the others before parking on a futex. Since only
+ * the producer pushes, a worker takes from its own deque the way thieves
+ * do, so items are handled in the order they were pushed.
+ */
+typedef struct worker_pool_s {
+    worker_t *workers;
+    int worker_cnt;
+    int next;            // round-robin for items with no preference
+    uint32_t sleeping_cnt;
+    bool stop;
+    worker_pool_handler_t handler;
+    void *arg;
+} worker_pool_t;
+
+int
+worker_pool_init(worker_pool_t *pool, int worker_cnt, uint32_t max_size,
+                 worker_pool_handler_t handler, void *arg);
+
+void
+worker_pool_clean(worker_pool_t *pool);
+
+int
+worker_pool_start(worker_pool_t *pool);
+
+void
+worker_pool_stop(worker_pool_t *pool);
+
+int
+worker_pool_push(worker_pool_t *pool, int hint, void *item);
+
+void
+worker_pool_set_cpu(worker_pool_t *pool, int worker_id, int cpu);
+
+uint32_t
+worker_pool_get_size(worker_pool_t *pool, int worker_id);
+
+void
+worker_pool_get_stats(worker_pool_t *pool, int worker_id,
+                      worker_stats_t *stats);
+#endif //__WORKER_POOL_H__
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "worker_pool.h"
+
+#define TEST_WORKER_CNT 4
+#define TEST_ITEM_CNT 200000
+#define TEST_SLOW_EVERY 1000
+#define TEST_SLOW_NS (20*1000)
+
+typedef struct test_ctx_s {
+    uint8_t *handled;
+    uint32_t cnt;
+} test_ctx_t;
+
+static void
+handle_item (void *item, int worker_id, void *arg)
+{
+    test_ctx_t *ctx = arg;
+    uintptr_t i = (uintptr_t)item - 1;
+    uint64_t start;
+
+    // some items take a while so work piles up behind them
+    if (i % TEST_SLOW_EVERY == 0) {
+        start = monotonic_ns();
+        while (monotonic_ns() - start < TEST_SLOW_NS) {
+            cpu_relax();
+        }
+    }
+    __atomic_add_fetch(&ctx->handled[i], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&ctx->cnt, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Everything is pushed to worker 0, the others only get work by stealing.
+ * Every item is handled exactly once and the stats add up.
+ */
+static int
+test_steal (void)
+{
+    worker_pool_t pool;
+    worker_stats_t stats;
+    test_ctx_t ctx;
+    void *item;
+    uint64_t local = 0, stolen = 0;
+    uint32_t i, bad = 0;
+
+    ctx.handled = calloc(TEST_ITEM_CNT, 1);
+    ctx.cnt = 0;
+    if (ctx.handled == NULL ||
+        worker_pool_init(&pool, TEST_WORKER_CNT, 1024, handle_item,
+                         &ctx) != 0) {
+        free(ctx.handled);
+        return -1;
+    }
+    if (worker_pool_start(&pool) != 0) {
+        worker_pool_clean(&pool);
+        free(ctx.handled);
+        return -1;
+    }
+    for (i = 0; i < TEST_ITEM_CNT; i++) {
+        // a full deque sends items elsewhere, wait when all are full
+        item = (void *)(uintptr_t)(i + 1);
+        while (worker_pool_push(&pool, 0, item) == -1) {
+            cpu_relax();
+        }
+    }
+    while (__atomic_load_n(&ctx.cnt, __ATOMIC_ACQUIRE) < TEST_ITEM_CNT) {
+        usleep(1000);
+    }
+    worker_pool_stop(&pool);
+
+    for (i = 0; i < TEST_WORKER_CNT; i++) {
+        worker_pool_get_stats(&pool, i, &stats);
+        printf("worker %u: local %lu, stolen %lu, aborts %lu, parks %lu, "
+               "idle %.1f ms\n", i, (unsigned long)stats.local,
+               (unsigned long)stats.stolen, (unsigned long)stats.aborts,
+               (unsigned long)stats.parks, (double)stats.idle_ns / 1000000);
+        local += stats.local;
+        stolen += stats.stolen;
+    }
+    worker_pool_clean(&pool);
+    for (i = 0; i < TEST_ITEM_CNT; i++) {
+        bad += (ctx.handled[i] != 1);
+    }
+    free(ctx.handled);
+
+    if (bad != 0 || local + stolen != TEST_ITEM_CNT) {
+        printf("FAIL: %u items not handled exactly once, %lu + %lu taken\n",
+               bad, (unsigned long)local, (unsigned long)stolen);
+        return -1;
+    }
+    printf("steal: %lu local, %lu stolen\n", (unsigned long)local,
+           (unsigned long)stolen);
+    return 0;
+}
+
+int main (void)
+{
+    if (test_steal() != 0) {
+        printf("FAIL\n");
+        return -1;
+    }
+    printf("PASS\n");
+    return 0;
+}
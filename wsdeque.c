@@ -0,0 +1,170 @@
+#include <stdlib.h>
+#include "util.h"
+#include "wsdeque.h"
+
+static wsdeque_array_t *
+wsdeque_array_alloc (uint64_t cap)
+{
+    wsdeque_array_t *a;
+
+    a = malloc(sizeof(wsdeque_array_t) + cap * sizeof(void *));
+    if (a == NULL) {
+        return NULL;
+    }
+    a->mask = cap - 1;
+    a->prev = NULL;
+    return a;
+}
+
+/*
+ * size is rounded up to a power of two.
+ */
+int
+wsdeque_init (wsdeque_t *dq, uint32_t size, uint32_t max_size)
+{
+    uint64_t cap;
+
+    memzero(dq, sizeof(wsdeque_t));
+    for (cap = 2; cap < size; cap <<= 1);
+
+    dq->array = wsdeque_array_alloc(cap);
+    if (dq->array == NULL) {
+        logger(ERROR, "Fail to malloc deque array.");
+        return -1;
+    }
+    dq->max_size = max_size;
+    return 0;
+}
+
+void
+wsdeque_clean (wsdeque_t *dq)
+{
+    wsdeque_array_t *a, *prev;
+
+    for (a = dq->array; a != NULL; a = prev) {
+        prev = a->prev;
+        free(a);
+    }
+    dq->array = NULL;
+}
+
+static wsdeque_array_t *
+wsdeque_grow (wsdeque_t *dq, wsdeque_array_t *a, int64_t t, int64_t b)
+{
+    wsdeque_array_t *n;
+    int64_t i;
+
+    n = wsdeque_array_alloc((a->mask + 1) * 2);
+    if (n == NULL) {
+        logger(ERROR, "Fail to grow deque array.");
+        return NULL;
+    }
+    for (i = t; i < b; i++) {
+        n->items[i & n->mask] = a->items[i & a->mask];
+    }
+    n->prev = a;
+    __atomic_store_n(&dq->array, n, __ATOMIC_RELEASE);
+    return n;
+}
+
+/*
+ * Owner only. -1 if the deque holds max_size items already or can't
+ * grow.
+ */
+int
+wsdeque_push (wsdeque_t *dq, void *item)
+{
+    wsdeque_array_t *a;
+    int64_t b, t;
+
+    b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED);
+    t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+    a = __atomic_load_n(&dq->array, __ATOMIC_RELAXED);
+
+    if (dq->max_size != 0 && b - t >= dq->max_size) {
+        return -1;
+    }
+    if (b - t > (int64_t)a->mask) {
+        a = wsdeque_grow(dq, a, t, b);
+        if (a == NULL) {
+            return -1;
+        }
+    }
+    __atomic_store_n(&a->items[b & a->mask], item, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/*
+ * Owner only, takes the item pushed last. NULL if empty.
+ */
+void *
+wsdeque_pop (wsdeque_t *dq)
+{
+    wsdeque_array_t *a;
+    int64_t b, t;
+    void *item;
+
+    b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED) - 1;
+    a = __atomic_load_n(&dq->array, __ATOMIC_RELAXED);
+    __atomic_store_n(&dq->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    t = __atomic_load_n(&dq->top, __ATOMIC_RELAXED);
+
+    if (t > b) {
+        __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    item = __atomic_load_n(&a->items[b & a->mask], __ATOMIC_RELAXED);
+    if (t == b) {
+        // the last item, thieves may be after it too
+        if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, False,
+                                         __ATOMIC_SEQ_CST,
+                                         __ATOMIC_RELAXED)) {
+            item = NULL;
+        }
+        __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return item;
+}
+
+/*
+ * Any thread, takes the oldest item.
+ */
+int
+wsdeque_steal (wsdeque_t *dq, void **item)
+{
+    wsdeque_array_t *a;
+    int64_t b, t;
+    void *p;
+
+    t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    b = __atomic_load_n(&dq->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) {
+        return WSDEQUE_EMPTY;
+    }
+
+    a = __atomic_load_n(&dq->array, __ATOMIC_ACQUIRE);
+    p = __atomic_load_n(&a->items[t & a->mask], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, False,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return WSDEQUE_ABORT;
+    }
+    *item = p;
+    return WSDEQUE_OK;
+}
+
+/*
+ * Only a snapshot, other threads may be moving both ends.
+ */
+uint32_t
+wsdeque_get_size (wsdeque_t *dq)
+{
+    int64_t b, t;
+
+    t = __atomic_load_n(&dq->top, __ATOMIC_RELAXED);
+    b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED);
+    return b > t ? b - t : 0;
+}
@@ -0,0 +1,57 @@
+#ifndef __WSDEQUE_H__
+#define __WSDEQUE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "util.h"
+
+#define WSDEQUE_INIT_SIZE 64
+
+enum {
+    WSDEQUE_OK = 0,
+    WSDEQUE_EMPTY,
+    WSDEQUE_ABORT, // lost the race for the top item, try again or elsewhere
+};
+
+/*
+ * Arrays outgrown are kept until the deque is cleaned, a thief may still
+ * be reading one.
+ */
+typedef struct wsdeque_array_s {
+    uint64_t mask;
+    struct wsdeque_array_s *prev;
+    void *items[];
+} wsdeque_array_t;
+
+/*
+ * Chase-Lev work-stealing deque, with the memory orders of Le et al.,
+ * "Correct and Efficient Work-Stealing for Weak Memory Models". Its one
+ * owner pushes and pops at the bottom without atomic read-modify-write
+ * unless a single item is left, any thread steals from the top with a
+ * CAS. The array grows as needed, up to max_size items if not 0.
+ */
+typedef struct wsdeque_s {
+    int64_t top cache_aligned;
+    int64_t bottom cache_aligned;
+    wsdeque_array_t *array;
+    uint32_t max_size;
+} wsdeque_t;
+
+int
+wsdeque_init(wsdeque_t *dq, uint32_t size, uint32_t max_size);
+
+void
+wsdeque_clean(wsdeque_t *dq);
+
+int
+wsdeque_push(wsdeque_t *dq, void *item);
+
+void *
+wsdeque_pop(wsdeque_t *dq);
+
+int
+wsdeque_steal(wsdeque_t *dq, void **item);
+
+uint32_t
+wsdeque_get_size(wsdeque_t *dq);
+#endif //__WSDEQUE_H__
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "wsdeque.h"
+
+#define TEST_ITEM_CNT 1000000
+#define TEST_THIEF_CNT 3
+
+// items are 1 based so none is NULL
+#define ITEM(i) ((void *)(uintptr_t)((i) + 1))
+#define INDEX(p) ((uintptr_t)(p) - 1)
+
+// pop is LIFO, steal FIFO, and the array grows past its initial size
+static int
+test_order (void)
+{
+    wsdeque_t dq;
+    void *item;
+    int i;
+
+    if (wsdeque_init(&dq, 4, 0) != 0) {
+        return -1;
+    }
+    for (i = 0; i < 100; i++) {
+        if (wsdeque_push(&dq, ITEM(i)) != 0) {
+            printf("FAIL: push %d\n", i);
+            wsdeque_clean(&dq);
+            return -1;
+        }
+    }
+    for (i = 0; i < 50; i++) {
+        if (wsdeque_steal(&dq, &item) != WSDEQUE_OK || item != ITEM(i)) {
+            printf("FAIL: steal %d\n", i);
+            wsdeque_clean(&dq);
+            return -1;
+        }
+    }
+    for (i = 99; i >= 50; i--) {
+        if (wsdeque_pop(&dq) != ITEM(i)) {
+            printf("FAIL: pop %d\n", i);
+            wsdeque_clean(&dq);
+            return -1;
+        }
+    }
+    if (wsdeque_pop(&dq) != NULL ||
+        wsdeque_steal(&dq, &item) != WSDEQUE_EMPTY ||
+        wsdeque_get_size(&dq) != 0) {
+        printf("FAIL: not empty\n");
+        wsdeque_clean(&dq);
+        return -1;
+    }
+    wsdeque_clean(&dq);
+    printf("order: ok\n");
+    return 0;
+}
+
+static int
+test_bound (void)
+{
+    wsdeque_t dq;
+    void *item;
+    int i;
+
+    if (wsdeque_init(&dq, 4, 10) != 0) {
+        return -1;
+    }
+    for (i = 0; i < 10; i++) {
+        wsdeque_push(&dq, ITEM(i));
+    }
+    if (wsdeque_push(&dq, ITEM(10)) == 0) {
+        printf("FAIL: pushed past the bound\n");
+        wsdeque_clean(&dq);
+        return -1;
+    }
+    wsdeque_steal(&dq, &item);
+    if (wsdeque_push(&dq, ITEM(10)) != 0) {
+        printf("FAIL: no room made by a steal\n");
+        wsdeque_clean(&dq);
+        return -1;
+    }
+    wsdeque_clean(&dq);
+    printf("bound: ok\n");
+    return 0;
+}
+
+typedef struct race_s {
+    wsdeque_t dq;
+    uint8_t *taken;
+    uint32_t done;
+} race_t;
+
+static void
+take (race_t *race, void *item)
+{
+    __atomic_add_fetch(&race->taken[INDEX(item)], 1, __ATOMIC_RELAXED);
+}
+
+static void *
+thief_thread (void *args)
+{
+    race_t *race = args;
+    void *item;
+
+    while (!__atomic_load_n(&race->done, __ATOMIC_ACQUIRE) ||
+           wsdeque_get_size(&race->dq) > 0) {
+        if (wsdeque_steal(&race->dq, &item) == WSDEQUE_OK) {
+            take(race, item);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * The owner pushes everything and pops every third item while thieves
+ * steal, every item is taken exactly once.
+ */
+static int
+test_race (void)
+{
+    pthread_t threads[TEST_THIEF_CNT];
+    race_t race;
+    uint64_t start, ns;
+    void *item;
+    uint32_t i, bad = 0;
+
+    race.taken = calloc(TEST_ITEM_CNT, 1);
+    race.done = 0;
+    if (race.taken == NULL || wsdeque_init(&race.dq, 16, 0) != 0) {
+        free(race.taken);
+        return -1;
+    }
+    start = monotonic_ns();
+    for (i = 0; i < TEST_THIEF_CNT; i++) {
+        pthread_create(&threads[i], NULL, thief_thread, &race);
+    }
+    for (i = 0; i < TEST_ITEM_CNT; i++) {
+        wsdeque_push(&race.dq, ITEM(i));
+        if (i % 3 == 0 && (item = wsdeque_pop(&race.dq)) != NULL) {
+            take(&race, item);
+        }
+    }
+    while ((item = wsdeque_pop(&race.dq)) != NULL) {
+        take(&race, item);
+    }
+    __atomic_store_n(&race.done, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < TEST_THIEF_CNT; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    ns = monotonic_ns() - start;
+
+    for (i = 0; i < TEST_ITEM_CNT; i++) {
+        bad += (race.taken[i] != 1);
+    }
+    wsdeque_clean(&race.dq);
+    free(race.taken);
+    if (bad != 0) {
+        printf("FAIL: %u items not taken exactly once\n", bad);
+        return -1;
+    }
+    printf("race: %d items, %d thieves, %.1f ns per item\n",
+           TEST_ITEM_CNT, TEST_THIEF_CNT, (double)ns / TEST_ITEM_CNT);
+    return 0;
+}
+
+int main (void)
+{
+    if (test_order() != 0 || test_bound() != 0 || test_race() != 0) {
+        printf("FAIL\n");
+        return -1;
+    }
+    printf("PASS\n");
+    return 0;
+}